@@ -1,4 +1,5 @@
 #include "Backlights.h"
+#include "Benchmark.h"
 #include <math.h>
 
 boolean Backlights::backlightState = false;
@@ -126,6 +127,11 @@ void Backlights::clear() {
 }
 
 void Backlights::show() {
+#ifdef BENCHMARK_BACKLIGHTS
+  if (!showing) {
+    return;
+  }
+#endif
   pixels.Show();
 }
 
@@ -134,5 +140,36 @@ void Backlights::setPixelColor(uint8_t digit, uint8_t hue, uint8_t sat, uint8_t
     pixels.SetPixelColor(digit, colorGamma.Correct(color));
 }
 
+#ifdef BENCHMARK_BACKLIGHTS
+void Backlights::benchmark() {
+  const uint32_t iterations = 100;
+  struct {
+    const char *name;
+    void (Backlights::*pattern)();
+  } patterns[] = {
+    { "rainbow", &Backlights::rainbowPattern },
+    { "pulse", &Backlights::pulsePattern },
+    { "breath", &Backlights::breathPattern },
+    { "aurora", &Backlights::auroraPattern }
+  };
+
+  showing = false;
+  for (auto &pattern : patterns) {
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+      (this->*pattern.pattern)();
+    }
+    printBenchmark("backlights", pattern.name, iterations, micros() - start);
+  }
+  showing = true;
+
+  uint32_t start = micros();
+  for (uint32_t i = 0; i < iterations; i++) {
+    show();
+  }
+  printBenchmark("backlights", "show", iterations, micros() - start);
+}
+#endif
+
 const String Backlights::patterns_str[Backlights::num_patterns] = 
   { "Dark", "Constant", "Rainbow", "Pulse", "Breath", "Aurora" };
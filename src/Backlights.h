@@ -53,9 +53,16 @@ public:
   void PowerOff()  { off = true; }
   void setOn(bool on) { off = !on; }
   void setBrightness(byte brightness) { this->brightness = brightness; }
+#ifdef BENCHMARK_BACKLIGHTS
+  // Print the time taken by each pattern, not counting sending it to the LEDs, and by sending it
+  void benchmark();
+#endif
 
 private:
   bool off;
+#ifdef BENCHMARK_BACKLIGHTS
+  bool showing = true;
+#endif
   byte brightness = 255;
   
   NeoPixelBus <NeoGrbFeature, Neo800KbpsMethod> pixels;
@@ -0,0 +1,72 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+
+/*
+ * If this is set, each result is passed to it instead of being printed, so that
+ * test/native/test_benchmarks can compare them with a baseline without a serial log.
+ */
+typedef void (*BenchmarkListener)(const char *benchmark, const char *name, uint32_t n, uint32_t us);
+
+inline BenchmarkListener& benchmarkListener() {
+  static BenchmarkListener listener = nullptr;
+  return listener;
+}
+
+/*
+ * The BENCHMARK_* builds print each result as a line of JSON, e.g.
+ *
+ *   {"benchmark":"decode","case":"24bit_dimmed","n":240,"us":5120}
+ *
+ * where n is how many operations took us microseconds in total. tools/benchmarks.py picks these out
+ * of a serial log and compares them with a saved baseline.
+ */
+inline void printBenchmark(const char *benchmark, const char *name, uint32_t n, uint32_t us) {
+  if (benchmarkListener() != nullptr) {
+    benchmarkListener()(benchmark, name, n, us);
+    return;
+  }
+  Serial.printf("{\"benchmark\":\"%s\",\"case\":\"%s\",\"n\":%lu,\"us\":%lu}\n",
+    benchmark, name, (unsigned long)n, (unsigned long)us);
+}
+
+/*
+ * GOLDEN_IMAGES builds print a hash of each decoded image in the same way, e.g.
+ *
+ *   {"golden":"/ips/cache/0","stage":"decode","hash":"1f3a9c07","us":18230}
+ *
+ * and tools/golden_images.py compares the hashes with ones from a known good build.
+ */
+inline void printGolden(const char *name, const char *stage, uint32_t hash, uint32_t us) {
+  Serial.printf("{\"golden\":\"%s\",\"stage\":\"%s\",\"hash\":\"%08lx\",\"us\":%lu}\n",
+    name, stage, (unsigned long)hash, (unsigned long)us);
+}
+
+/*
+ * Reads a string in memory as if it came from the network, so that parsers can be timed without it.
+ */
+class BenchmarkStream : public Stream {
+public:
+  BenchmarkStream(const char *data, size_t length) : data(data), length(length) {}
+
+  void rewind() { position = 0; }
+
+  int available() override { return length - position; }
+  int read() override { return position < length ? (uint8_t)data[position++] : -1; }
+  int peek() override { return position < length ? (uint8_t)data[position] : -1; }
+  size_t readBytes(char *buffer, size_t size) override {
+    size = min(size, length - position);
+    memcpy(buffer, data + position, size);
+    position += size;
+    return size;
+  }
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  const char *data;
+  size_t length;
+  size_t position = 0;
+};
+
+#endif // BENCHMARK_H
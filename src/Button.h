@@ -12,14 +12,14 @@
 
 class Button {
 public:
-	enum Event {none, button_clicked, long_press};
+	enum Event {none, button_clicked, long_press, double_clicked};
 
 	Button() {
 	}
 
 	bool state();
 	bool clicked();
-	Event getEvent();
+	virtual Event getEvent();
 	void setCallback(std::function<void(const Button*, Event)> callback);
 
 protected:
@@ -0,0 +1,90 @@
+#include "ButtonStateMachine.h"
+
+uint8_t ButtonStateMachine::edge(bool pressed, uint32_t atUs) {
+	// Anything that was due before this edge happened first
+	uint8_t events = settle(atUs);
+
+	rawPressed = pressed;
+	rawUs = atUs;
+
+	return events | settle(atUs);
+}
+
+uint8_t ButtonStateMachine::update(uint32_t nowUs) {
+	return settle(nowUs);
+}
+
+uint32_t ButtonStateMachine::usUntilUpdate(uint32_t nowUs) const {
+	uint32_t until = UINT32_MAX;
+
+	if (rawPressed != pressed) {
+		uint32_t elapsed = nowUs - changedUs;
+		until = !everChanged || elapsed >= BUTTON_DEBOUNCE_US ? 0 : BUTTON_DEBOUNCE_US - elapsed;
+	}
+
+	if (pressed && !longPressed) {
+		uint32_t elapsed = nowUs - pressedUs;
+		uint32_t untilLong = elapsed > BUTTON_LONG_PRESS_US ? 0 : BUTTON_LONG_PRESS_US - elapsed + 1;
+		if (untilLong < until) {
+			until = untilLong;
+		}
+	}
+
+	return until;
+}
+
+uint8_t ButtonStateMachine::settle(uint32_t nowUs) {
+	uint8_t events = NONE;
+
+	// The level has stayed put for long enough to believe it. It changed when the edge happened, or
+	// when the bounce period after the last change ended if that was later.
+	if (rawPressed != pressed && (!everChanged || nowUs - changedUs >= BUTTON_DEBOUNCE_US)) {
+		// Compared as time since the last change, which is right across a wrap however long the button sat idle
+		uint32_t atUs = rawUs;
+		if (everChanged && rawUs - changedUs < BUTTON_DEBOUNCE_US) {
+			atUs = changedUs + BUTTON_DEBOUNCE_US;
+		}
+		events |= change(rawPressed, atUs);
+	}
+
+	if (pressed && !longPressed && nowUs - pressedUs > BUTTON_LONG_PRESS_US) {
+		longPressed = true;
+		clickPending = false;
+		events |= LONG_PRESS;
+	}
+
+	return events;
+}
+
+uint8_t ButtonStateMachine::change(bool pressed, uint32_t atUs) {
+	this->pressed = pressed;
+	changedUs = atUs;
+	everChanged = true;
+
+	if (pressed) {
+		pressedUs = atUs;
+		longPressed = false;
+		return NONE;
+	}
+
+	if (longPressed) {
+		// Already reported while it was held
+		return NONE;
+	}
+
+	if (atUs - pressedUs > BUTTON_LONG_PRESS_US) {
+		// Released before anyone asked
+		longPressed = true;
+		clickPending = false;
+		return LONG_PRESS;
+	}
+
+	if (clickPending && atUs - clickUs <= BUTTON_DOUBLE_CLICK_US) {
+		clickPending = false;
+		return CLICK | DOUBLE_CLICK;
+	}
+
+	clickPending = true;
+	clickUs = atUs;
+	return CLICK;
+}
@@ -0,0 +1,61 @@
+#ifndef BUTTON_STATE_MACHINE_H
+#define BUTTON_STATE_MACHINE_H
+
+#include <stdint.h>
+
+// A change in level sooner than this after the last one is switch bounce
+#ifndef BUTTON_DEBOUNCE_US
+#define BUTTON_DEBOUNCE_US 50000
+#endif
+
+// Held down for longer than this is a long press rather than a click
+#ifndef BUTTON_LONG_PRESS_US
+#define BUTTON_LONG_PRESS_US 500000
+#endif
+
+// A click released within this long of the previous one is also a double click
+#ifndef BUTTON_DOUBLE_CLICK_US
+#define BUTTON_DOUBLE_CLICK_US 400000
+#endif
+
+/*
+ * Turns timestamped edges from a button into clicks, long presses and double clicks. It doesn't read
+ * pins or clocks itself, so it can be driven from an edge trace. Times are microseconds and may wrap.
+ *
+ * A click is reported as soon as the button is released, so that clicks don't have to wait to see whether
+ * another one follows. The second click of a pair is reported as both a click and a double click.
+ */
+class ButtonStateMachine {
+public:
+	enum Event {
+		NONE = 0,
+		CLICK = 1,
+		LONG_PRESS = 2,
+		DOUBLE_CLICK = 4
+	};
+
+	// The button is pressed (pressed == true) or released at atUs. Returns the Events that caused, or'd together.
+	uint8_t edge(bool pressed, uint32_t atUs);
+	// Time has moved on to nowUs without an edge. Returns the Events that caused.
+	uint8_t update(uint32_t nowUs);
+	// How long after nowUs update() needs to be called if there are no edges, or UINT32_MAX if it doesn't
+	uint32_t usUntilUpdate(uint32_t nowUs) const;
+
+	bool isPressed() const { return pressed; }
+
+private:
+	uint8_t settle(uint32_t nowUs);
+	uint8_t change(bool pressed, uint32_t atUs);
+
+	bool pressed = false;       // debounced
+	bool rawPressed = false;    // as of the last edge
+	uint32_t rawUs = 0;
+	uint32_t changedUs = 0;
+	bool everChanged = false;   // so the first edge is taken at once, whatever micros() says
+	uint32_t pressedUs = 0;
+	bool longPressed = false;
+	bool clickPending = false;  // the last release was a click that could start a double click
+	uint32_t clickUs = 0;
+};
+
+#endif // BUTTON_STATE_MACHINE_H
@@ -0,0 +1,60 @@
+#include "ConfigJson.h"
+#include "Benchmark.h"
+
+ConfigUpdateMessage::ConfigUpdateMessage(const BaseConfigItem &item) : rawJSON(item.toJSON()) {
+  JsonObject root = doc.to<JsonObject>();
+
+  root["type"] = "sv.update";
+
+  JsonObject value = root["value"].to<JsonObject>();
+  value[item.name] = serialized(rawJSON.c_str());
+}
+
+size_t serializeVolatileState(const VolatileState &state, char *buffer, size_t size) {
+  JsonDocument volatileState;
+  volatileState["screen_saver_on"] = state.screenSaverOn ? "ON" : "OFF";
+  volatileState["brightness"] = state.brightness;
+  volatileState["custom"] = state.custom;
+  volatileState["display"] = state.display;
+
+  volatileState["backlight_state"] = state.backlightOn ? "ON" : "OFF";
+  JsonArray blArray = volatileState["backlight_hs"].to<JsonArray>();
+  blArray.add(360.0 * state.backlightHue / 255.0);
+  blArray.add(100.0 * state.backlightSaturation / 255.0);
+  volatileState["backlight_brightness"] = state.backlightBrightness;
+  if (state.hasUnderlight) {
+    volatileState["underlight_state"] = state.backlightOn ? "ON" : "OFF";  // backlight and underlight share the same state
+    JsonArray ulArray = volatileState["underlight_hs"].to<JsonArray>();
+    ulArray.add(360.0 * state.underlightHue / 255.0);
+    ulArray.add(100.0 * state.underlightSaturation / 255.0);
+    volatileState["underlight_brightness"] = state.underlightBrightness;
+  }
+  return serializeJson(volatileState, buffer, size);
+}
+
+#ifdef BENCHMARK_JSON
+/*
+ * Time turning the config into JSON the way broadcastUpdate() and MQTTBroker::publishState() do.
+ */
+void benchmarkJson(const BaseConfigItem &root, const VolatileState &state) {
+  const uint32_t iterations = 20;
+
+  uint32_t start = micros();
+  for (uint32_t i = 0; i < iterations; i++) {
+    ConfigUpdateMessage message(root);
+    size_t len = message.length();
+    char *buffer = (char *)malloc(len + 1);
+    message.write(buffer, len + 1);
+    free(buffer);
+  }
+  printBenchmark("json", "broadcast_update", iterations, micros() - start);
+
+  start = micros();
+  for (uint32_t i = 0; i < iterations; i++) {
+    char buffer[384];
+    serializeVolatileState(state, buffer, sizeof(buffer));
+    String persistentState = root.toJSON();
+  }
+  printBenchmark("json", "publish_state", iterations, micros() - start);
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef CONFIG_JSON_H
+#define CONFIG_JSON_H
+
+#include <ArduinoJson.h>
+#include <ConfigItem.h>
+
+/*
+ * The sv.update message that tells the web pages an item has changed:
+ *
+ *   {"type":"sv.update","value":{"<name>":<the item as JSON>}}
+ *
+ * Measure it with length(), then write it into a buffer of at least that size.
+ */
+class ConfigUpdateMessage {
+public:
+  ConfigUpdateMessage(const BaseConfigItem &item);
+
+  size_t length() const { return measureJson(doc); }
+  size_t write(char *buffer, size_t size) const { return serializeJson(doc, buffer, size); }
+
+private:
+  String rawJSON; // The document points into this
+  JsonDocument doc;
+};
+
+/*
+ * What MQTT publishes that isn't in the config
+ */
+struct VolatileState {
+  bool screenSaverOn;
+  uint8_t brightness;
+  String custom;
+  int display;
+  bool backlightOn;
+  uint8_t backlightHue;
+  uint8_t backlightSaturation;
+  uint8_t backlightBrightness;
+  bool hasUnderlight;
+  uint8_t underlightHue;
+  uint8_t underlightSaturation;
+  uint8_t underlightBrightness;
+};
+
+size_t serializeVolatileState(const VolatileState &state, char *buffer, size_t size);
+
+#ifdef BENCHMARK_JSON
+// Print the time taken to make the sv.update message for root, and what publishState() sends
+void benchmarkJson(const BaseConfigItem &root, const VolatileState &state);
+#endif
+
+#endif // CONFIG_JSON_H
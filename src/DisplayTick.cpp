@@ -0,0 +1,110 @@
+#include <sys/time.h>
+#include "DisplayTick.h"
+
+namespace {
+
+class SystemTimeSource : public DisplayTick::TimeSource {
+public:
+  // SNTP and the RTC both set the system time
+  virtual int64_t nowUs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+};
+
+SystemTimeSource systemTimeSource;
+
+}
+
+bool DisplayTick::begin(TaskHandle_t task, TimeSource *source) {
+  end();
+
+  this->task = task;
+  this->source = source != nullptr ? source : &systemTimeSource;
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "display tick";
+
+  if (esp_timer_create(&args, &timer) != ESP_OK) {
+    timer = nullptr;
+    return false;
+  }
+
+  scheduled = false;
+  if (esp_timer_start_once(timer, schedule(this->source->nowUs())) != ESP_OK) {
+    end();
+    return false;
+  }
+
+  return true;
+}
+
+void DisplayTick::end() {
+  if (timer != nullptr) {
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+    timer = nullptr;
+  }
+}
+
+bool DisplayTick::take() {
+  if (pending) {
+    pending = false;
+    return true;
+  }
+
+  return false;
+}
+
+uint32_t DisplayTick::schedule(int64_t nowUs) {
+  int32_t phaseUs = nowUs % 1000000;
+  int32_t targetUs = 1000000 - leadUs;
+
+  if (scheduled) {
+    int32_t errorUs = phaseUs - targetUs;
+    if (errorUs >= 500000) {
+      errorUs -= 1000000;
+    } else if (errorUs < -500000) {
+      errorUs += 1000000;
+    }
+
+    uint32_t absErrorUs = abs(errorUs);
+    stats.ticks++;
+    if (absErrorUs >= leadUs) {
+      // The wall clock was stepped (SNTP, the RTC or a time zone change) rather than the timer being late.
+      // The next tick is scheduled from the new time, so this says nothing about how well ticks are placed.
+      stats.steps++;
+    } else {
+      stats.totalErrorUs += absErrorUs;
+      if (absErrorUs > stats.maxErrorUs) {
+        stats.maxErrorUs = absErrorUs;
+      }
+
+      // Learn slowly, so one odd tick doesn't throw the next ones off
+      stats.latencyUs += errorUs / 8;
+    }
+  }
+  scheduled = true;
+
+  int32_t delayUs = targetUs - phaseUs - stats.latencyUs;
+  while (delayUs < DISPLAY_TICK_MIN_DELAY_US) {
+    delayUs += 1000000;
+  }
+
+  return delayUs;
+}
+
+void DisplayTick::onTimer(void *arg) {
+  ((DisplayTick*)arg)->fire();
+}
+
+void DisplayTick::fire() {
+  esp_timer_start_once(timer, schedule(source->nowUs()));
+
+  pending = true;
+  xTaskNotify(task, DISPLAY_TICK_NOTIFY_BIT, eSetBits);
+}
@@ -0,0 +1,70 @@
+#ifndef DISPLAY_TICK_H
+#define DISPLAY_TICK_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// How long before each second the clock task is woken, so that the new digits are on the panels as it starts
+#ifndef DISPLAY_TICK_LEAD_US
+#define DISPLAY_TICK_LEAD_US 30000
+#endif
+
+// Set in the woken task's notification value on every tick
+#define DISPLAY_TICK_NOTIFY_BIT (1 << 0)
+
+// Never schedule a tick sooner than this, so a timer that fires a little early can't tick twice for one second
+#define DISPLAY_TICK_MIN_DELAY_US 250000
+
+/*
+ * Wakes a task once a second, a fixed lead time before the wall clock's second boundary. Each tick is
+ * scheduled from the wall clock rather than from the previous tick, so the timer can't drift away from
+ * it, and how late the timer usually fires is learnt and taken off the next delay.
+ */
+class DisplayTick {
+public:
+  // Where the wall clock comes from. Replace it to run the tick against a simulated clock.
+  class TimeSource {
+  public:
+    virtual int64_t nowUs() = 0;    // microseconds since the epoch
+  };
+
+  struct Stats {
+    uint32_t ticks = 0;
+    uint32_t steps = 0;             // ticks at least the lead time off, because the wall clock was set
+    uint64_t totalErrorUs = 0;      // distance of each other tick from where it should have been
+    uint32_t maxErrorUs = 0;
+    int32_t latencyUs = 0;          // how late the timer fires, as learnt so far
+
+    uint32_t meanErrorUs() const { return ticks == steps ? 0 : totalErrorUs / (ticks - steps); }
+  };
+
+  // task is notified with DISPLAY_TICK_NOTIFY_BIT on every tick
+  bool begin(TaskHandle_t task, TimeSource *source = nullptr);
+  void end();
+  bool isRunning() const { return timer != nullptr; }
+
+  // True once for each tick since the last call
+  bool take();
+
+  void setLeadUs(uint32_t leadUs) { this->leadUs = leadUs; }
+  uint32_t getLeadUs() const { return leadUs; }
+
+  // Account for how far off the tick at nowUs was and return the delay until the next one
+  uint32_t schedule(int64_t nowUs);
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  static void onTimer(void *arg);
+  void fire();
+
+  esp_timer_handle_t timer = nullptr;
+  TaskHandle_t task = nullptr;
+  TimeSource *source = nullptr;
+  uint32_t leadUs = DISPLAY_TICK_LEAD_US;
+  bool scheduled = false;
+  volatile bool pending = false;
+  Stats stats;
+};
+
+#endif // DISPLAY_TICK_H
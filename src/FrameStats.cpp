@@ -0,0 +1,122 @@
+#include "FrameStats.h"
+
+static const char *modeNames[FRAME_STATS_MODES] = { "time", "date", "weather", "slideshow" };
+static const char *stageNames[FRAME_STAGES] = { "open", "header", "read", "convert", "push", "status", "total" };
+
+void StageTime::add(uint32_t us) {
+  count++;
+  totalUs += us;
+  if (us > maxUs) maxUs = us;
+
+  uint8_t bucket = 0;
+  if (us >= (1 << FRAME_STATS_MIN_SHIFT)) {
+    bucket = min(32 - __builtin_clz(us) - FRAME_STATS_MIN_SHIFT, FRAME_STATS_BUCKETS - 1);
+  }
+
+  if (buckets[bucket] == UINT16_MAX) {
+    for (int i = 0; i < FRAME_STATS_BUCKETS; i++) {
+      buckets[i] >>= 1;
+    }
+  }
+  buckets[bucket]++;
+}
+
+uint32_t StageTime::percentileUs(uint8_t percent) const {
+  uint32_t samples = 0;
+  for (int i = 0; i < FRAME_STATS_BUCKETS; i++) {
+    samples += buckets[i];
+  }
+
+  uint32_t wanted = (samples * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (int i = 0; i < FRAME_STATS_BUCKETS - 1; i++) {
+    seen += buckets[i];
+    if (seen >= wanted) {
+      return min((uint32_t)1 << (FRAME_STATS_MIN_SHIFT + i), maxUs);
+    }
+  }
+
+  return maxUs;
+}
+
+void FrameStats::beginFrame() {
+  inFrame = true;
+  frameStages = 0;
+  memset(frameUs, 0, sizeof(frameUs));
+}
+
+void FrameStats::add(FrameStage stage, uint32_t us) {
+  if (inFrame) {
+    frameUs[stage] += us;
+    frameStages |= 1 << stage;
+  }
+}
+
+void FrameStats::endFrame(uint8_t mode, uint32_t totalUs) {
+  if (!inFrame) {
+    return;
+  }
+  inFrame = false;
+
+  if (mode >= FRAME_STATS_MODES) {
+    return;
+  }
+
+  for (int stage = 0; stage < FRAME_TOTAL; stage++) {
+    if (frameStages & (1 << stage)) {
+      stages[mode][stage].add(frameUs[stage]);
+    }
+  }
+  stages[mode][FRAME_TOTAL].add(totalUs);
+}
+
+String FrameStats::summary(uint8_t mode) const {
+  const StageTime &total = stages[mode][FRAME_TOTAL];
+  if (total.count == 0) {
+    return "";
+  }
+
+  // Room for the total with four 10 digit numbers (55 characters), which is longer than any stage
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "n %lu, total %lu/%lu/%luus",
+    (unsigned long)total.count, (unsigned long)total.meanUs(), (unsigned long)total.percentileUs(95), (unsigned long)total.maxUs);
+  String s(buffer);
+
+  for (int stage = 0; stage < FRAME_TOTAL; stage++) {
+    const StageTime &time = stages[mode][stage];
+    if (time.count != 0) {
+      snprintf(buffer, sizeof(buffer), ", %s %lu/%luus", stageNames[stage],
+        (unsigned long)time.meanUs(), (unsigned long)time.percentileUs(95));
+      s += buffer;
+    }
+  }
+
+  return s;
+}
+
+void FrameStats::toJson(JsonObject json, uint8_t mode) const {
+  const StageTime &total = stages[mode][FRAME_TOTAL];
+  json["n"] = total.count;
+
+  JsonArray totalArray = json["total"].to<JsonArray>();
+  totalArray.add(total.meanUs());
+  totalArray.add(total.percentileUs(95));
+  totalArray.add(total.maxUs);
+
+  for (int stage = 0; stage < FRAME_TOTAL; stage++) {
+    const StageTime &time = stages[mode][stage];
+    if (time.count != 0) {
+      JsonArray stageArray = json[stageNames[stage]].to<JsonArray>();
+      stageArray.add(time.meanUs());
+      stageArray.add(time.percentileUs(95));
+    }
+  }
+}
+
+const char* FrameStats::getModeName(uint8_t mode) {
+  return mode < FRAME_STATS_MODES ? modeNames[mode] : "";
+}
+
+const char* FrameStats::getStageName(FrameStage stage) {
+  return stage < FRAME_STAGES ? stageNames[stage] : "";
+}
@@ -0,0 +1,69 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// One per IPSClock::TimeOrDate value
+#define FRAME_STATS_MODES 4
+
+// Histogram bucket 0 is everything under 2^FRAME_STATS_MIN_SHIFT us, each bucket after that is twice as wide
+#define FRAME_STATS_MIN_SHIFT 6
+#define FRAME_STATS_BUCKETS 14
+
+enum FrameStage : uint8_t {
+  FRAME_OPEN,       // opening the image file or atlas
+  FRAME_HEADER,     // reading the image header
+  FRAME_READ,       // reading pixel rows
+  FRAME_CONVERT,    // decoding and dimming pixels into the sprite
+  FRAME_PUSH,       // sending the sprite to the panels, including waiting for DMA
+  FRAME_STATUS,     // drawing the status line over the digit
+  FRAME_TOTAL,      // the whole digit
+  FRAME_STAGES
+};
+
+/*
+ * Time spent in one stage. The histogram is coarse so that percentiles can be kept without storing
+ * samples. When a bucket fills up all of them are halved, so old frames fade out rather than the
+ * counts wrapping.
+ */
+struct StageTime {
+  uint32_t count = 0;
+  uint64_t totalUs = 0;
+  uint32_t maxUs = 0;
+  uint16_t buckets[FRAME_STATS_BUCKETS] = {0};
+
+  void add(uint32_t us);
+  uint32_t meanUs() const { return count == 0 ? 0 : totalUs / count; }
+  // Upper bound of the bucket the given percentile falls in, but no more than the slowest time seen
+  uint32_t percentileUs(uint8_t percent) const;
+};
+
+/*
+ * Per stage timings of each digit drawn, kept separately for each display mode. Stages add to the
+ * frame being drawn and the frame is added to the stats when it ends, so a stage that happens more
+ * than once in a digit counts once. Anything timed outside a frame, like prefetching, is ignored.
+ */
+class FrameStats {
+public:
+  void beginFrame();
+  void add(FrameStage stage, uint32_t us);
+  void endFrame(uint8_t mode, uint32_t totalUs);
+
+  const StageTime& get(uint8_t mode, FrameStage stage) const { return stages[mode][stage]; }
+  // e.g. "n 120, total 9850/14336/30120us, open 410/512us, ..." - mean/p95/max for the total, mean/p95 for stages
+  String summary(uint8_t mode) const;
+  void toJson(JsonObject json, uint8_t mode) const;
+
+  static const char* getModeName(uint8_t mode);
+  static const char* getStageName(FrameStage stage);
+
+private:
+  StageTime stages[FRAME_STATS_MODES][FRAME_STAGES];
+
+  bool inFrame = false;
+  uint8_t frameStages = 0;      // bitmap of the stages that happened in this frame
+  uint32_t frameUs[FRAME_STAGES];
+};
+
+#endif // FRAME_STATS_H
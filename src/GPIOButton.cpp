@@ -10,3 +10,63 @@
 byte GPIOButton::getPinValue() {
 	return digitalRead(pin) == pulldown;
 }
+
+void GPIOButton::attach() {
+	attachInterruptArg(digitalPinToInterrupt(pin), onInterrupt, this, CHANGE);
+}
+
+void IRAM_ATTR GPIOButton::onInterrupt(void *arg) {
+	GPIOButton *button = (GPIOButton*)arg;
+
+	// Read the level rather than trusting the edge, some pins raise spurious interrupts
+	Edge edge = { (uint32_t)micros(), digitalRead(button->pin) == button->pulldown };
+	button->edges.push(edge);
+
+	if (button->onEdge) {
+		button->onEdge();
+	}
+}
+
+Button::Event GPIOButton::getEvent() {
+	Event last = Event::none;
+	Edge edge;
+
+	while (edges.pop(edge)) {
+		Event event = dispatchEvents(machine.edge(edge.pressed, edge.us));
+		if (event != Event::none) {
+			last = event;
+		}
+	}
+
+	uint32_t now = micros();
+	if (edges.takeOverflow()) {
+		// Edges were lost, so start again from where the pin is now
+		Event event = dispatchEvents(machine.edge(getPinValue(), now));
+		if (event != Event::none) {
+			last = event;
+		}
+	}
+
+	Event event = dispatchEvents(machine.update(now));
+	if (event != Event::none) {
+		last = event;
+	}
+
+	return last;
+}
+
+Button::Event GPIOButton::dispatchEvents(uint8_t events) {
+	Event last = Event::none;
+
+	if (events & ButtonStateMachine::CLICK) {
+		dispatchEvent(last = Event::button_clicked);
+	}
+	if (events & ButtonStateMachine::DOUBLE_CLICK) {
+		dispatchEvent(last = Event::double_clicked);
+	}
+	if (events & ButtonStateMachine::LONG_PRESS) {
+		dispatchEvent(last = Event::long_press);
+	}
+
+	return last;
+}
@@ -9,7 +9,18 @@
 #define LIBRARIES_NIXIEMISC_GPIOBUTTON_H_
 
 #include "Button.h"
+#include "ButtonStateMachine.h"
+#include "SpscRing.h"
 
+// Edges that can be waiting for getEvent()
+#ifndef GPIO_BUTTON_EDGES
+#define GPIO_BUTTON_EDGES 16
+#endif
+
+/*
+ * Edges are timestamped by an interrupt and queued, so presses aren't lost however long it is
+ * between calls to getEvent().
+ */
 class GPIOButton: public Button {
 public:
 	GPIOButton(int pin, bool pulldown) : pin(pin), pulldown(pulldown) {
@@ -18,17 +29,39 @@ public:
 		} else {
 			pinMode(pin, INPUT_PULLUP);
 		}
+		attach();
 	}
 
 	GPIOButton(int pin) : pin(pin), pulldown(true) {
 	    pinMode(pin, INPUT);
+		attach();
 	}
 
+	virtual Event getEvent();
+	// How long until getEvent() needs calling again if there are no more edges, or UINT32_MAX
+	uint32_t usUntilUpdate() { return machine.usUntilUpdate(micros()); }
+	// Called from the interrupt after each edge, e.g. to wake the task that calls getEvent()
+	void setEdgeCallback(void (*onEdge)()) { this->onEdge = onEdge; }
+
 protected:
 	virtual byte getPinValue();
 
 	int pin;
 	bool pulldown;
+
+private:
+	struct Edge {
+		uint32_t us;
+		bool pressed;
+	};
+
+	static void onInterrupt(void *arg);
+	void attach();
+	Event dispatchEvents(uint8_t events);
+
+	SpscRing<Edge, GPIO_BUTTON_EDGES> edges;
+	ButtonStateMachine machine;
+	void (*volatile onEdge)() = nullptr;
 };
 
 #endif /* LIBRARIES_NIXIEMISC_GPIOBUTTON_H_ */
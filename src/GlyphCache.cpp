@@ -0,0 +1,128 @@
+#include "GlyphCache.h"
+
+bool GlyphKey::operator==(const GlyphKey& other) const {
+  return monochromeColor == other.monochromeColor
+    && fx == other.fx
+    && strcmp(name, other.name) == 0
+    && strcmp(dir, other.dir) == 0;
+}
+
+void GlyphCache::begin() {
+  if (psramFound()) {
+    allocCaps = MALLOC_CAP_SPIRAM;
+    setBudget(GLYPH_CACHE_PSRAM_BYTES);
+  } else {
+    allocCaps = MALLOC_CAP_8BIT;
+    setBudget(GLYPH_CACHE_BYTES);
+  }
+}
+
+void GlyphCache::setBudget(size_t budget) {
+  stats.budget = budget;
+
+  while (tail != nullptr && stats.used > stats.budget) {
+    stats.evictions++;
+    release(tail);
+  }
+}
+
+Glyph* GlyphCache::find(const GlyphKey& key) {
+  for (Glyph *glyph = head; glyph != nullptr; glyph = glyph->next) {
+    if (glyph->key == key) {
+      stats.hits++;
+      if (glyph != head) {
+        unlink(glyph);
+        pushFront(glyph);
+      }
+      return glyph;
+    }
+  }
+
+  stats.misses++;
+  return nullptr;
+}
+
+Glyph* GlyphCache::peek(const GlyphKey& key) {
+  for (Glyph *glyph = head; glyph != nullptr; glyph = glyph->next) {
+    if (glyph->key == key) {
+      return glyph;
+    }
+  }
+
+  return nullptr;
+}
+
+Glyph* GlyphCache::allocate(const GlyphKey& key, int16_t w, int16_t h, bool hasAlpha) {
+  size_t pixelBytes = w * h * sizeof(uint16_t);
+  size_t size = sizeof(Glyph) + pixelBytes + (hasAlpha ? w * h : 0);
+
+  if (size > stats.budget) {
+    return nullptr;
+  }
+
+  while (tail != nullptr && stats.used + size > stats.budget) {
+    stats.evictions++;
+    release(tail);
+  }
+
+  if (allocCaps == MALLOC_CAP_8BIT && heap_caps_get_free_size(MALLOC_CAP_8BIT) < size + GLYPH_CACHE_HEAP_RESERVE) {
+    return nullptr;
+  }
+
+  uint8_t *block = (uint8_t*)heap_caps_malloc(size, allocCaps);
+  if (block == nullptr) {
+    return nullptr;
+  }
+
+  Glyph *glyph = (Glyph*)block;
+  glyph->key = key;
+  glyph->w = w;
+  glyph->h = h;
+  glyph->pixels = (uint16_t*)(block + sizeof(Glyph));
+  glyph->alpha = hasAlpha ? block + sizeof(Glyph) + pixelBytes : nullptr;
+  glyph->size = size;
+
+  pushFront(glyph);
+  stats.used += size;
+  stats.count++;
+
+  return glyph;
+}
+
+void GlyphCache::remove(Glyph *glyph) {
+  if (glyph != nullptr) {
+    release(glyph);
+  }
+}
+
+void GlyphCache::flush(const char *dir) {
+  Glyph *glyph = head;
+  while (glyph != nullptr) {
+    Glyph *next = glyph->next;
+    if (dir == nullptr || strcmp(glyph->key.dir, dir) == 0) {
+      release(glyph);
+    }
+    glyph = next;
+  }
+}
+
+void GlyphCache::unlink(Glyph *glyph) {
+  if (glyph->prev) glyph->prev->next = glyph->next; else head = glyph->next;
+  if (glyph->next) glyph->next->prev = glyph->prev; else tail = glyph->prev;
+  glyph->prev = glyph->next = nullptr;
+}
+
+void GlyphCache::pushFront(Glyph *glyph) {
+  glyph->prev = nullptr;
+  glyph->next = head;
+  if (head) head->prev = glyph;
+  head = glyph;
+  if (tail == nullptr) tail = glyph;
+}
+
+void GlyphCache::release(Glyph *glyph) {
+  unlink(glyph);
+  stats.used -= glyph->size;
+  stats.count--;
+  heap_caps_free(glyph);
+}
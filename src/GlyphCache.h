@@ -0,0 +1,91 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <Arduino.h>
+
+// Byte budget for decoded glyphs. A full screen glyph is 135x240x2 = 64.8KB, plus 32.4KB if it has an alpha plane.
+// Two opaque ones fit, which a transition needs for its old and new frames.
+#ifndef GLYPH_CACHE_BYTES
+#define GLYPH_CACHE_BYTES (2 * (TFT_WIDTH * TFT_HEIGHT * 2 + sizeof(Glyph)))
+#endif
+
+// Budget used instead when the board has PSRAM
+#ifndef GLYPH_CACHE_PSRAM_BYTES
+#define GLYPH_CACHE_PSRAM_BYTES (2 * 1024 * 1024)
+#endif
+
+// Don't grow the cache if that would leave less than this much internal heap (HTTPS needs a lot)
+#ifndef GLYPH_CACHE_HEAP_RESERVE
+#define GLYPH_CACHE_HEAP_RESERVE (48 * 1024)
+#endif
+
+/*
+ * Everything that changes the decoded pixels of a glyph has to be part of the key. Glyphs are stored
+ * undimmed and dimmed as they are drawn, so dimming isn't.
+ */
+struct GlyphKey {
+  char dir[48];
+  char name[16];
+  int monochromeColor;
+  uint8_t fx;
+
+  bool operator==(const GlyphKey& other) const;
+};
+
+/*
+ * A decoded glyph. Pixels are RGB565 in sprite byte order (big-endian) so that
+ * they can be copied straight into a sprite buffer without swapping.
+ */
+struct Glyph {
+  GlyphKey key;
+  int16_t w;
+  int16_t h;
+  uint16_t *pixels;
+  uint8_t *alpha;     // nullptr if the glyph is opaque
+  size_t size;
+
+  Glyph *prev;
+  Glyph *next;
+};
+
+class GlyphCache {
+public:
+  struct Stats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    size_t used = 0;
+    size_t budget = 0;
+    uint16_t count = 0;
+  };
+
+  GlyphCache() : head(nullptr), tail(nullptr) {}
+
+  void begin();
+  void setBudget(size_t budget);
+
+  // Returns the glyph and marks it most recently used, or nullptr
+  Glyph* find(const GlyphKey& key);
+  // Returns the glyph without counting a hit or miss or changing its place in the LRU order, or nullptr
+  Glyph* peek(const GlyphKey& key);
+  // Evicts least recently used glyphs until the new one fits. Returns nullptr if it can't.
+  Glyph* allocate(const GlyphKey& key, int16_t w, int16_t h, bool hasAlpha);
+  // Throw away a glyph, e.g. if the decode failed part way through
+  void remove(Glyph *glyph);
+  // Throw away every glyph that came from dir, or everything if dir is null
+  void flush(const char *dir = nullptr);
+
+  const Stats& getStats() { return stats; }
+
+private:
+  void unlink(Glyph *glyph);
+  void pushFront(Glyph *glyph);
+  void release(Glyph *glyph);
+
+  Glyph *head;   // most recently used
+  Glyph *tail;   // least recently used
+  uint32_t allocCaps = MALLOC_CAP_8BIT;
+  Stats stats;
+};
+
+#endif // GLYPH_CACHE_H
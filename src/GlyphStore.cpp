@@ -0,0 +1,124 @@
+#include "GlyphStore.h"
+#include <string.h>
+
+#ifndef ESP32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+bool GlyphStore::begin() {
+#ifdef ESP32
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)GLYPH_STORE_SUBTYPE, GLYPH_STORE_PARTITION);
+  if (partition == nullptr) {
+    return false;
+  }
+  capacity = partition->size;
+#else
+  // The file can be in a directory that a clean checkout doesn't have yet, such as .pio
+  char dir[sizeof(GLYPH_STORE_FILE)];
+  strcpy(dir, GLYPH_STORE_FILE);
+  char *slash = strrchr(dir, '/');
+  if (slash != nullptr && slash != dir) {
+    *slash = 0;
+    mkdir(dir, 0755);
+  }
+
+  fd = open(GLYPH_STORE_FILE, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || ftruncate(fd, GLYPH_STORE_FILE_SIZE) != 0) {
+    return false;
+  }
+  capacity = GLYPH_STORE_FILE_SIZE;
+#endif
+
+  return map();
+}
+
+const uint8_t* GlyphStore::getAtlas(const char *dir) {
+  const GlyphStoreHeader *header = getHeader();
+  if (header == nullptr
+    || header->magic != GLYPH_STORE_MAGIC
+    || header->version != GLYPH_STORE_VERSION
+    || header->length > capacity - sizeof(GlyphStoreHeader)
+    || strncmp(header->dir, dir, sizeof(header->dir)) != 0) {
+    return nullptr;
+  }
+
+  return data + sizeof(GlyphStoreHeader);
+}
+
+bool GlyphStore::erase(size_t length) {
+  if (capacity == 0 || length > capacity) {
+    return false;
+  }
+
+  // Flash writes don't show up in the mapping until it is remapped
+  unmap();
+
+#ifdef ESP32
+  size_t sectorLength = (length + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+  return esp_partition_erase_range(partition, 0, sectorLength) == ESP_OK;
+#else
+  uint8_t erased[256];
+  memset(erased, 0xff, sizeof(erased));
+  for (size_t offset = 0; offset < length; offset += sizeof(erased)) {
+    size_t len = length - offset < sizeof(erased) ? length - offset : sizeof(erased);
+    if (pwrite(fd, erased, len, offset) != (ssize_t)len) {
+      return false;
+    }
+  }
+  return true;
+#endif
+}
+
+bool GlyphStore::write(size_t offset, const void *src, size_t length) {
+  if (offset + length > capacity) {
+    return false;
+  }
+
+#ifdef ESP32
+  return esp_partition_write(partition, offset, src, length) == ESP_OK;
+#else
+  return pwrite(fd, src, length, offset) == (ssize_t)length;
+#endif
+}
+
+bool GlyphStore::end() {
+  return map();
+}
+
+bool GlyphStore::map() {
+  if (data != nullptr) {
+    return true;
+  }
+
+#ifdef ESP32
+  const void *ptr;
+  if (esp_partition_mmap(partition, 0, capacity, ESP_PARTITION_MMAP_DATA, &ptr, &handle) != ESP_OK) {
+    return false;
+  }
+  data = (const uint8_t*)ptr;
+#else
+  void *ptr = mmap(nullptr, capacity, PROT_READ, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    return false;
+  }
+  data = (const uint8_t*)ptr;
+#endif
+
+  return true;
+}
+
+void GlyphStore::unmap() {
+  if (data == nullptr) {
+    return;
+  }
+
+#ifdef ESP32
+  spi_flash_munmap(handle);
+#else
+  munmap((void*)data, capacity);
+#endif
+  data = nullptr;
+}
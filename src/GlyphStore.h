@@ -0,0 +1,78 @@
+#ifndef GLYPH_STORE_H
+#define GLYPH_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ESP32
+#include <esp_partition.h>
+#endif
+
+// Label and subtype of the data partition in partitions_glyphs.csv / partitions_8M_glyphs.csv
+#ifndef GLYPH_STORE_PARTITION
+#define GLYPH_STORE_PARTITION "glyphs"
+#endif
+#ifndef GLYPH_STORE_SUBTYPE
+#define GLYPH_STORE_SUBTYPE 0x40
+#endif
+
+// Without a partition table the store is a plain file, mapped the same way
+#ifndef GLYPH_STORE_FILE
+#define GLYPH_STORE_FILE "glyphs.bin"
+#endif
+#ifndef GLYPH_STORE_FILE_SIZE
+#define GLYPH_STORE_FILE_SIZE (1024 * 1024)
+#endif
+
+#define GLYPH_STORE_MAGIC 0x52545347  // "GSTR"
+#define GLYPH_STORE_VERSION 1
+
+/*
+ * Starts the store, followed by length bytes of atlas. The size keeps the atlas 4-byte aligned.
+ */
+struct GlyphStoreHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t length;
+  uint32_t reserved;
+  char dir[48];
+};
+
+/*
+ * A region of flash that is memory-mapped so that glyphs can be sent to the panel straight from it.
+ */
+class GlyphStore {
+public:
+  GlyphStore() {}
+
+  // Map the store, returns false if there isn't one
+  bool begin();
+
+  bool mapped() { return data != nullptr; }
+  size_t size() { return capacity; }
+
+  // Erase the first length bytes. The store is unmapped until end() is called.
+  bool erase(size_t length);
+  bool write(size_t offset, const void *src, size_t length);
+  bool end();
+
+  const GlyphStoreHeader* getHeader() { return (const GlyphStoreHeader*)data; }
+  // Pointer to the atlas, or nullptr if the store doesn't hold one for dir
+  const uint8_t* getAtlas(const char *dir);
+
+private:
+  bool map();
+  void unmap();
+
+  const uint8_t *data = nullptr;
+  size_t capacity = 0;
+
+#ifdef ESP32
+  const esp_partition_t *partition = nullptr;
+  spi_flash_mmap_handle_t handle;
+#else
+  int fd = -1;
+#endif
+};
+
+#endif // GLYPH_STORE_H
@@ -1,5 +1,7 @@
 #include "TFTs.h"
 #include "IPSClock.h"
+#include "RenderTask.h"
+#include "UnpackTask.h"
 
 extern void broadcastUpdate(const BaseConfigItem& item);
 extern void broadcastFSChange();
@@ -22,7 +24,10 @@ IPSClock::IPSClock() {
 
 void IPSClock::init() {
 	displayTimer.init(millis(), 0);
-    oldClockFace = getClockFace().value;
+    // Called from the clock task, which is the one the tick should wake
+    displayTick.begin(xTaskGetCurrentTaskHandle());
+    // Nothing is selected until checkIconPack() has found the face, or unpacked it
+    oldClockFace = "";
 }
 
 bool IPSClock::clockOn() {
@@ -57,24 +62,40 @@ bool IPSClock::clockOn() {
 	return scheduledOn;
 }
 
+/*
+ * A new face is unpacked in the background, and the old one stays up until it is ready
+ */
 void IPSClock::checkIconPack() {
-    if (getClockFace().value != oldClockFace) {
-        getClockFace() = imageUnpacker->unpackImages("/ips/faces/", "/ips/cache", getClockFace(), oldClockFace);
+    if (getClockFace().value != requestedClockFace) {
+        requestedClockFace = getClockFace().value;
+        unpackTask->request(UnpackTask::CLOCK_FACE, "/ips/faces/", "/ips/cache", requestedClockFace);
+    }
+
+    UnpackTask::Result result;
+    if (unpackTask->takeResult(UnpackTask::CLOCK_FACE, result)) {
+        if (result.ok) {
+            oldClockFace = result.face;
+            tfts->claim();
+            tfts->setCacheDir(TIME, ImageUnpacker::faceDir("/ips/cache", oldClockFace).c_str());
+            tfts->invalidateAllDigits();
+            tfts->release();
+        } else if (oldClockFace.length() > 0) {
+            renderTask->postStatus("Reverting!");
+            getClockFace() = oldClockFace;
+            requestedClockFace = oldClockFace;
+        }
         getClockFace().put();
         broadcastUpdate(getClockFace());
         broadcastFSChange();
-        oldClockFace = getClockFace();
-        tfts->claim();
-        tfts->invalidateAllDigits();
-        tfts->release();
     }
 }
 
 void IPSClock::loop() {
     unsigned long nowMs = millis();
 
-    // display refresh
-    if (displayTimer.expired(nowMs)) {
+    // display refresh. The timer is only used if the tick couldn't be started.
+    bool ticked = displayTick.take();
+    if (ticked || (!displayTick.isRunning() && displayTimer.expired(nowMs))) {
         struct tm now;
         suseconds_t uSec;
         pTimeSync->getLocalTime(&now, &uSec);
@@ -83,15 +104,22 @@ void IPSClock::loop() {
             realms = realms % 1000;	// Something went wrong so pick a safe number for 1000 - realms...
         }
         unsigned long tDelay = 1000 - realms;
+        unsigned long startUs = micros();
+        uint8_t show = getTimeOrDate().value;
+
+        // How far into the second being shown we are. The tick wakes us just before it starts.
+        int32_t intoSecondUs = uSec;
+        if (ticked && uSec < 1000000 && uSec + displayTick.getLeadUs() >= 500000) {
+            intoSecondUs -= 1000000;
+            now.tm_sec++;
+            mktime(&now);
+        }
 
         if (clockOn() || (getDimming() == DIM)) {
-            tfts->claim();
-            tfts->setDimming(getBrightness());
-            tfts->setImageJustification(TFTs::MIDDLE_CENTER);
-            tfts->setBox(tfts->width(), tfts->height());
-            tfts->checkStatus();
-            tfts->enableAllDisplays();
-            // tfts->invalidateAllDigits();
+            // Drawn by the render task once everything has been worked out
+            RenderTask::DigitFrame frame;
+            frame.dimming = getBrightness();
+            frame.transition = getSlideTransition().value;
 
             // Display custom data if available: 
             uint8_t customDataLength = getCustomData().value.length();
@@ -131,55 +159,23 @@ void IPSClock::loop() {
                         SECONDS_TENS,
                         SECONDS_ONES
                     };
-                    tfts->setDigit(DIGITS[i], name, TFTs::yes);
+                    frame.setDigit(DIGITS[i], name, show);
                 }
             }
             // Display time: 
             else if (getTimeOrDate().value == TIME) {
-                uint8_t hour = now.tm_hour;
-
-                // refresh starting on seconds
-                if (getFourDigitDisplay() == SIX) {
-                    tfts->setDigit(SECONDS_ONES, digitToName[now.tm_sec % 10], TFTs::yes);
-                    tfts->setDigit(SECONDS_TENS, digitToName[now.tm_sec / 10], TFTs::yes);
-                    tfts->setDigit(MINUTES_ONES, digitToName[now.tm_min % 10], TFTs::yes);
-                    tfts->setDigit(MINUTES_TENS, digitToName[now.tm_min / 10], TFTs::yes);
-                } else {
-                    if (getFourDigitDisplay() == FOUR) {
-                        if (getHourFormat()) {  // true == show am/pm indicator
-                            tfts->setDigit(SECONDS_ONES, hour < 12 ? "am" : "pm", TFTs::yes);
-                        } else {
-                            tfts->setDigit(SECONDS_ONES, "space", TFTs::yes);
-                        }
-                    } else if (getFourDigitDisplay() == FOUR_WITH_SLIDESHOW && now.tm_sec % 10 == 3) {
-                        tfts->setShowDigits(SLIDE_SHOW);
-                        tfts->setDigit(SECONDS_ONES, digitToName[random(10)], TFTs::yes);
-                        tfts->setShowDigits(TIME);
-                    }
-                    tfts->setDigit(SECONDS_TENS, digitToName[now.tm_min % 10], TFTs::yes);
-                    tfts->setDigit(MINUTES_ONES, digitToName[now.tm_min / 10], TFTs::yes);
-                    if (now.tm_sec % 2 == 0) {
-                        tfts->setDigit(MINUTES_TENS, "space", TFTs::yes);
-                    } else {
-                        tfts->setDigit(MINUTES_TENS, "colon", TFTs::yes);
-                    }
+                if (getFourDigitDisplay() == FOUR_WITH_SLIDESHOW && now.tm_sec % 10 == 3) {
+                    frame.setDigit(SECONDS_ONES, digitToName[random(10)], SLIDE_SHOW);
                 }
 
-                if (getHourFormat()) {  // true = 12 hour display
-                    if (now.tm_hour > 12) {
-                        hour = now.tm_hour - 12;
-                    } else if (now.tm_hour == 0) {
-                        hour = 12;
+                // refresh starting on seconds
+                const char *names[NUM_DIGITS];
+                getTimeDigitNames(now, names);
+                for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+                    if (names[digit] != nullptr) {
+                        frame.setDigit(digit, names[digit], show);
                     }
                 }
-
-                tfts->setDigit(HOURS_ONES, digitToName[hour % 10], TFTs::yes);
-                tfts->setDigit(HOURS_ONES, digitToName[hour % 10], TFTs::yes);
-                if (hour < 10 && !getLeadingZero().value) {
-                    tfts->setDigit(HOURS_TENS, "space", TFTs::yes);
-                } else {
-                    tfts->setDigit(HOURS_TENS, digitToName[hour / 10], TFTs::yes);
-                }
             } 
             // Display Date: 
             else if (getTimeOrDate().value == DATE) {
@@ -201,33 +197,108 @@ void IPSClock::loop() {
                 }
 
                 // refresh starting on 'seconds'
-                tfts->setDigit(SECONDS_ONES, digitToName[year % 10], TFTs::yes);
-                tfts->setDigit(SECONDS_TENS, digitToName[year / 10], TFTs::yes);
-                tfts->setDigit(MINUTES_ONES, digitToName[month % 10], TFTs::yes);
-                tfts->setDigit(MINUTES_TENS, digitToName[month / 10], TFTs::yes);
-                tfts->setDigit(HOURS_ONES, digitToName[day % 10], TFTs::yes);
-                tfts->setDigit(HOURS_TENS, digitToName[day / 10], TFTs::yes);
+                frame.setDigit(SECONDS_ONES, digitToName[year % 10], show);
+                frame.setDigit(SECONDS_TENS, digitToName[year / 10], show);
+                frame.setDigit(MINUTES_ONES, digitToName[month % 10], show);
+                frame.setDigit(MINUTES_TENS, digitToName[month / 10], show);
+                frame.setDigit(HOURS_ONES, digitToName[day % 10], show);
+                frame.setDigit(HOURS_TENS, digitToName[day / 10], show);
             } else if (getTimeOrDate().value == SLIDE_SHOW) {
                 if (strcmp(TFTs::INVALID_DIGIT, tfts->getDigitName(SECONDS_ONES)) == 0) {
-                    tfts->setDigit(SECONDS_ONES, digitToName[0], TFTs::yes);
-                    tfts->setDigit(SECONDS_TENS, digitToName[1], TFTs::yes);
-                    tfts->setDigit(MINUTES_ONES, digitToName[2], TFTs::yes);
-                    tfts->setDigit(MINUTES_TENS, digitToName[3], TFTs::yes);
-                    tfts->setDigit(HOURS_ONES, digitToName[4], TFTs::yes);
-                    tfts->setDigit(HOURS_TENS, digitToName[5], TFTs::yes);
+                    frame.setDigit(SECONDS_ONES, digitToName[0], show);
+                    frame.setDigit(SECONDS_TENS, digitToName[1], show);
+                    frame.setDigit(MINUTES_ONES, digitToName[2], show);
+                    frame.setDigit(MINUTES_TENS, digitToName[3], show);
+                    frame.setDigit(HOURS_ONES, digitToName[4], show);
+                    frame.setDigit(HOURS_TENS, digitToName[5], show);
                 }
                 if (now.tm_sec % 10 == 0) {
-                    tfts->setDigit(random(6), digitToName[random(10)], TFTs::yes);
+                    frame.setDigit(random(6), digitToName[random(10)], show);
                 }
             } else {
                 Serial.println("Bad display state for clock");
             }
+
+            if (customDataLength == 0 && show == TIME) {
+                if (uSec < 1000000) {
+                    frame.measureJitter = true;
+                    frame.secondStartMicros = startUs - intoSecondUs;
+                }
+
+                prefetchNextSecond(now, frame);
+            }
+
+            renderTask->postDigits(frame);
         } else {
+            renderTask->discardDigits();
+            tfts->claim();
             tfts->disableAllDisplays();
+            tfts->release();
         }
 
-        tfts->release();
-
         displayTimer.init(nowMs, tDelay);
     }
 }
+
+/*
+ * The image for each digit when showing the time, or nullptr for digits that the time doesn't use.
+ */
+void IPSClock::getTimeDigitNames(const struct tm &now, const char *names[NUM_DIGITS]) {
+    uint8_t hour = now.tm_hour;
+
+    for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+        names[digit] = nullptr;
+    }
+
+    if (getFourDigitDisplay() == SIX) {
+        names[SECONDS_ONES] = digitToName[now.tm_sec % 10];
+        names[SECONDS_TENS] = digitToName[now.tm_sec / 10];
+        names[MINUTES_ONES] = digitToName[now.tm_min % 10];
+        names[MINUTES_TENS] = digitToName[now.tm_min / 10];
+    } else {
+        if (getFourDigitDisplay() == FOUR) {
+            if (getHourFormat()) {  // true == show am/pm indicator
+                names[SECONDS_ONES] = hour < 12 ? "am" : "pm";
+            } else {
+                names[SECONDS_ONES] = "space";
+            }
+        }
+        names[SECONDS_TENS] = digitToName[now.tm_min % 10];
+        names[MINUTES_ONES] = digitToName[now.tm_min / 10];
+        names[MINUTES_TENS] = now.tm_sec % 2 == 0 ? "space" : "colon";
+    }
+
+    if (getHourFormat()) {  // true = 12 hour display
+        if (now.tm_hour > 12) {
+            hour = now.tm_hour - 12;
+        } else if (now.tm_hour == 0) {
+            hour = 12;
+        }
+    }
+
+    names[HOURS_ONES] = digitToName[hour % 10];
+    if (hour < 10 && !getLeadingZero().value) {
+        names[HOURS_TENS] = "space";
+    } else {
+        names[HOURS_TENS] = digitToName[hour / 10];
+    }
+}
+
+/*
+ * The clock task is idle for most of each second, so decode whatever will change at the next one now.
+ * Then all that is left to do when it arrives is send it.
+ */
+void IPSClock::prefetchNextSecond(const struct tm &now, RenderTask::DigitFrame &frame) {
+    struct tm next = now;
+    next.tm_sec++;
+    mktime(&next);
+
+    const char *names[NUM_DIGITS];
+    getTimeDigitNames(next, names);
+    for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+        if (names[digit] != nullptr) {
+            strncpy(frame.prefetch[digit], names[digit], sizeof(frame.prefetch[digit]) - 1);
+        }
+    }
+    frame.prefetchShowDigits = TIME;
+}
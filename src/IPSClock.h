@@ -5,8 +5,9 @@
 #include <TimeSync.h>
 
 #include "ClockTimer.h"
-#include "ImageUnpacker.h"
+#include "DisplayTick.h"
 #include "IRAMPtrArray.h"
+#include "RenderTask.h"
 
 class IPSClock {
 public:
@@ -56,21 +57,25 @@ public:
     void loop();
     void checkIconPack();
     void setTimeSync(TimeSync *pTimeSync) { this->pTimeSync = pTimeSync; }
-    void setImageUnpacker(ImageUnpacker *imageUnpacker) { this->imageUnpacker = imageUnpacker; }
 
     bool clockOn();
     void setOnOverride() { onOverride = millis(); };
     void overrideUntilNextChange() { prevScheduleOn = clockOn(); temporaryOverride = true; }
     void setBrightness(byte brightness) { this->brightness = brightness; }
     uint8_t getBrightness() { return getDimming() == DIM && !clockOn() ? (brightness / 6) : brightness; }
+    DisplayTick& getDisplayTick() { return displayTick; }
 private:
     static IRAMPtrArray<const char*> digitToName;
 
+    void getTimeDigitNames(const struct tm &now, const char *names[NUM_DIGITS]);
+    void prefetchNextSecond(const struct tm &now, RenderTask::DigitFrame &frame);
+
     byte brightness = 255;
     ClockTimer::Timer displayTimer;
-    String oldClockFace;
+    DisplayTick displayTick;
+    String oldClockFace;        // showing
+    String requestedClockFace;  // being unpacked, or the same as oldClockFace
 	TimeSync *pTimeSync = 0;
-    ImageUnpacker *imageUnpacker;
     unsigned long onOverride = 0;
     bool temporaryOverride = false;
     bool prevScheduleOn = false;
@@ -0,0 +1,91 @@
+#include "ImageReader.h"
+
+ImageReader::Stats ImageReader::stats;
+
+ImageReader::ImageReader(fs::File &file, uint8_t *buffer, size_t bufferSize) :
+  file(file), buffer(buffer), bufferSize(bufferSize), pos(file.position())
+{
+}
+
+int ImageReader::read() {
+  const uint8_t *p = readBlock(1);
+  return p == nullptr ? -1 : *p;
+}
+
+size_t ImageReader::read(uint8_t *dest, size_t len) {
+  size_t done = 0;
+
+  while (done < len) {
+    if (pos >= bufferStart && pos < bufferStart + bufferLength) {
+      size_t n = min(len - done, (size_t)(bufferStart + bufferLength - pos));
+      memcpy(dest + done, buffer + (pos - bufferStart), n);
+      done += n;
+      pos += n;
+    } else if (len - done >= bufferSize) {
+      // Too big to be worth buffering, e.g. a whole raw image, so read it straight into place
+      size_t n = readAt(pos, dest + done, len - done);
+      done += n;
+      pos += n;
+      break;
+    } else if (!fill(pos, 1)) {
+      break;
+    }
+  }
+
+  return done;
+}
+
+const uint8_t* ImageReader::readBlock(size_t len) {
+  if (pos < bufferStart || pos + len > bufferStart + bufferLength) {
+    if (!fill(pos, len)) {
+      return nullptr;
+    }
+  }
+
+  const uint8_t *p = buffer + (pos - bufferStart);
+  pos += len;
+  return p;
+}
+
+size_t ImageReader::readAt(uint32_t at, uint8_t *dest, size_t len) {
+  unsigned long start = micros();
+  file.seek(at);
+  size_t n = file.read(dest, len);
+  stats.us += micros() - start;
+  stats.bytes += n;
+
+  return n;
+}
+
+bool ImageReader::seek(uint32_t pos, fs::SeekMode mode) {
+  switch (mode) {
+    case fs::SeekCur: this->pos += pos; break;
+    case fs::SeekEnd: this->pos = file.size() + pos; break;
+    default: this->pos = pos; break;
+  }
+
+  return true;
+}
+
+/*
+ * Fill the buffer so that it holds at least len bytes from position from.
+ */
+bool ImageReader::fill(uint32_t from, size_t len) {
+  if (len > bufferSize) {
+    return false;
+  }
+
+  uint32_t start = from & ~(uint32_t)(IMAGE_READ_ALIGNMENT - 1);
+  if (from + len > start + bufferSize) {
+    start = from;
+  }
+
+  unsigned long startUs = micros();
+  file.seek(start);
+  bufferStart = start;
+  bufferLength = file.read(buffer, bufferSize);
+  stats.us += micros() - startUs;
+  stats.bytes += bufferLength;
+
+  return from + len <= bufferStart + bufferLength;
+}
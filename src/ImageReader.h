@@ -0,0 +1,56 @@
+#ifndef IMAGE_READER_H
+#define IMAGE_READER_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Size of the scratch buffer images are read through. A LittleFS block is 4KB.
+#ifndef IMAGE_READ_BUFFER_SIZE
+#define IMAGE_READ_BUFFER_SIZE 4096
+#endif
+
+// Buffer fills start on a multiple of this, so that they line up with the file system's reads
+#ifndef IMAGE_READ_ALIGNMENT
+#define IMAGE_READ_ALIGNMENT 512
+#endif
+
+/*
+ * Reads an image through a scratch buffer, so that the header and rows come out of a few large aligned
+ * reads rather than one file system call per field or per row. The file's own position isn't kept
+ * in step, so don't use the file directly while a reader is using it.
+ */
+class ImageReader {
+public:
+  struct Stats {
+    uint32_t bytes = 0;   // read from the file system
+    uint32_t us = 0;      // spent reading them
+  };
+
+  ImageReader(fs::File &file, uint8_t *buffer, size_t bufferSize);
+
+  int read();
+  size_t read(uint8_t *dest, size_t len);
+  // Returns the next len bytes without copying them, or nullptr if there aren't that many or they
+  // don't fit in the buffer. The pointer is only valid until the next call.
+  const uint8_t* readBlock(size_t len);
+  // Read from somewhere else in the file without disturbing the buffer or the position
+  size_t readAt(uint32_t at, uint8_t *dest, size_t len);
+  bool seek(uint32_t pos, fs::SeekMode mode = fs::SeekSet);
+  size_t position() const { return pos; }
+
+  static const Stats& getStats() { return stats; }
+
+private:
+  bool fill(uint32_t from, size_t len);
+
+  fs::File &file;
+  uint8_t *buffer;
+  size_t bufferSize;
+  uint32_t bufferStart = 0;   // file position of buffer[0]
+  size_t bufferLength = 0;    // bytes in the buffer
+  uint32_t pos;
+
+  static Stats stats;
+};
+
+#endif // IMAGE_READER_H
@@ -1,10 +1,22 @@
 #include <LittleFS.h>
 
 #include "TFTs.h"
+#include "RenderTask.h"
 #include "ImageUnpacker.h"
 
-bool ImageUnpacker::newUnpack = true;
-const char* ImageUnpacker::unpackName = "";
+volatile bool ImageUnpacker::cancelled = false;
+uint8_t ImageUnpacker::lastProgress = 0;
+String ImageUnpacker::unpackLabel;
+String ImageUnpacker::previousAtlasName;
+bool ImageUnpacker::convertAsExtracted = false;
+String ImageUnpacker::pendingConvert;
+std::vector<ManifestEntry> ImageUnpacker::archiveEntries;
+std::vector<ManifestEntry> ImageUnpacker::previousEntries;
+std::vector<AtlasEntry> ImageUnpacker::previousAtlas;
+std::vector<String> ImageUnpacker::reusedNames;
+
+// Faces in all of these share the file system, so any of them can be evicted to make room for another
+static const char* cacheRoots[] = { "/ips/cache", "/ips/weather_cache", "/ips/slides_cache" };
 
 TarGzUnpacker &ImageUnpacker::getUnpacker() {
     static TarGzUnpacker *unpacker = 0;
@@ -15,76 +27,842 @@ TarGzUnpacker &ImageUnpacker::getUnpacker() {
         unpacker->setupFSCallbacks( targzTotalBytesFn, targzFreeBytesFn ); // prevent the partition from exploding, recommended
         unpacker->setGzProgressCallback( unpackProgressCallback ); // targzNullProgressCallback or defaultProgressCallback
         unpacker->setLoggerCallback( BaseUnpacker::targzPrintLoggerCallback  );    // gz log verbosity
-        unpacker->setTarStatusProgressCallback( statusProgressCallback ); // print the filenames as they're expanded
         unpacker->setTarMessageCallback( BaseUnpacker::targzPrintLoggerCallback ); // tar log verbosity
+        unpacker->setTarExcludeFilter( excludeUnchanged ); // skip images that are already in the atlas
     }
 
     return *unpacker;
 }
 
-void ImageUnpacker::statusProgressCallback(const char* name, size_t size, size_t total_unpacked) {
-	unpackName = name;
+/*
+ * Called for each entry in the archive. Records it for the manifest, and leaves it out if it is the
+ * same as last time and the previous atlas still has it.
+ */
+bool ImageUnpacker::excludeUnchanged(header_translated_t *header) {
+    // The unpacker can't be stopped, but it can be made to skip everything that is left
+    if (cancelled) {
+        return true;
+    }
+
+    // The previous image has been written by the time the next one starts
+    if (convertAsExtracted) {
+        convertPending();
+    }
+
+    String path(header->filename);
+    if (!path.endsWith(".bmp")) {
+        return false;
+    }
+
+    ManifestEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.name, imageName(path).c_str(), sizeof(entry.name) - 1);
+    entry.size = header->filesize;
+    entry.time = header->mtime;
+    entry.checksum = header->checksum;
+    archiveEntries.push_back(entry);
+
+    bool unchanged = false;
+    for (const ManifestEntry &previous : previousEntries) {
+        if (strcmp(previous.name, entry.name) == 0) {
+            unchanged = previous.size == entry.size && previous.time == entry.time && previous.checksum == entry.checksum;
+        }
+    }
+
+    bool inAtlas = false;
+    for (const AtlasEntry &atlasEntry : previousAtlas) {
+        if (strcmp(atlasEntry.name, entry.name) == 0) {
+            inAtlas = true;
+        }
+    }
+
+    if (unchanged && inAtlas) {
+        reusedNames.push_back(entry.name);
+        return true;
+    }
+
+    if (convertAsExtracted) {
+        pendingConvert = String(UNPACK_STAGING_DIR) + "/" + entry.name + ".bmp";
+    }
+
+    return false;
+}
+
+void ImageUnpacker::convertPending() {
+    if (pendingConvert.length() > 0) {
+        convertImage(pendingConvert);
+        pendingConvert = "";
+    }
 }
 
-void ImageUnpacker::unpackProgressCallback(uint8_t progress) {
-	tfts->drawMeter(progress, newUnpack, unpackName);
-	newUnpack = false;
+/*
+ * Convert one image, if the file system has room for the raw copy as well as the reserve. The space made
+ * before unpacking only allows for the archive's size, and a converted indexed image can be several times that.
+ */
+bool ImageUnpacker::convertImage(const String &name) {
+    size_t used = LittleFS.usedBytes() + getCacheReserve().value * 1024;
+    uint32_t room = LittleFS.totalBytes() > used ? LittleFS.totalBytes() - used : 0;
+
+    // Converting decodes through the same buffers as drawing, so only hold the TFTs for one image at a time
+    tfts->claim();
+    bool ok = tfts->ConvertImage(name.c_str(), room);
+    tfts->release();
+    return ok;
 }
 
-const String& ImageUnpacker::unpackImages(const String &srcDir, const String &destDir, const String &newFaces, const String &oldFaces) {
-    if (unpackImages(srcDir + newFaces, destDir)) {
-        return newFaces;
-    } else {
-        tfts->setStatus("Reverting!");
-        unpackImages(srcDir + oldFaces, destDir);
-        return oldFaces;
+/*
+ * The face that is showing stays up while another is unpacked, so progress only goes on the status line
+ */
+void ImageUnpacker::unpackProgressCallback(uint8_t progress) {
+    if (progress != lastProgress) {
+        lastProgress = progress;
+        renderTask->postStatus(unpackLabel + " " + String(progress) + "%");
     }
 }
 
+bool ImageUnpacker::unpackFace(const String &srcDir, const String &cacheRoot, const String &face) {
+    LittleFS.mkdir(cacheRoot);
+    removeLegacyFiles(cacheRoot);
+
+    return unpackImages(srcDir + face, faceDir(cacheRoot, face));
+}
+
 bool ImageUnpacker::unpackImages(const String &faceName, const String &dest) {
 	String fileName(faceName + ".tar.gz");
 
-    if (LittleFS.exists(fileName)) {
-        newUnpack = true;
+    if (!LittleFS.exists(fileName)) {
+        return false;
+    }
+
+    unsigned long start = millis();
+    lastStats = Stats();
+    strncpy(lastStats.name, faceName.substring(faceName.lastIndexOf('/') + 1).c_str(), sizeof(lastStats.name) - 1);
 
-        fs::File dir = LittleFS.open(dest);
-        String name = dir.getNextFileName();
-        while(name.length() > 0){
-            LittleFS.remove(name);
-            name = dir.getNextFileName();
+    beginManifest(fileName);
+
+    // If this archive was the last one unpacked here and its atlas is still intact, there is nothing to do
+    ManifestHeader previous;
+    bool havePrevious = readManifest(dest, previous, previousEntries);
+    if (havePrevious && strcmp(previous.archive, manifest.archive) == 0
+        && previous.archiveSize == manifest.archiveSize && previous.archiveTime == manifest.archiveTime) {
+        fs::File atlas = LittleFS.open(dest + "/" + ATLAS_FILE_NAME, "r");
+        bool intact = atlas && atlas.size() == previous.atlasSize;
+        atlas.close();
+        if (intact) {
+            markUsed(dest);
+#ifdef GLYPH_STORE
+            if (dest.startsWith("/ips/cache/")) {
+                tfts->claim();
+                if (!tfts->hasStoredGlyphs(dest.c_str())) {
+                    tfts->closeAtlas();
+                    Serial.printf("Glyph store %s\n", tfts->storeGlyphs(dest.c_str()) ? "updated" : "not updated");
+                }
+                tfts->release();
+            }
+#endif
+            lastStats.unchanged = true;
+            lastStats.images = previous.count;
+            lastStats.ms = millis() - start;
+            Serial.printf("%s is already unpacked in %s\n", fileName.c_str(), dest.c_str());
+            return true;
         }
-        dir.close();
+    }
 
-        TarGzUnpacker &unpacker = getUnpacker();
+    lastProgress = 0;
+    unpackLabel = lastStats.name;
 
-        if( !unpacker.tarGzExpander(tarGzFS, fileName.c_str(), tarGzFS, dest.c_str(), nullptr ) ) {
-            Serial.printf("tarGzExpander+intermediate file failed with return code #%d\n", unpacker.tarGzGetError() );
-            return false;
-        } else {
-            Serial.println("File unzipped");
-        }
-
-#ifdef notdef
-        dir = LittleFS.open(dest);
-        File file = dir.openNextFile();
-        while(file){
-            Serial.print("  FILE: ");
-            Serial.print(file.name());
-            Serial.print("  SIZE: ");
-
-    #ifdef CONFIG_LITTLEFS_FOR_IDF_3_2
-            Serial.println(file.size());
-    #else
-            Serial.print(file.size());
-            time_t t= file.getLastWrite();
-            struct tm * tmstruct = localtime(&t);
-            Serial.printf("  LAST WRITE: %d-%02d-%02d %02d:%02d:%02d\n",(tmstruct->tm_year)+1900,( tmstruct->tm_mon)+1, tmstruct->tm_mday,tmstruct->tm_hour , tmstruct->tm_min, tmstruct->tm_sec);
-    #endif
-            file.close();
-            file = dir.openNextFile();
+    // The unpacker needs the memory
+    tfts->claim();
+    tfts->flushGlyphCache();
+    tfts->release();
+
+    // Everything is unpacked into the staging directory and only replaces dest once it is complete, so
+    // whatever is showing from dest now carries on until then. The images are extracted and then packed
+    // into the atlas, so at worst there are two copies of them. Converting an image checks for its own room.
+    removeDir(UNPACK_STAGING_DIR);
+    LittleFS.mkdir(UNPACK_STAGING_DIR);
+    makeRoom(2 * uncompressedSize(fileName), dest);
+
+    // Try to reuse images from the last atlas. If that goes wrong, unpack everything again.
+    bool unpacked = extractImages(fileName, UNPACK_STAGING_DIR, havePrevious ? dest : "");
+    if (!unpacked && havePrevious && !cancelled) {
+        unpacked = extractImages(fileName, UNPACK_STAGING_DIR, "");
+    }
+
+    unpacked = unpacked && !cancelled && swapIn(dest);
+    if (unpacked) {
+        markUsed(dest);
+#ifdef GLYPH_STORE
+        if (dest.startsWith("/ips/cache/")) {
+            tfts->claim();
+            tfts->closeAtlas();
+            bool stored = tfts->storeGlyphs(dest.c_str());
+            tfts->release();
+            Serial.printf("Glyph store %s\n", stored ? "updated" : "not updated");
         }
-        dir.close();
 #endif
+    } else {
+        // Don't leave a partly unpacked face taking up space
+        removeDir(UNPACK_STAGING_DIR);
+        if (cancelled) {
+            Serial.printf("Cancelled unpacking %s\n", fileName.c_str());
+        }
+    }
+
+    previousEntries.clear();
+    previousAtlas.clear();
+    reusedNames.clear();
+
+    lastStats.ms = millis() - start;
+    Serial.printf("Unpacked %s in %lums, wrote %lu bytes, reused %d of %d images\n", fileName.c_str(),
+        (unsigned long)lastStats.ms, (unsigned long)lastStats.bytesWritten, lastStats.reused, lastStats.images);
+
+    return unpacked;
+}
+
+/*
+ * Unpack an archive as it is uploaded to fileName, into face's directory under cacheRoot. Each image is
+ * converted as soon as it has arrived, so once the upload has finished all that is left is to build the
+ * atlas. If the archive is bad the upload is rejected, so that it can be stopped before it fills the flash.
+ */
+bool ImageUnpacker::unpackUpload(UploadStream &upload, const String &cacheRoot, const String &face, const String &fileName) {
+    String dest = faceDir(cacheRoot, face);
+
+    lastStats = Stats();
+    lastStats.streamed = true;
+    strncpy(lastStats.name, face.c_str(), sizeof(lastStats.name) - 1);
+    lastProgress = 0;
+    unpackLabel = lastStats.name;
+
+    // The unpacker needs the memory
+    tfts->claim();
+    tfts->flushGlyphCache();
+    tfts->release();
+
+    LittleFS.mkdir(cacheRoot);
+    removeLegacyFiles(cacheRoot);
+    removeDir(UNPACK_STAGING_DIR);
+    LittleFS.mkdir(UNPACK_STAGING_DIR);
+
+    // Nothing can be reused, the archive hasn't been seen before
+    previousEntries.clear();
+    previousAtlas.clear();
+    previousAtlasName = "";
+    archiveEntries.clear();
+    reusedNames.clear();
+    lastStats.bytesWritten = 0;
+
+    convertAsExtracted = true;
+    TarGzUnpacker &unpacker = getUnpacker();
+    bool unpacked = unpacker.tarGzStreamExpander(&upload, tarGzFS, UNPACK_STAGING_DIR);
+    convertPending();
+    convertAsExtracted = false;
+
+    if (!unpacked && !cancelled) {
+        Serial.printf("tarGzStreamExpander failed with return code #%d\n", unpacker.tarGzGetError());
+        upload.reject();
+    }
+
+    // The manifest describes the archive as it ends up on the file system
+    unpacked = unpacked && !cancelled && upload.waitForFinish();
+    if (unpacked) {
+        beginManifest(fileName);
+        unpacked = finishImages(UNPACK_STAGING_DIR);
+    }
+
+    unpacked = unpacked && !cancelled && swapIn(dest);
+    if (unpacked) {
+        markUsed(dest);
+#ifdef GLYPH_STORE
+        // The store may hold the images this upload has just replaced
+        if (dest.startsWith("/ips/cache/")) {
+            tfts->claim();
+            if (tfts->isCacheDir(dest.c_str()) || tfts->hasStoredGlyphs(dest.c_str())) {
+                tfts->closeAtlas();
+                Serial.printf("Glyph store %s\n", tfts->storeGlyphs(dest.c_str()) ? "updated" : "not updated");
+            }
+            tfts->release();
+        }
+#endif
+    } else {
+        removeDir(UNPACK_STAGING_DIR);
+    }
+
+    previousEntries.clear();
+    archiveEntries.clear();
+
+    lastStats.ms = millis() - upload.getStartMs();
+    Serial.printf("%s %s as it was uploaded, %lums after the upload started\n", unpacked ? "Unpacked" : "Couldn't unpack",
+        fileName.c_str(), (unsigned long)lastStats.ms);
+
+    return unpacked;
+}
+
+void ImageUnpacker::beginManifest(const String &fileName) {
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.magic = MANIFEST_MAGIC;
+    manifest.version = MANIFEST_VERSION;
+    strncpy(manifest.archive, fileName.c_str(), sizeof(manifest.archive) - 1);
+    fs::File archive = LittleFS.open(fileName, "r");
+    manifest.archiveSize = archive.size();
+    manifest.archiveTime = archive.getLastWrite();
+    archive.close();
+}
+
+/*
+ * Extract the archive into dest. If previousDir is given, the images that haven't changed since the last
+ * archive was unpacked there are copied from its atlas instead of being extracted and converted again.
+ */
+bool ImageUnpacker::extractImages(const String &fileName, const String &dest, const String &previousDir) {
+    bool reuse = previousDir.length() > 0;
+    previousAtlasName = reuse ? previousDir + "/" + ATLAS_FILE_NAME : "";
+
+    fs::File dir = LittleFS.open(dest);
+    String name = dir.getNextFileName();
+    while(name.length() > 0){
+        LittleFS.remove(name);
+        name = dir.getNextFileName();
+    }
+    dir.close();
+
+    previousAtlas.clear();
+    if (reuse) {
+        fs::File previous = LittleFS.open(previousAtlasName, "r");
+        if (previous) {
+            readAtlasIndex(previous, previousAtlas);
+            previous.close();
+        }
+    }
+    archiveEntries.clear();
+    reusedNames.clear();
+    lastStats.bytesWritten = 0;
+    lastStats.reused = 0;
+
+    TarGzUnpacker &unpacker = getUnpacker();
+
+    if( !unpacker.tarGzExpander(tarGzFS, fileName.c_str(), tarGzFS, dest.c_str(), nullptr ) ) {
+        Serial.printf("tarGzExpander+intermediate file failed with return code #%d\n", unpacker.tarGzGetError() );
+        return false;
+    } else if (cancelled) {
+        return false;
+    } else {
+        Serial.println("File unzipped");
+    }
+
+    return finishImages(dest);
+}
+
+/*
+ * Convert what has been extracted into dest and pack it into an atlas
+ */
+bool ImageUnpacker::finishImages(const String &dest) {
+    fs::File dir = LittleFS.open(dest);
+    fs::File file = dir.openNextFile();
+    while (file) {
+        lastStats.bytesWritten += file.size();
+        file.close();
+        file = dir.openNextFile();
+    }
+    dir.close();
+
+#ifdef GOLDEN_IMAGES
+    tfts->claim();
+    tfts->hashImages(dest.c_str(), "decode");
+    tfts->release();
+#endif
+
+    convertImages(dest);
+    if (cancelled) {
+        return false;
+    }
+
+#ifdef GOLDEN_IMAGES
+    // Converting must not change a single pixel
+    tfts->claim();
+    tfts->hashImages(dest.c_str(), "raw");
+    tfts->release();
+#endif
+
+    bool built = buildAtlas(dest);
+
+    // Reused images are only in the atlas, so without it they are lost
+    return built || reusedNames.empty();
+}
+
+/*
+ * Decoding BMPs is slow, so do it once here instead of every time an image is drawn. Anything
+ * that can't be converted is left as it is and decoded at draw time.
+ */
+void ImageUnpacker::convertImages(const String &dest) {
+    int converted = 0;
+    unsigned long start = millis();
+
+    // Converting creates and renames files, so don't do it while walking the directory
+    std::vector<String> names;
+    listImages(dest, names);
+
+    for (const String &name : names) {
+        if (cancelled) {
+            break;
+        }
+
+        if (convertImage(name)) {
+            converted++;
+            fs::File file = LittleFS.open(name, "r");
+            lastStats.bytesWritten += file.size();
+            file.close();
+        }
+    }
+
+    Serial.printf("Converted %d of %d images in %s in %lums\n", converted, (int)names.size(), dest.c_str(), millis() - start);
+}
+
+void ImageUnpacker::listImages(const String &dest, std::vector<String> &names) {
+    fs::File dir = LittleFS.open(dest);
+    String name = dir.getNextFileName();
+    while(name.length() > 0){
+        if (name.endsWith(".bmp")) {
+            names.push_back(name);
+        }
+        name = dir.getNextFileName();
+    }
+    dir.close();
+}
+
+/*
+ * Reads the dimensions from the header of a raw, BMP or CLK image.
+ */
+bool ImageUnpacker::readImageSize(fs::File &file, uint16_t &w, uint16_t &h) {
+    uint8_t header[26];
+    size_t read = file.read(header, sizeof(header));
+    file.seek(0);
+
+    if (read >= RAW_IMAGE_HEADER_SIZE && header[0] == 'G' && header[1] == 'R') {
+        w = header[4] | (header[5] << 8);
+        h = header[6] | (header[7] << 8);
+        return true;
+    }
+
+    if (read >= 6 && header[0] == 'C' && header[1] == 'K') {
+        w = header[2] | (header[3] << 8);
+        h = header[4] | (header[5] << 8);
+        return true;
+    }
+
+    if (read >= 26 && header[0] == 'B' && header[1] == 'M') {
+        int32_t bmpW = header[18] | (header[19] << 8) | (header[20] << 16) | (header[21] << 24);
+        int32_t bmpH = header[22] | (header[23] << 8) | (header[24] << 16) | (header[25] << 24);
+        w = bmpW;
+        h = abs(bmpH);
         return true;
     }
+
+    return false;
+}
+
+/*
+ * Pack every image in dest, and any reused from the previous atlas, into a single atlas file, then
+ * delete the individual files and write the manifest. If the atlas can't be built, e.g. there isn't
+ * enough room, the individual files are kept.
+ */
+bool ImageUnpacker::buildAtlas(const String &dest) {
+    std::vector<String> names;
+    listImages(dest, names);
+
+    size_t count = names.size() + reusedNames.size();
+    if (count == 0) {
+        return false;
+    }
+
+    fs::File previous;
+    if (!reusedNames.empty()) {
+        previous = LittleFS.open(previousAtlasName, "r");
+    }
+
+    AtlasEntry *entries = (AtlasEntry*)calloc(count, sizeof(AtlasEntry));
+    const AtlasEntry **sources = (const AtlasEntry**)calloc(count, sizeof(AtlasEntry*));   // in the previous atlas, or null
+    ManifestEntry *manifestEntries = (ManifestEntry*)calloc(count, sizeof(ManifestEntry));
+    uint8_t *buffer = (uint8_t*)malloc(ATLAS_COPY_BUFFER_SIZE);
+    bool ok = entries != nullptr && sources != nullptr && manifestEntries != nullptr && buffer != nullptr;
+    ok = ok && (reusedNames.empty() || previous);
+
+    uint32_t offset = ATLAS_HEADER_SIZE + count * sizeof(AtlasEntry);
+    for (size_t i = 0; ok && i < count; i++) {
+        String baseName = i < names.size() ? imageName(names[i]) : reusedNames[i - names.size()];
+        if (baseName.length() >= sizeof(entries[i].name)) {
+            ok = false;
+            break;
+        }
+        strcpy(entries[i].name, baseName.c_str());
+
+        if (i < names.size()) {
+            fs::File file = LittleFS.open(names[i], "r");
+            ok = file && readImageSize(file, entries[i].w, entries[i].h);
+            if (ok) {
+                entries[i].size = file.size();
+            }
+            file.close();
+        } else {
+            for (const AtlasEntry &entry : previousAtlas) {
+                if (strcmp(entry.name, entries[i].name) == 0) {
+                    sources[i] = &entry;
+                }
+            }
+            ok = sources[i] != nullptr;
+            if (ok) {
+                entries[i].w = sources[i]->w;
+                entries[i].h = sources[i]->h;
+                entries[i].size = sources[i]->size;
+            }
+        }
+        entries[i].offset = offset;
+        offset += (entries[i].size + ATLAS_ALIGNMENT - 1) & ~(ATLAS_ALIGNMENT - 1);
+
+        strcpy(manifestEntries[i].name, entries[i].name);
+        for (const ManifestEntry &entry : archiveEntries) {
+            if (strcmp(entry.name, manifestEntries[i].name) == 0) {
+                manifestEntries[i] = entry;
+            }
+        }
+    }
+
+    String atlasName = dest + "/" + ATLAS_FILE_NAME;
+    String tmpName = atlasName + ".tmp";
+
+    fs::File atlas;
+    if (ok) {
+        atlas = LittleFS.open(tmpName, "w");
+        ok = atlas;
+    }
+
+    if (ok) {
+        uint8_t header[ATLAS_HEADER_SIZE] = {
+            ATLAS_MAGIC & 0xff, ATLAS_MAGIC >> 8,
+            ATLAS_VERSION,
+            0,
+            (uint8_t)(count & 0xff), (uint8_t)(count >> 8),
+            0, 0
+        };
+        ok = atlas.write(header, sizeof(header)) == sizeof(header);
+        ok = ok && atlas.write((uint8_t*)entries, count * sizeof(AtlasEntry)) == count * sizeof(AtlasEntry);
+    }
+
+    for (size_t i = 0; ok && i < count; i++) {
+        fs::File file;
+        fs::File &source = sources[i] != nullptr ? previous : file;
+        if (sources[i] != nullptr) {
+            previous.seek(sources[i]->offset);
+        } else {
+            file = LittleFS.open(names[i], "r");
+        }
+
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        size_t remaining = entries[i].size;
+        while (ok && remaining > 0) {
+            size_t len = source.read(buffer, min(remaining, (size_t)ATLAS_COPY_BUFFER_SIZE));
+            ok = len > 0 && atlas.write(buffer, len) == len;
+            for (size_t j = 0; j < len; j++) {
+                hash = (hash ^ buffer[j]) * 16777619u;
+            }
+            remaining -= len;
+        }
+        file.close();
+
+        // A reused image must be exactly what was there last time
+        if (sources[i] != nullptr) {
+            for (const ManifestEntry &entry : previousEntries) {
+                if (strcmp(entry.name, entries[i].name) == 0 && entry.hash != hash) {
+                    Serial.printf("%s has changed in the previous atlas\n", entry.name);
+                    ok = false;
+                }
+            }
+        }
+        manifestEntries[i].hash = hash;
+
+        uint32_t padding[1] = { 0 };
+        size_t padLength = (ATLAS_ALIGNMENT - entries[i].size % ATLAS_ALIGNMENT) % ATLAS_ALIGNMENT;
+        ok = ok && atlas.write((uint8_t*)padding, padLength) == padLength;
+    }
+
+    if (atlas) {
+        atlas.close();
+    }
+    if (previous) {
+        previous.close();
+    }
+    free(buffer);
+    free(entries);
+    free(sources);
+
+    if (ok) {
+        ok = LittleFS.rename(tmpName, atlasName);
+    }
+    if (!ok) {
+        free(manifestEntries);
+        LittleFS.remove(tmpName);
+        Serial.println("Couldn't build atlas, keeping individual images");
+        return false;
+    }
+    lastStats.bytesWritten += offset;
+    lastStats.images = count;
+    lastStats.reused = reusedNames.size();
+
+#ifdef BENCHMARK_IMAGE_LOAD
+    tfts->claim();
+    tfts->benchmarkImageLoad(dest.c_str());
+    tfts->closeAtlas();
+    tfts->release();
+#endif
+
+    for (const String &name : names) {
+        LittleFS.remove(name);
+    }
+
+    // Only written once everything else is in place, so an unpack that is interrupted is done again
+    manifest.count = count;
+    manifest.atlasSize = offset;
+    fs::File manifestFile = LittleFS.open(dest + "/" + MANIFEST_FILE_NAME, "w");
+    if (manifestFile) {
+        manifestFile.write((uint8_t*)&manifest, sizeof(manifest));
+        manifestFile.write((uint8_t*)manifestEntries, count * sizeof(ManifestEntry));
+        manifestFile.close();
+        lastStats.bytesWritten += sizeof(manifest) + count * sizeof(ManifestEntry);
+    }
+    free(manifestEntries);
+
+    Serial.printf("Built atlas of %d images\n", count);
+
+    return true;
+}
+
+bool ImageUnpacker::readManifest(const String &dest, ManifestHeader &header, std::vector<ManifestEntry> &entries) {
+    entries.clear();
+
+    fs::File file = LittleFS.open(dest + "/" + MANIFEST_FILE_NAME, "r");
+    if (!file) {
+        return false;
+    }
+
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header)
+        && header.magic == MANIFEST_MAGIC && header.version == MANIFEST_VERSION;
+    if (ok) {
+        entries.resize(header.count);
+        ok = file.read((uint8_t*)entries.data(), header.count * sizeof(ManifestEntry)) == header.count * sizeof(ManifestEntry);
+    }
+    file.close();
+
+    if (!ok) {
+        entries.clear();
+    }
+    return ok;
+}
+
+bool ImageUnpacker::readAtlasIndex(fs::File &atlas, std::vector<AtlasEntry> &entries) {
+    uint8_t header[ATLAS_HEADER_SIZE];
+    if (atlas.read(header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+
+    uint16_t magic = header[0] | (header[1] << 8);
+    uint16_t count = header[4] | (header[5] << 8);
+    if (magic != ATLAS_MAGIC || header[2] != ATLAS_VERSION) {
+        return false;
+    }
+
+    entries.resize(count);
+    if (atlas.read((uint8_t*)entries.data(), count * sizeof(AtlasEntry)) != count * sizeof(AtlasEntry)) {
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * The name an image has in the atlas: the file name without the directory or .bmp
+ */
+String ImageUnpacker::imageName(const String &path) {
+    return path.substring(path.lastIndexOf('/') + 1, path.endsWith(".bmp") ? path.length() - 4 : path.length());
+}
+
+/*
+ * The size of the tar inside a .tar.gz, from the gzip trailer. It is modulo 2^32, which is plenty here.
+ */
+uint32_t ImageUnpacker::uncompressedSize(const String &fileName) {
+    uint8_t trailer[4] = { 0, 0, 0, 0 };
+
+    fs::File file = LittleFS.open(fileName, "r");
+    if (file && file.size() >= sizeof(trailer)) {
+        file.seek(file.size() - sizeof(trailer));
+        file.read(trailer, sizeof(trailer));
+    }
+    file.close();
+
+    return trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+}
+
+/*
+ * Evict the least recently selected faces, from any cache root, until there is room for needed bytes as
+ * well as the reserve. Faces that are selected for display, and keep, are never evicted.
+ */
+bool ImageUnpacker::makeRoom(uint32_t needed, const String &keep) {
+    size_t reserve = getCacheReserve().value * 1024;
+
+    while (LittleFS.totalBytes() - LittleFS.usedBytes() < needed + reserve) {
+        String oldest;
+        uint32_t oldestUsed = UINT32_MAX;
+
+        for (const char *root : cacheRoots) {
+            std::vector<ResidentFace> faces;
+            listResidentFaces(root, faces);
+            for (const ResidentFace &face : faces) {
+                String dir = faceDir(root, face.name);
+                if (face.lastUsed < oldestUsed && dir != keep && !tfts->isCacheDir(dir.c_str())) {
+                    oldest = dir;
+                    oldestUsed = face.lastUsed;
+                }
+            }
+        }
+
+        if (oldest.length() == 0) {
+            Serial.printf("Nothing left to evict, %lu bytes free\n", (unsigned long)(LittleFS.totalBytes() - LittleFS.usedBytes()));
+            return false;
+        }
+
+        Serial.printf("Evicting %s\n", oldest.c_str());
+        tfts->claim();
+        tfts->flushGlyphCache(oldest.c_str());
+        tfts->closeAtlas();
+        tfts->release();
+        removeDir(oldest);
+    }
+
+    return true;
+}
+
+/*
+ * Stamp dest as the most recently selected face. Stamps only ever go up, so the first one continues
+ * from the highest already on the file system.
+ */
+void ImageUnpacker::markUsed(const String &dest) {
+    if (useCount == 0) {
+        for (const char *root : cacheRoots) {
+            std::vector<ResidentFace> faces;
+            listResidentFaces(root, faces);
+            for (const ResidentFace &face : faces) {
+                useCount = max(useCount, face.lastUsed);
+            }
+        }
+    }
+    useCount++;
+
+    fs::File file = LittleFS.open(dest + "/" + LAST_USED_FILE_NAME, "w");
+    if (file) {
+        file.write((uint8_t*)&useCount, sizeof(useCount));
+        file.close();
+    }
+}
+
+/*
+ * Replace dest with what has been unpacked into the staging directory. The TFTs are held so that nothing
+ * is drawn from dest while it is half gone.
+ */
+bool ImageUnpacker::swapIn(const String &dest) {
+    tfts->claim();
+    tfts->closeAtlas();
+    tfts->flushGlyphCache(dest.c_str());
+    removeDir(dest);
+    bool ok = LittleFS.rename(UNPACK_STAGING_DIR, dest);
+    tfts->release();
+
+    if (!ok) {
+        Serial.printf("Couldn't move the unpacked images to %s\n", dest.c_str());
+    }
+    return ok;
+}
+
+uint32_t ImageUnpacker::readLastUsed(const String &dest) {
+    uint32_t lastUsed = 0;
+
+    fs::File file = LittleFS.open(dest + "/" + LAST_USED_FILE_NAME, "r");
+    if (file) {
+        if (file.read((uint8_t*)&lastUsed, sizeof(lastUsed)) != sizeof(lastUsed)) {
+            lastUsed = 0;
+        }
+        file.close();
+    }
+
+    return lastUsed;
+}
+
+/*
+ * Every face directory under cacheRoot, and the space it takes. One that was never finished has a lastUsed
+ * of 0, so it is the first to go.
+ */
+void ImageUnpacker::listResidentFaces(const String &cacheRoot, std::vector<ResidentFace> &faces) {
+    fs::File root = LittleFS.open(cacheRoot);
+    if (!root || !root.isDirectory()) {
+        return;
+    }
+
+    fs::File dir = root.openNextFile();
+    while (dir) {
+        if (dir.isDirectory()) {
+            ResidentFace face;
+            face.name = dir.name();
+
+            fs::File file = dir.openNextFile();
+            while (file) {
+                face.bytes += file.size();
+                file.close();
+                file = dir.openNextFile();
+            }
+            face.lastUsed = readLastUsed(faceDir(cacheRoot, face.name));
+
+            faces.push_back(face);
+        }
+        dir.close();
+        dir = root.openNextFile();
+    }
+    root.close();
+}
+
+void ImageUnpacker::removeDir(const String &dir) {
+    std::vector<String> names;
+
+    fs::File file = LittleFS.open(dir);
+    String name = file.getNextFileName();
+    while (name.length() > 0) {
+        names.push_back(name);
+        name = file.getNextFileName();
+    }
+    file.close();
+
+    for (const String &name : names) {
+        LittleFS.remove(name);
+    }
+    LittleFS.rmdir(dir);
+}
+
+/*
+ * Faces used to be unpacked straight into the cache root. Anything left over from then is just taking up space.
+ */
+void ImageUnpacker::removeLegacyFiles(const String &cacheRoot) {
+    std::vector<String> names;
+
+    fs::File root = LittleFS.open(cacheRoot);
+    fs::File file = root.openNextFile();
+    while (file) {
+        if (!file.isDirectory()) {
+            names.push_back(file.path());
+        }
+        file.close();
+        file = root.openNextFile();
+    }
+    root.close();
+
+    for (const String &name : names) {
+        LittleFS.remove(name);
+    }
 }
@@ -1,21 +1,123 @@
 #ifndef _IPS_IMAGE_UNPACKER_H
 #define _IPS_IMAGE_UNPACKER_H
 #include <ESP32-targz.h>
+#include <ConfigItem.h>
+#include <vector>
+
+#include "TFTs.h"
+#include "UploadStream.h"
+
+// Written next to the atlas once it has been built, so that an archive doesn't have to be unpacked again
+#define MANIFEST_MAGIC 0x4d55  // "UM"
+#define MANIFEST_VERSION 1
+#define MANIFEST_FILE_NAME "unpack.manifest"
+// Faces are unpacked here, then moved into place once they are complete
+#define UNPACK_STAGING_DIR "/ips/staging"
+// Each face is unpacked into its own directory under a cache root. This records when it was last selected.
+#define LAST_USED_FILE_NAME "last_used"
+
+struct ManifestHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t count;
+    uint16_t reserved2;
+    char archive[64];
+    uint32_t archiveSize;
+    uint32_t archiveTime;
+    uint32_t atlasSize;
+};
+
+struct ManifestEntry {
+    char name[16];      // as in the atlas, without the .bmp
+    uint32_t size;      // size, modification time and header checksum from the tar header
+    uint32_t time;
+    uint32_t checksum;
+    uint32_t hash;      // FNV-1a of the image as it is stored in the atlas
+};
 
 class ImageUnpacker {
 public:
-    const String& unpackImages(const String &srcDir, const String &destDir, const String &newFaces, const String &oldFaces);
+    struct Stats {
+        char name[32] = "";
+        uint32_t ms = 0;
+        uint32_t bytesWritten = 0;
+        uint16_t images = 0;
+        uint16_t reused = 0;        // copied from the previous atlas rather than extracted
+        bool unchanged = false;     // already unpacked, so nothing was done
+        bool streamed = false;      // unpacked as it was uploaded, ms is from the start of the upload
+    };
+
+    // A face that is unpacked under a cache root
+    struct ResidentFace {
+        String name;
+        uint32_t bytes = 0;
+        uint32_t lastUsed = 0;
+    };
+
+    // Space to leave free on the file system when deciding which faces to evict, in KB
+    static IntConfigItem& getCacheReserve() { static IntConfigItem cache_reserve("cache_reserve", 64); return cache_reserve; }
+
+    // Unpack face from srcDir into its directory under cacheRoot, unless it is still there from last time.
+    // Returns false if it couldn't be, or was cancelled.
+    bool unpackFace(const String &srcDir, const String &cacheRoot, const String &face);
+    // Unpack an archive while it is being uploaded to fileName. Returns false if it couldn't be unpacked,
+    // and rejects the upload if that is because the archive is bad.
+    bool unpackUpload(UploadStream &upload, const String &cacheRoot, const String &face, const String &fileName);
+    // Stop unpackFace() as soon as it can, from another task. Cleared by resetCancel().
+    void cancel() { cancelled = true; }
+    void resetCancel() { cancelled = false; }
+
+    static String faceDir(const String &cacheRoot, const String &face) { return cacheRoot + "/" + face; }
+    static void listResidentFaces(const String &cacheRoot, std::vector<ResidentFace> &faces);
+
+    const Stats& getLastStats() { return lastStats; }
 
 protected:
     bool unpackImages(const String &faceName, const String &dest);
+    bool makeRoom(uint32_t needed, const String &keep);
+    void markUsed(const String &dest);
+    bool extractImages(const String &fileName, const String &dest, const String &previousDir);
+    bool finishImages(const String &dest);
+    bool swapIn(const String &dest);
+    void beginManifest(const String &fileName);
+    void convertImages(const String &dest);
+    bool buildAtlas(const String &dest);
+
+    static void listImages(const String &dest, std::vector<String> &names);
+    static bool readImageSize(fs::File &file, uint16_t &w, uint16_t &h);
+    static bool readManifest(const String &dest, ManifestHeader &header, std::vector<ManifestEntry> &entries);
+    static bool readAtlasIndex(fs::File &atlas, std::vector<AtlasEntry> &entries);
+    static String imageName(const String &path);
+    static uint32_t uncompressedSize(const String &fileName);
+    static uint32_t readLastUsed(const String &dest);
+    static void removeDir(const String &dir);
+    static void removeLegacyFiles(const String &cacheRoot);
+
+    static volatile bool cancelled;
+    static uint8_t lastProgress;
+    static String unpackLabel;      // shown with the progress
+    static String previousAtlasName;
+    static bool convertAsExtracted;     // convert each image as soon as it has been extracted
+    static String pendingConvert;       // the last image extracted, if it hasn't been converted yet
+
+    // What the archive being unpacked contains, and what can be reused from the last one
+    static std::vector<ManifestEntry> archiveEntries;
+    static std::vector<ManifestEntry> previousEntries;
+    static std::vector<AtlasEntry> previousAtlas;
+    static std::vector<String> reusedNames;
+
+    uint32_t useCount = 0;      // stamp given to the last face selected, 0 until the caches have been scanned
 
-    static bool newUnpack;
-    static const char* unpackName;
+    ManifestHeader manifest;
+    Stats lastStats;
 
     static TarGzUnpacker& getUnpacker();
 
-    static void statusProgressCallback(const char* name, size_t size, size_t total_unpacked);
     static void unpackProgressCallback(uint8_t progress);
+    static bool excludeUnchanged(header_translated_t *header);
+    static void convertPending();
+    static bool convertImage(const String &name);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,297 @@
+#include "JsonStreamParser.h"
+
+// Containers are counted in a bit mask
+#define JSON_STREAM_MAX_NESTING 32
+
+bool JsonStreamParser::parse(Stream &stream, Listener &listener) {
+  this->stream = &stream;
+  bufferPos = bufferLen = 0;
+  pushedBack = -1;
+  depth = 0;
+  arrays = 0;
+  error = nullptr;
+
+  State state = VALUE;
+  while (true) {
+    int c = nextNonSpace();
+    if (c < 0) {
+      return fail("Incomplete input");
+    }
+
+    switch (state) {
+      case ARRAY_START:
+        if (c == ']') {
+          if (!pop(c, listener)) {
+            return false;
+          }
+          state = NEXT;
+          break;
+        }
+        // fall through
+      case VALUE:
+        if (c == '{') {
+          if (!push(false)) {
+            return false;
+          }
+          state = OBJECT_START;
+        } else if (c == '[') {
+          if (!push(true)) {
+            return false;
+          }
+          state = ARRAY_START;
+        } else {
+          if (c == '"') {
+            if (!readString(value, sizeof(value))) {
+              return false;
+            }
+            valueIsString = true;
+          } else if (!readScalar(c)) {
+            return false;
+          }
+          listener.value(*this, value);
+          state = NEXT;
+        }
+        break;
+
+      case OBJECT_START:
+        if (c == '}') {
+          if (!pop(c, listener)) {
+            return false;
+          }
+          state = NEXT;
+          break;
+        }
+        // fall through
+      case KEY:
+        if (c != '"') {
+          return fail("Expected a key");
+        }
+        // A key too deep to remember still has to be read
+        if (!readString(depth <= JSON_STREAM_MAX_DEPTH ? levels[depth - 1].key : value, JSON_STREAM_KEY_SIZE)) {
+          return false;
+        }
+        state = COLON;
+        break;
+
+      case COLON:
+        if (c != ':') {
+          return fail("Expected ':'");
+        }
+        state = VALUE;
+        break;
+
+      case NEXT:
+        if (c == ',' && depth > 0) {
+          if (arrays & (1UL << (depth - 1))) {
+            if (depth <= JSON_STREAM_MAX_DEPTH) {
+              levels[depth - 1].index++;
+            }
+            state = VALUE;
+          } else {
+            state = KEY;
+          }
+        } else if (c == '}' || c == ']') {
+          if (!pop(c, listener)) {
+            return false;
+          }
+        } else {
+          return fail("Expected ',' or the end of a container");
+        }
+        break;
+    }
+
+    if (state == NEXT && depth == 0) {
+      return true;
+    }
+  }
+}
+
+bool JsonStreamParser::at(const char *path) const {
+  if (depth > JSON_STREAM_MAX_DEPTH) {
+    return false;
+  }
+
+  uint8_t level = 0;
+  while (*path) {
+    if (level == depth) {
+      return false;
+    }
+
+    size_t len = strcspn(path, ".");
+    const Level &current = levels[level];
+    if (current.array) {
+      if (len != 1 || *path != '*') {
+        int index = 0;
+        for (size_t i = 0; i < len; i++) {
+          if (!isdigit(path[i])) {
+            return false;
+          }
+          index = index * 10 + path[i] - '0';
+        }
+        if (index != current.index) {
+          return false;
+        }
+      }
+    } else if (strncmp(current.key, path, len) != 0 || current.key[len] != 0) {
+      return false;
+    }
+
+    level++;
+    path += len;
+    if (*path == '.') {
+      path++;
+    }
+  }
+
+  return level == depth;
+}
+
+int JsonStreamParser::getIndex(uint8_t level) const {
+  if (level >= depth || level >= JSON_STREAM_MAX_DEPTH || !levels[level].array) {
+    return -1;
+  }
+
+  return levels[level].index;
+}
+
+/*
+ * Read what has already arrived in one go, but don't ask for more than that, or a connection that
+ * is kept alive would wait for the next response.
+ */
+int JsonStreamParser::next() {
+  if (pushedBack >= 0) {
+    int c = pushedBack;
+    pushedBack = -1;
+    return c;
+  }
+
+  if (bufferPos == bufferLen) {
+    int available = stream->available();
+    size_t wanted = available > 0 ? min((size_t)available, sizeof(buffer)) : 1;
+    bufferLen = stream->readBytes((char *)buffer, wanted);
+    bufferPos = 0;
+    if (bufferLen == 0) {
+      return -1;
+    }
+  }
+
+  return buffer[bufferPos++];
+}
+
+int JsonStreamParser::nextNonSpace() {
+  int c;
+  do {
+    c = next();
+  } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+
+  return c;
+}
+
+bool JsonStreamParser::readString(char *out, size_t size) {
+  size_t len = 0;
+
+  while (true) {
+    int c = next();
+    if (c < 0) {
+      return fail("Incomplete string");
+    }
+    if (c == '"') {
+      break;
+    }
+    if (c == '\\') {
+      c = next();
+      switch (c) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'u':
+          // Nothing that is wanted needs more than ASCII
+          for (int i = 0; i < 4; i++) {
+            if (!isxdigit(next())) {
+              return fail("Bad escape");
+            }
+          }
+          c = '?';
+          break;
+        case '"': case '\\': case '/':
+          break;
+        default:
+          return fail("Bad escape");
+      }
+    }
+    if (len < size - 1) {
+      out[len++] = c;
+    }
+  }
+
+  out[len] = 0;
+  return true;
+}
+
+/*
+ * A number, true, false or null, which runs up to the next delimiter
+ */
+bool JsonStreamParser::readScalar(int first) {
+  if (first != '-' && !isdigit(first) && first != 't' && first != 'f' && first != 'n') {
+    return fail("Unexpected character");
+  }
+
+  size_t len = 0;
+  int c = first;
+  while (c >= 0 && c != ',' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+    if (len < sizeof(value) - 1) {
+      value[len++] = c;
+    }
+    c = next();
+  }
+  value[len] = 0;
+  valueIsString = false;
+
+  // The delimiter belongs to whatever comes next. The end of the input is only an error if this
+  // value was inside a container.
+  pushedBack = c;
+  if (c < 0 && depth > 0) {
+    return fail("Incomplete input");
+  }
+
+  return true;
+}
+
+bool JsonStreamParser::push(bool array) {
+  if (depth == JSON_STREAM_MAX_NESTING) {
+    return fail("Too deep");
+  }
+
+  if (depth < JSON_STREAM_MAX_DEPTH) {
+    Level &level = levels[depth];
+    level.array = array;
+    level.index = array ? 0 : -1;
+    level.key[0] = 0;
+  }
+  if (array) {
+    arrays |= 1UL << depth;
+  } else {
+    arrays &= ~(1UL << depth);
+  }
+  depth++;
+
+  return true;
+}
+
+bool JsonStreamParser::pop(int c, Listener &listener) {
+  if (depth == 0 || ((arrays & (1UL << (depth - 1))) != 0) != (c == ']')) {
+    return fail("Mismatched brackets");
+  }
+
+  depth--;
+  listener.endContainer(*this);
+
+  return true;
+}
+
+bool JsonStreamParser::fail(const char *error) {
+  this->error = error;
+  return false;
+}
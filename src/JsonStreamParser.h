@@ -0,0 +1,94 @@
+#ifndef JSON_STREAM_PARSER_H
+#define JSON_STREAM_PARSER_H
+
+#include <Arduino.h>
+
+// How deep the path to a value is remembered. Values nested deeper than this are still parsed.
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 6
+#endif
+
+// Longer keys and values are truncated
+#ifndef JSON_STREAM_KEY_SIZE
+#define JSON_STREAM_KEY_SIZE 16
+#endif
+
+#ifndef JSON_STREAM_VALUE_SIZE
+#define JSON_STREAM_VALUE_SIZE 32
+#endif
+
+/*
+ * Reads JSON from a stream a value at a time and hands each one to a listener, along with the path to
+ * it, so that a response can be boiled down to the few values that are wanted without building a
+ * document. It uses the same small amount of memory however big the response is.
+ *
+ * Reading stops at the end of the top level value, so it can be used on a connection that is kept
+ * alive.
+ */
+class JsonStreamParser {
+public:
+  class Listener {
+  public:
+    virtual ~Listener() {}
+    // A string, number, true, false or null at the current path
+    virtual void value(const JsonStreamParser &parser, const char *value) = 0;
+    // The object or array at the current path has ended
+    virtual void endContainer(const JsonStreamParser &parser) {}
+  };
+
+  // False if the JSON is malformed or stopped arriving, and getError() says why
+  bool parse(Stream &stream, Listener &listener);
+
+  /*
+   * True if the current path is e.g. "list.*.main.temp", where a number is an array index and *
+   * matches any index.
+   */
+  bool at(const char *path) const;
+  uint8_t getDepth() const { return depth; }
+  // The index into the array at level, or -1 if it is an object
+  int getIndex(uint8_t level) const;
+  // The value passed to value() was a string
+  bool isString() const { return valueIsString; }
+  const char *getError() const { return error; }
+
+private:
+  enum State : uint8_t {
+    VALUE,
+    ARRAY_START,
+    OBJECT_START,
+    KEY,
+    COLON,
+    NEXT
+  };
+
+  struct Level {
+    bool array;
+    int index;
+    char key[JSON_STREAM_KEY_SIZE];
+  };
+
+  int next();
+  int nextNonSpace();
+  bool readString(char *out, size_t size);
+  bool readScalar(int first);
+  bool push(bool array);
+  bool pop(int c, Listener &listener);
+  bool fail(const char *error);
+
+  Stream *stream = nullptr;
+  uint8_t buffer[64];
+  uint8_t bufferPos = 0;
+  uint8_t bufferLen = 0;
+  int pushedBack = -1;
+
+  // Containers deeper than JSON_STREAM_MAX_DEPTH are only counted, in arrays as bits
+  uint8_t depth = 0;
+  uint32_t arrays = 0;
+  Level levels[JSON_STREAM_MAX_DEPTH];
+
+  char value[JSON_STREAM_VALUE_SIZE];
+  bool valueIsString = false;
+  const char *error = nullptr;
+};
+
+#endif // JSON_STREAM_PARSER_H
@@ -1,4 +1,5 @@
 #include "OpenWeatherMapWeatherService.h"
+#include "Benchmark.h"
 #include <math.h>
 
 #define SECONDS_IN_DAY 86400
@@ -12,6 +13,24 @@ static size_t _freeHeap() {
 #endif
 
 OpenWeatherMapWeatherService::OpenWeatherMapWeatherService() : WeatherService() {
+    strcpy(next.conditions, "unknown");
+    for (int i = 0; i < 6; i++) {
+        strcpy(next.iconNames[i], "unknown");
+        next.days[i] = -1;
+        next.temp_min[i] = NAN;
+        next.temp_max[i] = NAN;
+    }
+    next.temp = NAN;
+    next.humidity = -1;
+}
+
+/*
+ * null and strings aren't temperatures
+ */
+static float toFloat(const JsonStreamParser &parser, const char *value) {
+    return !parser.isString() && (value[0] == '-' || isdigit(value[0])) ? atof(value) : NAN;
+}
+
 /*
  * Only want these fields for current conditions:
  *
@@ -24,49 +43,223 @@ OpenWeatherMapWeatherService::OpenWeatherMapWeatherService() : WeatherService()
     ],
     "main": {
       "temp": 298.48,
-      "temp_min": 297.56,
-      "temp_max": 300.05,
       "humidity": 64
-    }
+    },
+    "timezone": 7200
  }
- *
- * See https://arduinojson.org/v6/assistant/#/step1 for sizing details
  */
-    todayFilter["weather"][0]["main"] = true;
-    todayFilter["weather"][0]["icon"] = true;
+class OpenWeatherMapWeatherService::CurrentReader : public JsonStreamParser::Listener {
+public:
+    CurrentReader(Forecast &forecast) : forecast(forecast) {
+        strcpy(forecast.conditions, "Unknown");
+        strcpy(forecast.iconNames[5], "unknown");
+        forecast.temp = NAN;
+        forecast.humidity = -1;
+    }
 
-    todayFilter["main"]["temp"] = true;
+    void value(const JsonStreamParser &parser, const char *value) override {
+        if (parser.at("weather.0.main")) {
+            strlcpy(forecast.conditions, value, sizeof(forecast.conditions));
+        } else if (parser.at("weather.0.icon")) {
+            strlcpy(forecast.iconNames[5], value, sizeof(forecast.iconNames[5]));
+        } else if (parser.at("main.temp")) {
+            forecast.temp = toFloat(parser, value);
+        } else if (parser.at("main.humidity")) {
+            forecast.humidity = parser.isString() ? -1 : atoi(value);
+        } else if (parser.at("timezone")) {
+            tzOffset = atol(value);
+            haveTzOffset = true;
+        }
+    }
+
+    Forecast &forecast;
+    int tzOffset = 0;
+    bool haveTzOffset = false;
+};
 
 /*
- * And these for 5 day forecast:
+ * Folds each 3 hourly entry of the forecast into the high and low for its day, and the icon at noon,
+ * as it arrives:
  *
  {
     "list": [
         {
-            "dt": true,
+            "dt": 1661871600,
             "main": {
-                "temp": true
+                "temp": 296.76
             },
             "weather": [
                 {
-                    "main": true,
-                    "icon": true
+                    "icon": "10d"
                 }
             ]
         }
     ],
     "city": {
-        "timezone": true
+        "timezone": 7200
     }
-}
-*/
-    forecastFilter["list"][0]["dt"] = true;
-    forecastFilter["list"][0]["main"]["temp"] = true;
-    
-    forecastFilter["list"][0]["weather"][0]["main"] = true;
-    forecastFilter["list"][0]["weather"][0]["icon"] = true;
-    forecastFilter["city"]["timezone"] = true;
-}
+ }
+ *
+ * The forecast's own timezone comes after the list, so it is split into days using the timezone
+ * from the current weather instead.
+ */
+class OpenWeatherMapWeatherService::ForecastReader : public JsonStreamParser::Listener {
+public:
+    ForecastReader(Forecast &forecast, int tzOffset, time_t now) : forecast(forecast), tzOffset(tzOffset) {
+        // Truncate to midnight in current timezone:
+        midnightLocal = now - (now + tzOffset) % SECONDS_IN_DAY;
+        midnightLocal += SECONDS_IN_DAY;   // Advance to midnight of next day
+        nextNoon = midnightLocal + SECONDS_IN_DAY / 2;   // Calculate noon of next day too
+
+        time_t ftime = now + tzOffset;
+        struct tm ftm;
+        gmtime_r(&ftime, &ftm);
+        dIndex = ftm.tm_wday;
+
+        forecast.days[hiLoIndex] = dIndex;
+        forecast.temp_min[hiLoIndex] = NAN;
+        forecast.temp_max[hiLoIndex] = NAN;
+        startEntry();
+    }
+
+    void value(const JsonStreamParser &parser, const char *value) override {
+        if (parser.at("list.*.dt")) {
+            dt = atol(value);
+            haveDt = true;
+        } else if (parser.at("list.*.main.temp")) {
+            entryTemp = toFloat(parser, value);
+        } else if (parser.at("list.*.weather.0.icon")) {
+            strlcpy(icon, value, sizeof(icon));
+        } else if (parser.at("city.timezone")) {
+            cityTzOffset = atol(value);
+            haveCityTzOffset = true;
+        }
+    }
+
+    void endContainer(const JsonStreamParser &parser) override {
+        if (parser.at("list.*")) {
+            addEntry(parser.getIndex(1));
+            startEntry();
+        }
+    }
+
+    // False if the days were split in the wrong timezone
+    bool finish() {
+        if (hiLoIndex == 1) {
+            hiLoIndex--;
+            dIndex = (dIndex + 1) % 7;
+            forecast.days[hiLoIndex] = dIndex;
+            if (!isnan(lastTemp)) {
+                forecast.temp_min[hiLoIndex] = forecast.temp_max[hiLoIndex] = lastTemp;
+            }
+        }
+
+        // Sometimes the last forecast entry is before noon on that day
+        if (iconNameIndex >= 0) {
+            strcpy(forecast.iconNames[iconNameIndex--], iName);
+        }
+
+        // Just in case
+        for (int i = iconNameIndex; i >= 0; i--) {
+            strcpy(forecast.iconNames[i], "unknown");
+        }
+
+        if (missing) {
+#ifdef DEBUG_DESERIALIZATION
+            Serial.println("Couldn't read all of the forecast");
+#endif
+        }
+
+        return !haveCityTzOffset || cityTzOffset == tzOffset;
+    }
+
+private:
+    void startEntry() {
+        haveDt = false;
+        entryTemp = NAN;
+        strcpy(icon, "unknown");
+    }
+
+    void addEntry(int i) {
+        if (!haveDt) {
+            missing = true;
+#ifdef DEBUG_DESERIALIZATION
+            Serial.print("Could not get timestamp for item ");
+            Serial.println(i);
+#endif
+        }
+
+        // An entry from midnight on belongs to the next day. Entries after the last day shown are left out.
+        if (haveDt && dt >= midnightLocal) {
+            midnightLocal += SECONDS_IN_DAY;
+            if (hiLoIndex > 0) {
+                hiLoIndex--;
+                forecast.temp_min[hiLoIndex] = NAN;
+                forecast.temp_max[hiLoIndex] = NAN;
+                maxTemp = -INFINITY;
+                minTemp = INFINITY;
+                dIndex = (dIndex + 1) % 7;
+                forecast.days[hiLoIndex] = dIndex;
+            } else {
+                pastLastDay = true;
+            }
+        }
+
+        lastTemp = entryTemp;
+        if (isnan(entryTemp)) {
+            missing = true;
+#ifdef DEBUG_DESERIALIZATION
+            Serial.print("Could not get temp for item ");
+            Serial.println(i);
+#endif
+        } else if (!pastLastDay) {
+            maxTemp = max(maxTemp, entryTemp);
+            minTemp = min(minTemp, entryTemp);
+            forecast.temp_min[hiLoIndex] = minTemp;
+            forecast.temp_max[hiLoIndex] = maxTemp;
+        }
+
+        strcpy(iName, icon);
+        if (strcmp(iName, "unknown") == 0) {
+            missing = true;
+#ifdef DEBUG_DESERIALIZATION
+            Serial.print("Could not get icon for item ");
+            Serial.println(i);
+#endif
+        }
+
+        if (haveDt && dt >= nextNoon) {
+            nextNoon += SECONDS_IN_DAY;
+            if (iconNameIndex >= 0) {
+                strcpy(forecast.iconNames[iconNameIndex--], iName);
+            }
+        }
+    }
+
+    Forecast &forecast;
+    int tzOffset;
+    int cityTzOffset = 0;
+    bool haveCityTzOffset = false;
+
+    time_t midnightLocal;
+    time_t nextNoon;
+    int dIndex;
+    int iconNameIndex = 4;
+    char iName[sizeof(forecast.iconNames[0])] = "unknown";
+    int hiLoIndex = 5;
+    bool pastLastDay = false;
+    // Not +-200, which a temperature in Kelvin is above
+    float maxTemp = -INFINITY;
+    float minTemp = INFINITY;
+    float lastTemp = NAN;
+    bool missing = false;
+
+    // The entry being read
+    long dt;
+    bool haveDt;
+    float entryTemp;
+    char icon[sizeof(forecast.iconNames[0])];
+};
 
 const String& OpenWeatherMapWeatherService::getIconName(int day) {
     return iconNames[day];
@@ -88,6 +281,18 @@ float OpenWeatherMapWeatherService::getNowTemp() {
     return temp;
 }
 
+void OpenWeatherMapWeatherService::commit() {
+    conditions = next.conditions;
+    for (int i = 0; i < 6; i++) {
+        iconNames[i] = next.iconNames[i];
+        days[i] = next.days[i];
+        temp_min[i] = next.temp_min[i];
+        temp_max[i] = next.temp_max[i];
+    }
+    temp = next.temp;
+    humidity = next.humidity;
+}
+
 bool OpenWeatherMapWeatherService::sendRequest(WiFiClientSecure &client, const char *request, int count) {
     const char *token = getWeatherToken().value.c_str();
 
@@ -186,43 +391,54 @@ bool OpenWeatherMapWeatherService::getCurrentWeatherInfo(WiFiClientSecure &clien
         return false;
     }
 
-	JsonDocument doc;
+    return readCurrent(client);
+}
 
+bool OpenWeatherMapWeatherService::readCurrent(Stream &stream) {
 #ifdef DEBUG_WEATHER_MEMORY
     Serial.print("Free heap: ");
     Serial.println(_freeHeap());
 #endif
 
-    bool parsingError = false;
-
-	DeserializationError deserializeError = deserializeJson(doc, client, DeserializationOption::Filter(todayFilter));
-	if (!deserializeError) {
-        JsonObject weather = doc["weather"][0];
-        conditions = weather["main"] | "Unknown";
-        iconNames[5] = weather["icon"] | "unknown";
-
-        JsonObject main = doc["main"];
-        temp = main.containsKey("temp") ? main["temp"] : NAN;
-        humidity = main.containsKey("humidity") ? main["humidity"] : -1;
-	} else {
-        parsingError = true;
+    CurrentReader reader(next);
+    if (!parser.parse(stream, reader)) {
 #ifdef DEBUG_DESERIALIZATION
-		Serial.print("Deserialize error while parsing weather: ");
-		Serial.println(deserializeError.c_str());
+        Serial.print("Deserialize error while parsing weather: ");
+        Serial.println(parser.getError());
 #endif
-	}
+        return false;
+    }
 
-#ifdef DEBUG_WEATHER_MEMORY
-    Serial.print("Free heap: ");
-    Serial.println(_freeHeap());
+    if (!reader.haveTzOffset) {
+#ifdef DEBUG_DESERIALIZATION
+        Serial.println("Could not get timezone");
 #endif
+        return false;
+    }
+    tzOffset = reader.tzOffset;
+    haveTzOffset = true;
 
-    return !parsingError;
+    return true;
 }
 
 bool OpenWeatherMapWeatherService::getForecastWeatherInfo(WiFiClientSecure &client, int count) {
-    DeserializationError deserializeError;
-    bool parsingError = false;
+    if (!sendRequest(client, "forecast", count)) {
+        return false;
+    }
+
+    // Waits for the clock to be set
+    time_t now;
+    struct tm timeinfo;
+    getLocalTime(&timeinfo);
+    time(&now);
+
+    return readForecast(client, now);
+}
+
+bool OpenWeatherMapWeatherService::readForecast(Stream &stream, time_t now) {
+    if (!haveTzOffset) {
+        return false;
+    }
 
 #ifdef DEBUG_WEATHER_MEMORY
     Serial.print("Free heap: ");
@@ -231,168 +447,20 @@ bool OpenWeatherMapWeatherService::getForecastWeatherInfo(WiFiClientSecure &clie
     Serial.println(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
 #endif
 
-    {
-        if (!sendRequest(client, "forecast", count)) {
-            return false;
-        }
-
-        JsonDocument forecastDoc;
-        DeserializationError deserializeError = deserializeJson(forecastDoc, client, DeserializationOption::Filter(forecastFilter));
-        if (!deserializeError) {
-            bool missing = false;
-    /*
-    {
-        "list": [
-            {
-                "dt": true,
-                "main": {
-                    "temp": true
-                },
-                "weather": [
-                    {
-                        "main": true,
-                        "icon": true
-                    }
-                ]
-            }
-        ],
-        "city": {
-            "timezone": true
-        }
-    }
-
-    */
-            int tzOffset = forecastDoc["city"]["timezone"] | -1;
-
-            if (tzOffset == -1) {
-                missing = true;
-#ifdef DEBUG_DESERIALIZATION
-                Serial.print("Could not get timezone");
-#endif
-                return false;
-            }
-
-            time_t now;
-            struct tm timeinfo;
-            getLocalTime(&timeinfo);
-            time(&now);
-
-            // Truncate to midnight in current timezone:
-            time_t midnightLocal = now - (now + tzOffset) % SECONDS_IN_DAY;
-            midnightLocal += SECONDS_IN_DAY;   // Advance to midnight of next day
-            time_t nextNoon = midnightLocal + SECONDS_IN_DAY / 2;   // Calculate noon of next day too
-
-            time_t ftime = now + tzOffset;
-            struct tm ftm;
-            gmtime_r(&ftime, &ftm);
-            int dIndex = ftm.tm_wday;
-
-            JsonArray list = forecastDoc["list"];
-            int iconNameIndex = 4;
-            const char *iName = "unknown";
-            int hiLoIndex = 5;
-            float maxTemp = -200;
-            float minTemp = 200;
-            temp_min[hiLoIndex] = NAN;
-            temp_max[hiLoIndex] = NAN;
-            float temp = NAN;
-
-            for (int i=0; i<list.size(); i++) {
-                JsonObject forecast = list[i];
-                long dt = forecast.containsKey("dt") ? forecast["dt"] : NAN;
-
-                if (isnan(dt)) {
-                    missing = true;
-#ifdef DEBUG_DESERIALIZATION
-                    Serial.print("Could not get timestamp for item ");
-                    Serial.println(i);
-#endif
-                }
-                JsonObject main = forecast["main"];
-                temp = main.containsKey("temp") ? main["temp"] : NAN;
-                if (!isnan(temp)) {
-                    maxTemp = max(maxTemp, temp);
-                    minTemp = min(minTemp, temp);
-                    temp_min[hiLoIndex] = minTemp;
-                    temp_max[hiLoIndex] = maxTemp;
-                } else {
-                    missing = true;
+    ForecastReader reader(next, tzOffset, now);
+    if (!parser.parse(stream, reader)) {
 #ifdef DEBUG_DESERIALIZATION
-                    Serial.print("Could not get temp for item ");
-                    Serial.println(i);
-#endif
-                }
-
-                JsonObject weather = forecast["weather"][0];
-                iName = weather.containsKey("icon") ? (const char*)weather["icon"] : "unknown";
-                if (strcmp(iName, "unkown") == 0) {
-                    missing = true;
-#ifdef DEBUG_DESERIALIZATION
-                    Serial.print("Could not get icon for item ");
-                    Serial.println(i);
-#endif
-                }
-
-                if (dt >= nextNoon) {
-                    nextNoon += SECONDS_IN_DAY;
-                    iconNames[iconNameIndex] = iName;
-                    iconNameIndex--;
-                }
-
-                if (dt > midnightLocal) {
-                    midnightLocal += SECONDS_IN_DAY;
-                    hiLoIndex--;
-                    temp_min[hiLoIndex] = NAN;
-                    temp_max[hiLoIndex] = NAN;
-                    maxTemp = -200;
-                    minTemp = 200;
-                    dIndex = (dIndex + 1) % 7;
-                    days[hiLoIndex] = dIndex;
-                }
-            }
-
-            if (hiLoIndex == 1) {
-                hiLoIndex--;
-                dIndex = (dIndex + 1) % 7;
-                days[hiLoIndex] = dIndex;
-                if (!isnan(temp)) {
-                    temp_min[hiLoIndex] = temp_max[hiLoIndex] = temp;
-                }
-            }
-
-            // Sometimes the last forecast entry is before noon on that day
-            if (iconNameIndex >= 0) {
-                iconNames[iconNameIndex--] = iName;
-            }
-
-            // Just in case
-            if (iconNameIndex >= 0) {
-                for (int i=iconNameIndex; i--; i>=0) {
-                    iconNames[i] = "unknown";
-                }
-            }
-
-            if(missing) {
-#ifdef DEBUG_WEATHER_MEMORY
-                Serial.print("Couldn't read all data. Free heap: ");
-                Serial.print(_freeHeap());
-                Serial.print(", Max block size=");
-                Serial.println(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
-
-                parsingError = true;
-                serializeJson(forecastDoc, Serial);
-                Serial.println("");
+        Serial.print("Deserialize error while parsing forecast: ");
+        Serial.println(parser.getError());
 #endif
-            }
-        }
+        return false;
     }
 
-    if (deserializeError) {
-        parsingError = true;
+    if (!reader.finish()) {
 #ifdef DEBUG_DESERIALIZATION
-        Serial.print("Deserialize error while parsing forecast: ");
-        Serial.println(deserializeError.c_str());
+        Serial.println("Timezone changed, the forecast will be split into days again next time");
 #endif
+        return false;
     }
 
 #ifdef DEBUG_WEATHER_MEMORY
@@ -400,9 +468,67 @@ bool OpenWeatherMapWeatherService::getForecastWeatherInfo(WiFiClientSecure &clie
     Serial.println(_freeHeap());
 #endif
 
-    return !parsingError;
+    return true;
+}
+
+#ifdef BENCHMARK_WEATHER
+/*
+ * A made up forecast of count 3 hourly entries, the same shape as the real one
+ */
+static String makeForecast(int count, time_t now) {
+    String json = "{\"cod\":\"200\",\"message\":0,\"cnt\":" + String(count) + ",\"list\":[";
+    char entry[512];
+    for (int i = 0; i < count; i++) {
+        snprintf(entry, sizeof(entry),
+            "%s{\"dt\":%ld,\"main\":{\"temp\":%.2f,\"feels_like\":298.74,\"temp_min\":297.56,\"temp_max\":300.05,"
+            "\"pressure\":1015,\"sea_level\":1015,\"grnd_level\":933,\"humidity\":64,\"temp_kf\":-0.25},"
+            "\"weather\":[{\"id\":500,\"main\":\"Rain\",\"description\":\"light rain\",\"icon\":\"10d\"}],"
+            "\"clouds\":{\"all\":100},\"wind\":{\"speed\":0.62,\"deg\":349,\"gust\":1.18},\"visibility\":10000,"
+            "\"pop\":0.32,\"rain\":{\"3h\":0.26},\"sys\":{\"pod\":\"d\"},\"dt_txt\":\"2022-08-30 15:00:00\"}",
+            i == 0 ? "" : ",", (long)(now + i * SECONDS_IN_PERIOD), 290.0 + (i % 8));
+        json += entry;
+    }
+    json += "],\"city\":{\"id\":3163858,\"name\":\"Zocca\",\"coord\":{\"lat\":44.34,\"lon\":10.99},"
+        "\"country\":\"IT\",\"population\":4593,\"timezone\":7200,\"sunrise\":1661834187,\"sunset\":1661882248}}";
+
+    return json;
 }
 
+/*
+ * Time parsing the current weather in test/weather.json, and made up forecasts of 5 and 15 days.
+ * This overwrites the forecast, so run it just before a real one is fetched. test/native/test_weather
+ * checks what is read, and that nothing is allocated while reading it.
+ */
+void OpenWeatherMapWeatherService::benchmark() {
+    const uint32_t iterations = 10;
+    const char *current =
+        "{\"coord\":{\"lon\":10.99,\"lat\":44.34},\"weather\":[{\"id\":501,\"main\":\"Rain\",\"description\":\"moderate rain\",\"icon\":\"10d\"}],\"base\":\"stations\",\"main\":{\"temp\":298.48,\"feels_like\":298.74,\"temp_min\":297.56,\"temp_max\":300.05,\"pressure\":1015,\"humidity\":64,\"sea_level\":1015,\"grnd_level\":933},"
+        "\"visibility\":10000,\"wind\":{\"speed\":0.62,\"deg\":349,\"gust\":1.18},\"rain\":{\"1h\":3.16},\"clouds\":{\"all\":100},\"dt\":1661870592,\"sys\":{\"type\":2,\"id\":2075663,\"country\":\"IT\",\"sunrise\":1661834187,\"sunset\":1661882248},\"timezone\":7200,\"id\":3163858,\"name\":\"Zocca\",\"cod\":200}";
+
+    BenchmarkStream currentStream(current, strlen(current));
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        currentStream.rewind();
+        readCurrent(currentStream);
+    }
+    printBenchmark("weather", "current", iterations, micros() - start);
+
+    time_t now;
+    time(&now);
+    const int counts[] = { 40, 120 };
+    for (int count : counts) {
+        String json = makeForecast(count, now);
+        BenchmarkStream stream(json.c_str(), json.length());
+        start = micros();
+        for (uint32_t i = 0; i < iterations; i++) {
+            stream.rewind();
+            readForecast(stream, now);
+        }
+        printBenchmark("weather", count == 40 ? "forecast" : "forecast_15_days", iterations, micros() - start);
+    }
+}
+#endif
+
 bool OpenWeatherMapWeatherService::getWeatherInfo() {
     bool ret = false;
 
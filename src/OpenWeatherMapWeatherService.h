@@ -10,9 +10,9 @@
 #include <ESPAsyncHTTPClient.h>
 #endif
 #include <ConfigItem.h>
-#include <ArduinoJson.h>
 
 #include "WeatherService.h"
+#include "JsonStreamParser.h"
 
 class OpenWeatherMapWeatherService : public WeatherService {
 public:
@@ -25,14 +25,41 @@ public:
     virtual float           getLow(int day);
     virtual int             getDayOfWeek(int day);
     virtual float           getNowTemp();
+    virtual void            commit();
+
+    // Read a response into the forecast being fetched. The current weather must be read first, for its
+    // timezone, and the forecast is split into days from now. Public so recorded responses can be fed in.
+    bool readCurrent(Stream &stream);
+    bool readForecast(Stream &stream, time_t now);
+#ifdef BENCHMARK_WEATHER
+    // Print the time taken to parse the current weather and a 5 day forecast
+    void benchmark();
+#endif
 
 private:
+    class CurrentReader;
+    class ForecastReader;
+
     bool sendRequest(WiFiClientSecure &client, const char *request, int count);
     bool getCurrentWeatherInfo(WiFiClientSecure &client);
     bool getForecastWeatherInfo(WiFiClientSecure &client, int count);
 
-    JsonDocument todayFilter;
-    JsonDocument forecastFilter;
+    JsonStreamParser parser;
+
+    // What is being fetched. commit() copies it to the fields below, which are what is drawn.
+    struct Forecast {
+        char conditions[16];
+        char iconNames[6][8];
+        int days[6];
+        float temp_min[6];
+        float temp_max[6];
+        float temp;
+        int humidity;
+    } next;
+
+    // From the current weather. The forecast is split into days with it as it arrives.
+    int tzOffset = 0;
+    bool haveTzOffset = false;
 
     String conditions = "unknown";
     String iconNames[6] {
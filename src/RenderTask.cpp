@@ -0,0 +1,522 @@
+#include "RenderTask.h"
+
+// How often to look for a status message that has been up long enough
+#define STATUS_CHECK_MS 250
+// The animation draws a frame whenever it is ready to
+#define ANIMATION_POLL_MS 1
+
+void RenderTask::DigitFrame::setDigit(uint8_t digit, const char *name, uint8_t show) {
+  strncpy(names[digit], name, sizeof(names[digit]) - 1);
+  showDigits[digit] = show;
+}
+
+void RenderTask::WeatherFrame::setTile(uint8_t digit, const WeatherTile &tile) {
+  tiles[digit] = tile;
+  digitMap |= 1 << digit;
+}
+
+void RenderTask::begin() {
+  xTaskCreatePinnedToCore(
+    taskFn,     /* Function to implement the task */
+    "Render task",  /* Name of the task */
+    4096,       /* Stack size in words */
+    this,       /* Task input parameter */
+    tskIDLE_PRIORITY + 2,  /* Ahead of the clock task, so posted frames are drawn promptly */
+    &task,      /* Task handle. */
+    RENDER_TASK_CORE
+  );
+}
+
+void RenderTask::post(uint8_t command) {
+  if (pending & command) {
+    stats.merged++;
+  }
+  pending |= command;
+  stats.commands++;
+}
+
+void RenderTask::postDigits(const DigitFrame &newFrame) {
+  portENTER_CRITICAL(&lock);
+  if (!(pending & DIGITS)) {
+    frameDigits = 0;
+  }
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    if (newFrame.names[digit][0] != 0) {
+      strcpy(frame.names[digit], newFrame.names[digit]);
+      frame.showDigits[digit] = newFrame.showDigits[digit];
+      frameDigits |= 1 << digit;
+    }
+  }
+  frame.dimming = newFrame.dimming;
+  frame.transition = newFrame.transition;
+  memcpy(frame.prefetch, newFrame.prefetch, sizeof(frame.prefetch));
+  frame.prefetchShowDigits = newFrame.prefetchShowDigits;
+  frame.measureJitter = newFrame.measureJitter;
+  frame.secondStartMicros = newFrame.secondStartMicros;
+  animationOn = false;
+  post(DIGITS);
+  portEXIT_CRITICAL(&lock);
+
+  if (task != nullptr) {
+    xTaskNotifyGive(task);
+  }
+}
+
+void RenderTask::discardDigits() {
+  portENTER_CRITICAL(&lock);
+  pending &= ~(DIGITS | ANIMATION);
+  bool wasAnimating = animationOn;
+  animationOn = false;
+  portEXIT_CRITICAL(&lock);
+
+  if (wasAnimating && task != nullptr) {
+    xTaskNotifyGive(task);
+  }
+}
+
+void RenderTask::postWeather(const WeatherFrame &newFrame) {
+  portENTER_CRITICAL(&lock);
+  if (!(pending & WEATHER)) {
+    weather.digitMap = 0;
+    weather.allDigits = false;
+  }
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    if (newFrame.digitMap & (1 << digit)) {
+      weather.tiles[digit] = newFrame.tiles[digit];
+    }
+  }
+  weather.digitMap |= newFrame.digitMap;
+  weather.showDigits = newFrame.showDigits;
+  weather.backgroundShowDigits = newFrame.backgroundShowDigits;
+  weather.dimming = newFrame.dimming;
+  weather.color = newFrame.color;
+  weather.allDigits |= newFrame.allDigits;
+  animationOn = false;
+  post(WEATHER);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postAnimation(uint8_t showDigits, uint8_t dimming) {
+  portENTER_CRITICAL(&lock);
+  // They would only be drawn over
+  pending &= ~DIGITS;
+  animationOn = true;
+  animationShowDigits = showDigits;
+  animationDimming = dimming;
+  post(ANIMATION);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postMenuShow() {
+  portENTER_CRITICAL(&lock);
+  menuShow = true;
+  menuHide = false;
+  menuChoose = false;
+  menuMoves = 0;
+  animationOn = false;
+  post(MENU);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postMenuMove(int moves) {
+  portENTER_CRITICAL(&lock);
+  // Moves add up, rather than replacing each other
+  menuMoves += moves;
+  post(MENU);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postMenuHide(bool choose) {
+  portENTER_CRITICAL(&lock);
+  menuHide = true;
+  menuShow = false;
+  menuChoose = choose;
+  if (!choose) {
+    menuMoves = 0;
+  }
+  post(MENU);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+bool RenderTask::takeMenuChoice(char *text, size_t size) {
+  portENTER_CRITICAL(&lock);
+  bool ready = menuChoiceReady;
+  if (ready) {
+    strncpy(text, menuChoice, size - 1);
+    text[size - 1] = 0;
+    menuChoiceReady = false;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  return ready;
+}
+
+void RenderTask::postInvalidate() {
+  if (task == nullptr) {
+    tfts->claim();
+    tfts->invalidateAllDigits();
+    tfts->release();
+    return;
+  }
+
+  portENTER_CRITICAL(&lock);
+  post(INVALIDATE);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postStatus(const char *newStatus) {
+  if (task == nullptr) {
+    tfts->setStatus(newStatus);
+    return;
+  }
+
+  portENTER_CRITICAL(&lock);
+  strncpy(status, newStatus, sizeof(status) - 1);
+  status[sizeof(status) - 1] = 0;
+  post(STATUS);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::postMeter(int val, bool first, const char *legend) {
+  if (task == nullptr) {
+    tfts->drawMeter(val, first, legend);
+    return;
+  }
+
+  portENTER_CRITICAL(&lock);
+  if (!(pending & METER)) {
+    meterFirst = false;
+  }
+  // The background has to be drawn if any of the merged updates wanted it
+  meterFirst |= first;
+  meterValue = val;
+  strncpy(meterLegend, legend != nullptr ? legend : "", sizeof(meterLegend) - 1);
+  meterLegend[sizeof(meterLegend) - 1] = 0;
+  post(METER);
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+void RenderTask::taskFn(void *arg) {
+  ((RenderTask*)arg)->run();
+}
+
+void RenderTask::run() {
+  DigitFrame drawFrame;
+  WeatherFrame weatherFrame;
+  char drawStatus[sizeof(status)];
+  char drawLegend[sizeof(meterLegend)];
+  uint32_t nextFrameMs = 0;
+  bool prefetch = false;
+  bool animating = false;
+  unsigned long statusCheckMs = 0;
+
+  while (true) {
+    uint32_t waitMs = STATUS_CHECK_MS;
+    if (animating) {
+      waitMs = ANIMATION_POLL_MS;
+    } else if (nextFrameMs > 0) {
+      waitMs = nextFrameMs;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+
+    uint8_t commands;
+    uint8_t digitMap = 0;
+    uint8_t weatherMap = 0;
+    int value = 0;
+    bool first = false;
+    bool showMenu = false;
+    bool hideMenu = false;
+    bool chooseMenu = false;
+    int moves = 0;
+
+    portENTER_CRITICAL(&lock);
+    commands = pending;
+    pending = 0;
+    if (commands & DIGITS) {
+      drawFrame = frame;
+      digitMap = frameDigits;
+    }
+    if (commands & STATUS) {
+      strcpy(drawStatus, status);
+    }
+    if (commands & METER) {
+      value = meterValue;
+      first = meterFirst;
+      strcpy(drawLegend, meterLegend);
+    }
+    if (commands & WEATHER) {
+      weatherFrame = weather;
+      weatherMap = weather.digitMap;
+    }
+    if (commands & MENU) {
+      showMenu = menuShow;
+      hideMenu = menuHide;
+      chooseMenu = menuChoose;
+      moves = menuMoves;
+      menuShow = false;
+      menuHide = false;
+      menuChoose = false;
+      menuMoves = 0;
+    }
+    bool animate = animationOn;
+    uint8_t animationShow = animationShowDigits;
+    uint8_t animationDim = animationDimming;
+    portEXIT_CRITICAL(&lock);
+
+    if (commands & METER) {
+      tfts->drawMeter(value, first, drawLegend);
+    }
+    if (commands & STATUS) {
+      tfts->setStatus(drawStatus);
+    }
+
+    // Claiming the TFTs would finish the transition, so leave the status until it has
+    if (commands != 0 || (nextFrameMs == 0 && millis() - statusCheckMs >= STATUS_CHECK_MS)) {
+      statusCheckMs = millis();
+      tfts->claim();
+      if (commands & INVALIDATE) {
+        tfts->invalidateAllDigits();
+      }
+      // Let the digits under an old status message be redrawn
+      tfts->checkStatus();
+      tfts->release();
+    }
+
+    if (animating && !animate) {
+      // So that every digit is drawn again over it
+      tfts->claim();
+      tfts->invalidateAllDigits();
+      tfts->release();
+      animating = false;
+    }
+
+    if (commands & DIGITS) {
+      drawDigits(drawFrame, digitMap);
+      prefetch = true;
+    }
+    if (commands & WEATHER) {
+      drawWeather(weatherFrame, weatherMap);
+    }
+    if (commands & MENU) {
+      drawMenu(showMenu, hideMenu, chooseMenu, moves);
+    }
+
+    if (animate) {
+      if (commands & ANIMATION) {
+        tfts->claim();
+        tfts->setShowDigits(animationShow);
+        tfts->setDimming(animationDim);
+        tfts->release();
+      }
+      animating = true;
+      tfts->animateRain();
+    }
+
+    // The rest of a transition is drawn a frame at a time, leaving the TFTs free in between
+    nextFrameMs = tfts->stepTransition();
+    if (nextFrameMs == 0 && prefetch) {
+      // Which could evict the pixels being animated, so it waits
+      prefetchDigits(drawFrame);
+      prefetch = false;
+    }
+  }
+}
+
+void RenderTask::drawDigits(const DigitFrame &frame, uint8_t digitMap) {
+  tfts->claim();
+  tfts->setDimming(frame.dimming);
+  tfts->setImageJustification(TFTs::MIDDLE_CENTER);
+  tfts->setBox(tfts->width(), tfts->height());
+  tfts->setTransition(frame.transition);
+  tfts->enableAllDisplays();
+
+  // Digits showing the same image are sent together
+  tfts->beginUpdate();
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    if (digitMap & (1 << digit)) {
+      tfts->setShowDigits(frame.showDigits[digit]);
+      tfts->setDigit(digit, frame.names[digit], TFTs::yes);
+    }
+  }
+
+  // release() waits for the last push to finish
+  tfts->release();
+  if (frame.measureJitter) {
+    tickJitter.add(abs((int32_t)(micros() - frame.secondStartMicros)));
+  }
+}
+
+void RenderTask::prefetchDigits(const DigitFrame &frame) {
+  const char *names[NUM_DIGITS];
+  bool prefetch = false;
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    names[digit] = frame.prefetch[digit][0] != 0 ? frame.prefetch[digit] : nullptr;
+    prefetch |= names[digit] != nullptr;
+  }
+
+  if (prefetch) {
+    tfts->claim();
+    tfts->setShowDigits(frame.prefetchShowDigits);
+    tfts->prefetchDigits(names);
+    tfts->release();
+  }
+}
+
+void RenderTask::drawWeather(const WeatherFrame &frame, uint8_t digitMap) {
+  tfts->claim();
+  tfts->setShowDigits(frame.showDigits);
+  tfts->setDimming(frame.dimming);
+  if (frame.allDigits) {
+    tfts->checkStatus();
+    tfts->enableAllDisplays();
+  }
+
+  if (tfts->isEnabled()) {
+    for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+      if (digitMap & (1 << digit)) {
+        drawWeatherTile(digit, frame, frame.tiles[digit]);
+      }
+    }
+  }
+
+  tfts->release();
+}
+
+void RenderTask::drawWeatherTile(uint8_t digit, const WeatherFrame &frame, const WeatherTile &tile) {
+  char txt[10];
+
+  // Load 'space' glyph if any
+  tfts->setShowDigits(frame.backgroundShowDigits);
+  tfts->setImageJustification(TFTs::MIDDLE_CENTER);
+  tfts->setDigit(SECONDS_ONES, "space", TFTs::no);
+  TFT_eSprite &sprite = tfts->drawImage(SECONDS_ONES);
+  tfts->setShowDigits(frame.showDigits);
+
+  tfts->setImageJustification(TFTs::TOP_CENTER);
+  tfts->setBox(128, 128);
+
+  uint16_t TEMP_COLOR = tfts->dimColor(frame.color);
+  uint16_t HILO_COLOR = TEMP_COLOR;
+  uint16_t DAY_FG_COLOR = tfts->dimColor(TFT_GOLD);
+  uint16_t DAY_BG_COLOR = tfts->dimColor(TFT_RED);
+  tfts->setMonochromeColor(frame.color);
+
+  tfts->setDigit(digit, tile.icon, TFTs::no);
+  tfts->drawImage(digit);
+
+  float val = NAN;
+
+  if (tile.showNow) {
+    sprite.setTextColor(TEMP_COLOR);
+    sprite.setTextFont(6);
+    sprite.setTextDatum(BC_DATUM);
+    val = tile.now;
+    if (isnan(val)) {
+      strcpy(txt, "--");
+    } else {
+      sprintf(txt, "%.0f", round(val));
+    }
+    sprite.drawString(txt, sprite.width()/2, sprite.height()*3/4 - 2);
+  }
+
+  sprite.setTextFont(4);
+
+  int baseline = sprite.height()-30;
+  int arrowHeight = 10, arrowWidth = 10;
+  int arrowPadding = 2;
+  int tempInset=10;
+  int textHeight = sprite.fontHeight();
+  int arrowTop = baseline - textHeight + 2;
+
+  sprite.setTextColor(HILO_COLOR);
+
+  sprite.setTextDatum(BL_DATUM);
+  val = round(tile.high);
+  if (isnan(val)) {
+    strcpy(txt, "--");
+  } else {
+    sprintf(txt, "%.0f", round(val));
+  }
+  sprite.drawString(txt, tempInset + arrowWidth + arrowPadding, baseline);
+
+  // Draw up-arrow
+  sprite.fillTriangle(tempInset, arrowTop+arrowHeight,     // bottom left
+        tempInset+arrowWidth, arrowTop+arrowHeight,  // bottom right
+        tempInset+arrowWidth/2, arrowTop,            // top-center
+        TEMP_COLOR);
+
+  val = round(tile.low);
+  if (isnan(val)) {
+    strcpy(txt, "--");
+  } else {
+    sprintf(txt, "%.0f", round(val));
+  }
+  int textWidth=sprite.textWidth(txt, 4);
+  sprite.setTextDatum(BL_DATUM);
+  sprite.drawString(txt, sprite.width() - tempInset - textWidth, baseline);
+
+  // Draw down-arrow
+  int arrowLeft = sprite.width() - tempInset - textWidth - arrowPadding - arrowWidth;
+
+  sprite.fillTriangle(arrowLeft, arrowTop,        // top left
+      arrowLeft + arrowWidth, arrowTop,       // top right
+      arrowLeft + arrowWidth/2, arrowTop+arrowHeight, // bottom center
+      TEMP_COLOR);
+
+  sprite.setTextDatum(BC_DATUM);
+  if (tile.labelOnBar) {
+    sprite.fillRect(0, sprite.height() - 26, sprite.width(), 26, DAY_BG_COLOR);
+    sprite.setTextColor(DAY_FG_COLOR);
+    sprite.drawString(tile.label, sprite.width()/2, sprite.height() + 2);
+  } else {
+    sprite.drawString(tile.label, sprite.width()/2, sprite.height()-4);
+  }
+
+  tfts->pushSpriteToDigits(tfts->chip_select.getDigitMap());
+}
+
+void RenderTask::drawMenu(bool show, bool hide, bool choose, int moves) {
+  const char *choice = nullptr;
+
+  tfts->claim();
+  if (choose && menuDrawer) {
+    // The menu is only touched here, so the selection is the one that was drawn, after every move
+    choice = menuDrawer(false, moves);
+  }
+  if (hide) {
+    tfts->fillScreen(TFT_BLACK);
+    tfts->invalidateAllDigits();
+  } else if (menuDrawer) {
+    menuDrawer(show, moves);
+    tfts->getSprite().pushSprite(0, 0);
+  }
+  tfts->release();
+
+  if (choice != nullptr) {
+    portENTER_CRITICAL(&lock);
+    strncpy(menuChoice, choice, sizeof(menuChoice) - 1);
+    menuChoice[sizeof(menuChoice) - 1] = 0;
+    menuChoiceReady = true;
+    portEXIT_CRITICAL(&lock);
+
+    if (menuChosen) {
+      menuChosen();
+    }
+  }
+}
@@ -0,0 +1,153 @@
+#ifndef RENDER_TASK_H
+#define RENDER_TASK_H
+
+#include <Arduino.h>
+#include <functional>
+#include "TFTs.h"
+
+// The network stack runs on core 0
+#ifndef RENDER_TASK_CORE
+#define RENDER_TASK_CORE 1
+#endif
+
+/*
+ * Draws digits, weather tiles, the matrix animation, the menu, status messages and the unpack meter
+ * for everyone else, so that they can post what they want shown and carry on without waiting for the
+ * SPI bus. Each kind of command has a mailbox that only holds the latest request, so anything
+ * superseded before the task gets to it is merged away. Two changes to the same digit only draw the
+ * second, for example.
+ *
+ * Anything else that draws does it under TFTs::claim(), which this task also holds while it draws.
+ */
+class RenderTask {
+public:
+  // Digit changes that are drawn together
+  struct DigitFrame {
+    char names[NUM_DIGITS][16] = {};        // "" leaves the digit alone
+    uint8_t showDigits[NUM_DIGITS] = {};    // which set of images each name is from
+    uint8_t dimming = 255;
+    uint8_t transition = TFTs::NO_TRANSITION;
+    // Decoded after the frame has been sent, and any transition has finished, ready for the next one.
+    // "" for nothing.
+    char prefetch[NUM_DIGITS][16] = {};
+    uint8_t prefetchShowDigits = 0;
+    // Record how long after micros() was secondStartMicros the frame finished being sent
+    bool measureJitter = false;
+    uint32_t secondStartMicros = 0;
+
+    void setDigit(uint8_t digit, const char *name, uint8_t show);
+  };
+
+  // An icon from the weather, with the high and low under it
+  struct WeatherTile {
+    char icon[16] = "";
+    float high = NAN;
+    float low = NAN;
+    bool showNow = false;     // draw now large over the icon
+    float now = NAN;
+    char label[12] = "";      // under the temperatures
+    bool labelOnBar = false;  // on a bar, as a day is, rather than plain, as the date is
+  };
+
+  // Weather tiles that are drawn together
+  struct WeatherFrame {
+    WeatherTile tiles[NUM_DIGITS];
+    uint8_t digitMap = 0;             // the digits that have a tile
+    uint8_t showDigits = 0;           // which set of images the icons are from
+    uint8_t backgroundShowDigits = 0; // and the set with the "space" drawn behind them
+    uint8_t dimming = 255;
+    uint16_t color = 0;               // of the text, before it is dimmed
+    bool allDigits = false;           // the weather is the whole display, so turn every digit on
+
+    void setTile(uint8_t digit, const WeatherTile &tile);
+  };
+
+  // Draws the menu into the sprite. show draws it from scratch, then the selection is moved down by
+  // moves, or up if it is negative. Returns the text of the selected item.
+  typedef std::function<const char*(bool show, int moves)> MenuDrawer;
+
+  struct Stats {
+    uint32_t commands = 0;    // posted
+    uint32_t merged = 0;      // superseded before they were drawn
+  };
+
+  void begin();
+
+  void postDigits(const DigitFrame &frame);
+  // Throw away digit changes that haven't been drawn yet, and stop the animation, because something
+  // else is about to draw
+  void discardDigits();
+  void postWeather(const WeatherFrame &frame);
+  // Draw the matrix animation, a frame whenever it is ready, until anything else but the status or
+  // meter is posted. Post again to change how it is drawn.
+  void postAnimation(uint8_t showDigits, uint8_t dimming);
+  // chosen is called on the render task when a choice is ready for takeMenuChoice()
+  void setMenuDrawer(MenuDrawer drawer, std::function<void()> chosen) { menuDrawer = drawer; menuChosen = chosen; }
+  void postMenuShow();
+  void postMenuMove(int moves);
+  // Blank the menu, so the digits are drawn again. With choose, the moves posted before it are made
+  // first, and the item they leave selected is kept for takeMenuChoice().
+  void postMenuHide(bool choose = false);
+  // The item chosen by postMenuHide(true), once the render task has got to it
+  bool takeMenuChoice(char *text, size_t size);
+  // Every digit is redrawn by the next frame
+  void postInvalidate();
+  void postStatus(const char *status);
+  void postStatus(const String &status) { postStatus(status.c_str()); }
+  void postMeter(int val, bool first, const char *legend);
+
+  // From the start of each second to the end of sending the frame that shows it
+  const DrawTime& getTickJitter() { return tickJitter; }
+  const Stats& getStats() { return stats; }
+
+private:
+  static void taskFn(void *arg);
+  void run();
+  void post(uint8_t command);
+  void drawDigits(const DigitFrame &frame, uint8_t digitMap);
+  void prefetchDigits(const DigitFrame &frame);
+  void drawWeather(const WeatherFrame &frame, uint8_t digitMap);
+  void drawWeatherTile(uint8_t digit, const WeatherFrame &frame, const WeatherTile &tile);
+  void drawMenu(bool show, bool hide, bool choose, int moves);
+
+  enum {
+    DIGITS = 1,
+    INVALIDATE = 2,
+    STATUS = 4,
+    METER = 8,
+    WEATHER = 16,
+    ANIMATION = 32,
+    MENU = 64
+  };
+
+  TaskHandle_t task = nullptr;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  // Mailboxes, guarded by lock
+  uint8_t pending = 0;
+  DigitFrame frame;
+  uint8_t frameDigits = 0;
+  char status[48];
+  int meterValue = 0;
+  bool meterFirst = false;
+  char meterLegend[32];
+  WeatherFrame weather;
+  bool animationOn = false;
+  uint8_t animationShowDigits = 0;
+  uint8_t animationDimming = 255;
+  bool menuShow = false;
+  bool menuHide = false;
+  bool menuChoose = false;
+  int menuMoves = 0;
+  char menuChoice[32] = "";
+  bool menuChoiceReady = false;
+
+  MenuDrawer menuDrawer;
+  std::function<void()> menuChosen;
+  Stats stats;
+  DrawTime tickJitter;
+};
+
+extern RenderTask *renderTask;
+
+#endif // RENDER_TASK_H
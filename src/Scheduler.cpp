@@ -0,0 +1,128 @@
+#include <esp_timer.h>
+#include "Scheduler.h"
+
+namespace {
+
+class SystemClock : public Scheduler::Clock {
+public:
+  virtual uint64_t nowUs() {
+    return esp_timer_get_time();
+  }
+};
+
+SystemClock systemClock;
+
+}
+
+void Scheduler::begin(TaskHandle_t task, Clock *clock) {
+  this->task = task;
+  this->clock = clock != nullptr ? clock : &systemClock;
+  windowStartUs = this->clock->nowUs();
+}
+
+uint8_t Scheduler::add(const char *name, Job job, uint32_t periodMs, uint32_t events) {
+  if (jobCount >= SCHEDULER_MAX_JOBS) {
+    Serial.printf("Scheduler: no room for job %s\n", name);
+    return jobCount;
+  }
+
+  Entry &entry = jobs[jobCount];
+  entry.name = name;
+  entry.job = job;
+  entry.periodMs = periodMs;
+  entry.events = events;
+  entry.lastRunUs = 0;    // so a periodic job runs straight away
+  entry.runs = 0;
+  entry.windowUs = 0;
+  entry.usPerSecond = 0;
+
+  return jobCount++;
+}
+
+void Scheduler::setPeriod(uint8_t id, uint32_t periodMs) {
+  if (id < jobCount) {
+    jobs[id].periodMs = periodMs;
+  }
+}
+
+void Scheduler::signal(uint32_t events) {
+  if (task != nullptr) {
+    xTaskNotify(task, events, eSetBits);
+  }
+}
+
+void IRAM_ATTR Scheduler::signalFromISR(uint32_t events, BaseType_t *higherPriorityTaskWoken) {
+  if (task != nullptr) {
+    xTaskNotifyFromISR(task, events, eSetBits, higherPriorityTaskWoken);
+  }
+}
+
+void Scheduler::loop() {
+  uint32_t events = 0;
+  TickType_t toSleep = nextDelayMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(nextDelayMs);
+
+  xTaskNotifyWait(0, UINT32_MAX, &events, toSleep);
+  nextDelayMs = run(events, clock->nowUs());
+}
+
+uint32_t Scheduler::run(uint32_t events, uint64_t nowUs) {
+  // This wakeup is the first of the next window if the current one is over
+  uint64_t windowUs = nowUs - windowStartUs;
+  if (windowUs >= 1000000) {
+    wakeupsPerSecond = (uint64_t)wakeups * 1000000 / windowUs;
+    for (uint8_t i = 0; i < jobCount; i++) {
+      jobs[i].usPerSecond = (uint64_t)jobs[i].windowUs * 1000000 / windowUs;
+      jobs[i].windowUs = 0;
+    }
+    wakeups = 0;
+    windowStartUs = nowUs;
+  }
+  wakeups++;
+
+  for (uint8_t i = 0; i < jobCount; i++) {
+    Entry &entry = jobs[i];
+    uint64_t periodUs = (uint64_t)entry.periodMs * 1000;
+    bool periodDue = entry.periodMs != 0 && nowUs - entry.lastRunUs >= periodUs;
+
+    if (periodDue || (entry.events & events) != 0) {
+      uint64_t startUs = clock->nowUs();
+      entry.job();
+      entry.runs++;
+      entry.windowUs += clock->nowUs() - startUs;
+      // Periods are measured from when the job was due to run, so a slow job doesn't push the others back
+      // and waking up late doesn't make it drift. A job that missed whole periods runs once, not once for each.
+      if (periodDue && nowUs - entry.lastRunUs < 2 * periodUs) {
+        entry.lastRunUs += periodUs;
+      } else {
+        entry.lastRunUs = nowUs;
+      }
+    }
+  }
+
+  uint64_t afterUs = clock->nowUs();
+  uint32_t delayMs = UINT32_MAX;
+  for (uint8_t i = 0; i < jobCount; i++) {
+    Entry &entry = jobs[i];
+    if (entry.periodMs != 0) {
+      uint64_t dueUs = entry.lastRunUs + (uint64_t)entry.periodMs * 1000;
+      uint32_t untilMs = dueUs <= afterUs ? 0 : (dueUs - afterUs + 999) / 1000;
+      if (untilMs < delayMs) {
+        delayMs = untilMs;
+      }
+    }
+  }
+
+  return delayMs;
+}
+
+Scheduler::JobStats Scheduler::getJobStats(uint8_t id) const {
+  JobStats stats;
+
+  if (id < jobCount) {
+    stats.name = jobs[id].name;
+    stats.runs = jobs[id].runs;
+    stats.usPerSecond = jobs[id].usPerSecond;
+  }
+
+  return stats;
+}
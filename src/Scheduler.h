@@ -0,0 +1,74 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+
+#ifndef SCHEDULER_MAX_JOBS
+#define SCHEDULER_MAX_JOBS 12
+#endif
+
+/*
+ * Runs jobs on one task when they are due, or when an event they wait for is signalled, and lets the
+ * task sleep in between. Events are bits in the task's notification value, so other tasks, timer
+ * callbacks and ISRs can all signal them.
+ */
+class Scheduler {
+public:
+  typedef std::function<void()> Job;
+
+  // Where time comes from. Replace it to run the scheduler against a fake clock.
+  class Clock {
+  public:
+    virtual uint64_t nowUs() = 0;
+  };
+
+  struct JobStats {
+    const char *name = "";
+    uint32_t runs = 0;
+    uint32_t usPerSecond = 0;   // CPU time used over the last measured second
+  };
+
+  void begin(TaskHandle_t task, Clock *clock = nullptr);
+
+  // Run job every periodMs and whenever one of events is signalled. periodMs == 0 means only on events.
+  // Returns an id for setPeriod(). Jobs due at the same time run in the order they were added.
+  uint8_t add(const char *name, Job job, uint32_t periodMs, uint32_t events = 0);
+  void setPeriod(uint8_t id, uint32_t periodMs);
+
+  void signal(uint32_t events);
+  void signalFromISR(uint32_t events, BaseType_t *higherPriorityTaskWoken);
+
+  // Sleep until a job is due or an event is signalled, then run whatever is ready
+  void loop();
+  // Run whatever is ready at nowUs given events, and return how long until the next job is due
+  uint32_t run(uint32_t events, uint64_t nowUs);
+
+  uint32_t getWakeupsPerSecond() const { return wakeupsPerSecond; }
+  uint8_t getJobCount() const { return jobCount; }
+  JobStats getJobStats(uint8_t id) const;
+
+private:
+  struct Entry {
+    const char *name;
+    Job job;
+    uint32_t periodMs;
+    uint32_t events;
+    uint64_t lastRunUs;
+    uint32_t runs;
+    uint32_t windowUs;
+    uint32_t usPerSecond;
+  };
+
+  Entry jobs[SCHEDULER_MAX_JOBS];
+  uint8_t jobCount = 0;
+  TaskHandle_t task = nullptr;
+  Clock *clock = nullptr;
+  uint32_t nextDelayMs = 0;
+
+  uint64_t windowStartUs = 0;
+  uint32_t wakeups = 0;
+  uint32_t wakeupsPerSecond = 0;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,53 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A fixed size queue with one producer and one consumer that never blocks or locks, so that an ISR can
+ * push and a task can pop. N must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscRing {
+	static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+	// Returns false, and remembers that it did, if the ring is full
+	bool push(const T& item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N) {
+			overflowed.store(true, std::memory_order_relaxed);
+			return false;
+		}
+
+		items[h & (N - 1)] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = items[t & (N - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// True if anything was dropped since the last call
+	bool takeOverflow() {
+		return overflowed.exchange(false, std::memory_order_relaxed);
+	}
+
+private:
+	T items[N];
+	std::atomic<uint32_t> head{0};
+	std::atomic<uint32_t> tail{0};
+	std::atomic<bool> overflowed{false};
+};
+
+#endif // SPSC_RING_H
@@ -1,5 +1,6 @@
 #include "TFTs.h"
 #include "IPSClock.h"
+#include "Benchmark.h"
 #include <WiFi.h>
 #include "matrix-code-14.h"
 #include <byteswap.h>
@@ -153,6 +154,14 @@ void StaticSprite::pushImageWithAlpha(int32_t x, int32_t y, int32_t w, int32_t h
   }
 }
 
+void StaticSprite::setBuffer(uint8_t *buffer) {
+  _img8   = buffer;
+  _img8_1 = _img8;
+  _img8_2 = _img8;
+  _img    = (uint16_t*) _img8;
+  _img4   = _img8;
+}
+
 void StaticSprite::init() {
   _iwidth  = _dwidth  = _bitwidth = TFT_WIDTH;
   _iheight = _dheight = TFT_HEIGHT;
@@ -168,11 +177,7 @@ void StaticSprite::init() {
   _sh = TFT_HEIGHT;
   _scolor = TFT_BLACK;
 
-  _img8   = output_buffer;
-  _img8_1 = _img8;
-  _img8_2 = _img8;
-  _img    = (uint16_t*) _img8;
-  _img4   = _img8;
+  setBuffer(output_buffer);
 
   _created = true;
 
@@ -183,9 +188,17 @@ void StaticSprite::init() {
 
 void TFTs::claim() {
   xSemaphoreTake(tftMutex, portMAX_DELAY);
+  // Whatever is drawn next would be drawn over, or could evict the pixels of the transition
+  finishTransition();
 }
 
 void TFTs::release(){
+  if (updating) {
+    endUpdate();
+  }
+
+  // Nothing else may use the bus until the last digit has been sent
+  waitForDMA();
   xSemaphoreGive(tftMutex);
 }
 
@@ -266,6 +279,7 @@ void TFTs::setStatus(const char* s) {
   uint8_t saved = chip_select.getDigitMap();
   chip_select.setAll();
 
+  invalidatePanels(chip_select.getDigitMap());
   drawStatus();
 
   chip_select.setDigitMap(saved, true);
@@ -279,6 +293,7 @@ void TFTs::printlnAll(const char* s) {
   uint8_t saved = chip_select.getDigitMap();
   chip_select.setAll();
 
+  invalidatePanels(chip_select.getDigitMap());
   if (getCursorY() >= height() - 10) {
     setCursor(0,0);
     fillRect(0, 0, width(), height(), TFT_BLACK);
@@ -296,6 +311,7 @@ void TFTs::printAll(const char* s) {
   uint8_t saved = chip_select.getDigitMap();
   chip_select.setAll();
 
+  invalidatePanels(chip_select.getDigitMap());
   if (getCursorY() >= height() - 10) {
     setCursor(0,0);
     fillRect(0, 0, width(), height(), TFT_BLACK);
@@ -313,11 +329,8 @@ void TFTs::drawStatus() {
   }
   
   if (statusSet) {
-#ifdef USE_DMA
-  while(dmaBusy()) {
-    delay(1);
-  }
-#endif
+    waitForDMA();
+    invalidatePanels(chip_select.getDigitMap());
     TFT_eSprite& sprite = getStatusSprite();
     sprite.pushSprite(0, height() - sprite.height());
   }
@@ -335,6 +348,7 @@ void TFTs::animateRain() {
 
     uint8_t saved = chip_select.getDigitMap();
     chip_select.setAll();
+    invalidatePanels(chip_select.getDigitMap());
 
   #ifndef SMOOTH_FONT
     TFT_eSprite& sprite = getSprite();
@@ -367,6 +381,7 @@ void TFTs::drawMeter(int val, bool first, const char *legend) {
   uint8_t saved = chip_select.getDigitMap();
 
   chip_select.setAll();
+  invalidatePanels(chip_select.getDigitMap());
 
   if (first) {
     last_angle = 30;
@@ -418,18 +433,38 @@ void TFTs::drawMeter(int val, bool first, const char *legend) {
 }
 
 void TFTs::setShowDigits(byte show) {
+  if (show != showDigits) {
+    flushUpdate();
+  }
   showDigits = show;
 }
 
 void TFTs::setDimming(uint8_t dimming) {
   if (dimming != this->dimming) {
+    flushUpdate();
     SET_DIMMING(dimming);
     this->dimming = dimming;
+    buildDimTables();
+  }
+}
+
+/*
+ * Each channel of a dimmed RGB565 pixel only depends on the same channel of the original, so dimming
+ * is three lookups instead of three multiplies and shifts. Entries are already shifted into place.
+ */
+void TFTs::buildDimTables() {
+  for (uint16_t i = 0; i < 64; i++) {
+    if (i < 32) {
+      dimRed[i] = ((i * dimming) >> 8) << 11;
+      dimBlue[i] = (i * dimming) >> 8;
+    }
+    dimGreen[i] = ((i * dimming) >> 8) << 5;
   }
 }
 
 void TFTs::invalidateAllDigits() {
   loadedFilename[0] = 0;
+  invalidatePanels((1 << NUM_DIGITS) - 1);
   for (uint8_t digit=0; digit < NUM_DIGITS; digit++) {
     setDigit(digit, INVALID_DIGIT, TFTs::no);
   }
@@ -441,6 +476,12 @@ void TFTs::begin(fs::FS& fs) {
   }
 
   this->fs = &fs;
+
+  glyphCache.begin();
+#ifdef GLYPH_STORE
+  glyphStore.begin();
+#endif
+  buildDimTables();
   
   // Start with all displays selected.
   chip_select.begin();
@@ -452,6 +493,14 @@ void TFTs::begin(fs::FS& fs) {
 
 #ifdef USE_DMA
   initDMA();
+
+  // A second buffer lets the next digit be decoded while the last one is sent. Without it, every
+  // decode has to wait for the previous transfer to finish. Without PSRAM the glyph cache saves more
+  // than that, so it only gets one if the cache still has room.
+  size_t reserve = GLYPH_CACHE_HEAP_RESERVE + (psramFound() ? 0 : glyphCache.getStats().budget);
+  if (heap_caps_get_free_size(MALLOC_CAP_DMA) >= sizeof(StaticSprite::output_buffer) + reserve) {
+    frameBuffers[1] = (uint8_t*)heap_caps_malloc(sizeof(StaticSprite::output_buffer), MALLOC_CAP_DMA);
+  }
 #endif
   
   // Clear all displays
@@ -466,6 +515,7 @@ void TFTs::begin(fs::FS& fs) {
 }
 
 void TFTs::enableAllDisplays() {
+  waitForDMA();
   chip_select.setAll();
   writecommand(0x29); // Display ON
   TFT_BACKLIGHT_ON;
@@ -473,6 +523,7 @@ void TFTs::enableAllDisplays() {
 }
 
 void TFTs::disableAllDisplays() {
+  waitForDMA();
   chip_select.setAll();
   writecommand(0x28); // Display OFF
   TFT_BACKLIGHT_OFF;
@@ -482,6 +533,7 @@ void TFTs::disableAllDisplays() {
 void TFTs::clear() {
   // Start with all displays selected.
   chip_select.setAll();
+  invalidatePanels(chip_select.getDigitMap());
   enableAllDisplays();
 }
 
@@ -490,37 +542,407 @@ void TFTs::setDigit(uint8_t digit, const char *name, show_t show) {
   strcpy(icons[digit], name);
   
   if (show != no && (changed || show == force)) {
-    showDigit(digit);
+    if (updating) {
+      pendingDigits |= 1 << digit;
+    } else {
+      showDigit(digit);
+    }
   }
 }
 
-/* 
- * Displays the bitmap for the value to the given digit. 
+void TFTs::showAllDigits() {
+  bool wasUpdating = updating;
+
+  beginUpdate();
+  pendingDigits = (1 << NUM_DIGITS) - 1;
+  flushUpdate();
+  updating = wasUpdating;
+}
+
+/*
+ * Draw the digits that changed since beginUpdate(). Anything that changes how an image is drawn
+ * calls this first, so all of the pending digits are drawn with the same settings.
  */
-void TFTs::showDigit(uint8_t digit) {
+void TFTs::flushUpdate() {
+  uint8_t remaining = pendingDigits;
+  pendingDigits = 0;
+
+  TransitionGroup groups[NUM_DIGITS];
+  uint8_t groupCount = 0;
+
+  while (remaining != 0) {
+    uint8_t digit = __builtin_ctz(remaining);
+    uint8_t digitMap = 0;
+
+    for (uint8_t other = digit; other < NUM_DIGITS; other++) {
+      if ((remaining & (1 << other)) && strcmp(icons[other], icons[digit]) == 0) {
+        digitMap |= 1 << other;
+      }
+    }
+    remaining &= ~digitMap;
+
+    if (canTransition(digit, digitMap)) {
+      groups[groupCount++] = { digit, digitMap, nullptr, nullptr };
+    } else {
+      showDigitGroup(digit, digitMap);
+    }
+
+    if (enabled) {
+      spiBytesSaved += (__builtin_popcount(digitMap) - 1) * TFT_WIDTH * TFT_HEIGHT * 2;
+    }
+  }
+
+  if (groupCount > 0) {
+    showTransition(groups, groupCount);
+  }
+}
+
+void TFTs::prefetchDigits(const char *names[NUM_DIGITS]) {
   if (!enabled) {
     return;
   }
 
-  if (*icons[digit] == 0) {
+  const char *dir = getCacheDir();
+  GlyphKey key;
+
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    const char *name = names[digit];
+    if (name == nullptr || *name == 0 || strcmp(name, icons[digit]) == 0) {
+      continue;
+    }
+
+#ifdef GLYPH_STORE
+    // Already as fast as it gets
+    if (pixelsNeedDimming() == false && findStoredImage(dir, name) != nullptr) {
+      continue;
+    }
+#endif
+
+    setGlyphKey(key, dir, name);
+    if (glyphCache.peek(key) != nullptr) {
+      continue;
+    }
+
+#ifdef USE_DMA
+    // Decoding goes through the sprite, so it mustn't be the buffer that is being sent
+    if (frameBuffers[1] == nullptr) {
+      waitForDMA();
+    }
+#endif
+    LoadImageIntoBuffer(dir, name);
+  }
+}
+
+void TFTs::setShown(uint8_t digit, uint8_t digitMap) {
+  for (uint8_t other = 0; other < NUM_DIGITS; other++) {
+    if (digitMap & (1 << other)) {
+      strcpy(shownIcons[other], icons[digit]);
+      shownDirs[other] = getCacheDir();
+    }
+  }
+}
+
+/*
+ * A group can be animated if every panel in it is showing the same image, so there is a single starting frame.
+ */
+bool TFTs::canTransition(uint8_t digit, uint8_t digitMap) {
+  if (transition == NO_TRANSITION || !enabled || *icons[digit] == 0) {
+    return false;
+  }
+
+  uint8_t first = __builtin_ctz(digitMap);
+  if (*shownIcons[first] == 0) {
+    return false;
+  }
+
+  for (uint8_t other = first + 1; other < NUM_DIGITS; other++) {
+    if ((digitMap & (1 << other)) 
+      && (strcmp(shownIcons[other], shownIcons[first]) != 0 || shownDirs[other] != shownDirs[first])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*
+ * Animate every group from the image on its panels to its new image, a frame at a time for all of the groups in
+ * parallel. Only the first frame is drawn here, and stepTransition() draws the rest. Groups whose images aren't
+ * available as whole frames are drawn without a transition.
+ */
+void TFTs::showTransition(TransitionGroup *groups, uint8_t count) {
+  const char *dir = getCacheDir();
+
+  finishTransition();
+  waitForDMA();
+
+  // Loading an image can evict other glyphs, so load everything before holding on to any pixels
+  for (uint8_t i = 0; i < count; i++) {
+    if (findFramePixels(dir, icons[groups[i].digit]) == nullptr) {
+      LoadImageIntoBuffer(dir, icons[groups[i].digit]);
+    }
+  }
+
+  animatingCount = 0;
+  afterCount = 0;
+
+  for (uint8_t i = 0; i < count; i++) {
+    TransitionGroup group = groups[i];
+    group.from = findFramePixels(shownDirs[group.digit], shownIcons[group.digit]);
+    group.to = findFramePixels(dir, icons[group.digit]);
+    if (group.from != nullptr && group.to != nullptr) {
+      animating[animatingCount++] = group;
+    } else {
+      after[afterCount++] = group;
+    }
+  }
+
+  if (animatingCount == 0) {
+    endTransition();
+    return;
+  }
+
+  animatingType = transition;
+  if (animatingType == RANDOM_TRANSITION) {
+    animatingType = random(WIPE_TRANSITION, NO_TRANSITION);
+  }
+
+  animatingFrame = 1;
+  animatingFrameMicros = micros();
+  for (uint8_t i = 0; i < animatingCount; i++) {
+    drawTransitionFrame(animating[i], animatingType, animatingFrame);
+  }
+}
+
+uint32_t TFTs::stepTransition() {
+  const uint32_t frameBudget = TRANSITION_TIME_MS * 1000 / TRANSITION_FRAMES;
+
+  xSemaphoreTake(tftMutex, portMAX_DELAY);
+  if (animatingCount == 0) {
+    xSemaphoreGive(tftMutex);
+    return 0;
+  }
+
+  uint32_t elapsed = micros() - animatingFrameMicros;
+  if (elapsed < frameBudget) {
+    xSemaphoreGive(tftMutex);
+    return max((frameBudget - elapsed) / 1000, (uint32_t)1);
+  }
+
+  if (elapsed > 2 * frameBudget) {
+    // Can't keep up, so go straight to the new images
+    animatingFrame = TRANSITION_FRAMES;
+  } else {
+    animatingFrame++;
+  }
+  animatingFrameMicros = micros();
+  for (uint8_t i = 0; i < animatingCount; i++) {
+    drawTransitionFrame(animating[i], animatingType, animatingFrame);
+  }
+
+  if (animatingFrame >= TRANSITION_FRAMES) {
+    endTransition();
+  }
+  bool more = animatingCount > 0;
+
+  release();
+  return more ? frameBudget / 1000 : 0;
+}
+
+// Draw the last frame of the transition being animated, if there is one
+void TFTs::finishTransition() {
+  if (animatingCount == 0) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < animatingCount; i++) {
+    drawTransitionFrame(animating[i], animatingType, TRANSITION_FRAMES);
+  }
+  endTransition();
+}
+
+/*
+ * Once the last frame has been drawn. The groups that couldn't be animated are drawn now, as loading their images
+ * could have evicted the animated pixels.
+ */
+void TFTs::endTransition() {
+  for (uint8_t i = 0; i < animatingCount; i++) {
+    setShown(animating[i].digit, animating[i].digitMap);
+  }
+  animatingCount = 0;
+
+  uint8_t count = afterCount;
+  afterCount = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    showDigitGroup(after[i].digit, after[i].digitMap);
+  }
+}
+
+void TFTs::drawTransitionFrame(const TransitionGroup &group, uint8_t type, int frame) {
 #ifdef USE_DMA
-    while(dmaBusy()) {
-      delay(1);
+  // With only one buffer, the previous frame has to finish sending before it can be reused
+  if (frameBuffers[1] == nullptr) {
+    waitForDMA();
+  }
+#endif
+
+  StaticSprite& sprite = getSprite();
+  uint16_t *pixels = (uint16_t*)sprite.getPointer();
+
+  composeFrame(type, group.from, group.to, frame, pixels);
+  dimPixels(pixels, pixels, TFT_WIDTH * TFT_HEIGHT);
+
+  if (statusSet) {
+    TFT_eSprite& statusSprite = getStatusSprite();
+    statusSprite.pushToSprite(&sprite, 0, height() - statusSprite.height());
+  }
+
+  waitForDMA();
+  chip_select.setDigitMap(group.digitMap);
+  pushSpriteToDigits(group.digitMap);
+}
+
+/*
+ * Build frame number frame, out of TRANSITION_FRAMES, of a transition from one whole-screen image to another.
+ * All pixels are in sprite byte order and undimmed.
+ */
+void TFTs::composeFrame(uint8_t type, const uint16_t *from, const uint16_t *to, int frame, uint16_t *out) {
+  const size_t rowBytes = TFT_WIDTH * sizeof(uint16_t);
+
+  if (frame >= TRANSITION_FRAMES) {
+    memcpy(out, to, TFT_HEIGHT * rowBytes);
+    return;
+  }
+
+  int split = TFT_HEIGHT * frame / TRANSITION_FRAMES;
+
+  switch (type) {
+    case WIPE_TRANSITION:
+      // The new image is uncovered from the top down
+      memcpy(out, to, split * rowBytes);
+      memcpy(out + split * TFT_WIDTH, from + split * TFT_WIDTH, (TFT_HEIGHT - split) * rowBytes);
+      break;
+
+    case SLIDE_TRANSITION:
+      // The old image moves up and the new one follows it in from the bottom
+      memcpy(out, from + split * TFT_WIDTH, (TFT_HEIGHT - split) * rowBytes);
+      memcpy(out + (TFT_HEIGHT - split) * TFT_WIDTH, to, split * rowBytes);
+      break;
+
+    case CROSSFADE_TRANSITION: {
+      uint8_t alpha = 255 * frame / TRANSITION_FRAMES;
+      for (int i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++) {
+        out[i] = __bswap_16(alphaBlend(alpha, __bswap_16(to[i]), __bswap_16(from[i])));
+      }
+      break;
+    }
+
+    case FLIP_TRANSITION: {
+      // The old image folds up to a line across the middle, then the new one unfolds from it
+      const uint16_t *src = from;
+      int height = TFT_HEIGHT * (TRANSITION_FRAMES - 2 * frame) / TRANSITION_FRAMES;
+      if (height < 0) {
+        src = to;
+        height = -height;
+      }
+      int top = (TFT_HEIGHT - height) / 2;
+
+      for (int row = 0; row < TFT_HEIGHT; row++) {
+        if (row < top || row >= top + height) {
+          memset(out + row * TFT_WIDTH, 0, rowBytes);
+        } else {
+          memcpy(out + row * TFT_WIDTH, src + (row - top) * TFT_HEIGHT / height * TFT_WIDTH, rowBytes);
+        }
+      }
+      break;
     }
+
+    default:
+      memcpy(out, to, TFT_HEIGHT * rowBytes);
+      break;
+  }
+}
+
+/*
+ * Undimmed pixels for a whole-screen opaque image, from the glyph cache or the glyph store, or nullptr.
+ */
+const uint16_t* TFTs::findFramePixels(const char *dir, const char *name) {
+  GlyphKey key;
+  setGlyphKey(key, dir, name);
+
+  const Glyph *glyph = glyphCache.peek(key);
+  if (glyph != nullptr && glyph->w == TFT_WIDTH && glyph->h == TFT_HEIGHT && glyph->alpha == nullptr) {
+    return glyph->pixels;
+  }
+
+#ifdef GLYPH_STORE
+  const uint8_t *image = findStoredImage(dir, name);
+  if (image != nullptr && (image[4] | (image[5] << 8)) == TFT_WIDTH && (image[6] | (image[7] << 8)) == TFT_HEIGHT) {
+    return (const uint16_t*)(image + RAW_IMAGE_HEADER_SIZE);
+  }
 #endif
-    chip_select.setDigit(digit);
+
+  return nullptr;
+}
+
+/* 
+ * Displays the bitmap for the value of digit on every digit in digitMap.
+ */
+void TFTs::showDigitGroup(uint8_t digit, uint8_t digitMap) {
+  if (!enabled) {
+    return;
+  }
+  finishTransition();
+
+  unsigned long start = micros();
+  frameStats.beginFrame();
+
+  if (*icons[digit] == 0) {
+    waitForDMA();
+    chip_select.setDigitMap(digitMap);
+    invalidatePanels(digitMap);
     fillScreen(TFT_BLACK);
-    drawStatus();
+    frameStats.add(FRAME_PUSH, micros() - start);
+    timedDrawStatus();
   } else {
-    unsigned long start = millis();
-    TFT_eSprite& sprite = drawImage(digit);
-#ifdef DEBUG_OUTPUT
-    Serial.printf("Draw image took %d ms\n", millis() - start);
+#ifdef GLYPH_STORE
+    if (pushStoredGlyph(digit, digitMap)) {
+      invalidatePanels(digitMap);
+      setShown(digit, digitMap);
+      storeDrawTime.add(micros() - start);
+      frameStats.add(FRAME_PUSH, micros() - start);
+      timedDrawStatus();
+      frameStats.endFrame(showDigits, micros() - start);
+      return;
+    }
 #endif
-#ifndef USE_DMA
-    sprite.pushSprite(0,0);
+    TFT_eSprite& sprite = drawImage(digit, digitMap);
+#ifdef DEBUG_OUTPUT
+    Serial.printf("Draw image took %d us\n", micros() - start);
 #endif
+    // Put the status in the sprite rather than pushing it separately. It can't be pushed while the
+    // digit is still being sent by DMA, and this way the tile hashes match what is on the panel.
+    if (statusSet) {
+      unsigned long statusStart = micros();
+      TFT_eSprite& statusSprite = getStatusSprite();
+      statusSprite.pushToSprite(&sprite, 0, height() - statusSprite.height());
+      frameStats.add(FRAME_STATUS, micros() - statusStart);
+    }
+    unsigned long pushStart = micros();
+    pushSpriteToDigits(digitMap);
+    frameStats.add(FRAME_PUSH, micros() - pushStart);
+    setShown(digit, digitMap);
+    spriteDrawTime.add(micros() - start);
+  }
+
+  frameStats.endFrame(showDigits, micros() - start);
+}
+
+void TFTs::timedDrawStatus() {
+  if (statusSet) {
+    unsigned long start = micros();
     drawStatus();
+    frameStats.add(FRAME_STATUS, micros() - start);
   }
 }
 
@@ -555,10 +977,10 @@ uint16_t rotate_right(uint16_t value, int count) {
 // These BMP functions are stolen directly from the TFT_SPIFFS_BMP example in the TFT_eSPI library.
 // Unfortunately, they aren't part of the library itself, so I had to copy them.
 // I've modified DrawImage to buffer the whole image at once instead of doing it line-by-line.
-bool TFTs::LoadBMPImageIntoBuffer(fs::File &bmpFile) {
+bool TFTs::ReadBMPHeader(ImageReader &bmpFile, ImageInfo &info) {
   uint32_t bmpStart, headerSize, paletteSize = 0;
-  int16_t w, h, row, col;
-  uint16_t  r, g, b, bitDepth;
+  int16_t w, h;
+  uint16_t bitDepth;
   
   // First two bytes should already have been read
   bmpFile.seek(8, fs::SeekCur); // Skip file size and a reserved word
@@ -596,27 +1018,26 @@ bool TFTs::LoadBMPImageIntoBuffer(fs::File &bmpFile) {
   Serial.print("dimming: ");
   Serial.println(dimming);
 #endif
-  uint32_t palette[256];
-  MaskData maskData;
+  MaskData &maskData = info.maskData;
   if (bitDepth <= 8) // 1,2,4,8 bit bitmap: read color palette
   {
     read32(bmpFile); read32(bmpFile); read32(bmpFile); // size, w resolution, h resolution
     paletteSize = read32(bmpFile);
     if (paletteSize == 0) paletteSize = 1 << bitDepth; // if 0, size is 2^bitDepth
     if (compression == 3) {
-      bmpFile.seek(14 + 12 + headerSize); // start of color palette
+      bmpFile.seek(info.start + 14 + 12 + headerSize); // start of color palette
     } else if (compression == 6) {
-      bmpFile.seek(14 + 16 + headerSize); // start of color palette
+      bmpFile.seek(info.start + 14 + 16 + headerSize); // start of color palette
     } else {
-      bmpFile.seek(14 + headerSize); // start of color palette
+      bmpFile.seek(info.start + 14 + headerSize); // start of color palette
     }
     for (uint16_t i = 0; i < paletteSize; i++) {
-      palette[i] = read32(bmpFile);
+      info.palette[i] = read32(bmpFile);
     }
   } else if (bitDepth == 16) {
     // Seek past some data
     bmpFile.seek(20, fs::SeekCur);
-    if (bmpFile.position() != bmpStart) {
+    if (bmpFile.position() != info.start + bmpStart) {
       maskData.rMask = read32(bmpFile);
       maskData.rShift = (calc_shift(maskData.rMask) - (5 - __builtin_popcount(maskData.rMask))) % 16;
       maskData.gMask = read32(bmpFile);
@@ -636,318 +1057,730 @@ bool TFTs::LoadBMPImageIntoBuffer(fs::File &bmpFile) {
     }
   }
 
-  bmpFile.seek(bmpStart);
+  info.w = w;
+  info.h = abs(h);
+  info.bitDepth = bitDepth;
+  info.rowSize = ((bitDepth * w +31) >> 5) * 4;
+  info.reversed = h > 0;
+  info.dataStart = info.start + bmpStart;
 
-  return LoadImageBytesIntoSprite(w, abs(h), bitDepth, ((bitDepth * w +31) >> 5) * 4, h > 0, &maskData, palette, bmpFile);
-}
+  bmpFile.seek(info.dataStart);
 
-bool TFTs::LoadCLKImageIntoBuffer(fs::File &clkFile) {
-  int16_t w, h;
+  return true;
+}
 
+bool TFTs::ReadCLKHeader(ImageReader &clkFile, ImageInfo &info) {
   // First two bytes should already have been read
-  w = read16(clkFile);
-  h = read16(clkFile);
+  info.w = read16(clkFile);
+  info.h = read16(clkFile);
 #ifdef DEBUG_OUTPUT
   Serial.print("image W, H: ");
-  Serial.print(w); 
+  Serial.print(info.w); 
   Serial.print(", "); 
-  Serial.println(h);
+  Serial.println(info.h);
   Serial.print("dimming: ");
   Serial.println(dimming);
 #endif
 
-  MaskData maskData;
+  info.bitDepth = 16;
+  info.rowSize = info.w * 2;
+  info.reversed = false;
+  info.dataStart = clkFile.position();
 
-  return LoadImageBytesIntoSprite(w, h, 16, w * 2, false, &maskData, 0, clkFile);
+  return true;
 }
 
-uint16_t TFTs::dimColor(uint16_t color) {
-#ifdef DIM_WITH_TFT_BACKLIGHT_PIN
-  return color;
-#else
-  if (dimming == 255) {
-    return color;
-  }
-
-#define TFT_RED         0xF800      /* 255,   0,   0 */
+bool TFTs::LoadBMPImageIntoBuffer(ImageReader &bmpFile, uint32_t start) {
+  ImageInfo info;
+  info.start = start;
 
-  // 16 BPP pixel format: R5, G6, B5 ; bin: RRRR RGGG GGGB BBBB
-  // align to 8-bit value (MSB left aligned)
-  uint16_t r, g, b;
+  uint32_t headerStart = micros();
+  bool headerRead = ReadBMPHeader(bmpFile, info);
+  frameStats.add(FRAME_HEADER, micros() - headerStart);
+  if (!headerRead) {
+    return false;
+  }
 
-  r = color >> 11;
-  g = (color >> 5) & 0x3f;
-  b = color & 0x1f;
+  return LoadImageBytesIntoSprite(info, bmpFile);
+}
 
-  r *= dimming;
-  g *= dimming;
-  b *= dimming;
-  r = r >> 8;
-  g = g >> 8;
-  b = b >> 8;
+bool TFTs::LoadCLKImageIntoBuffer(ImageReader &clkFile) {
+  ImageInfo info;
 
-  return (r << 11) | (g << 5) | b;
-#endif
-}
+  uint32_t headerStart = micros();
+  bool headerRead = ReadCLKHeader(clkFile, info);
+  frameStats.add(FRAME_HEADER, micros() - headerStart);
+  if (!headerRead) {
+    return false;
+  }
 
-void TFTs::setMonochromeColor(int color) {
-  monochromeColor = color;
+  return LoadImageBytesIntoSprite(info, clkFile);
 }
 
-bool TFTs::LoadImageBytesIntoSprite(int16_t w, int16_t h, uint8_t bitDepth, int16_t rowSize, bool reversed, MaskData *pMaskData, uint32_t *palette, fs::File &file) {
-  // Calculate top left coords of box - default to MIDDLE_CENTER
-  int16_t x = (TFT_WIDTH - boxWidth) / 2;
-  int16_t y = (TFT_HEIGHT - boxHeight) / 2;
-
-  switch (imageJustification) {
-    case TOP_LEFT: x = y = 0; break;
-    case TOP_CENTER: y = 0; break;
-    case TOP_RIGHT: x = (TFT_WIDTH - boxWidth); y = 0; break;
-    case MIDDLE_LEFT: x = 0; break;
-    case MIDDLE_RIGHT: x = (TFT_WIDTH - boxWidth); break;
-    case BOTTOM_LEFT: x = 0; y = (TFT_HEIGHT - boxHeight); break;
-    case BOTTOM_CENTER: y = (TFT_HEIGHT - boxHeight); break;
-    case BOTTOM_RIGHT: x = (TFT_WIDTH - boxWidth); y = (TFT_HEIGHT - boxHeight); break;
+/*
+ * Images that ImageUnpacker has already converted with ConvertImage(). The pixels are in sprite
+ * byte order so, unless the image needs dimming, they are read straight into place.
+ */
+bool TFTs::LoadRawImageIntoBuffer(ImageReader &rawFile, uint32_t start) {
+  // First two bytes should already have been read
+  uint32_t headerStart = micros();
+  uint8_t version = rawFile.read();
+  uint8_t flags = rawFile.read();
+  int16_t w = read16(rawFile);
+  int16_t h = read16(rawFile);
+  frameStats.add(FRAME_HEADER, micros() - headerStart);
+
+  if (version != RAW_IMAGE_VERSION || w < 1 || w > TFT_WIDTH || h < 1 || h > TFT_HEIGHT) {
+    return false;
   }
 
-  // Center image in box
-  int16_t imgXOffset = (boxWidth - w) / 2;
-  int16_t imgYOffset = (boxHeight - h) / 2;
-
-  x += imgXOffset;
-  y += imgYOffset;
+  bool hasAlpha = (flags & RAW_IMAGE_ALPHA) != 0;
+  size_t pixelCount = w * h;
+
+  Glyph *glyph = glyphCache.allocate(loadingKey, w, h, hasAlpha);
+  if (glyph != nullptr) {
+    uint32_t readStart = micros();
+    bool read = rawFile.read((uint8_t*)glyph->pixels, pixelCount * 2) == pixelCount * 2
+      && (!hasAlpha || rawFile.read(glyph->alpha, pixelCount) == pixelCount);
+    frameStats.add(FRAME_READ, micros() - readStart);
+    if (!read) {
+      glyphCache.remove(glyph);
+      return false;
+    }
 
-  uint32_t outputBufferSize = w * 2;
-  if (outputBufferSize < rowSize) {
-    outputBufferSize = rowSize; // So that input and output buffer can be the same. Basically for bitDepth >= 16
+    drawGlyph(glyph);
+    return true;
   }
-  uint8_t outputBuffer[outputBufferSize];
-  uint8_t alphaBuffer[w];
 
-  uint32_t inputBufferSize = rowSize;
-  uint8_t *inputBuffer = outputBuffer;
+  // No room in the cache, so go straight to the sprite
+  int16_t x, y;
+  getImageOrigin(w, h, x, y);
 
-  if (bitDepth < 16) {
-    inputBuffer = (uint8_t*)malloc(inputBufferSize);
+  StaticSprite& sprite = getSprite();
+  if (!hasAlpha && x == 0 && w == TFT_WIDTH && y >= 0 && y + h <= TFT_HEIGHT) {
+    if (h != TFT_HEIGHT) {
+      sprite.fillSprite(0);
+    }
+    uint16_t *pixels = (uint16_t*)sprite.getPointer() + y * TFT_WIDTH;
+    uint32_t readStart = micros();
+    bool read = rawFile.read((uint8_t*)pixels, pixelCount * 2) == pixelCount * 2;
+    frameStats.add(FRAME_READ, micros() - readStart);
+    if (!read) {
+      return false;
+    }
+    uint32_t convertStart = micros();
+    dimPixels(pixels, pixels, pixelCount);
+    frameStats.add(FRAME_CONVERT, micros() - convertStart);
+    return true;
   }
 
-#ifdef DEBUG_OUTPUT  
-  Serial.print("image W, H: ");
-  Serial.print(w); 
-  Serial.print(", "); 
-  Serial.println(h);
-  Serial.print("dimming: ");
-  Serial.println(dimming);
-  Serial.print("input size, output size: ");
-  Serial.print(inputBufferSize); 
-  Serial.print(", "); 
-  Serial.println(outputBufferSize);
-#endif
-  uint8_t opaque = rotate_right(pMaskData->aMask, pMaskData->aShift);
-  if (bitDepth == 1 && monochromeColor >= 0) {
-    opaque = 1;
-  }
-  StaticSprite& sprite = getSprite();
-  bool leaveBackground = opaque != 0;
-  leaveBackground = leaveBackground || (w == TFT_WIDTH && h == TFT_HEIGHT);
-  if (!leaveBackground) {
+  if (!hasAlpha) {
     sprite.fillSprite(0);
   }
-  
+
   bool oldSwapBytes = sprite.getSwapBytes();
-  sprite.setSwapBytes(true);
+  sprite.setSwapBytes(false);
 
-  // 0,0 coordinates are top left
-  int spriteRow = 0;
-#ifdef USE_DMA
-  int dmaBufRows = 0;
-  spriteRow = h + imgYOffset;
-  if (h != sprite.height()) {
-      while (dmaBusy()) {
-        delay(1);
-      }
-      pushImageDMA(0, spriteRow, sprite.width(), sprite.height() - spriteRow, (uint16_t const*)(&StaticSprite::output_buffer[sprite.width() * spriteRow * 2]));
-  }
-#endif
-  int oneBitColor = dimColor(monochromeColor);
+  uint16_t pixelBuffer[w];
+  uint8_t alphaBuffer[w];
+  bool loaded = true;
+  uint32_t readUs = 0;
+  uint32_t convertUs = 0;
 
   for (int row = 0; row < h; row++) {
-    size_t read = file.read(inputBuffer, inputBufferSize);
-    if (read != inputBufferSize) {
-#ifdef DEBUG_OUTPUT
-      Serial.println("Bytes read, bytes asked for:");
-      Serial.print(read);
-      Serial.print(", ");
-      Serial.println(inputBufferSize);
-#endif
+    uint32_t rowStart = micros();
+    if (rawFile.read((uint8_t*)pixelBuffer, w * 2) != w * 2) {
+      loaded = false;
       break;
     }
-    
-    // Colors are already in 16-bit R5, G6, B5 format
+    // Unbuffered, so that the pixel rows stay in the buffer
+    if (hasAlpha && rawFile.readAt(start + RAW_IMAGE_HEADER_SIZE + pixelCount * 2 + row * w, alphaBuffer, w) != w) {
+      loaded = false;
+      break;
+    }
+    uint32_t convertStart = micros();
+    readUs += convertStart - rowStart;
+
+    dimPixels(pixelBuffer, pixelBuffer, w);
+    if (hasAlpha) {
+      sprite.pushImageWithAlpha(x, y + row, w, 1, pixelBuffer, alphaBuffer, 255);
+    } else {
+      sprite.pushImage(x, y + row, w, 1, pixelBuffer);
+    }
+    convertUs += micros() - convertStart;
+  }
+
+  sprite.setSwapBytes(oldSwapBytes);
+  frameStats.add(FRAME_READ, readUs);
+  frameStats.add(FRAME_CONVERT, convertUs);
+
+  return loaded;
+}
+
+/*
+ * Rewrite a BMP or CLK image in place in the raw format, undimmed. 1-bit images are left alone
+ * because their colour depends on the monochrome color that is set when they are drawn. Indexed
+ * images get bigger, up to three bytes a pixel with alpha, so they are left alone too if that
+ * wouldn't fit in room.
+ */
+bool TFTs::ConvertImage(const char *filename, uint32_t room) {
+#ifdef TFTS_FX
+  return false;
+#else
+  fs::File inFile = fs->open(filename, "r");
+  if (!inFile) {
+    return false;
+  }
+
+  ImageReader reader(inFile, imageReadBuffer, sizeof(imageReadBuffer));
+  ImageInfo info;
+  bool ok = false;
+  uint16_t magic = read16(reader);
+  if (magic == 0x4B43) {
+    ok = ReadCLKHeader(reader, info);
+  } else if (magic == 0x4D42) {
+    ok = ReadBMPHeader(reader, info);
+  }
+
+  if (!ok || info.bitDepth == 1) {
+    inFile.close();
+    return false;
+  }
+
+  int16_t w = info.w;
+  int16_t h = info.h;
+  uint8_t opaque = rotate_right(info.maskData.aMask, info.maskData.aShift);
+
+  uint32_t rawSize = RAW_IMAGE_HEADER_SIZE + (uint32_t)w * h * (opaque != 0 ? 3 : 2);
+  if (rawSize > room) {
+    inFile.close();
+    return false;
+  }
+
+  uint8_t *outputBuffer = (uint8_t*)malloc(w * 2);
+  uint8_t *alphaBuffer = (uint8_t*)malloc(w);
+
+  char tmpName[255];
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", filename);
+  fs::File outFile = fs->open(tmpName, "w");
+
+  ok = outFile && outputBuffer && alphaBuffer;
+  if (ok) {
+    uint8_t header[RAW_IMAGE_HEADER_SIZE] = {
+      RAW_IMAGE_MAGIC & 0xff, RAW_IMAGE_MAGIC >> 8,
+      RAW_IMAGE_VERSION,
+      (uint8_t)(opaque != 0 ? RAW_IMAGE_ALPHA : 0),
+      (uint8_t)(w & 0xff), (uint8_t)(w >> 8),
+      (uint8_t)(h & 0xff), (uint8_t)(h >> 8)
+    };
+    ok = outFile.write(header, sizeof(header)) == sizeof(header);
+  }
+
+  BuildPalette(info, -1);
+
+  // Pixels first, then a second pass for the alpha plane if there is one. Rows are read top down so the
+  // output file can be written sequentially.
+  for (int pass = 0; ok && pass < (opaque != 0 ? 2 : 1); pass++) {
+    for (int row = 0; ok && row < h; row++) {
+      int fileRow = info.reversed ? (h-row-1) : row;
+      reader.seek(info.dataStart + fileRow * info.rowSize);
+      const uint8_t *inputBuffer = reader.readBlock(info.rowSize);
+      if (inputBuffer == nullptr) {
+        ok = false;
+        break;
+      }
+
+      DecodeRow(info, inputBuffer, outputBuffer, alphaBuffer, opaque, -1);
+
+      if (pass == 0) {
+        uint16_t *pixels = (uint16_t*)outputBuffer;
+        for (int col = 0; col < w; col++) {
+          pixels[col] = __bswap_16(pixels[col]);
+        }
+        ok = outFile.write(outputBuffer, w * 2) == w * 2;
+      } else {
+        ok = outFile.write(alphaBuffer, w) == w;
+      }
+    }
+  }
+
+  inFile.close();
+  if (outFile) {
+    outFile.close();
+  }
+
+  free(outputBuffer);
+  free(alphaBuffer);
+
+  // If anything went wrong, e.g. the file system is full, the original is still usable
+  if (ok) {
+    ok = fs->rename(tmpName, filename);
+  }
+  if (!ok) {
+    fs->remove(tmpName);
+  }
+
+  return ok;
+#endif
+}
+
+/*
+ * Images and cached glyphs are kept undimmed, so dim them as they are drawn. Pixels are in sprite byte
+ * order. src and dst may be the same buffer.
+ */
+void TFTs::dimPixels(const uint16_t *src, uint16_t *dst, size_t count) {
+  if (!pixelsNeedDimming()) {
+    if (src != dst) {
+      memcpy(dst, src, count * sizeof(uint16_t));
+    }
+    return;
+  }
+
+  size_t i = 0;
+
+  // Two pixels per 32-bit word if both buffers can be word aligned
+  if ((((uintptr_t)src ^ (uintptr_t)dst) & 2) == 0) {
+    if (((uintptr_t)src & 2) != 0 && count > 0) {
+      dst[0] = __bswap_16(dimColor(__bswap_16(src[0])));
+      i = 1;
+    }
+
+    const uint32_t *in = (const uint32_t*)(src + i);
+    uint32_t *out = (uint32_t*)(dst + i);
+    for (; i + 1 < count; i += 2) {
+      uint32_t pair = *in++;
+      // Swap the bytes of both pixels at once
+      pair = ((pair & 0x00ff00ff) << 8) | ((pair >> 8) & 0x00ff00ff);
+      uint32_t lo = dimRed[(pair >> 11) & 0x1f] | dimGreen[(pair >> 5) & 0x3f] | dimBlue[pair & 0x1f];
+      uint32_t hi = dimRed[pair >> 27] | dimGreen[(pair >> 21) & 0x3f] | dimBlue[(pair >> 16) & 0x1f];
+      pair = lo | (hi << 16);
+      *out++ = ((pair & 0x00ff00ff) << 8) | ((pair >> 8) & 0x00ff00ff);
+    }
+  }
+
+  for (; i < count; i++) {
+    dst[i] = __bswap_16(dimColor(__bswap_16(src[i])));
+  }
+}
+
+uint16_t TFTs::dimColor(uint16_t color) {
+  if (!pixelsNeedDimming()) {
+    return color;
+  }
+
+  // 16 BPP pixel format: R5, G6, B5 ; bin: RRRR RGGG GGGB BBBB
+  return dimRed[color >> 11] | dimGreen[(color >> 5) & 0x3f] | dimBlue[color & 0x1f];
+}
+
+void TFTs::setMonochromeColor(int color) {
+  if (color != monochromeColor) {
+    flushUpdate();
+  }
+  monochromeColor = color;
+}
+
+void TFTs::getImageOrigin(int16_t w, int16_t h, int16_t &x, int16_t &y) {
+  // Calculate top left coords of box - default to MIDDLE_CENTER
+  x = (TFT_WIDTH - boxWidth) / 2;
+  y = (TFT_HEIGHT - boxHeight) / 2;
+
+  switch (imageJustification) {
+    case TOP_LEFT: x = y = 0; break;
+    case TOP_CENTER: y = 0; break;
+    case TOP_RIGHT: x = (TFT_WIDTH - boxWidth); y = 0; break;
+    case MIDDLE_LEFT: x = 0; break;
+    case MIDDLE_RIGHT: x = (TFT_WIDTH - boxWidth); break;
+    case BOTTOM_LEFT: x = 0; y = (TFT_HEIGHT - boxHeight); break;
+    case BOTTOM_CENTER: y = (TFT_HEIGHT - boxHeight); break;
+    case BOTTOM_RIGHT: x = (TFT_WIDTH - boxWidth); y = (TFT_HEIGHT - boxHeight); break;
+  }
+
+  // Center image in box
+  x += (boxWidth - w) / 2;
+  y += (boxHeight - h) / 2;
+}
+
+/*
+ * Draw a cached glyph into the sprite the same way LoadImageBytesIntoSprite would have.
+ */
+void TFTs::drawGlyph(Glyph *glyph) {
+  int16_t x, y;
+  getImageOrigin(glyph->w, glyph->h, x, y);
+
+  StaticSprite& sprite = getSprite();
+  bool fullScreen = glyph->w == TFT_WIDTH && glyph->h == TFT_HEIGHT;
+
+  if (fullScreen && glyph->alpha == nullptr) {
+    dimPixels(glyph->pixels, (uint16_t*)sprite.getPointer(), TFT_WIDTH * TFT_HEIGHT);
+    return;
+  }
+
+  if (glyph->alpha == nullptr && !fullScreen) {
+    sprite.fillSprite(0);
+  }
+
+  // Pixels are already in sprite byte order
+  bool oldSwapBytes = sprite.getSwapBytes();
+  sprite.setSwapBytes(false);
+
+  if (!pixelsNeedDimming()) {
+    if (glyph->alpha != nullptr) {
+      sprite.pushImageWithAlpha(x, y, glyph->w, glyph->h, glyph->pixels, glyph->alpha, 255);
+    } else {
+      sprite.pushImage(x, y, glyph->w, glyph->h, glyph->pixels);
+    }
+  } else {
+    // The glyph is undimmed, so dim it a row at a time on the way into the sprite
+    uint16_t rowBuffer[glyph->w];
+    for (int row = 0; row < glyph->h; row++) {
+      dimPixels(glyph->pixels + row * glyph->w, rowBuffer, glyph->w);
+      if (glyph->alpha != nullptr) {
+        sprite.pushImageWithAlpha(x, y + row, glyph->w, 1, rowBuffer, glyph->alpha + row * glyph->w, 255);
+      } else {
+        sprite.pushImage(x, y + row, glyph->w, 1, rowBuffer);
+      }
+    }
+  }
+
+  sprite.setSwapBytes(oldSwapBytes);
+}
+
+/*
+ * Apply any effect to a pixel and pack it as RGB565.
+ */
+uint16_t TFTs::toRGB565(uint16_t r, uint16_t g, uint16_t b, uint16_t oneBitColor) {
+#ifdef TFTS_FX
+  if (TFTs::getFx() == IPSClock::GREYSCALE) {
+    // convert to greyscale
+    // if they were all 8 bit: uint8_t grey = r * 299 + g * 587 + b * 114 / 1000;
+    uint16_t grey = (((r * 598) + 299) + (g * 587) + ((b * 228) + 114)) / 1000;
+    r = grey >> 1;
+    g = grey;
+    b = grey >> 1;
+    r = (r * (oneBitColor >> 11)) / 31;
+    g = (g * ((oneBitColor >> 5) & 0x3f)) / 63;
+    b = (b * (oneBitColor & 0x1f)) / 31;
+  }
+#endif
+  return (r << 11) | (g << 5) | b;
+}
+
+/*
+ * Convert the palette of an indexed image to RGB565 once, with the effect and monochrome color
+ * already applied, so that decoding a pixel is a single lookup. Must be called before DecodeRow.
+ */
+void TFTs::BuildPalette(const ImageInfo &info, int oneBitColor) {
+  if (info.bitDepth > 8) {
+    return;
+  }
+
+  int colors = 1 << info.bitDepth;
+  for (int i = 0; i < colors; i++) {
+    uint32_t c = info.palette[i];
+    uint16_t b = (c >> 3) & 0x1f;
+    uint16_t g = (c >> 10) & 0x3f;
+    uint16_t r = (c >> 19) & 0x1f;
+    rgb565Palette[i] = toRGB565(r, g, b, oneBitColor);
+    if (i < 2) {
+      // Black is transparent in 1-bit images
+      oneBitAlpha[i] = (r | g | b) == 0 ? 0 : 255;
+    }
+  }
+
+  if (info.bitDepth == 1) {
+    // No monochrome color (-1) is white, so "1" pixels are drawn white whatever the file's palette says
+    uint16_t color = oneBitColor;
+    rgb565Palette[1] = toRGB565((color >> 11) & 0x1f, (color >> 5) & 0x3f, color & 0x1f, color);
+    oneBitAlpha[1] = 255;
+  }
+}
+
+/*
+ * Decode a row of a 1, 2, 4 or 8 bit image using the palette from BuildPalette, a whole input byte at a time.
+ */
+void TFTs::DecodeIndexedRow(const ImageInfo &info, const uint8_t *in, uint16_t *out, uint8_t *alphaBuffer) {
+  const uint16_t *palette = rgb565Palette;
+  int16_t w = info.w;
+  int col = 0;
+
+  switch (info.bitDepth) {
+    case 8:
+      for (; col < w; col++) {
+        out[col] = palette[in[col]];
+      }
+      break;
+    case 4:
+      for (; col + 1 < w; col += 2) {
+        uint8_t byte = *in++;
+        out[col] = palette[byte >> 4];
+        out[col + 1] = palette[byte & 0x0f];
+      }
+      if (col < w) {
+        out[col] = palette[*in >> 4];
+      }
+      break;
+    case 2:
+      for (; col + 3 < w; col += 4) {
+        uint8_t byte = *in++;
+        out[col] = palette[byte >> 6];
+        out[col + 1] = palette[(byte >> 4) & 0x03];
+        out[col + 2] = palette[(byte >> 2) & 0x03];
+        out[col + 3] = palette[byte & 0x03];
+      }
+      for (int shift = 6; col < w; col++, shift -= 2) {
+        out[col] = palette[(*in >> shift) & 0x03];
+      }
+      break;
+    case 1:
+      for (; col + 7 < w; col += 8) {
+        uint8_t byte = *in++;
+        for (int bit = 0; bit < 8; bit++) {
+          uint8_t pixel = (byte >> (7 - bit)) & 0x01;
+          out[col + bit] = palette[pixel];
+          alphaBuffer[col + bit] = oneBitAlpha[pixel];
+        }
+      }
+      for (int shift = 7; col < w; col++, shift--) {
+        uint8_t pixel = (*in >> shift) & 0x01;
+        out[col] = palette[pixel];
+        alphaBuffer[col] = oneBitAlpha[pixel];
+      }
+      break;
+  }
+}
+
+/*
+ * Convert one row of image data to little-endian RGB565 in outputBuffer, plus alpha if the image has any.
+ * inputBuffer and outputBuffer may be the same buffer for 16 bit images. The row is not dimmed.
+ */
+void TFTs::DecodeRow(const ImageInfo &info, const uint8_t *inputBuffer, uint8_t *outputBuffer, uint8_t *alphaBuffer, uint8_t opaque, int oneBitColor) {
+  const MaskData *pMaskData = &info.maskData;
+  uint8_t bitDepth = info.bitDepth;
+  int16_t w = info.w;
+
+  if (bitDepth <= 8) {
+    DecodeIndexedRow(info, inputBuffer, (uint16_t*)outputBuffer, alphaBuffer);
+    return;
+  }
+
+  // Colors are already in 16-bit R5, G6, B5 format
 #ifdef DIM_WITH_TFT_BACKLIGHT_PIN
-    if (
-      bitDepth != 16
-      || pMaskData->aMask != 0
+  if (
+    bitDepth != 16
+    || pMaskData->aMask != 0
 #ifdef TFTS_FX
-      || IPSClock::getFx() != IPSClock::NONE
+    || IPSClock::getFx() != IPSClock::NONE
 #endif
-    ) {
+  ) {
 #else
-    if (
-      dimming != 255
-      || bitDepth != 16
-      || pMaskData->aMask != 0
+  if (
+    bitDepth != 16
+    || pMaskData->aMask != 0
 #ifdef TFTS_FX
-      || TFTs::getFx() != NONE
+    || TFTs::getFx() != NONE
 #endif
-    ) {
+  ) {
 #endif
-      uint8_t*  inputPtr = inputBuffer;
-
-      for (int col = 0; col < w; col++)
-      {
-        uint16_t r, g, b;
-        uint32_t c = 0;
-        int pixel = 0;
-
-        switch (bitDepth) {
-          case 32:
-            inputPtr++;
-          case 24:
-            b = *inputPtr++;
-            g = *inputPtr++;
-            r = *inputPtr++;
-            break;
-          case 16:
-            {
-              uint16_t pix;
-              ((uint8_t *)&pix)[0] = inputBuffer[col*2]; // LSB
-              ((uint8_t *)&pix)[1] = inputBuffer[col*2+1]; // MSB
-
-              // align to 8-bit value (MSB left aligned)
-              r = rotate_right((pix & pMaskData->rMask), pMaskData->rShift);
-              g = rotate_right((pix & pMaskData->gMask), pMaskData->gShift);
-              b = rotate_right((pix & pMaskData->bMask), pMaskData->bShift);
-              if (opaque != 0) {
-                alphaBuffer[col] = rotate_right((pix & pMaskData->aMask), pMaskData->aShift) * 255 / opaque;
-              }
-            }
-            break;
-          case 8:
-            c = palette[*inputPtr++];
-            b = (c >> 3) & 0x1f; g = (c >> 10) & 0x3f; r = (c >> 19) & 0x1f;
-            // b = c & 0xff; g = (c >> 8) & 0xff; r = (c >> 16) & 0xff;
-            break;
-          case 4:
-            c = palette[(*inputPtr >> ((col & 0x01)?0:4)) & 0x0F];
-            if (col & 0x01) inputPtr++;
-            b = (c >> 3) & 0x1f; g = (c >> 10) & 0x3f; r = (c >> 19) & 0x1f;
-            break;
-          case 2:
-            pixel = (*inputPtr >> ((3 - (col & 0x03))<< 1)) & 0x03;
-            if ((col & 0x03) == 0x03) inputPtr++;
-            c = palette[pixel];
-            b = (c >> 3) & 0x1f; g = (c >> 10) & 0x3f; r = (c >> 19) & 0x1f;
-            break;
-          case 1:
-            pixel = (*inputPtr >> (7 - (col & 0x07))) & 0x01;
-            if ((col & 0x07) == 0x07) inputPtr++;
-            alphaBuffer[col] = 255;
-            if (oneBitColor >= 0 && pixel == 1) {
-              r = (oneBitColor >> 11) & 0x1f;
-              b = (oneBitColor) & 0x1f;
-              g = (oneBitColor >> 5) & 0x3f;
-            } else {
-              c = palette[pixel];
-              b = (c >> 3) & 0x1f; g = (c >> 10) & 0x3f; r = (c >> 19) & 0x1f;
-              if (b == 0 && g == 0 && r == 0) {
-                alphaBuffer[col] = 0;
-              }
+    const uint8_t*  inputPtr = inputBuffer;
+
+    for (int col = 0; col < w; col++)
+    {
+      uint16_t r, g, b;
+
+      switch (bitDepth) {
+        case 32:
+          inputPtr++;
+        case 24:
+          b = *inputPtr++;
+          g = *inputPtr++;
+          r = *inputPtr++;
+          break;
+        case 16:
+          {
+            uint16_t pix;
+            ((uint8_t *)&pix)[0] = inputBuffer[col*2]; // LSB
+            ((uint8_t *)&pix)[1] = inputBuffer[col*2+1]; // MSB
+
+            // align to 8-bit value (MSB left aligned)
+            r = rotate_right((pix & pMaskData->rMask), pMaskData->rShift);
+            g = rotate_right((pix & pMaskData->gMask), pMaskData->gShift);
+            b = rotate_right((pix & pMaskData->bMask), pMaskData->bShift);
+            if (opaque != 0) {
+              alphaBuffer[col] = rotate_right((pix & pMaskData->aMask), pMaskData->aShift) * 255 / opaque;
             }
-            break;
-        }
-#ifdef TFTS_FX
-        if (TFTs::getFx() == IPSClock::GREYSCALE) {
-          // convert to greyscale
-          // if they were all 8 bit: uint8_t grey = r * 299 + g * 587 + b * 114 / 1000;
-          uint16_t grey = (((r * 598) + 299) + (g * 587) + ((b * 228) + 114)) / 1000;
-          r = grey >> 1;
-          g = grey;
-          b = grey >> 1;
-          r = (r * (oneBitColor >> 11)) / 31;
-          g = (g * ((oneBitColor >> 5) & 0x3f)) / 63;
-          b = (b * (oneBitColor & 0x1f)) / 31;
-        }
+          }
+          break;
+      }
+      uint16_t finalPixel = toRGB565(r, g, b, oneBitColor);
+      outputBuffer[col*2+1] = finalPixel >> 8;
+      outputBuffer[col*2] = finalPixel & 0xff;
+    }
+  } else if (inputBuffer != outputBuffer) {
+    memcpy(outputBuffer, inputBuffer, w * 2);
+  }
+}
+
+bool TFTs::LoadImageBytesIntoSprite(const ImageInfo &info, ImageReader &file) {
+  int16_t w = info.w;
+  int16_t h = info.h;
+  uint8_t bitDepth = info.bitDepth;
+  int16_t rowSize = info.rowSize;
+  bool reversed = info.reversed;
+  const MaskData *pMaskData = &info.maskData;
+
+  int16_t x, y;
+  getImageOrigin(w, h, x, y);
+
+  // Rows are decoded straight out of the reader's buffer
+  uint16_t outputBuffer[w];
+  uint8_t alphaBuffer[w];
+
+#ifdef DEBUG_OUTPUT  
+  Serial.print("image W, H: ");
+  Serial.print(w); 
+  Serial.print(", "); 
+  Serial.println(h);
+  Serial.print("dimming: ");
+  Serial.println(dimming);
+  Serial.print("row size: ");
+  Serial.println(rowSize); 
 #endif
-#ifndef DIM_WITH_TFT_BACKLIGHT_PIN        
-        if (dimming != 255 && bitDepth != 1) {
-          r *= dimming;
-          g *= dimming;
-          b *= dimming;
-          r = r >> 8;
-          g = g >> 8;
-          b = b >> 8;
-        }
+  uint8_t opaque = rotate_right(pMaskData->aMask, pMaskData->aShift);
+  if (bitDepth == 1 && monochromeColor >= 0) {
+    opaque = 1;
+  }
+  StaticSprite& sprite = getSprite();
+  bool leaveBackground = opaque != 0;
+  leaveBackground = leaveBackground || (w == TFT_WIDTH && h == TFT_HEIGHT);
+  if (!leaveBackground) {
+    sprite.fillSprite(0);
+  }
+  
+  bool oldSwapBytes = sprite.getSwapBytes();
+  sprite.setSwapBytes(false);
+
+  // Keep an undimmed decoded copy so the next time this glyph is needed it doesn't have to be read again
+  Glyph *glyph = glyphCache.allocate(loadingKey, w, h, opaque != 0);
+
+  uint32_t convertStart = micros();
+  BuildPalette(info, monochromeColor);
+  uint32_t convertUs = micros() - convertStart;
+  uint32_t readUs = 0;
+
+  for (int row = 0; row < h; row++) {
+    uint32_t rowStart = micros();
+    const uint8_t *inputBuffer = file.readBlock(rowSize);
+    convertStart = micros();
+    readUs += convertStart - rowStart;
+    if (inputBuffer == nullptr) {
+#ifdef DEBUG_OUTPUT
+      Serial.printf("Couldn't read row %d\n", row);
 #endif
-        // convert to RGB565
-        uint16_t finalPixel = (r << 11) | (g << 5) | b;
-        outputBuffer[col*2+1] = finalPixel >> 8;
-        outputBuffer[col*2] = finalPixel & 0xff;
+      glyphCache.remove(glyph);
+      glyph = nullptr;
+      break;
+    }
+    
+    DecodeRow(info, inputBuffer, (uint8_t*)outputBuffer, alphaBuffer, opaque, monochromeColor);
+
+    // Sprite byte order from here on
+    uint16_t *pixels = outputBuffer;
+    for (int col = 0; col < w; col++) {
+      pixels[col] = __bswap_16(pixels[col]);
+    }
+
+    int glyphRow = reversed ? (h-row-1) : row;
+    if (glyph != nullptr) {
+      memcpy(glyph->pixels + glyphRow * w, pixels, w * sizeof(uint16_t));
+      if (glyph->alpha != nullptr) {
+        memcpy(glyph->alpha + glyphRow * w, alphaBuffer, w);
       }
     }
 
-    int spriteRow = reversed ? (h-row-1) + y : row + y;
+    dimPixels(pixels, pixels, w);
+
+    int spriteRow = glyphRow + y;
     if (opaque != 0) {
-      sprite.pushImageWithAlpha(x, spriteRow, w, 1, (uint16_t*)outputBuffer, alphaBuffer, 255);
+      sprite.pushImageWithAlpha(x, spriteRow, w, 1, pixels, alphaBuffer, 255);
     } else {
-      sprite.pushImage(x, spriteRow, w, 1, (uint16_t*)outputBuffer);
-    }
-#ifdef USE_DMA
-    dmaBufRows++;
-    if (dmaBufRows == 10) {
-      while (dmaBusy()) {
-        delay(1);
-      }
-      pushImageDMA(0, spriteRow, sprite.width(), dmaBufRows, (uint16_t const*)(&StaticSprite::output_buffer[sprite.width() * spriteRow * 2]));
-      dmaBufRows = 0;
+      sprite.pushImage(x, spriteRow, w, 1, pixels);
     }
+    convertUs += micros() - convertStart;
+  }
+
+  sprite.setSwapBytes(oldSwapBytes);
+  frameStats.add(FRAME_READ, readUs);
+  frameStats.add(FRAME_CONVERT, convertUs);
+
+  return true;
+}
+
+void TFTs::setGlyphKey(GlyphKey &key, const char *dir, const char *name) {
+  strncpy(key.dir, dir, sizeof(key.dir) - 1);
+  key.dir[sizeof(key.dir) - 1] = 0;
+  strncpy(key.name, name, sizeof(key.name) - 1);
+  key.name[sizeof(key.name) - 1] = 0;
+  key.monochromeColor = monochromeColor;
+#ifdef TFTS_FX
+  key.fx = TFTs::getFx();
+#else
+  key.fx = 0;
 #endif
+}
+
+bool TFTs::LoadImageIntoBuffer(const char* dir, const char* name) {
+  bool loaded = false;
+
+  setGlyphKey(loadingKey, dir, name);
+
+  Glyph *glyph = glyphCache.find(loadingKey);
+  if (glyph != nullptr) {
+    uint32_t convertStart = micros();
+    drawGlyph(glyph);
+    frameStats.add(FRAME_CONVERT, micros() - convertStart);
+    return true;
   }
 
-#ifdef USE_DMA
-  if (dmaBufRows != 0 || spriteRow != 0) {
-      while (dmaBusy()) {
-        delay(1);
-      }
-      pushImageDMA(0, 0, sprite.width(), spriteRow + dmaBufRows, (uint16_t const*)(&StaticSprite::output_buffer[0]));
+  uint32_t openStart = micros();
+  bool hasAtlas = openAtlas(dir);
+  frameStats.add(FRAME_OPEN, micros() - openStart);
+
+  if (hasAtlas) {
+    loaded = LoadAtlasImage(name);
+  } else {
+    loaded = LoadFileImage(dir, name);
   }
-#endif
 
-  sprite.setSwapBytes(oldSwapBytes);
+  if (!loaded) {
+    getSprite().fillSprite(0);
+  }
+  return loaded;
+}
 
-  if (bitDepth < 16) {
-    free(inputBuffer);
+bool TFTs::LoadAtlasImage(const char* name) {
+  for (uint16_t i = 0; i < atlasCount; i++) {
+    if (strcmp(atlasIndex[i].name, name) == 0) {
+      atlasFile.seek(atlasIndex[i].offset);
+      return LoadImageFromFile(atlasFile, atlasIndex[i].offset);
+    }
   }
 
-  return true;
+  return false;
 }
 
-bool TFTs::LoadImageIntoBuffer(const char* filename) {
+bool TFTs::LoadFileImage(const char* dir, const char* name) {
   bool loaded = false;
 
+  char filename[255];
+  snprintf(filename, sizeof(filename), "%s/%s.bmp", dir, name);
+
+  uint32_t openStart = micros();
   if (fs->exists(filename)) {
     fs::File file;
     file = fs->open(filename, "r");
+    frameStats.add(FRAME_OPEN, micros() - openStart);
     if (file) {
-      uint16_t magic = read16(file);
- 
-      if (magic == 0x4B43) { // look for "CK" header
-        loaded = LoadCLKImageIntoBuffer(file);
-      }
-
-      if (magic == 0x4D42) {
-        loaded = LoadBMPImageIntoBuffer(file);
-      }
+      loaded = LoadImageFromFile(file, 0);
 
       file.close();
 
@@ -955,53 +1788,664 @@ bool TFTs::LoadImageIntoBuffer(const char* filename) {
     }
   }
 
-  if (!loaded) {
-    getSprite().fillSprite(0);
+  return loaded;
+}
+
+/*
+ * file must be positioned at start, which is where the image begins.
+ */
+bool TFTs::LoadImageFromFile(fs::File &file, uint32_t start) {
+  ImageReader reader(file, imageReadBuffer, sizeof(imageReadBuffer));
+  uint32_t headerStart = micros();
+  uint16_t magic = read16(reader);
+  frameStats.add(FRAME_HEADER, micros() - headerStart);
+
+  if (magic == 0x4B43) { // look for "CK" header
+    return LoadCLKImageIntoBuffer(reader);
+  }
+
+  if (magic == 0x4D42) {
+    return LoadBMPImageIntoBuffer(reader, start);
   }
+
+  if (magic == RAW_IMAGE_MAGIC) {
+    return LoadRawImageIntoBuffer(reader, start);
+  }
+
   return false;
 }
 
-TFT_eSprite& TFTs::drawImage(uint8_t digit) {
+/*
+ * Make the atlas for dir, if there is one, the open atlas. Returns false if dir doesn't have an atlas.
+ */
+bool TFTs::openAtlas(const char *dir) {
+  if (strcmp(atlasDir, dir) == 0) {
+    return atlasIndex != nullptr;
+  }
+
+  closeAtlas();
+
+  // Remember the directory even if there is no atlas, so we don't keep looking for one
+  strncpy(atlasDir, dir, sizeof(atlasDir) - 1);
+  atlasDir[sizeof(atlasDir) - 1] = 0;
+
+  char filename[255];
+  snprintf(filename, sizeof(filename), "%s/%s", dir, ATLAS_FILE_NAME);
+
+  if (!fs->exists(filename)) {
+    return false;
+  }
+
+  atlasFile = fs->open(filename, "r");
+  if (!atlasFile) {
+    return false;
+  }
+
+  uint16_t magic = read16(atlasFile);
+  uint8_t version = atlasFile.read();
+  atlasFile.read();
+  uint16_t count = read16(atlasFile);
+  read16(atlasFile);
+
+  if (magic == ATLAS_MAGIC && version == ATLAS_VERSION && count > 0) {
+    atlasIndex = (AtlasEntry*)malloc(count * sizeof(AtlasEntry));
+    if (atlasIndex != nullptr) {
+      if (atlasFile.read((uint8_t*)atlasIndex, count * sizeof(AtlasEntry)) == count * sizeof(AtlasEntry)) {
+        atlasCount = count;
+        return true;
+      }
+      free(atlasIndex);
+      atlasIndex = nullptr;
+    }
+  }
+
 #ifdef DEBUG_OUTPUT
-  uint32_t StartTime = millis();
+  Serial.printf("Bad atlas %s\n", filename);
 #endif
+  atlasFile.close();
+
+  return false;
+}
+
+void TFTs::closeAtlas() {
+  if (atlasFile) {
+    atlasFile.close();
+  }
+
+  free(atlasIndex);
+  atlasIndex = nullptr;
+  atlasCount = 0;
+  atlasDir[0] = 0;
+}
+
+#ifdef GLYPH_STORE
+/*
+ * The store holds a copy of one directory's atlas. If there isn't room for all of it, the images
+ * that don't fit are drawn the normal way.
+ */
+bool TFTs::storeGlyphs(const char *dir) {
+  if (!glyphStore.mapped()) {
+    return false;
+  }
+
   char filename[255];
+  snprintf(filename, sizeof(filename), "%s/%s", dir, ATLAS_FILE_NAME);
 
-  yield();
+  fs::File atlas = fs->open(filename, "r");
+  if (!atlas) {
+    return false;
+  }
 
-#ifdef USE_DMA
-  while(dmaBusy()) {
-    delay(1);
+  size_t length = atlas.size();
+  if (length > glyphStore.size() - sizeof(GlyphStoreHeader)) {
+    length = glyphStore.size() - sizeof(GlyphStoreHeader);
+  }
+
+  uint8_t *buffer = (uint8_t*)malloc(ATLAS_COPY_BUFFER_SIZE);
+  bool ok = buffer != nullptr && glyphStore.erase(sizeof(GlyphStoreHeader) + length);
+
+  size_t offset = 0;
+  while (ok && offset < length) {
+    size_t len = atlas.read(buffer, min(length - offset, (size_t)ATLAS_COPY_BUFFER_SIZE));
+    ok = len > 0 && glyphStore.write(sizeof(GlyphStoreHeader) + offset, buffer, len);
+    offset += len;
+  }
+
+  // The header goes last, so that a partly written store is never used
+  if (ok) {
+    GlyphStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = GLYPH_STORE_MAGIC;
+    header.version = GLYPH_STORE_VERSION;
+    header.length = length;
+    strncpy(header.dir, dir, sizeof(header.dir) - 1);
+    ok = glyphStore.write(0, &header, sizeof(header));
+  }
+
+  glyphStore.end();
+  atlas.close();
+  free(buffer);
+
+  return ok;
+}
+
+/*
+ * Send an image from the memory-mapped glyph store straight to the panel, bypassing the sprite.
+ * Only opaque raw images qualify, and only when they don't need dimming.
+ */
+bool TFTs::pushStoredGlyph(uint8_t digit, uint8_t digitMap) {
+#ifndef DIM_WITH_TFT_BACKLIGHT_PIN
+  if (dimming != 255) {
+    return false;
+  }
+#endif
+
+  const uint8_t *image = findStoredImage(getCacheDir(), icons[digit]);
+  if (image == nullptr) {
+    return false;
+  }
+
+  const uint16_t *pixels = (const uint16_t*)(image + RAW_IMAGE_HEADER_SIZE);
+  int16_t w = image[4] | (image[5] << 8);
+  int16_t h = image[6] | (image[7] << 8);
+  int16_t x, y;
+  getImageOrigin(w, h, x, y);
+
+  waitForDMA();
+  chip_select.setDigitMap(digitMap);
+
+  // Clear around the image, as fillSprite() would have done
+  if (y > 0) fillRect(0, 0, TFT_WIDTH, y, TFT_BLACK);
+  if (y + h < TFT_HEIGHT) fillRect(0, y + h, TFT_WIDTH, TFT_HEIGHT - y - h, TFT_BLACK);
+  if (x > 0) fillRect(0, y, x, h, TFT_BLACK);
+  if (x + w < TFT_WIDTH) fillRect(x + w, y, TFT_WIDTH - x - w, h, TFT_BLACK);
+
+  // Pixels are already in panel byte order
+  bool oldSwapBytes = getSwapBytes();
+  setSwapBytes(false);
+  pushImage(x, y, w, h, pixels);
+  setSwapBytes(oldSwapBytes);
+
+  return true;
+}
+
+/*
+ * An opaque raw image in the glyph store that is safe to send straight from flash, or nullptr.
+ */
+const uint8_t* TFTs::findStoredImage(const char *dir, const char *name) {
+  if (!openAtlas(dir)) {
+    return nullptr;
+  }
+
+  const uint8_t *atlas = glyphStore.getAtlas(dir);
+  if (atlas == nullptr) {
+    return nullptr;
+  }
+
+  // Make sure the store was written from the atlas that is on the file system now
+  if (memcmp(atlas + ATLAS_HEADER_SIZE, atlasIndex, atlasCount * sizeof(AtlasEntry)) != 0) {
+    return nullptr;
+  }
+
+  const AtlasEntry *entry = nullptr;
+  for (uint16_t i = 0; i < atlasCount; i++) {
+    if (strcmp(atlasIndex[i].name, name) == 0) {
+      entry = &atlasIndex[i];
+      break;
+    }
+  }
+
+  if (entry == nullptr || entry->offset + entry->size > glyphStore.getHeader()->length) {
+    return nullptr;
+  }
+
+  const uint8_t *image = atlas + entry->offset;
+  if (image[0] != 'G' || image[1] != 'R' || image[2] != RAW_IMAGE_VERSION || (image[3] & RAW_IMAGE_ALPHA) != 0) {
+    return nullptr;
+  }
+
+  // TFT_eSPI reads pixels a word at a time
+  const uint16_t *pixels = (const uint16_t*)(image + RAW_IMAGE_HEADER_SIZE);
+  if (((uintptr_t)pixels & 3) != 0) {
+    return nullptr;
+  }
+
+  return image;
+}
+#endif
+
+#ifdef BENCHMARK_IMAGE_LOAD
+/*
+ * Needs the per-file images as well as the atlas, so ImageUnpacker calls it before it deletes them.
+ * The glyph cache is flushed before each load so that every load actually goes to the file system.
+ */
+void TFTs::benchmarkImageLoad(const char *dir) {
+  if (!openAtlas(dir)) {
+    return;
+  }
+
+  uint32_t atlasTotal = 0;
+  uint32_t fileTotal = 0;
+  uint16_t fileCount = 0;
+  char caseName[80];
+
+  for (uint16_t i = 0; i < atlasCount; i++) {
+    const char *name = atlasIndex[i].name;
+
+    strncpy(loadingKey.dir, dir, sizeof(loadingKey.dir) - 1);
+    strncpy(loadingKey.name, name, sizeof(loadingKey.name) - 1);
+
+    glyphCache.flush();
+    uint32_t start = micros();
+    LoadAtlasImage(name);
+    uint32_t atlasTime = micros() - start;
+
+    glyphCache.flush();
+    start = micros();
+    bool loaded = LoadFileImage(dir, name);
+    uint32_t fileTime = micros() - start;
+
+    atlasTotal += atlasTime;
+    snprintf(caseName, sizeof(caseName), "%s/%s", dir, name);
+    printBenchmark("image_load_atlas", caseName, 1, atlasTime);
+    // Images reused from the previous atlas have no file
+    if (loaded) {
+      fileTotal += fileTime;
+      fileCount++;
+      printBenchmark("image_load_file", caseName, 1, fileTime);
+    }
   }
+  glyphCache.flush();
+
+  printBenchmark("image_load_atlas", dir, atlasCount, atlasTotal);
+  printBenchmark("image_load_file", dir, fileCount, fileTotal);
+}
 #endif
-  chip_select.setDigit(digit);
 
+#ifdef GOLDEN_IMAGES
+/*
+ * Decode each image in dir on its own and print its hash. Images are drawn undimmed and untinted, so
+ * only the face's own settings, like justification, affect the hashes.
+ */
+void TFTs::hashImages(const char *dir, const char *stage) {
+  uint8_t savedDimming = dimming;
+  int savedMonochromeColor = monochromeColor;
+  dimming = 255;
+  monochromeColor = -1;
+  buildDimTables();
+
+  char name[80];
+
+  fs::File root = fs->open(dir);
+  String fileName = root.getNextFileName();
+  while (fileName.length() > 0) {
+    if (fileName.endsWith(".bmp")) {
+      String baseName = fileName.substring(fileName.lastIndexOf('/') + 1, fileName.length() - 4);
+
+      uint32_t start = micros();
+      uint32_t hash = hashImage(dir, baseName.c_str());
+      uint32_t elapsed = micros() - start;
+
+      snprintf(name, sizeof(name), "%s/%s", dir, baseName.c_str());
+      printGolden(name, stage, hash, elapsed);
+    }
+    fileName = root.getNextFileName();
+  }
+  root.close();
+
+  dimming = savedDimming;
+  monochromeColor = savedMonochromeColor;
+  buildDimTables();
+}
+
+/*
+ * Decode dir/name.bmp into a cleared sprite and hash the whole sprite. The glyph cache is flushed
+ * first, so that the image goes through the loaders, and after, so that it isn't drawn as a digit.
+ */
+uint32_t TFTs::hashImage(const char *dir, const char *name) {
+  StaticSprite& sprite = getSprite();
+  const uint16_t *pixels = (const uint16_t*)sprite.getPointer();
+
+  setGlyphKey(loadingKey, dir, name);
+  glyphCache.flush();
+  sprite.fillSprite(0);
+
+  LoadFileImage(dir, name);
+
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++) {
+    hash = (hash ^ pixels[i]) * 16777619u;
+  }
+
+  glyphCache.flush();
+  return hash;
+}
+#endif
+
+#ifdef BENCHMARK_DECODE
+/*
+ * Time decoding each bit depth, with and without dimming, alpha and effects, and blending rows into
+ * the sprite. Uses made up rows so that the file system isn't involved. n is the number of pixels.
+ */
+void TFTs::benchmarkDecode() {
+  const uint8_t bitDepths[] = { 32, 24, 16, 8, 4, 2, 1 };
+  uint8_t savedDimming = dimming;
+  ImageInfo info;
+  info.w = TFT_WIDTH;
+  info.h = TFT_HEIGHT;
+  for (int i = 0; i < 256; i++) {
+    info.palette[i] = esp_random() & 0xffffff;
+  }
+
+  uint8_t inputBuffer[TFT_WIDTH * 4];
+  uint16_t outputBuffer[TFT_WIDTH * 2];
+  uint8_t alphaBuffer[TFT_WIDTH];
+  for (int i = 0; i < sizeof(inputBuffer); i++) {
+    inputBuffer[i] = esp_random();
+  }
+
+  auto decode = [&](const char *name, uint8_t opaque) {
+    uint32_t start = micros();
+    BuildPalette(info, -1);
+    for (int row = 0; row < TFT_HEIGHT; row++) {
+      DecodeRow(info, inputBuffer, (uint8_t*)outputBuffer, alphaBuffer, opaque, -1);
+      dimPixels(outputBuffer, outputBuffer, TFT_WIDTH);
+    }
+    printBenchmark("decode", name, TFT_WIDTH * TFT_HEIGHT, micros() - start);
+  };
+
+  char name[32];
+  for (uint8_t dim : { 255, 128 }) {
+    dimming = dim;
+    buildDimTables();
+
+    for (uint8_t bitDepth : bitDepths) {
+      info.bitDepth = bitDepth;
+      info.rowSize = (TFT_WIDTH * bitDepth + 31) / 32 * 4;
+      snprintf(name, sizeof(name), "%dbit%s", bitDepth, dim == 255 ? "" : "_dimmed");
+      decode(name, 0);
+    }
+
+    // ARGB4444, set up the way ReadBMPHeader() would
+    MaskData &maskData = info.maskData;
+    maskData.rMask = 0x0f00;
+    maskData.rShift = (calc_shift(maskData.rMask) - (5 - __builtin_popcount(maskData.rMask))) % 16;
+    maskData.gMask = 0x00f0;
+    maskData.gShift = (calc_shift(maskData.gMask) - (6 - __builtin_popcount(maskData.gMask))) % 16;
+    maskData.bMask = 0x000f;
+    maskData.bShift = (calc_shift(maskData.bMask) - (5 - __builtin_popcount(maskData.rMask))) % 16;
+    maskData.aMask = 0xf000;
+    maskData.aShift = calc_shift(maskData.aMask);
+    info.bitDepth = 16;
+    info.rowSize = TFT_WIDTH * 2;
+    snprintf(name, sizeof(name), "16bit_alpha%s", dim == 255 ? "" : "_dimmed");
+    decode(name, rotate_right(maskData.aMask, maskData.aShift));
+    maskData = MaskData();
+
+#ifdef TFTS_FX
+    uint8_t savedFx = getFx().value;
+    info.bitDepth = 24;
+    info.rowSize = TFT_WIDTH * 3;
+    for (uint8_t fx : { GREYSCALE, TINT }) {
+      getFx().value = fx;
+      snprintf(name, sizeof(name), "24bit_%s%s", fx == GREYSCALE ? "greyscale" : "tint", dim == 255 ? "" : "_dimmed");
+      decode(name, 0);
+    }
+    getFx().value = savedFx;
+#endif
+
+    uint32_t start = micros();
+    for (int row = 0; row < TFT_HEIGHT; row++) {
+      dimPixels(outputBuffer, outputBuffer, TFT_WIDTH);
+    }
+    printBenchmark("decode", dim == 255 ? "cached" : "cached_dimmed", TFT_WIDTH * TFT_HEIGHT, micros() - start);
+  }
+
+  dimming = savedDimming;
+  buildDimTables();
+
+  // Blending rows into the sprite, as LoadImageBytesIntoSprite does for images with alpha or a transparent color
+  StaticSprite& sprite = getSprite();
+  for (int i = 0; i < TFT_WIDTH; i++) {
+    alphaBuffer[i] = i & 0x0f;
+  }
+
+  uint32_t start = micros();
+  for (int row = 0; row < TFT_HEIGHT; row++) {
+    sprite.pushImageWithAlpha(0, row, TFT_WIDTH, 1, outputBuffer, alphaBuffer, 0x0f);
+  }
+  printBenchmark("blend", "alpha", TFT_WIDTH * TFT_HEIGHT, micros() - start);
+
+  start = micros();
+  for (int row = 0; row < TFT_HEIGHT; row++) {
+    sprite.pushImageWithTransparency(0, row, TFT_WIDTH, 1, outputBuffer, outputBuffer[0]);
+  }
+  printBenchmark("blend", "transparency", TFT_WIDTH * TFT_HEIGHT, micros() - start);
+}
+#endif
+
+#ifdef BENCHMARK_ANIMATION
+/*
+ * Time drawing frames of the matrix animation into the sprite. Nothing is sent to the panels.
+ */
+void TFTs::benchmarkAnimation() {
+  const uint32_t frames = 100;
+
+#ifdef SMOOTH_FONT
+  DigitalRainAnim animator = getMatrixAnimator();
+#else
+  DigitalRainAnimation& animator = getMatrixAnimator();
+  getSprite().setFreeFont(MATRIX_FONT);
+#endif
+
+  uint32_t start = micros();
+  for (uint32_t i = 0; i < frames; i++) {
+    animator.animate(255);
+  }
+  printBenchmark("animation", "frame", frames, micros() - start);
+
+  getSprite().fillSprite(0);
+}
+#endif
+
+/*
+ * Time and date share the clock face, weather and the slide show each have their own.
+ */
+static uint8_t cacheDirIndex(uint8_t showDigits) {
   if (showDigits == IPSClock::WEATHER) {
-    strcpy(filename, "/ips/weather_cache/");
+    return 1;
   } else if (showDigits == IPSClock::SLIDE_SHOW) {
-    strcpy(filename, "/ips/slides_cache/");
+    return 2;
   } else {
-    strcpy(filename, "/ips/cache/");
+    return 0;
   }
-  strcat(filename, icons[digit]);
-  strcat(filename, ".bmp");
-  
-  LoadImageIntoBuffer(filename);
-  // }
+}
+
+void TFTs::setCacheDir(uint8_t showDigits, const char *dir) {
+  char *cacheDir = cacheDirs[cacheDirIndex(showDigits)];
+  strncpy(cacheDir, dir, sizeof(cacheDirs[0]) - 1);
+  cacheDir[sizeof(cacheDirs[0]) - 1] = 0;
+}
+
+const char* TFTs::getCacheDir(uint8_t showDigits) {
+  return cacheDirs[cacheDirIndex(showDigits)];
+}
+
+bool TFTs::isCacheDir(const char *dir) {
+  for (uint8_t i = 0; i < NUM_CACHE_DIRS; i++) {
+    if (strcmp(cacheDirs[i], dir) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* TFTs::getCacheDir() {
+  return getCacheDir(showDigits);
+}
+
+/*
+ * Decode the image for digit into the sprite, then select the digits in digitMap. With DMA, the decode
+ * overlaps sending the previous digit, and this waits for that to finish before changing the selection.
+ */
+TFT_eSprite& TFTs::drawImage(uint8_t digit, uint8_t digitMap) {
+#ifdef DEBUG_OUTPUT
+  uint32_t StartTime = millis();
+#endif
+  yield();
+
 #ifdef USE_DMA
-  else {
-    TFT_eSprite& sprite = getSprite();
-    pushImageDMA(0, 0, sprite.width(), sprite.height(), (uint16_t const*)(&StaticSprite::output_buffer[0]));
+  // With only one buffer, the previous digit has to finish sending before it can be reused
+  if (frameBuffers[1] == nullptr) {
+    uint32_t waitStart = micros();
+    waitForDMA();
+    frameStats.add(FRAME_PUSH, micros() - waitStart);
   }
 #endif
 
-  return getSprite();
+  LoadImageIntoBuffer(getCacheDir(), icons[digit]);
+
 #ifdef DEBUG_OUTPUT
-  Serial.print("img transfer: ");  
+  Serial.print("img decode: ");  
   Serial.println(millis() - StartTime);  
 #endif
+
+  uint32_t waitStart = micros();
+  waitForDMA();
+  frameStats.add(FRAME_PUSH, micros() - waitStart);
+  chip_select.setDigitMap(digitMap);
+
+  return getSprite();
 }
 
+void TFTs::waitForDMA() {
+#ifdef USE_DMA
+  if (dmaPending) {
+    // dmaWait() blocks on the SPI driver's completion queue, so the task sleeps until the transfer is done
+    dmaWait();
+    endWrite();
+    dmaPending = false;
+  }
+#endif
+}
+
+/*
+ * Hash each tile of the sprite, and work out which tiles differ from what is on any of the digits in digitMap.
+ * Returns a bitmap of dirty tile columns for each row of tiles.
+ */
+void TFTs::findDirtyTiles(uint8_t digitMap, uint16_t *dirtyColumns) {
+  const uint16_t *pixels = (const uint16_t*)getSprite().getPointer();
+
+  for (int row = 0; row < DIRTY_TILE_ROWS; row++) {
+    dirtyColumns[row] = 0;
+
+    for (int col = 0; col < DIRTY_TILE_COLUMNS; col++) {
+      int x = col * DIRTY_TILE_WIDTH;
+      int y = row * DIRTY_TILE_HEIGHT;
+      int w = min(DIRTY_TILE_WIDTH, TFT_WIDTH - x);
+      int h = min(DIRTY_TILE_HEIGHT, TFT_HEIGHT - y);
+
+      // FNV-1a
+      uint32_t hash = 2166136261u;
+      for (int tileY = y; tileY < y + h; tileY++) {
+        const uint16_t *p = pixels + tileY * TFT_WIDTH + x;
+        for (int i = 0; i < w; i++) {
+          hash = (hash ^ p[i]) * 16777619u;
+        }
+      }
+
+      for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+        if ((digitMap & (1 << digit)) == 0) {
+          continue;
+        }
+        if ((validPanels & (1 << digit)) == 0 || tileHashes[digit][row][col] != hash) {
+          dirtyColumns[row] |= 1 << col;
+        }
+        tileHashes[digit][row][col] = hash;
+      }
+    }
+  }
+
+  validPanels |= digitMap;
+}
+
+/*
+ * Send the sprite to the digits in digitMap, which must already be selected, but only the rectangles
+ * that have changed since the last push. With DMA this returns once the transfer has started.
+ */
+void TFTs::pushSpriteToDigits(uint8_t digitMap) {
+  StaticSprite& sprite = getSprite();
+  uint16_t *pixels = (uint16_t*)sprite.getPointer();
+
+  uint16_t dirtyColumns[DIRTY_TILE_ROWS];
+  findDirtyTiles(digitMap, dirtyColumns);
+
+  // Whatever is in the sprite, the panels don't show a known image any more
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    if (digitMap & (1 << digit)) {
+      shownIcons[digit][0] = 0;
+    }
+  }
+
+  uint32_t pushed = 0;
+  int row = 0;
+  while (row < DIRTY_TILE_ROWS) {
+    if (dirtyColumns[row] == 0) {
+      row++;
+      continue;
+    }
+
+    // Merge rows of tiles with the same dirty columns into one rectangle
+    int firstRow = row;
+#ifdef USE_DMA
+    // DMA needs the pixels to be contiguous, so send whole rows
+    while (row < DIRTY_TILE_ROWS && dirtyColumns[row] != 0) row++;
+    int x = 0;
+    int w = TFT_WIDTH;
+#else
+    uint16_t columns = dirtyColumns[row];
+    while (row < DIRTY_TILE_ROWS && dirtyColumns[row] == columns) row++;
+    int x = __builtin_ctz(columns) * DIRTY_TILE_WIDTH;
+    int w = min((int)(32 - __builtin_clz(columns)) * DIRTY_TILE_WIDTH, TFT_WIDTH) - x;
+#endif
+    int y = firstRow * DIRTY_TILE_HEIGHT;
+    int h = min(row * DIRTY_TILE_HEIGHT, TFT_HEIGHT) - y;
+
+#ifdef USE_DMA
+    if (!dmaPending) {
+      startWrite();
+      dmaPending = true;
+    }
+    pushImageDMA(x, y, w, h, pixels + y * TFT_WIDTH);
+#else
+    sprite.pushSprite(x, y, x, y, w, h);
+#endif
+    pushed += w * h * 2;
+  }
+
+  spiBytesSaved += TFT_WIDTH * TFT_HEIGHT * 2 - pushed;
+
+#ifdef USE_DMA
+  // Decode the next digit into the other buffer while this one is sent. That buffer has the frame
+  // from two pushes ago, and images with transparency are drawn over what is there, so bring it up to date.
+  if (pushed != 0 && frameBuffers[1] != nullptr) {
+    memcpy(frameBuffers[drawBuffer ^ 1], frameBuffers[drawBuffer], sizeof(StaticSprite::output_buffer));
+    drawBuffer ^= 1;
+    sprite.setBuffer(frameBuffers[drawBuffer]);
+  }
+#endif
+}
+
+void TFTs::invalidatePanels(uint8_t digitMap) {
+  validPanels &= ~digitMap;
+
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    if (digitMap & (1 << digit)) {
+      shownIcons[digit][0] = 0;
+    }
+  }
+}
 
 // These read 16- and 32-bit types from the SD card file.
 // BMP data is stored little-endian, Arduino is little-endian too.
@@ -1022,4 +2466,16 @@ uint32_t TFTs::read32(fs::File &f) {
   ((uint8_t *)&result)[3] = f.read(); // MSB
   return result;
 }
+
+uint16_t TFTs::read16(ImageReader &r) {
+  uint16_t result = 0;
+  r.read((uint8_t *)&result, sizeof(result));
+  return result;
+}
+
+uint32_t TFTs::read32(ImageReader &r) {
+  uint32_t result = 0;
+  r.read((uint8_t *)&result, sizeof(result));
+  return result;
+}
 //// END STOLEN CODE
@@ -7,6 +7,12 @@
 #include <TFT_eSPI.h>
 #include "ChipSelect.h"
 #include "DigitalRainAnimation.h"
+#include "FrameStats.h"
+#include "GlyphCache.h"
+#include "ImageReader.h"
+#ifdef GLYPH_STORE
+#include "GlyphStore.h"
+#endif
 
 #define TFT_PWM_CHANNEL 0
 #define TFT_PWM_FREQ 20000   // PWM frequency for TFT dimming (Hz)
@@ -18,6 +24,7 @@ public:
   void pushImageWithTransparency(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t transparentColor = 0);
   void pushImageWithAlpha(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint8_t *alpha, uint8_t opaque);
   void init();
+  void setBuffer(uint8_t *buffer);
 
   static uint8_t output_buffer[];
 };
@@ -33,6 +40,78 @@ struct MaskData {
   uint8_t aShift = 0;
 };
 
+struct ImageInfo {
+  int16_t w = 0;
+  int16_t h = 0;
+  uint8_t bitDepth = 16;
+  int16_t rowSize = 0;
+  bool reversed = false;  // BMP rows are usually stored bottom up
+  uint32_t start = 0;     // offset of the image in its file, non-zero when it is in an atlas
+  uint32_t dataStart = 0;
+  MaskData maskData;
+  uint32_t palette[256];
+};
+
+// Display-ready image format written by TFTs::ConvertImage(). The header is followed by w*h big-endian
+// RGB565 pixels and then, if RAW_IMAGE_ALPHA is set, w*h alpha bytes. Multi-byte header fields are little-endian.
+#define RAW_IMAGE_MAGIC 0x5247  // "GR"
+#define RAW_IMAGE_VERSION 1
+#define RAW_IMAGE_ALPHA 0x01
+#define RAW_IMAGE_HEADER_SIZE 8  // magic, version, flags, w, h
+
+// One file per cache directory holding all of its images back to back, so that drawing a digit is a seek and
+// a read instead of a path lookup, open and close. The header is followed by count AtlasEntry records, then the images.
+#define ATLAS_MAGIC 0x4147  // "GA"
+#define ATLAS_VERSION 1
+#define ATLAS_HEADER_SIZE 8  // magic, version, reserved, count, reserved
+#define ATLAS_FILE_NAME "glyphs.atlas"
+#define ATLAS_ALIGNMENT 4  // images start on a word boundary so they can be sent to the panel from mapped flash
+
+// Clock face, weather icons and slide show
+#define NUM_CACHE_DIRS 3
+
+#ifndef ATLAS_COPY_BUFFER_SIZE
+#define ATLAS_COPY_BUFFER_SIZE 4096
+#endif
+
+// Digits changed between beginUpdate() and endUpdate() are animated with this many frames, taking about this long
+#ifndef TRANSITION_FRAMES
+#define TRANSITION_FRAMES 8
+#endif
+#ifndef TRANSITION_TIME_MS
+#define TRANSITION_TIME_MS 240
+#endif
+
+// The panel is split into tiles, and only tiles whose contents changed since they were last sent to a digit are
+// pushed again. 5 x 15 tiles cover 135x240, and a row of tile columns fits in a uint16_t.
+#ifndef DIRTY_TILE_WIDTH
+#define DIRTY_TILE_WIDTH 27
+#endif
+#ifndef DIRTY_TILE_HEIGHT
+#define DIRTY_TILE_HEIGHT 16
+#endif
+#define DIRTY_TILE_COLUMNS ((TFT_WIDTH + DIRTY_TILE_WIDTH - 1) / DIRTY_TILE_WIDTH)
+#define DIRTY_TILE_ROWS ((TFT_HEIGHT + DIRTY_TILE_HEIGHT - 1) / DIRTY_TILE_HEIGHT)
+
+struct AtlasEntry {
+  char name[16];
+  uint32_t offset;  // from the start of the atlas
+  uint32_t size;
+  uint16_t w;
+  uint16_t h;
+};
+
+// Time taken to get a digit from storage onto the panel
+struct DrawTime {
+  uint32_t count = 0;
+  uint64_t totalUs = 0;
+  uint32_t lastUs = 0;
+  uint32_t maxUs = 0;
+
+  void add(uint32_t us) { count++; totalUs += us; lastUs = us; if (us > maxUs) maxUs = us; }
+  uint32_t meanUs() const { return count == 0 ? 0 : totalUs / count; }
+};
+
 class TFTs : public TFT_eSPI {
 public:
   TFTs() : TFT_eSPI(), chip_select(), enabled(false)
@@ -41,6 +120,8 @@ public:
   // no == Do not send to TFT. yes == Send to TFT if changed. force == Send to TFT.
   enum show_t { no, yes, force };
   enum image_justification_t { TOP_LEFT, TOP_CENTER, TOP_RIGHT, MIDDLE_LEFT, MIDDLE_CENTER, MIDDLE_RIGHT, BOTTOM_LEFT, BOTTOM_CENTER, BOTTOM_RIGHT };
+  // Values of the slide_transition setting
+  enum transition_t { RANDOM_TRANSITION, WIPE_TRANSITION, SLIDE_TRANSITION, CROSSFADE_TRANSITION, FLIP_TRANSITION, NO_TRANSITION };
 #ifdef TFTS_FX
   enum GRAPHICS_FX {
     NONE = 0,
@@ -52,6 +133,7 @@ public:
 #endif
   static const char* INVALID_DIGIT;
 
+  // Anyone else that claims the TFTs finishes a transition that is still being animated first
   void claim();
   void release();
 
@@ -62,17 +144,36 @@ public:
   void setDigit(uint8_t digit, const char* name, show_t show=yes);
   const char* getDigitName(uint8_t index) { return icons[index]; }
 
+  // Between these, digits are only drawn at endUpdate(), and digits that show the same image are
+  // sent to all of their displays at once.
+  void beginUpdate() { updating = true; }
+  void endUpdate() { flushUpdate(); updating = false; }
+  // How digits changed between beginUpdate() and endUpdate() go from the old image to the new one
+  void setTransition(uint8_t transition) { this->transition = transition; }
+  // endUpdate() only draws the first frame of a transition, so the TFTs aren't held for all of it.
+  // Draw the next frame once it is due, claiming the TFTs without finishing the transition. Returns
+  // the ms until the next one is due, 0 once there's nothing left to draw.
+  uint32_t stepTransition();
+  // Decode the images digits are about to show, so that drawing them later is just a copy and a push.
+  // names has one entry per digit, nullptr for no change.
+  void prefetchDigits(const char *names[NUM_DIGITS]);
+  // SPI bytes that didn't have to be sent because a frame went to several digits at once
+  uint32_t getSpiBytesSaved() { return spiBytesSaved; }
+
   void invalidateAllDigits();
+  // Send the sprite to the selected digits, skipping tiles that haven't changed since they were last sent
+  void pushSpriteToDigits(uint8_t digitMap);
 
-  void showAllDigits() { for (uint8_t digit=0; digit < NUM_DIGITS; digit++) showDigit(digit); }
-  void showDigit(uint8_t digit);
-  TFT_eSprite& drawImage(uint8_t digit);
+  void showAllDigits();
+  void showDigit(uint8_t digit) { showDigitGroup(digit, 1 << digit); }
+  TFT_eSprite& drawImage(uint8_t digit) { return drawImage(digit, 1 << digit); }
+  TFT_eSprite& drawImage(uint8_t digit, uint8_t digitMap);
   StaticSprite& getSprite();
 
   void animateRain();
 
-  void setImageJustification(image_justification_t value) { imageJustification = value; }
-  void setBox(uint16_t w, uint16_t h) { boxWidth = w; boxHeight = h; }
+  void setImageJustification(image_justification_t value) { if (value != imageJustification) flushUpdate(); imageJustification = value; }
+  void setBox(uint16_t w, uint16_t h) { if (w != boxWidth || h != boxHeight) flushUpdate(); boxWidth = w; boxHeight = h; }
   // Controls the power to all displays
   void enableAllDisplays();
   void disableAllDisplays();
@@ -93,6 +194,50 @@ public:
   uint16_t dimColor(uint16_t pixel);
   void setMonochromeColor(int color);
 
+  // Decoded glyphs are cached so that redrawing a digit doesn't have to go back to the file system
+  void flushGlyphCache(const char *dir = nullptr) { glyphCache.flush(dir); }
+  void setGlyphCacheBudget(size_t budget) { glyphCache.setBudget(budget); }
+  const GlyphCache::Stats& getGlyphCacheStats() { return glyphCache.getStats(); }
+
+  // The directory the selected face for showDigits is unpacked in. Set with the TFTs claimed.
+  void setCacheDir(uint8_t showDigits, const char *dir);
+  const char* getCacheDir(uint8_t showDigits);
+  // True if dir is the selected face for any of them, so mustn't be removed
+  bool isCacheDir(const char *dir);
+
+  // Convert a BMP or CLK image to the raw format so that it can be drawn without decoding. The raw image is
+  // written before the original is removed, and is left out if it would need more than room bytes.
+  bool ConvertImage(const char *filename, uint32_t room);
+  // Must be called before the files in a cache directory are changed
+  void closeAtlas();
+#ifdef GLYPH_STORE
+  // Copy the atlas for dir into the memory-mapped glyph store
+  bool storeGlyphs(const char *dir);
+  bool hasStoredGlyphs(const char *dir) { return glyphStore.getAtlas(dir) != nullptr; }
+#endif
+  // Digits drawn via the sprite, and straight from the glyph store
+  const DrawTime& getSpriteDrawTime() { return spriteDrawTime; }
+  const DrawTime& getStoreDrawTime() { return storeDrawTime; }
+  const FrameStats& getFrameStats() { return frameStats; }
+#ifdef BENCHMARK_IMAGE_LOAD
+  // Print the time taken to load each image in dir from the atlas and from its own file
+  void benchmarkImageLoad(const char *dir);
+#endif
+#ifdef GOLDEN_IMAGES
+  // Print a hash of the sprite after decoding each image in dir, and how long the decode took
+  void hashImages(const char *dir, const char *stage);
+  // The hash of the sprite after decoding dir/name.bmp at the current dimming and tint
+  uint32_t hashImage(const char *dir, const char *name);
+#endif
+#ifdef BENCHMARK_DECODE
+  // Print decode, dim and blend times for each bit depth
+  void benchmarkDecode();
+#endif
+#ifdef BENCHMARK_ANIMATION
+  // Print the time taken to draw a frame of the matrix animation
+  void benchmarkAnimation();
+#endif
+
 private:
   static SemaphoreHandle_t tftMutex;
 
@@ -103,12 +248,60 @@ private:
   DigitalRainAnimation& getMatrixAnimator();
 #endif
   void drawStatus();
+  void showDigitGroup(uint8_t digit, uint8_t digitMap);
+  void flushUpdate();
+
+  bool updating = false;
+  uint8_t pendingDigits = 0;
+  uint32_t spiBytesSaved = 0;
+
+  struct TransitionGroup {
+    uint8_t digit;
+    uint8_t digitMap;
+    const uint16_t *from;
+    const uint16_t *to;
+  };
+
+  uint8_t transition = NO_TRANSITION;
+  // The image on each panel, if it was drawn from one. Used as the starting point of a transition.
+  char shownIcons[NUM_DIGITS][16] = {};
+  const char *shownDirs[NUM_DIGITS] = {};
+
+  // The transition being animated. Its pixels can't be evicted, as anything else that could load an
+  // image claims the TFTs, which finishes it first.
+  TransitionGroup animating[NUM_DIGITS];
+  uint8_t animatingCount = 0;
+  uint8_t animatingType = NO_TRANSITION;
+  int animatingFrame = 0;             // the last one drawn
+  unsigned long animatingFrameMicros = 0;  // when it was started
+  // Drawn without a transition once it has finished
+  TransitionGroup after[NUM_DIGITS];
+  uint8_t afterCount = 0;
+
+  void setShown(uint8_t digit, uint8_t digitMap);
+  bool canTransition(uint8_t digit, uint8_t digitMap);
+  void showTransition(TransitionGroup *groups, uint8_t count);
+  void finishTransition();
+  void endTransition();
+  void drawTransitionFrame(const TransitionGroup &group, uint8_t type, int frame);
+  void composeFrame(uint8_t type, const uint16_t *from, const uint16_t *to, int frame, uint16_t *out);
+  const uint16_t* findFramePixels(const char *dir, const char *name);
 
   byte showDigits = 0;
   image_justification_t imageJustification = MIDDLE_CENTER;
   uint16_t boxWidth = TFT_WIDTH;
   uint16_t boxHeight = TFT_HEIGHT;
   uint8_t dimming = 255; // amount of dimming graphics
+  uint16_t dimRed[32];
+  uint16_t dimGreen[64];
+  uint16_t dimBlue[32];
+
+  void buildDimTables();
+#ifdef DIM_WITH_TFT_BACKLIGHT_PIN
+  bool pixelsNeedDimming() { return false; }
+#else
+  bool pixelsNeedDimming() { return dimming != 255; }
+#endif
   int monochromeColor = -1;
 
   unsigned long statusTime = 0;
@@ -123,13 +316,75 @@ private:
   bool enabled;
   fs::FS* fs;
 
-  bool LoadImageIntoBuffer(const char* filename);
-  bool LoadBMPImageIntoBuffer(fs::File &file);
-  bool LoadCLKImageIntoBuffer(fs::File &file);
-  bool LoadImageBytesIntoSprite(int16_t w, int16_t h, uint8_t bpp, int16_t rowSize, bool reversed, MaskData *pMaskData, uint32_t *palette, fs::File &file);
+  GlyphCache glyphCache;
+  GlyphKey loadingKey;
+
+  char cacheDirs[NUM_CACHE_DIRS][48] = {};
+  const char* getCacheDir();
+  void getImageOrigin(int16_t w, int16_t h, int16_t &x, int16_t &y);
+  void drawGlyph(Glyph *glyph);
+  void setGlyphKey(GlyphKey &key, const char *dir, const char *name);
+
+  fs::File atlasFile;
+  char atlasDir[48] = "";   // directory atlasFile belongs to, even if it doesn't have one
+  AtlasEntry *atlasIndex = nullptr;
+  uint16_t atlasCount = 0;
+
+  bool openAtlas(const char *dir);
+
+  // Hash of each tile last sent to each panel. A panel's hashes are only valid if its bit is set in validPanels.
+  uint32_t tileHashes[NUM_DIGITS][DIRTY_TILE_ROWS][DIRTY_TILE_COLUMNS];
+  uint8_t validPanels = 0;
+
+  void findDirtyTiles(uint8_t digitMap, uint16_t *dirtyColumns);
+  // Call when something is drawn on the panels without going through pushSpriteToDigits
+  void invalidatePanels(uint8_t digitMap);
+
+#ifdef USE_DMA
+  uint8_t *frameBuffers[2] = { StaticSprite::output_buffer, nullptr };
+  uint8_t drawBuffer = 0;
+  bool dmaPending = false;
+#endif
+  void waitForDMA();
+
+  DrawTime spriteDrawTime;
+  DrawTime storeDrawTime;
+  FrameStats frameStats;
+
+  void timedDrawStatus();
+#ifdef GLYPH_STORE
+  GlyphStore glyphStore;
+
+  bool pushStoredGlyph(uint8_t digit, uint8_t digitMap);
+  const uint8_t* findStoredImage(const char *dir, const char *name);
+#endif
+
+  bool LoadImageIntoBuffer(const char* dir, const char* name);
+  bool LoadAtlasImage(const char* name);
+  bool LoadFileImage(const char* dir, const char* name);
+  bool LoadImageFromFile(fs::File &file, uint32_t start);
+  bool LoadBMPImageIntoBuffer(ImageReader &file, uint32_t start);
+  bool LoadCLKImageIntoBuffer(ImageReader &file);
+  bool LoadRawImageIntoBuffer(ImageReader &file, uint32_t start);
+  bool ReadBMPHeader(ImageReader &file, ImageInfo &info);
+  bool ReadCLKHeader(ImageReader &file, ImageInfo &info);
+  void DecodeRow(const ImageInfo &info, const uint8_t *inputBuffer, uint8_t *outputBuffer, uint8_t *alphaBuffer, uint8_t opaque, int oneBitColor);
+  bool LoadImageBytesIntoSprite(const ImageInfo &info, ImageReader &file);
+  uint16_t toRGB565(uint16_t r, uint16_t g, uint16_t b, uint16_t oneBitColor);
+  void BuildPalette(const ImageInfo &info, int oneBitColor);
+  void DecodeIndexedRow(const ImageInfo &info, const uint8_t *in, uint16_t *out, uint8_t *alphaBuffer);
+
+  uint16_t rgb565Palette[256];  // palette of the image being decoded
+  uint8_t oneBitAlpha[2];
+  void dimPixels(const uint16_t *src, uint16_t *dst, size_t count);
 
   uint16_t read16(fs::File &f);
   uint32_t read32(fs::File &f);
+  uint16_t read16(ImageReader &r);
+  uint32_t read32(ImageReader &r);
+
+  // Shared by every image load, which all happen with the TFTs claimed
+  uint8_t imageReadBuffer[IMAGE_READ_BUFFER_SIZE];
 
   uint8_t FileInBuffer=255; // invalid, always load first image
   uint8_t NextFileRequired = 0; 
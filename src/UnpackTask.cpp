@@ -0,0 +1,217 @@
+#include "UnpackTask.h"
+
+void UnpackTask::begin(ImageUnpacker *unpacker, Callback onDone) {
+  this->unpacker = unpacker;
+  this->onDone = onDone;
+
+  xTaskCreatePinnedToCore(
+    taskFn,     /* Function to implement the task */
+    "Unpack task",  /* Name of the task */
+    6144,       /* Stack size in words */
+    this,       /* Task input parameter */
+    tskIDLE_PRIORITY,  /* Behind everything that keeps the clock going */
+    &task,      /* Task handle. */
+    UNPACK_TASK_CORE
+  );
+}
+
+void UnpackTask::request(uint8_t slot, const char *srcDir, const char *cacheRoot, const String &face) {
+  portENTER_CRITICAL(&lock);
+  Request &request = requests[slot];
+  strncpy(request.srcDir, srcDir, sizeof(request.srcDir) - 1);
+  request.srcDir[sizeof(request.srcDir) - 1] = 0;
+  strncpy(request.cacheRoot, cacheRoot, sizeof(request.cacheRoot) - 1);
+  request.cacheRoot[sizeof(request.cacheRoot) - 1] = 0;
+  strncpy(request.face, face.c_str(), sizeof(request.face) - 1);
+  request.face[sizeof(request.face) - 1] = 0;
+  pending |= 1 << slot;
+  done &= ~(1 << slot);
+  if (active == slot) {
+    unpacker->cancel();
+  }
+  portEXIT_CRITICAL(&lock);
+
+  xTaskNotifyGive(task);
+}
+
+bool UnpackTask::takeResult(uint8_t slot, Result &result) {
+  bool ready = false;
+
+  portENTER_CRITICAL(&lock);
+  if (done & (1 << slot)) {
+    result = results[slot];
+    done &= ~(1 << slot);
+    ready = true;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  return ready;
+}
+
+void UnpackTask::taskFn(void *arg) {
+  ((UnpackTask*)arg)->run();
+}
+
+uint32_t UnpackTask::beginUpload(const char *cacheRoot, const String &face, const String &archiveName) {
+  portENTER_CRITICAL(&lock);
+  bool busy = uploading;
+  uploading = true;
+  portEXIT_CRITICAL(&lock);
+
+  if (busy) {
+    return 0;
+  }
+
+  // The task isn't reading it until the upload is pending
+  if (!upload.begin()) {
+    portENTER_CRITICAL(&lock);
+    uploading = false;
+    portEXIT_CRITICAL(&lock);
+    return 0;
+  }
+
+  portENTER_CRITICAL(&lock);
+  strncpy(uploadRequest.cacheRoot, cacheRoot, sizeof(uploadRequest.cacheRoot) - 1);
+  uploadRequest.cacheRoot[sizeof(uploadRequest.cacheRoot) - 1] = 0;
+  strncpy(uploadRequest.face, face.c_str(), sizeof(uploadRequest.face) - 1);
+  uploadRequest.face[sizeof(uploadRequest.face) - 1] = 0;
+  strncpy(uploadArchive, archiveName.c_str(), sizeof(uploadArchive) - 1);
+  uploadArchive[sizeof(uploadArchive) - 1] = 0;
+  uploadPending = true;
+  uploadDone = false;
+  portEXIT_CRITICAL(&lock);
+
+  if (++lastOwner == 0) {
+    lastOwner = 1;
+  }
+  feeder = lastOwner;
+  xTaskNotifyGive(task);
+
+  return feeder;
+}
+
+bool UnpackTask::putUpload(uint32_t owner, const uint8_t *data, size_t len) {
+  if (owner == 0 || owner != feeder) {
+    return true;
+  }
+
+  // Waiting for room would hold up async_tcp, and every other connection with it
+  if (!upload.put(data, len, 0)) {
+    feeder = 0;
+    if (upload.isRejected()) {
+      return false;
+    }
+
+    // The archive is still saved, and is unpacked when it is selected
+    Serial.println("Unpacking couldn't keep up with the upload");
+    upload.abandon();
+  }
+
+  return true;
+}
+
+void UnpackTask::endUpload(uint32_t owner) {
+  if (owner != 0 && owner == feeder) {
+    upload.finish();
+    feeder = 0;
+  }
+}
+
+void UnpackTask::abandonUpload(uint32_t owner) {
+  if (owner != 0 && owner == feeder) {
+    upload.abandon();
+    feeder = 0;
+  }
+}
+
+bool UnpackTask::takeUploadResult(Result &result) {
+  bool ready = false;
+
+  portENTER_CRITICAL(&lock);
+  if (uploadDone) {
+    result = uploadResult;
+    uploadDone = false;
+    ready = true;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  return ready;
+}
+
+void UnpackTask::unpackUpload() {
+  Request request;
+  char archive[sizeof(uploadArchive)];
+
+  portENTER_CRITICAL(&lock);
+  request = uploadRequest;
+  strcpy(archive, uploadArchive);
+  uploadPending = false;
+  unpacker->resetCancel();
+  portEXIT_CRITICAL(&lock);
+
+  bool ok = unpacker->unpackUpload(upload, request.cacheRoot, request.face, archive);
+
+  portENTER_CRITICAL(&lock);
+  strcpy(uploadResult.face, request.face);
+  strcpy(uploadResult.cacheRoot, request.cacheRoot);
+  uploadResult.ok = ok;
+  uploadDone = true;
+  uploading = false;
+  portEXIT_CRITICAL(&lock);
+}
+
+void UnpackTask::run() {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (true) {
+      int8_t slot = -1;
+      bool uploaded = false;
+      Request request;
+
+      portENTER_CRITICAL(&lock);
+      bool haveUpload = uploadPending;
+      portEXIT_CRITICAL(&lock);
+
+      // The upload can't wait, it is arriving now
+      if (haveUpload) {
+        unpackUpload();
+        uploaded = true;
+      }
+
+      portENTER_CRITICAL(&lock);
+      for (uint8_t i = 0; !uploaded && i < NUM_SLOTS; i++) {
+        if (pending & (1 << i)) {
+          slot = i;
+          request = requests[i];
+          pending &= ~(1 << i);
+          active = i;
+          unpacker->resetCancel();
+          break;
+        }
+      }
+      portEXIT_CRITICAL(&lock);
+
+      if (slot >= 0) {
+        bool ok = unpacker->unpackFace(request.srcDir, request.cacheRoot, request.face);
+
+        portENTER_CRITICAL(&lock);
+        active = -1;
+        // If there is a newer request for the slot, this result is already out of date
+        if (!(pending & (1 << slot))) {
+          strcpy(results[slot].face, request.face);
+          strcpy(results[slot].cacheRoot, request.cacheRoot);
+          results[slot].ok = ok;
+          done |= 1 << slot;
+        }
+        portEXIT_CRITICAL(&lock);
+      } else if (!uploaded) {
+        break;
+      }
+
+      if (onDone) {
+        onDone();
+      }
+    }
+  }
+}
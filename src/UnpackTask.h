@@ -0,0 +1,97 @@
+#ifndef UNPACK_TASK_H
+#define UNPACK_TASK_H
+
+#include <Arduino.h>
+#include <functional>
+#include "ImageUnpacker.h"
+
+// Alongside the network stack, away from the render task
+#ifndef UNPACK_TASK_CORE
+#define UNPACK_TASK_CORE 0
+#endif
+
+/*
+ * Unpacks faces in the background, so the clock keeps ticking on the old face until the new one is
+ * ready. Each kind of face has a mailbox that only holds the latest request. A request that replaces
+ * the one being unpacked cancels it, rather than waiting for it to finish.
+ *
+ * An archive can also be unpacked as it is uploaded, which goes ahead of any requests.
+ */
+class UnpackTask {
+public:
+  enum Slot {
+    CLOCK_FACE = 0,
+    WEATHER_ICONS,
+    SLIDE_SHOW,
+    NUM_SLOTS
+  };
+
+  struct Result {
+    char face[32] = "";
+    char cacheRoot[24] = "";
+    bool ok = false;
+  };
+
+  typedef std::function<void()> Callback;
+
+  // onDone is called from the task whenever a result is ready
+  void begin(ImageUnpacker *unpacker, Callback onDone);
+
+  // Unpack face from srcDir into its directory under cacheRoot
+  void request(uint8_t slot, const char *srcDir, const char *cacheRoot, const String &face);
+  // True, once, when the latest request for slot has finished
+  bool takeResult(uint8_t slot, Result &result);
+
+  // Called from the web server, which mustn't block. Unpack face into cacheRoot as it is uploaded to
+  // archiveName. Returns the owner to pass to the calls below, which ignore any other owner, or 0 if
+  // another upload is still being unpacked.
+  uint32_t beginUpload(const char *cacheRoot, const String &face, const String &archiveName);
+  // The next part of the upload. False if the archive is bad, so the upload should be stopped. If the
+  // unpacker has fallen behind it stops, and the archive is unpacked when it is selected instead.
+  bool putUpload(uint32_t owner, const uint8_t *data, size_t len);
+  // Once archiveName has been closed
+  void endUpload(uint32_t owner);
+  void abandonUpload(uint32_t owner);
+  // True, once, when an upload has been unpacked or has failed
+  bool takeUploadResult(Result &result);
+
+private:
+  static void taskFn(void *arg);
+  void run();
+
+  struct Request {
+    char srcDir[24];
+    char cacheRoot[24];
+    char face[32];
+  };
+
+  TaskHandle_t task = nullptr;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+  ImageUnpacker *unpacker = nullptr;
+  Callback onDone;
+
+  // Mailboxes, guarded by lock. A bit per slot.
+  uint8_t pending = 0;
+  uint8_t done = 0;
+  int8_t active = -1;   // slot being unpacked
+  Request requests[NUM_SLOTS];
+  Result results[NUM_SLOTS];
+
+  UploadStream upload;
+  // Only used by the web server
+  uint32_t feeder = 0;    // owner of the upload being put
+  uint32_t lastOwner = 0;
+  // Guarded by lock
+  bool uploading = false; // from beginUpload() until it has been unpacked
+  bool uploadPending = false;
+  bool uploadDone = false;
+  Request uploadRequest;
+  char uploadArchive[64];
+  Result uploadResult;
+
+  void unpackUpload();
+};
+
+extern UnpackTask *unpackTask;
+
+#endif // UNPACK_TASK_H
@@ -0,0 +1,101 @@
+#include "UploadStream.h"
+
+// How often a blocked read looks to see if the upload has finished
+#define UPLOAD_STREAM_POLL_MS 100
+
+bool UploadStream::begin() {
+  if (buffer == nullptr) {
+    buffer = xStreamBufferCreate(UPLOAD_STREAM_BUFFER_SIZE, 1);
+    if (buffer == nullptr) {
+      return false;
+    }
+  }
+
+  xStreamBufferReset(buffer);
+  peeked = -1;
+  startMs = millis();
+  finished = false;
+  abandoned = false;
+  rejected = false;
+
+  return true;
+}
+
+bool UploadStream::put(const uint8_t *data, size_t len, TickType_t wait) {
+  while (len > 0 && !rejected && !abandoned) {
+    size_t sent = xStreamBufferSend(buffer, data, len, wait);
+    if (sent == 0) {
+      return false;
+    }
+    data += sent;
+    len -= sent;
+  }
+
+  return !rejected && !abandoned;
+}
+
+bool UploadStream::waitForFinish() {
+  unsigned long start = millis();
+  while (!finished && !abandoned && millis() - start < UPLOAD_STREAM_TIMEOUT_MS) {
+    delay(UPLOAD_STREAM_POLL_MS);
+  }
+
+  return finished && !abandoned;
+}
+
+/*
+ * Wait for a byte to peek at. False at the end of the upload, or if it stopped arriving.
+ */
+bool UploadStream::fill() {
+  if (peeked >= 0) {
+    return true;
+  }
+
+  unsigned long start = millis();
+  while (!abandoned && millis() - start < UPLOAD_STREAM_TIMEOUT_MS) {
+    uint8_t b;
+    if (xStreamBufferReceive(buffer, &b, 1, pdMS_TO_TICKS(UPLOAD_STREAM_POLL_MS)) == 1) {
+      peeked = b;
+      return true;
+    }
+    if (finished && xStreamBufferIsEmpty(buffer)) {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+int UploadStream::available() {
+  if (!fill()) {
+    return 0;
+  }
+
+  return 1 + xStreamBufferBytesAvailable(buffer);
+}
+
+int UploadStream::read() {
+  if (!fill()) {
+    return -1;
+  }
+
+  int b = peeked;
+  peeked = -1;
+  return b;
+}
+
+int UploadStream::peek() {
+  return fill() ? peeked : -1;
+}
+
+size_t UploadStream::readBytes(char *out, size_t length) {
+  size_t count = 0;
+
+  while (count < length && fill()) {
+    out[count++] = peeked;
+    peeked = -1;
+    count += xStreamBufferReceive(buffer, out + count, length - count, 0);
+  }
+
+  return count;
+}
@@ -0,0 +1,59 @@
+#ifndef UPLOAD_STREAM_H
+#define UPLOAD_STREAM_H
+
+#include <Arduino.h>
+#include <freertos/stream_buffer.h>
+
+#ifndef UPLOAD_STREAM_BUFFER_SIZE
+#define UPLOAD_STREAM_BUFFER_SIZE 16384
+#endif
+
+// How long the reader waits for more of the upload before giving up on it
+#ifndef UPLOAD_STREAM_TIMEOUT_MS
+#define UPLOAD_STREAM_TIMEOUT_MS 10000
+#endif
+
+/*
+ * Hands an upload over from the web server, which pushes it a chunk at a time, to something that pulls
+ * it through a Stream on another task. Reads block until there is data, or the upload has finished.
+ * The web server can't wait for room, so the buffer has to cover the reader falling behind for a while.
+ *
+ * The buffer is allocated by the first begin() and kept for the next upload.
+ */
+class UploadStream : public Stream {
+public:
+  bool begin();
+
+  // Writer side. False if the reader has given up, or it couldn't keep up for wait ticks.
+  bool put(const uint8_t *data, size_t len, TickType_t wait);
+  // Nothing more will be put()
+  void finish() { finished = true; }
+  // Stop putting, e.g. because the reader couldn't keep up
+  void abandon() { abandoned = true; }
+
+  // Reader side
+  // The upload wasn't what was expected, so the writer should stop
+  void reject() { rejected = true; }
+  bool isRejected() { return rejected; }
+  // Wait for the writer to finish, true if it did
+  bool waitForFinish();
+  unsigned long getStartMs() { return startMs; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  bool fill();
+
+  StreamBufferHandle_t buffer = nullptr;
+  int peeked = -1;
+  unsigned long startMs = 0;
+  volatile bool finished = false;
+  volatile bool abandoned = false;
+  volatile bool rejected = false;
+};
+
+#endif // UPLOAD_STREAM_H
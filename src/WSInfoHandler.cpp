@@ -29,7 +29,7 @@ void WSInfoHandler::handle(AsyncWebSocketClient *client, char *data) {
 	cbFunc();
 
 	// static Uptime uptime;
-	const size_t bufferSize = JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(30);
+	const size_t bufferSize = JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(40);
 	DynamicJsonDocument doc(bufferSize);
 	JsonObject root = doc.to<JsonObject>();
 
@@ -67,6 +67,24 @@ void WSInfoHandler::handle(AsyncWebSocketClient *client, char *data) {
 	value["sync_failed_msg"] = lastFailedMessage;
 	value["sync_failed_cnt"] = failedCount;
 
+	value["glyph_cache_hits"] = glyphCacheHits;
+	value["glyph_cache_misses"] = glyphCacheMisses;
+	value["glyph_cache_evictions"] = glyphCacheEvictions;
+	value["glyph_cache_size"] = glyphCacheSize;
+	value["digit_draw_time"] = digitDrawTime;
+	value["spi_bytes_saved"] = spiBytesSaved;
+	value["image_read_rate"] = imageReadRate;
+	value["tick_jitter"] = tickJitter;
+	value["tick_phase_error"] = tickPhaseError;
+	value["clock_task_wakeups"] = clockTaskWakeups;
+	value["clock_task_cpu"] = clockTaskCpu;
+	value["render_commands"] = renderCommands;
+	value["frame_stats_time"] = frameStatsTime;
+	value["frame_stats_date"] = frameStatsDate;
+	value["frame_stats_weather"] = frameStatsWeather;
+	value["frame_stats_slideshow"] = frameStatsSlideshow;
+	value["last_unpack"] = lastUnpack;
+
 	// if (pBlankingMonitor) {
 	// 	value["on_time"] = pBlankingMonitor->onTime();
 	// 	value["off_time"] = pBlankingMonitor->offTime();
@@ -70,6 +70,74 @@ public:
 		this->description = description;
 	}
 
+	void setGlyphCacheHits(const String& glyphCacheHits) {
+		this->glyphCacheHits = glyphCacheHits;
+	}
+
+	void setGlyphCacheMisses(const String& glyphCacheMisses) {
+		this->glyphCacheMisses = glyphCacheMisses;
+	}
+
+	void setGlyphCacheEvictions(const String& glyphCacheEvictions) {
+		this->glyphCacheEvictions = glyphCacheEvictions;
+	}
+
+	void setGlyphCacheSize(const String& glyphCacheSize) {
+		this->glyphCacheSize = glyphCacheSize;
+	}
+
+	void setDigitDrawTime(const String& digitDrawTime) {
+		this->digitDrawTime = digitDrawTime;
+	}
+
+	void setSpiBytesSaved(const String& spiBytesSaved) {
+		this->spiBytesSaved = spiBytesSaved;
+	}
+
+	void setImageReadRate(const String& imageReadRate) {
+		this->imageReadRate = imageReadRate;
+	}
+
+	void setTickJitter(const String& tickJitter) {
+		this->tickJitter = tickJitter;
+	}
+
+	void setTickPhaseError(const String& tickPhaseError) {
+		this->tickPhaseError = tickPhaseError;
+	}
+
+	void setClockTaskWakeups(const String& clockTaskWakeups) {
+		this->clockTaskWakeups = clockTaskWakeups;
+	}
+
+	void setClockTaskCpu(const String& clockTaskCpu) {
+		this->clockTaskCpu = clockTaskCpu;
+	}
+
+	void setRenderCommands(const String& renderCommands) {
+		this->renderCommands = renderCommands;
+	}
+
+	void setFrameStatsTime(const String& frameStatsTime) {
+		this->frameStatsTime = frameStatsTime;
+	}
+
+	void setFrameStatsDate(const String& frameStatsDate) {
+		this->frameStatsDate = frameStatsDate;
+	}
+
+	void setFrameStatsWeather(const String& frameStatsWeather) {
+		this->frameStatsWeather = frameStatsWeather;
+	}
+
+	void setFrameStatsSlideshow(const String& frameStatsSlideshow) {
+		this->frameStatsSlideshow = frameStatsSlideshow;
+	}
+
+	void setLastUnpack(const String& lastUnpack) {
+		this->lastUnpack = lastUnpack;
+	}
+
 private:
 	CbFunc cbFunc;
 
@@ -87,6 +155,23 @@ private:
 	String revision;
 	String description;
 	String uptime;
+	String glyphCacheHits;
+	String glyphCacheMisses;
+	String glyphCacheEvictions;
+	String glyphCacheSize;
+	String digitDrawTime;
+	String spiBytesSaved;
+	String imageReadRate;
+	String tickJitter;
+	String tickPhaseError;
+	String clockTaskWakeups;
+	String clockTaskCpu;
+	String renderCommands;
+	String frameStatsTime;
+	String frameStatsDate;
+	String frameStatsWeather;
+	String frameStatsSlideshow;
+	String lastUnpack;
 };
 
 
@@ -4,6 +4,8 @@
 #include "weather.h"
 #include "ColorConversion.h"
 #include "IPSClock.h"
+#include "RenderTask.h"
+#include "UnpackTask.h"
 
 #include <math.h>
 
@@ -12,7 +14,8 @@ extern void broadcastFSChange();
 
 Weather::Weather(WeatherService *weatherService) {
     this->weatherService = weatherService;
-    oldIcons = getIconPack().value;
+    // Nothing is selected until checkIconPack() has found the icons, or unpacked them
+    oldIcons = "";
 	displayTimer.init(millis(), 0);
 }
 
@@ -22,108 +25,29 @@ void drawCross(int x, int y, unsigned int color)
 
 const int tzOffset = -18000;
 
-void Weather::drawDisplay(int index, int display, bool showDay) {
-    if (!tfts->isEnabled() || IPSClock::getCustomData().value.length() > 0) {
+/*
+ * The tile for day index of the forecast, 5 being today, copied out so that the render task can draw it
+ * while the forecast is being fetched again.
+ */
+void Weather::addTile(RenderTask::WeatherFrame &frame, int index, int display, bool showDay) {
+    if (IPSClock::getCustomData().value.length() > 0) {
         return;
     }
-    
-    char txt[10];
-
-    // Load 'space' glyph if any
-    tfts->setShowDigits(IPSClock::TIME);
-    tfts->setImageJustification(TFTs::MIDDLE_CENTER);
-    tfts->setDigit(SECONDS_ONES, "space", TFTs::no);
-    TFT_eSprite &sprite = tfts->drawImage(SECONDS_ONES);
-    tfts->setShowDigits(IPSClock::WEATHER);
-
-    tfts->setImageJustification(TFTs::TOP_CENTER);
-    tfts->setBox(128, 128);
-
-    uint16_t rgb565 = hsv2rgb565(getWeatherHue(), getWeatherSaturation(), getWeatherValue());
-
-    uint16_t TEMP_COLOR = tfts->dimColor(rgb565);
-    uint16_t HILO_COLOR = TEMP_COLOR;
-    uint16_t DAY_FG_COLOR = tfts->dimColor(TFT_GOLD);
-    uint16_t DAY_BG_COLOR = tfts->dimColor(TFT_RED);
-	tfts->setMonochromeColor(rgb565);
-
-    tfts->setDigit(indexToScreen[display], weatherService->getIconName(index).c_str(), TFTs::no);
-    tfts->drawImage(indexToScreen[display]);
-
-    float val = NAN;
-
-    if (index == 5) {
-        sprite.setTextColor(TEMP_COLOR);
-        sprite.setTextFont(6);
-        sprite.setTextDatum(BC_DATUM);
-        val = weatherService->getNowTemp();
-        if (isnan(val)) {
-            strcpy(txt, "--");
-        } else {
-            sprintf(txt, "%.0f", round(val));
-        }
-        sprite.drawString(txt, sprite.width()/2, sprite.height()*3/4 - 2);
-    }
-
-    sprite.setTextFont(4);
-
-    int baseline = sprite.height()-30;
-    int arrowHeight = 10, arrowWidth = 10;
-    int arrowPadding = 2;
-    int tempInset=10;
-    int textHeight = sprite.fontHeight();
-    int arrowTop = baseline - textHeight + 2;
-
-    sprite.setTextColor(HILO_COLOR);
-
-    sprite.setTextDatum(BL_DATUM);
-    val = round(weatherService->getHigh(index));
-    if (isnan(val)) {
-        strcpy(txt, "--");
-    } else {
-        sprintf(txt, "%.0f", round(val));
-    }
-    sprite.drawString(txt, tempInset + arrowWidth + arrowPadding, baseline);
-
-    // Draw up-arrow
-    sprite.fillTriangle(tempInset, arrowTop+arrowHeight,     // bottom left
-                tempInset+arrowWidth, arrowTop+arrowHeight,  // bottom right
-                tempInset+arrowWidth/2, arrowTop,            // top-center
-                TEMP_COLOR);
-
-
-    val = round(weatherService->getLow(index));
-    if (isnan(val)) {
-        strcpy(txt, "--");
-    } else {
-        sprintf(txt, "%.0f", round(val));
-    }
-    int textWidth=sprite.textWidth(txt, 4);
-    sprite.setTextDatum(BL_DATUM);
-    sprite.drawString(txt, sprite.width() - tempInset - textWidth, baseline);
-
-    // Draw down-arrow
-    int arrowLeft = sprite.width() - tempInset - textWidth - arrowPadding - arrowWidth;
-
-    sprite.fillTriangle(arrowLeft, arrowTop,        // top left
-            arrowLeft + arrowWidth, arrowTop,       // top right
-            arrowLeft + arrowWidth/2, arrowTop+arrowHeight, // bottom center
-            TEMP_COLOR);
 
+    RenderTask::WeatherTile tile;
+    strncpy(tile.icon, weatherService->getIconName(index).c_str(), sizeof(tile.icon) - 1);
+    tile.high = weatherService->getHigh(index);
+    tile.low = weatherService->getLow(index);
+    tile.showNow = index == 5;
+    tile.now = weatherService->getNowTemp();
+    tile.labelOnBar = showDay;
 
     if (showDay) {
-        sprite.setTextDatum(BC_DATUM);
-        sprite.fillRect(0, sprite.height() - 26, sprite.width(), 26, DAY_BG_COLOR);
-        sprite.setTextColor(DAY_FG_COLOR);
-        if (index == 5)     // today
-            sprite.drawString("Today", sprite.width()/2, sprite.height() + 2);
-        else {
+        if (index == 5) {    // today
+            strcpy(tile.label, "Today");
+        } else {
             int dow = weatherService->getDayOfWeek(index);
-            if (dow >= 0) {
-                sprite.drawString(daysOfWeek[weatherService->getDayOfWeek(index)], sprite.width()/2, sprite.height() + 2);
-            } else {
-                sprite.drawString("Unknown", sprite.width()/2, sprite.height() + 2);
-            }
+            strcpy(tile.label, dow >= 0 ? daysOfWeek[dow] : "Unknown");
         }
     } else {
         struct tm now;
@@ -147,52 +71,56 @@ void Weather::drawDisplay(int index, int display, bool showDay) {
             break;
         }
 
-        sprintf(txt, "%02d-%02d-%02d", day, month, year);
-
-        sprite.setTextDatum(BC_DATUM);
-
-        sprite.drawString(txt, sprite.width()/2, sprite.height()-4);
+        snprintf(tile.label, sizeof(tile.label), "%02d-%02d-%02d", day, month, year);
     }
 
-    sprite.pushSprite(0, 0);
+    frame.setTile(indexToScreen[display], tile);
 }
 
 void Weather::drawSingleDay(uint8_t dimming, int day, int display) {
-    unsigned long nowMs = millis();
-
-    if (preDraw(dimming)) {
+    if (drawDue()) {
+        RenderTask::WeatherFrame frame;
+        startFrame(frame, dimming);
         // day is indexed from 0 thru 5 with 0 being today
-        drawDisplay(5-day, display, false);
-
-        postDraw();
+        addTile(frame, 5-day, display, false);
+        renderTask->postWeather(frame);
     }
 }
 
+/*
+ * New icons are unpacked in the background, and the old ones stay up until they are ready
+ */
 void Weather::checkIconPack() {
-    if (getIconPack().value != oldIcons) {
-        getIconPack() = imageUnpacker->unpackImages("/ips/weather/", "/ips/weather_cache", getIconPack(), oldIcons);
+    if (getIconPack().value != requestedIcons) {
+        requestedIcons = getIconPack().value;
+        unpackTask->request(UnpackTask::WEATHER_ICONS, "/ips/weather/", "/ips/weather_cache", requestedIcons);
+    }
+
+    UnpackTask::Result result;
+    if (unpackTask->takeResult(UnpackTask::WEATHER_ICONS, result)) {
+        if (result.ok) {
+            oldIcons = result.face;
+            tfts->claim();
+            tfts->setCacheDir(IPSClock::WEATHER, ImageUnpacker::faceDir("/ips/weather_cache", oldIcons).c_str());
+            tfts->invalidateAllDigits();
+            tfts->release();
+            _redraw = true;
+        } else if (oldIcons.length() > 0) {
+            renderTask->postStatus("Reverting!");
+            getIconPack() = oldIcons;
+            requestedIcons = oldIcons;
+        }
 		getIconPack().put();
 		broadcastUpdate(getIconPack());
         broadcastFSChange();
-        oldIcons = getIconPack();
-        tfts->claim();
-        tfts->invalidateAllDigits();
-        tfts->release();
-        _redraw = true;
     }
 }
 
-bool Weather::preDraw(uint8_t dimming) {
+bool Weather::drawDue() {
     unsigned long nowMs = millis();
 
     if (_redraw || displayTimer.expired(nowMs)) {
         _redraw = false;
-
-        tfts->claim();
-    	tfts->setShowDigits(IPSClock::WEATHER);
-        // tfts->invalidateAllDigits();
-        tfts->setDimming(dimming);
-
         displayTimer.init(nowMs, 10000);
 
         return true;
@@ -201,20 +129,24 @@ bool Weather::preDraw(uint8_t dimming) {
     return false;
 }
 
-void Weather::postDraw() {
-    tfts->release();
+void Weather::startFrame(RenderTask::WeatherFrame &frame, uint8_t dimming) {
+    frame.showDigits = IPSClock::WEATHER;
+    // The "space" from the clock face is drawn behind each tile
+    frame.backgroundShowDigits = IPSClock::TIME;
+    frame.dimming = dimming;
+    frame.color = hsv2rgb565(getWeatherHue(), getWeatherSaturation(), getWeatherValue());
 }
 
 void Weather::loop(uint8_t dimming) {
-    if (preDraw(dimming)) {
-        tfts->checkStatus();
-        tfts->enableAllDisplays();
+    if (drawDue()) {
+        RenderTask::WeatherFrame frame;
+        startFrame(frame, dimming);
+        frame.allDigits = true;
 
         for (int i=0; i<6; i++) {
-            drawDisplay(i, i);
+            addTile(frame, i, i);
         }
 
-        postDraw();
+        renderTask->postWeather(frame);
    }
 }
-
@@ -18,5 +18,7 @@ public:
     virtual float           getLow(int day) = 0;
     virtual int             getDayOfWeek(int day) = 0;
     virtual float           getNowTemp() = 0;
+    // Make what getWeatherInfo() fetched visible to the getters above. Nothing should be reading them.
+    virtual void            commit() = 0;
 };
 #endif
\ No newline at end of file
@@ -28,8 +28,12 @@
 #include "weather.h"
 #include "ScreenSaver.h"
 #include "mqttBroker.h"
+#include "ConfigJson.h"
 #include "IRAMPtrArray.h"
 #include "Uptime.h"
+#include "Scheduler.h"
+#include "RenderTask.h"
+#include "UnpackTask.h"
 
 //#define DEBUG(...) { Serial.println(__VA_ARGS__); }
 #ifndef DEBUG
@@ -73,18 +77,22 @@ void setWiFiAP(bool on);
 void infoCallback();
 String wifiCallback();
 String clockFacesCallback();
+String residentFacesCallback();
+String cacheRoot(const String &fileSet);
 void broadcastUpdate(String msg);
 void broadcastUpdate(const BaseConfigItem& item);
 void setFace(const char *menuLabel);
 void initFacesMenu();
 
 TFTs *tfts = NULL;
+RenderTask *renderTask = NULL;
 eSPIMenu::Menu *menu;
 Backlights *backlights = NULL;
 IPSClock *ipsClock = NULL;
 Weather *weather = NULL;
 WeatherService *weatherService = NULL;
 ImageUnpacker *imageUnpacker = NULL;
+UnpackTask *unpackTask = NULL;
 
 ScreenSaver *screenSaver;
 
@@ -126,6 +134,7 @@ SemaphoreHandle_t wsMutex;
 SemaphoreHandle_t memMutex;
 QueueHandle_t weatherQueue;
 QueueHandle_t mainQueue;
+Scheduler clockScheduler;
 
 AsyncWiFiManagerParameter *hostnameParam;
 String ssid("EleksTubeIPS");
@@ -157,6 +166,15 @@ enum MAIN_MESSAGE {
 	MQTT_PUBLISH = 1
 };
 
+// Events the clock task's scheduler waits for, as well as DISPLAY_TICK_NOTIFY_BIT
+enum CLOCK_EVENT {
+	QUEUE_EVENT = (1 << 1),		// Something was put on mainQueue
+	CONFIG_EVENT = (1 << 2),	// Something that changes what is displayed
+	BUTTON_EVENT = (1 << 3),	// A button changed state
+	UNPACK_EVENT = (1 << 4),	// The unpack task has finished with a face
+	MENU_EVENT = (1 << 5)		// The render task has the face chosen from the menu
+};
+
 // Clock config
 IRAMPtrArray<BaseConfigItem*> clockSet {
 	// Clock
@@ -191,7 +209,8 @@ CompositeConfigItem ledConfig("leds", 0, ledSet);
 // Allocate these on the heap to save some dram space
 StringConfigItem *fileSet = new StringConfigItem("file_set", 10, "faces");
 StringConfigItem *slidesSet = new StringConfigItem("slide_show", 25, "anime_female");
-String *oldSlidesSet = new String("anime_female");
+String *oldSlidesSet = new String("");		// showing
+String *requestedSlidesSet = new String("");	// being unpacked, or the same as oldSlidesSet
 
 IRAMPtrArray<BaseConfigItem*> faceSet {
 	// Faces
@@ -199,6 +218,7 @@ IRAMPtrArray<BaseConfigItem*> faceSet {
 	&Weather::getIconPack(),
 	slidesSet,
 	fileSet,
+	&ImageUnpacker::getCacheReserve(),
 	0
 };
 CompositeConfigItem facesConfig("faces", 0, faceSet);
@@ -268,7 +288,7 @@ EEPROMConfig config(rootConfig);
 
 void asyncTimeSetCallback(String time) {
 	DEBUG(time);
-	tfts->setStatus("NTP time received...");
+	renderTask->postStatus("NTP time received...");
 #ifndef DS1302
 	rtcTimeSync->enabled(false);
 	rtcTimeSync->setDevice();
@@ -304,7 +324,8 @@ void onWeatherConfigChanged(ConfigItem<String> &item) {
 
 void broadcastFSChange() {
 	String freeSpace = String(LittleFS.totalBytes() - LittleFS.usedBytes());
-	String msg = "{\"type\":\"sv.update\",\"value\":{\"fs_free\":" + freeSpace + ",\"fs_size\":" + String(LittleFS.totalBytes()) + "}}";
+	String msg = "{\"type\":\"sv.update\",\"value\":{\"fs_free\":" + freeSpace + ",\"fs_size\":" + String(LittleFS.totalBytes())
+		+ "," + residentFacesCallback() + "}}";
 	broadcastUpdate(msg);
 }
 
@@ -329,23 +350,34 @@ void onMatrixHueChanged(ConfigItem<int> &item) {
 }
 
 void onDisplayChanged(ConfigItem<int> &item) {
-	tfts->invalidateAllDigits();
+	renderTask->postInvalidate();
 
 	weather->redraw();
+	clockScheduler.signal(CONFIG_EVENT);
 }
 
 void onBrightnessChanged(ConfigItem<byte> &item) {
 	weather->redraw();
+	clockScheduler.signal(CONFIG_EVENT);
 }
 
 template <class T>
 void onWeatherColorChanged(ConfigItem<T> &item) {
 	weather->redraw();
+	clockScheduler.signal(CONFIG_EVENT);
 }
 
 bool menuDrawn = false;
 
 void onButtonEvent(const Button *button, Button::Event evt) {
+	if (evt == Button::double_clicked) {
+		// Nothing uses these yet, and the second click has already been reported on its own
+		return;
+	}
+
+	// Whatever happens below, the display will need updating
+	clockScheduler.signal(CONFIG_EVENT);
+
 	// Any event will reset the screensaver timer, which will turn it off if it was visible
 	bool screenSaverWasOn = screenSaver->reset();
 
@@ -372,25 +404,21 @@ void onButtonEvent(const Button *button, Button::Event evt) {
 	// ... like the menu
 #ifdef BUTTON_MENU_PINS
 	if (button == rightButton && evt == Button::button_clicked && menuDrawn) {
-		menu->down();
-		tfts->getSprite().pushSprite(0, 0);
+		renderTask->postMenuMove(1);
 	}
 
 	if (button == leftButton && evt == Button::button_clicked  && menuDrawn) {
-		menu->up();
-		tfts->getSprite().pushSprite(0, 0);
+		renderTask->postMenuMove(-1);
 	}
 
 	if (button == modeButton) {
 		if (evt == Button::long_press) {
 			if (!menuDrawn) {
-				tfts->clear();
-				initFacesMenu();
-				menu->show();
-				tfts->getSprite().pushSprite(0, 0);
+				renderTask->discardDigits();
+				renderTask->postMenuShow();
 				menuDrawn = true;
 			} else {
-				tfts->invalidateAllDigits();
+				renderTask->postInvalidate();
 				menuDrawn = false;
 				weather->redraw();
 			}
@@ -398,9 +426,8 @@ void onButtonEvent(const Button *button, Button::Event evt) {
 
 		if (evt == Button::button_clicked) {
 			if (menuDrawn) {
-				setFace(menu->getSelectedText());
-				tfts->fillScreen(TFT_BLACK);
-				tfts->invalidateAllDigits();
+				// The render task moves the selection, so it says what was chosen once it has caught up
+				renderTask->postMenuHide(true);
 				menuDrawn = false;
 				weather->redraw();
 			} else {
@@ -411,7 +438,7 @@ void onButtonEvent(const Button *button, Button::Event evt) {
 				dateOrTime.put();
 				broadcastUpdate(dateOrTime);
 				dateOrTime.notify();
-				tfts->invalidateAllDigits();
+				renderTask->postInvalidate();
 			}
 		}
 	}
@@ -432,25 +459,176 @@ void onButtonEvent(const Button *button, Button::Event evt) {
 		dateOrTime.put();
 		broadcastUpdate(dateOrTime);
 		dateOrTime.notify();
-		tfts->invalidateAllDigits();
+		renderTask->postInvalidate();
 #endif
 	}
 #endif
 }
 
-#define DEFAULT_MAIN_SLEEP (pdMS_TO_TICKS(1))
+// How often the clock task jobs run when nothing wakes them sooner
+#define DISPLAY_PERIOD_MS 1000
+#define ICON_PACK_PERIOD_MS 1000
+#define MQTT_PERIOD_MS 2000
+#define MQTT_DIAGNOSTICS_PERIOD_MS 60000
+#define UPTIME_PERIOD_MS 1000
 
+// The render task draws each frame when it is ready, until something else is posted
 void runMatrixAnimation() {
-	tfts->setShowDigits(IPSClock::getTimeOrDate());
-	tfts->setDimming(ipsClock->getBrightness());
-	tfts->animateRain();
-	tfts->invalidateAllDigits();
+	renderTask->postAnimation(IPSClock::getTimeOrDate(), ipsClock->getBrightness());
+}
+
+void postToClockTask(uint32_t msg) {
+	xQueueSend(mainQueue, &msg, pdMS_TO_TICKS(100));
+	clockScheduler.signal(QUEUE_EVENT);
+}
+
+void readMainQueue() {
+	uint32_t value;
+	while(xQueueReceive(mainQueue, &value, 0) == pdTRUE) {
+		if (value == MQTT_PUBLISH) {
+			mqttBroker->publishState();
+		}
+		DEBUG("Clock task getting right to it");
+	}
+}
+
+void IRAM_ATTR onButtonEdge() {
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	clockScheduler.signalFromISR(BUTTON_EVENT, &higherPriorityTaskWoken);
+	if (higherPriorityTaskWoken) {
+		portYIELD_FROM_ISR();
+	}
+}
+
+uint8_t buttonJob;
+
+void readButtons() {
+	uint32_t untilUs = UINT32_MAX;
+
+#ifdef BUTTON_MENU_PINS
+	leftButton->getEvent();
+	rightButton->getEvent();
+	modeButton->getEvent();
+	untilUs = std::min(untilUs, leftButton->usUntilUpdate());
+	untilUs = std::min(untilUs, rightButton->usUntilUpdate());
+	untilUs = std::min(untilUs, modeButton->usUntilUpdate());
+#endif
+#ifdef BUTTON_POWER_PIN
+	powerButton->getEvent();
+	untilUs = std::min(untilUs, powerButton->usUntilUpdate());
+#endif
+
+	// Edges wake the job. It only needs a timer to see a bounce settle or a press become a long one.
+	clockScheduler.setPeriod(buttonJob, untilUs == UINT32_MAX ? 0 : untilUs / 1000 + 1);
+}
+
+void checkIconPacks() {
+	if (menuDrawn) {
+		return;
+	}
+
+	char face[32];
+	if (renderTask->takeMenuChoice(face, sizeof(face))) {
+		setFace(face);
+		weather->redraw();
+	}
+
+	// New slides are unpacked in the background, and the old ones stay up until they are ready
+	if (slidesSet->value != *requestedSlidesSet) {
+		*requestedSlidesSet = slidesSet->value;
+		unpackTask->request(UnpackTask::SLIDE_SHOW, "/ips/slides/", "/ips/slides_cache", *requestedSlidesSet);
+	}
+
+	UnpackTask::Result result;
+	if (unpackTask->takeUploadResult(result)) {
+		// Draw it again if it has just replaced what is showing
+		if (result.ok && tfts->isCacheDir(ImageUnpacker::faceDir(result.cacheRoot, result.face).c_str())) {
+			tfts->claim();
+			tfts->invalidateAllDigits();
+			tfts->release();
+			weather->redraw();
+		}
+		broadcastFSChange();
+	}
+
+	if (unpackTask->takeResult(UnpackTask::SLIDE_SHOW, result)) {
+		if (result.ok) {
+			*oldSlidesSet = result.face;
+			tfts->claim();
+			tfts->setCacheDir(IPSClock::SLIDE_SHOW, ImageUnpacker::faceDir("/ips/slides_cache", *oldSlidesSet).c_str());
+			tfts->invalidateAllDigits();
+			tfts->release();
+		} else if (oldSlidesSet->length() > 0) {
+			renderTask->postStatus("Reverting!");
+			slidesSet->value = *oldSlidesSet;
+			*requestedSlidesSet = *oldSlidesSet;
+		}
+		slidesSet->put();
+		broadcastUpdate(*slidesSet);
+		broadcastFSChange();
+	}
+	weather->checkIconPack();
+	ipsClock->checkIconPack();
+}
+
+void updateDisplay() {
+	if (menuDrawn) {
+		return;
+	}
+
+	ipsClock->setBrightness(ipsClock->getBrightnessConfig());
+
+	if ((ipsClock->getDimming() == IPSClock::MATRIX) && !ipsClock->clockOn()) {
+		runMatrixAnimation();
+	} else if (ipsClock->clockOn() && screenSaver->isOn()) {
+		switch(ScreenSaver::getScreenSaver()) {
+			case ScreenSaver::BLANK:
+				renderTask->discardDigits();
+				tfts->claim();
+				tfts->disableAllDisplays();
+				tfts->release();
+				break;
+			default:
+				runMatrixAnimation();
+				break;
+		}
+	} else {
+		switch (IPSClock::getTimeOrDate().value) {
+			case IPSClock::WEATHER:
+				renderTask->discardDigits();
+				if (ipsClock->clockOn() || (ipsClock->getDimming() == IPSClock::DIM)) {
+					// The forecast mustn't change while it is being copied for the render task
+					xSemaphoreTake(memMutex, portMAX_DELAY);
+					weather->loop(ipsClock->getBrightness());
+					xSemaphoreGive(memMutex);
+				} else {
+					tfts->claim();
+					tfts->disableAllDisplays();
+					tfts->release();
+				}
+				break;
+			case IPSClock::SLIDE_SHOW:
+				// drop through
+			default:
+				if (timeSync->initialized() || rtcTimeSync->initialized()) {
+					ipsClock->loop();
+					if (ipsClock->getFourDigitDisplay() == IPSClock::FOUR_WITH_WEATHER && IPSClock::getTimeOrDate().value == IPSClock::TIME) {
+						xSemaphoreTake(memMutex, portMAX_DELAY);
+						weather->drawSingleDay(ipsClock->getBrightness(), 0, 0);
+						xSemaphoreGive(memMutex);
+					}
+				}
+				break;
+		}
+	}
 }
 
 void clockTaskFn(void *pArg) {
-	TickType_t toSleep = DEFAULT_MAIN_SLEEP;
+	clockScheduler.begin(xTaskGetCurrentTaskHandle());
 
 	imageUnpacker = new ImageUnpacker();
+	unpackTask = new UnpackTask();
+	unpackTask->begin(imageUnpacker, []() { clockScheduler.signal(UNPACK_EVENT); });
 
 	weatherService = new OpenWeatherMapWeatherService();
 	WeatherService::getLatitude().setCallback(onWeatherConfigChanged);
@@ -459,7 +637,6 @@ void clockTaskFn(void *pArg) {
 	WeatherService::getUnits().setCallback(onWeatherConfigChanged);
 
 	weather = new Weather(weatherService);
-	weather->setImageUnpacker(imageUnpacker);
 	weather->setTimeSync(timeSync);
 	Weather::getWeatherHue().setCallback(onWeatherColorChanged);
 	Weather::getWeatherSaturation().setCallback(onWeatherColorChanged);
@@ -471,13 +648,10 @@ void clockTaskFn(void *pArg) {
 
 	ipsClock = new IPSClock();
 	ipsClock->init();
-	ipsClock->setImageUnpacker(imageUnpacker);
 	ipsClock->setTimeSync(timeSync);
 	ipsClock->getTimeOrDate().setCallback(onDisplayChanged);
 	ipsClock->getBrightnessConfig().setCallback(onBrightnessChanged);
 
-	*oldSlidesSet = slidesSet->value;
-
 	screenSaver = new ScreenSaver();
 
 #ifdef BUTTON_MENU_PINS
@@ -488,98 +662,39 @@ void clockTaskFn(void *pArg) {
 	leftButton->setCallback(onButtonEvent);
 	modeButton->setCallback(onButtonEvent);
 	rightButton->setCallback(onButtonEvent);
+
+	leftButton->setEdgeCallback(onButtonEdge);
+	modeButton->setEdgeCallback(onButtonEdge);
+	rightButton->setEdgeCallback(onButtonEdge);
 #endif
 #ifdef BUTTON_POWER_PIN
 	powerButton = new GPIOButton(BUTTON_POWER_PIN, false);
 
 	powerButton->setCallback(onButtonEvent);
+	powerButton->setEdgeCallback(onButtonEdge);
 #endif
 
 	screenSaver->reset();
 
 	mqttBroker->init(ssid);
 
-	while (true) {
-		uint32_t value;
-		while(xQueueReceive(mainQueue, &value, toSleep) == pdTRUE) {
-			if (value == MQTT_PUBLISH) {
-				mqttBroker->publishState();
-			}
-			DEBUG("Clock task getting right to it");
-		}
-
-		uptime.loop();
-
-#ifdef BUTTON_MENU_PINS
-		leftButton->getEvent();
-		rightButton->getEvent();
-		modeButton->getEvent();
+	// In the order they should run when they are due at the same time
+	clockScheduler.add("queue", readMainQueue, 0, QUEUE_EVENT);
+	clockScheduler.add("uptime", []() { uptime.loop(); }, UPTIME_PERIOD_MS);
+#if defined(BUTTON_MENU_PINS) || defined(BUTTON_POWER_PIN)
+	buttonJob = clockScheduler.add("buttons", readButtons, 0, BUTTON_EVENT);
 #endif
-#ifdef BUTTON_POWER_PIN
-		powerButton->getEvent();
-#endif
-		tfts->checkStatus();
-
-		if (menuDrawn) {
-			continue;
-		}
+	clockScheduler.add("icon packs", checkIconPacks, ICON_PACK_PERIOD_MS, QUEUE_EVENT | CONFIG_EVENT | UNPACK_EVENT | MENU_EVENT);
+	clockScheduler.add("display", updateDisplay, DISPLAY_PERIOD_MS, DISPLAY_TICK_NOTIFY_BIT | QUEUE_EVENT | CONFIG_EVENT);
+	clockScheduler.add("mqtt", []() { mqttBroker->checkConnection(); }, MQTT_PERIOD_MS);
+	clockScheduler.add("diagnostics", []() { mqttBroker->publishDiagnostics(); }, MQTT_DIAGNOSTICS_PERIOD_MS);
 
-		ipsClock->setBrightness(ipsClock->getBrightnessConfig());
-
-		if ((ipsClock->getDimming() == IPSClock::MATRIX) && !ipsClock->clockOn()) {
-			runMatrixAnimation();
-		} else if (ipsClock->clockOn() && screenSaver->isOn()) {
-			switch(ScreenSaver::getScreenSaver()) {
-				case ScreenSaver::BLANK:
-					tfts->disableAllDisplays();
-					break;
-				default:
-					runMatrixAnimation();
-					break;
-			}
-		} else {
-			// Memory is an issue if one of the below decides to unpack a .gz.tar file
-			// and the weather task decides to retrieve the forecast at the same time
-			xSemaphoreTake(memMutex, portMAX_DELAY);
-
-			tfts->setShowDigits(IPSClock::getTimeOrDate());
-			if (slidesSet->value != *oldSlidesSet) {
-				slidesSet->value = imageUnpacker->unpackImages("/ips/slides/", "/ips/slides_cache", *slidesSet, *oldSlidesSet);
-				slidesSet->put();
-				broadcastUpdate(*slidesSet);
-				broadcastFSChange();
-				*oldSlidesSet = slidesSet->value;
-				tfts->claim();
-				tfts->invalidateAllDigits();
-				tfts->release();
-			}
-			weather->checkIconPack();
-			ipsClock->checkIconPack();
-
-			switch (IPSClock::getTimeOrDate().value) {
-				case IPSClock::WEATHER:
-					if (ipsClock->clockOn() || (ipsClock->getDimming() == IPSClock::DIM)) {
-						weather->loop(ipsClock->getBrightness());
-					} else {
-						tfts->disableAllDisplays();
-					}
-					break;
-				case IPSClock::SLIDE_SHOW:
-					// drop through
-				default:
-					if (timeSync->initialized() || rtcTimeSync->initialized()) {
-						ipsClock->loop();
-						if (ipsClock->getFourDigitDisplay() == IPSClock::FOUR_WITH_WEATHER && IPSClock::getTimeOrDate().value == IPSClock::TIME) {
-							weather->drawSingleDay(ipsClock->getBrightness(), 0, 0);
-						}
-					}
-					break;
-			}
-
-			xSemaphoreGive(memMutex);
-		}
+#ifdef BENCHMARK_JSON
+	benchmarkJson(rootConfig, mqttBroker->getVolatileState());
+#endif
 
-		mqttBroker->checkConnection();
+	while (true) {
+		clockScheduler.loop();
 	}
 }
 
@@ -610,15 +725,23 @@ void weatherTaskFn(void *pArg) {
 
 		toSleep = DEFAULT_WEATHER_SLEEP;
 		if ((WiFi.status() == WL_CONNECTED) && !wifiManager->isAP()) {
-			// Memory is an issue if the clock task decides to unpack a .gz.tar file
-			// and this task tries to retrieve the forecast at the same time
-			xSemaphoreTake(memMutex, portMAX_DELAY);
+#ifdef BENCHMARK_WEATHER
+			static bool benchmarked = false;
+			if (!benchmarked) {
+				benchmarked = true;
+				((OpenWeatherMapWeatherService*)weatherService)->benchmark();
+			}
+#endif
+			// The forecast is read a value at a time, so this can happen alongside unpacking
 			bool gotWeather = weatherService->getWeatherInfo();
-			xSemaphoreGive(memMutex);
 			if (!gotWeather) {
 				DEBUG("Failed to get weather");
 				toSleep = pdMS_TO_TICKS(180000);	// Try again in 3 minutes
 			} else {
+				// The forecast mustn't change while it is being drawn
+				xSemaphoreTake(memMutex, portMAX_DELAY);
+				weatherService->commit();
+				xSemaphoreGive(memMutex);
 				weather->redraw();
 			}
 		}
@@ -693,6 +816,71 @@ void infoCallback() {
 	wsInfoHandler.setLastFailedMessage(syncStats.lastFailedMessage);
 	wsInfoHandler.setLastUpdateTime(syncStats.lastUpdateTime);
 	wsInfoHandler.setHostname(hostName);
+
+	const GlyphCache::Stats &cacheStats = tfts->getGlyphCacheStats();
+	wsInfoHandler.setGlyphCacheHits(String(cacheStats.hits));
+	wsInfoHandler.setGlyphCacheMisses(String(cacheStats.misses));
+	wsInfoHandler.setGlyphCacheEvictions(String(cacheStats.evictions));
+	wsInfoHandler.setGlyphCacheSize(String(cacheStats.count) + " glyphs, " + String(cacheStats.used) + "/" + String(cacheStats.budget));
+
+	const DrawTime &spriteDrawTime = tfts->getSpriteDrawTime();
+	const DrawTime &storeDrawTime = tfts->getStoreDrawTime();
+	wsInfoHandler.setDigitDrawTime(
+		"sprite " + String(spriteDrawTime.meanUs()) + "us (" + String(spriteDrawTime.count) + ")"
+		+ ", store " + String(storeDrawTime.meanUs()) + "us (" + String(storeDrawTime.count) + ")"
+	);
+
+	// Rate since the Info page last asked
+	static uint32_t lastSpiBytesSaved = 0;
+	static unsigned long lastSpiBytesMs = 0;
+	uint32_t spiBytesSaved = tfts->getSpiBytesSaved();
+	unsigned long nowMs = millis();
+	if (nowMs != lastSpiBytesMs) {
+		wsInfoHandler.setSpiBytesSaved(String((uint32_t)((uint64_t)(spiBytesSaved - lastSpiBytesSaved) * 1000 / (nowMs - lastSpiBytesMs))) + " bytes/s (" + String(spiBytesSaved) + " total)");
+	}
+	lastSpiBytesSaved = spiBytesSaved;
+	lastSpiBytesMs = nowMs;
+
+	const ImageReader::Stats &readStats = ImageReader::getStats();
+	if (readStats.us != 0) {
+		wsInfoHandler.setImageReadRate(String((uint32_t)((uint64_t)readStats.bytes * 1000 / readStats.us)) + " bytes/ms (" + String(readStats.bytes / 1024) + "KB total)");
+	}
+
+	const RenderTask::Stats &renderStats = renderTask->getStats();
+	wsInfoHandler.setRenderCommands(String(renderStats.commands) + " posted, " + String(renderStats.merged) + " merged");
+
+	const FrameStats &frameStats = tfts->getFrameStats();
+	wsInfoHandler.setFrameStatsTime(frameStats.summary(IPSClock::TIME));
+	wsInfoHandler.setFrameStatsDate(frameStats.summary(IPSClock::DATE));
+	wsInfoHandler.setFrameStatsWeather(frameStats.summary(IPSClock::WEATHER));
+	wsInfoHandler.setFrameStatsSlideshow(frameStats.summary(IPSClock::SLIDE_SHOW));
+
+	const ImageUnpacker::Stats &unpackStats = imageUnpacker->getLastStats();
+	if (unpackStats.streamed) {
+		wsInfoHandler.setLastUnpack(String(unpackStats.name) + ": unpacked while uploading, ready " + String(unpackStats.ms) + "ms after the upload started, "
+			+ String(unpackStats.bytesWritten) + " bytes written");
+	} else if (unpackStats.unchanged) {
+		wsInfoHandler.setLastUnpack(String(unpackStats.name) + ": unchanged, " + String(unpackStats.ms) + "ms");
+	} else if (unpackStats.name[0] != 0) {
+		wsInfoHandler.setLastUnpack(String(unpackStats.name) + ": " + String(unpackStats.ms) + "ms, " + String(unpackStats.bytesWritten) + " bytes written, "
+			+ String(unpackStats.reused) + " of " + String(unpackStats.images) + " images reused");
+	}
+
+	const DrawTime &tickJitter = renderTask->getTickJitter();
+	wsInfoHandler.setClockTaskWakeups(String(clockScheduler.getWakeupsPerSecond()) + "/s");
+	String clockTaskCpu;
+	for (uint8_t i = 0; i < clockScheduler.getJobCount(); i++) {
+		Scheduler::JobStats jobStats = clockScheduler.getJobStats(i);
+		if (i != 0) {
+			clockTaskCpu += ", ";
+		}
+		clockTaskCpu += String(jobStats.name) + " " + String(jobStats.usPerSecond) + "us/s";
+	}
+	wsInfoHandler.setClockTaskCpu(clockTaskCpu);
+
+	const DisplayTick::Stats &tickStats = ipsClock->getDisplayTick().getStats();
+	wsInfoHandler.setTickPhaseError("mean " + String(tickStats.meanErrorUs()) + "us, max " + String(tickStats.maxErrorUs) + "us, timer latency " + String(tickStats.latencyUs) + "us, " + String(tickStats.steps) + " time steps");
+	wsInfoHandler.setTickJitter("mean " + String(tickJitter.meanUs()) + "us, max " + String(tickJitter.maxUs) + "us (" + String(tickJitter.count) + ")");
 }
 
 void broadcastUpdate(String msg) {
@@ -706,23 +894,14 @@ void broadcastUpdate(String msg) {
 void broadcastUpdate(const BaseConfigItem& item) {
 	xSemaphoreTake(wsMutex, portMAX_DELAY);
 
-	JsonDocument doc;
-	JsonObject root = doc.to<JsonObject>();
-
-	root["type"] = "sv.update";
-
-	JsonVariant value = root.createNestedObject("value");
-	String rawJSON = item.toJSON();	// This object needs to hang around until we are done serializing.
-	value[item.name] = serialized(rawJSON.c_str());
-
-    size_t len = measureJson(root);
-    AsyncWebSocketMessageBuffer * buffer = ws->makeBuffer(len);
-    if (buffer) {
-    	serializeJson(root, (char *)buffer->get(), len);
-    	ws->textAll(buffer);
-    }
-	uint32_t msg = MQTT_PUBLISH;
-	xQueueSend(mainQueue, &msg, pdMS_TO_TICKS(100));
+	ConfigUpdateMessage message(item);
+	size_t len = message.length();
+	AsyncWebSocketMessageBuffer * buffer = ws->makeBuffer(len);
+	if (buffer) {
+		message.write((char *)buffer->get(), len);
+		ws->textAll(buffer);
+	}
+	postToClockTask(MQTT_PUBLISH);
 
 	xSemaphoreGive(wsMutex);	
 }
@@ -745,6 +924,7 @@ void updateValue(int screen, String pair) {
 		// Order of below is important to maintain external consistency
 		broadcastUpdate(*item);
 		item->notify();
+		clockScheduler.signal(CONFIG_EVENT);
 		if (_key == "hostname") {
 			config.commit();
 			ESP.restart();
@@ -864,6 +1044,15 @@ void handleDelete(AsyncWebServerRequest *request) {
 	request->send(500, "text/plain", "Delete dailed");
 }
 
+/*
+ * With ?unpack=1 the archive is also unpacked as it arrives, instead of being read back from flash when
+ * it is selected. A bad archive is then rejected before the rest of it has been written.
+ */
+struct UploadState {
+	uint32_t unpackOwner;	// from UnpackTask::beginUpload(), 0 if this one isn't being unpacked
+	bool rejected;
+};
+
 void handleUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
 	if (!filename.endsWith(".tar.gz")) {
 		DEBUG("Invalid file type");
@@ -871,23 +1060,64 @@ void handleUpload(AsyncWebServerRequest *request, String filename, size_t index,
 		return;
 	}
 
+	String fileName = "/ips/" + fileSet->value + "/" + filename;
+
 	if (!index)
 	{
 		DEBUG((String) "UploadStart: " + filename);
+		// Kept with the request, which frees it, as more than one upload can be arriving
+		UploadState *state = (UploadState*)malloc(sizeof(UploadState));
+		if (state == NULL) {
+			request->send(500, "text/plain", "Out of memory");
+			return;
+		}
+		state->unpackOwner = 0;
+		state->rejected = false;
+		request->_tempObject = state;
+
+		if (request->hasParam("unpack")) {
+			// Not even gzip, so don't bother
+			if (len < 3 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8) {
+				state->rejected = true;
+				request->send(415, "text/plain", "Not a .tar.gz file");
+				return;
+			}
+			String face = filename.substring(0, filename.length() - strlen(".tar.gz"));
+			uint32_t owner = unpackTask->beginUpload(cacheRoot(fileSet->value).c_str(), face, fileName);
+			if (owner == 0) {
+				DEBUG("Already unpacking an upload, just saving this one");
+			} else {
+				state->unpackOwner = owner;
+				// Don't leave the unpacker waiting for the rest of it
+				request->onDisconnect([owner]() { unpackTask->abandonUpload(owner); });
+			}
+		}
 		// open the file on first call and store the file handle in the request object
-		request->_tempFile = LittleFS.open("/ips/" + fileSet->value + "/" + filename, "wb", true);
+		request->_tempFile = LittleFS.open(fileName, "wb", true);
+	}
+	UploadState *state = (UploadState*)request->_tempObject;
+	if (state == NULL || state->rejected) {
+		return;
 	}
 	if (len)
 	{
 		// stream the incoming chunk to the opened file
 		DEBUG((String) "Writing: " + len + " byted");
 		request->_tempFile.write(data, len);
+		if (!unpackTask->putUpload(state->unpackOwner, data, len)) {
+			state->rejected = true;
+			request->_tempFile.close();
+			LittleFS.remove(fileName);
+			request->send(422, "text/plain", "Invalid archive");
+			return;
+		}
 	}
 	if (final)
 	{
 		DEBUG((String) "UploadEnd: " + filename);
 		// close the file handle as the upload is now done
 		request->_tempFile.close();
+		unpackTask->endUpload(state->unpackOwner);
 		request->send(200, "text/plain", "File uploaded");
 
 		wsFacesHandler.broadcast(*ws, 0);
@@ -1047,14 +1277,49 @@ String clockFacesCallback() {
     }
 	dir.close();
 
-	options += "}";
+	options += "},";
+	options += residentFacesCallback();
 
 	return options;
 }
 
+/*
+ * Where the faces in a file set are unpacked
+ */
+String cacheRoot(const String &fileSet) {
+	if (fileSet == "weather") {
+		return "/ips/weather_cache";
+	} else if (fileSet == "slides") {
+		return "/ips/slides_cache";
+	} else {
+		return "/ips/cache";
+	}
+}
+
+/*
+ * The faces in the file set being viewed that are unpacked, and how much space each takes
+ */
+String residentFacesCallback() {
+	std::vector<ImageUnpacker::ResidentFace> faces;
+	ImageUnpacker::listResidentFaces(cacheRoot(fileSet->value), faces);
+
+	String resident = "\"face_resident\":{";
+	String sep = "\"";
+	for (const ImageUnpacker::ResidentFace &face : faces) {
+		resident += sep + face.name + "\":" + String(face.bytes);
+		sep = ",\"";
+	}
+	resident += "}";
+
+	return resident;
+}
+
 void ledTaskFn(void *pArg) {
 	backlights = new Backlights();
 	backlights->begin();
+#ifdef BENCHMARK_BACKLIGHTS
+	backlights->benchmark();
+#endif
 
 	while (true) {
 		if (ipsClock != NULL) {
@@ -1089,7 +1354,7 @@ void improvTaskFn(void *pArg) {
         manifest[3]
 	);
 
-	improvWiFi.setInfoCallback([](const char *msg) {tfts->setStatus(msg);});
+	improvWiFi.setInfoCallback([](const char *msg) {renderTask->postStatus(msg);});
 	improvWiFi.setWiFiCallback(setWiFiCredentials);
 
 	DEBUG("Running improv");
@@ -1121,7 +1386,7 @@ void initFromEEPROM() {
 }
 
 void connectedHandler() {
-	tfts->setStatus(WiFi.localIP().toString());
+	renderTask->postStatus(WiFi.localIP().toString());
 	DEBUG("connectedHandler");
 	MDNS.end();
 	MDNS.begin(hostName.value.c_str());
@@ -1137,9 +1402,9 @@ void apChange(AsyncWiFiManager *wifiManager) {
 	DEBUG("apChange()");
 	DEBUG(wifiManager->isAP());
 	if (wifiManager->isAP()) {
-		tfts->setStatus(ssid);
+		renderTask->postStatus(ssid);
 	} else {
-		tfts->setStatus("AP Destroyed...");
+		renderTask->postStatus("AP Destroyed...");
 		uint32_t value = WEATHER_UPDATE;
 		xQueueSend(weatherQueue, &value, 0);	// Not enough memory to make an HTTPS request while AP is active
 	}
@@ -1198,9 +1463,33 @@ void setup() {
 	tfts->fillScreen(TFT_BLACK);
 	tfts->setTextColor(TFT_WHITE, TFT_BLACK);
 	tfts->setCursor(0, 0, 2);
-	tfts->setStatus("setup...");
+#ifdef BENCHMARK_DECODE
+	tfts->benchmarkDecode();
+#endif
+#ifdef BENCHMARK_ANIMATION
+	tfts->benchmarkAnimation();
+#endif
+
+	renderTask = new RenderTask();
+	renderTask->begin();
+	renderTask->postStatus("setup...");
 
 	menu = new eSPIMenu::Menu(&tfts->getSprite());
+	// It draws into the sprite, so it is drawn by the render task
+	renderTask->setMenuDrawer([](bool show, int moves) {
+		if (show) {
+			tfts->clear();
+			initFacesMenu();
+			menu->show();
+		}
+		for (; moves > 0; moves--) {
+			menu->down();
+		}
+		for (; moves < 0; moves++) {
+			menu->up();
+		}
+		return menu->getSelectedText();
+	}, []() { clockScheduler.signal(MENU_EVENT); });
 
 	createSSID();
 
@@ -1268,7 +1557,7 @@ IPSClock::getTimeZone().setCallback(onTimezoneChanged);
 		0
 	);
 
-	tfts->setStatus("Connecting...");
+	renderTask->postStatus("Connecting...");
 
 	wifiManager->setDebugOutput(false);
 	wifiManager->setHostname(hostName.value.c_str());	// name router associates DNS entry with
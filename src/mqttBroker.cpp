@@ -8,6 +8,7 @@
 #include "Backlights.h"
 #include "mqttBroker.h"
 #include "IPSClock.h"
+#include "TFTs.h"
 
 extern AsyncWiFiManager *wifiManager;
 extern CompositeConfigItem rootConfig;
@@ -15,7 +16,7 @@ extern ScreenSaver *screenSaver;
 extern void broadcastUpdate(const BaseConfigItem&);
 extern IRAMPtrArray<const char*> manifest;
 extern SemaphoreHandle_t memMutex;
-extern QueueHandle_t mainQueue;
+extern void postToClockTask(uint32_t msg);
 
 static const char *device_s = "dev";
 IRAMPtrArray<const char*> MQTTBroker::displayStates {
@@ -157,7 +158,7 @@ void MQTTBroker::onMessage(const espMqttClientTypes::MessageProperties& properti
 	}
 
     uint32_t msg = 1;
-	xQueueSend(mainQueue, &msg, pdMS_TO_TICKS(100));
+	postToClockTask(msg);
 }
 
 bool MQTTBroker::init(const String& id) {
@@ -171,6 +172,7 @@ bool MQTTBroker::init(const String& id) {
         sprintf(volatileStateTopic, "clock/%s/volatile/state", id.c_str());
         sprintf(persistentStateTopic, "clock/%s/persistent/state", id.c_str());
         sprintf(availabilityTopic, "clock/%s/availability", id.c_str());
+        sprintf(diagnosticsTopic, "clock/%s/diagnostics/state", id.c_str());
 
         client.setServer(getHost().value.c_str(), getPort());
         client.setCredentials(getUser().value.c_str(),getPassword().value.c_str());
@@ -187,7 +189,7 @@ bool MQTTBroker::init(const String& id) {
 #endif
         screenSaver->setChangeCallback([this](bool isOff) { 
             uint32_t msg = 1;
-            xQueueSend(mainQueue, &msg, pdMS_TO_TICKS(100));
+            postToClockTask(msg);
         });
         
         reconnect = true;
@@ -215,26 +217,8 @@ void MQTTBroker::publishState() {
         // Takes a lot of memory
         if (xSemaphoreTake(memMutex, pdMS_TO_TICKS(500)) == pdTRUE)
         {
-            JsonDocument volatileState;
-            volatileState["screen_saver_on"] = screenSaver->isOn() ? "ON" : "OFF";
-            volatileState["brightness"] = IPSClock::getBrightnessConfig().value;
-            volatileState["custom"] = IPSClock::getCustomData().value;
-            volatileState["display"] = IPSClock::getTimeOrDate().value;
-
-            volatileState["backlight_state"] = Backlights::backlightState ? "ON" : "OFF";
-            JsonArray blArray = volatileState["backlight_hs"].to<JsonArray>();
-            blArray.add(360.0 * Backlights::backlightHue / 255.0);
-            blArray.add(100.0 * Backlights::backlightSaturation / 255.0);
-            volatileState["backlight_brightness"] = Backlights::backlightBrightness;
-#if (NUM_LEDS > 6)
-            volatileState["underlight_state"] = Backlights::backlightState ? "ON" : "OFF";  // backlight and underlight share the same state
-            JsonArray ulArray = volatileState["underlight_hs"].to<JsonArray>();
-            ulArray.add(360.0 * Backlights::underlightHue / 255.0);
-            ulArray.add(100.0 * Backlights::underlightSaturation / 255.0);
-            volatileState["underlight_brightness"] = Backlights::underlightBrightness;
-#endif
             char buffer[384];
-            size_t n = serializeJson(volatileState, buffer);
+            serializeVolatileState(getVolatileState(), buffer, sizeof(buffer));
             client.publish(volatileStateTopic, 1, false, buffer);
             client.publish(persistentStateTopic, 1, false, rootConfig.toJSON().c_str());
             xSemaphoreGive(memMutex);
@@ -244,6 +228,58 @@ void MQTTBroker::publishState() {
     }
 }
 
+VolatileState MQTTBroker::getVolatileState() {
+    VolatileState state;
+    state.screenSaverOn = screenSaver->isOn();
+    state.brightness = IPSClock::getBrightnessConfig().value;
+    state.custom = IPSClock::getCustomData().value;
+    state.display = IPSClock::getTimeOrDate().value;
+
+    state.backlightOn = Backlights::backlightState;
+    state.backlightHue = Backlights::backlightHue;
+    state.backlightSaturation = Backlights::backlightSaturation;
+    state.backlightBrightness = Backlights::backlightBrightness;
+#if (NUM_LEDS > 6)
+    state.hasUnderlight = true;
+    state.underlightHue = Backlights::underlightHue;
+    state.underlightSaturation = Backlights::underlightSaturation;
+    state.underlightBrightness = Backlights::underlightBrightness;
+#else
+    state.hasUnderlight = false;
+#endif
+    return state;
+}
+
+/*
+ * Frame timings for each display mode. The state is the mean time to draw a digit in the mode that
+ * is showing now, and the per stage breakdown goes in the attributes.
+ */
+void MQTTBroker::publishDiagnostics() {
+    if (client.connected()) {
+        if (xSemaphoreTake(memMutex, pdMS_TO_TICKS(500)) == pdTRUE)
+        {
+            const FrameStats &frameStats = tfts->getFrameStats();
+            uint8_t mode = IPSClock::getTimeOrDate().value;
+
+            JsonDocument diagnostics;
+            if (mode < FRAME_STATS_MODES) {
+                diagnostics["frame_ms"] = frameStats.get(mode, FRAME_TOTAL).meanUs() / 1000.0;
+            }
+            JsonObject modes = diagnostics["modes"].to<JsonObject>();
+            for (uint8_t i = 0; i < FRAME_STATS_MODES; i++) {
+                if (frameStats.get(i, FRAME_TOTAL).count != 0) {
+                    frameStats.toJson(modes[FrameStats::getModeName(i)].to<JsonObject>(), i);
+                }
+            }
+
+            char buffer[1024];
+            size_t n = serializeJson(diagnostics, buffer);
+            client.publish(diagnosticsTopic, 0, false, buffer);
+            xSemaphoreGive(memMutex);
+        }
+    }
+}
+
 void MQTTBroker::sendHADiscoveryMessage() {
     char buffer[1024];
     delay(300);
@@ -444,8 +480,34 @@ void MQTTBroker::sendHADiscoveryMessage() {
 
     client.publish(discoveryTopic, 1, false, buffer);
 
+    sprintf(discoveryTopic, "homeassistant/sensor/%s/frame_time/config", id.c_str());
+
+    doc.clear();
+
+    doc["~"] = home;
+    doc["name"] = "Frame Time";
+    doc["icon"] = "mdi:timer-outline";
+    doc["unique_id"] = "frame_time" + id;
+    doc["ent_cat"] = "diagnostic";
+    doc["stat_cla"] = "measurement";
+    doc["unit_of_meas"] = "ms";
+    doc["avty_t"] = availabilityTopic;
+    doc["stat_t"] = diagnosticsTopic;
+    doc["val_tpl"] = "{{value_json.frame_ms}}";
+    doc["json_attr_t"] = diagnosticsTopic;
+    doc["json_attr_tpl"] = "{{value_json.modes | tojson}}";
+    doc["dev"]["configuration_url"] = "http://" + WiFi.localIP().toString() + "/";
+    doc["dev"]["name"] = manifest[3];
+    doc["dev"]["identifiers"][0] = WiFi.macAddress();
+    doc["dev"]["model"] = manifest[0];
+    doc["dev"]["sw_version"] = manifest[1];
+
+    n = serializeJson(doc, buffer);
+
+    client.publish(discoveryTopic, 1, false, buffer);
+
     client.publish(availabilityTopic, 2, true, "online");
 
     uint32_t msg = 1;
-	xQueueSend(mainQueue, &msg, pdMS_TO_TICKS(100));
+	postToClockTask(msg);
 }
\ No newline at end of file
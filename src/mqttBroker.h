@@ -7,6 +7,7 @@
 #include <espMqttClient.h>
 #endif
 #include "IRAMPtrArray.h"
+#include "ConfigJson.h"
 
 class MQTTBroker
 {
@@ -20,6 +21,8 @@ public:
     void connect();
     void checkConnection();
     void publishState();
+    void publishDiagnostics();
+    VolatileState getVolatileState();
 
 private:
     void onConnect(bool sessionPresent);
@@ -38,6 +41,7 @@ private:
     char persistentStateTopic[64];
     char volatileStateTopic[64];
     char availabilityTopic[64];
+    char diagnosticsTopic[64];
 
     const char* screenSaverTopic = "~/set/screen_saver";
     const char* brightnessTopic = "~/set/brightness";
@@ -13,8 +13,9 @@
 #include <TimeSync.h>
 
 #include "ClockTimer.h"
+#include "TFTs.h"
+#include "RenderTask.h"
 #include "WeatherService.h"
-#include "ImageUnpacker.h"
 
 class Weather {
 public:
@@ -25,7 +26,6 @@ public:
     static ByteConfigItem& getWeatherSaturation() { static ByteConfigItem weather_saturation("weather_saturation", 166); return weather_saturation; }
     static ByteConfigItem& getWeatherValue() { static ByteConfigItem weather_value("weather_value", 250); return weather_value; }
 
-    void setImageUnpacker(ImageUnpacker *imageUnpacker) { this->imageUnpacker = imageUnpacker; }
     void setTimeSync(TimeSync *pTimeSync) { this->pTimeSync = pTimeSync; }
     void checkIconPack();
 
@@ -52,14 +52,14 @@ private:
         "Saturday"
     };
 
-    void drawDisplay(int index, int display, bool showDay = true);
-    bool preDraw(uint8_t dimming);
-    void postDraw();
+    void addTile(RenderTask::WeatherFrame &frame, int index, int display, bool showDay = true);
+    bool drawDue();
+    void startFrame(RenderTask::WeatherFrame &frame, uint8_t dimming);
 
     WeatherService *weatherService;
-    String oldIcons;
+    String oldIcons;        // showing
+    String requestedIcons;  // being unpacked, or the same as oldIcons
     ClockTimer::Timer displayTimer;
-    ImageUnpacker *imageUnpacker;
     bool _redraw = false;
 	TimeSync *pTimeSync = 0;
 };
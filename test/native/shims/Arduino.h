@@ -0,0 +1,162 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+/*
+ * Just enough of the ESP32 Arduino core to build the parts of src/ that don't need the hardware on
+ * the host, for the tests in test/native. Pins, LEDC and the like do nothing. Time comes from
+ * ShimClock.h, and random numbers are the same on every run.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+#include "ShimClock.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+using std::min;
+using std::max;
+using std::isnan;
+using std::isinf;
+using std::abs;
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define PI 3.1415926535897932384626433832795
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline unsigned long millis() { return shim::nowUs() / 1000; }
+inline unsigned long micros() { return (uint32_t)shim::nowUs(); }
+inline void delayMicroseconds(uint32_t us) {
+  if (shim::frozen) {
+    shim::advanceTimeUs(us);
+  } else {
+    usleep(us);
+  }
+}
+inline void delay(uint32_t ms) { delayMicroseconds(ms * 1000); }
+inline void yield() {}
+
+// xorshift32, so that anything drawn from random numbers is the same every run
+namespace shim {
+inline uint32_t randomState = 2463534242u;
+}
+inline uint32_t esp_random() {
+  uint32_t x = shim::randomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return shim::randomState = x;
+}
+inline void randomSeed(unsigned long seed) { if (seed != 0) shim::randomState = seed; }
+inline long random(long howbig) { return howbig <= 0 ? 0 : esp_random() % howbig; }
+inline long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  const long dividend = out_max - out_min;
+  const long divisor = in_max - in_min;
+  const long delta = x - in_min;
+  return divisor == 0 ? out_min : (delta * dividend + (divisor / 2)) / divisor + out_min;
+}
+
+inline char* itoa(int value, char *result, int base) {
+  strcpy(result, String((long)value, base).c_str());
+  return result;
+}
+inline char* ltoa(long value, char *result, int base) {
+  strcpy(result, String(value, base).c_str());
+  return result;
+}
+inline char* utoa(unsigned value, char *result, int base) {
+  strcpy(result, String((unsigned long)value, base).c_str());
+  return result;
+}
+
+// newlib has it, glibc only since 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t length = strlen(src);
+  if (size != 0) {
+    size_t n = length < size - 1 ? length : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
+#endif
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t val) {}
+inline int digitalRead(uint8_t pin) { return HIGH; }
+inline void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val) {}
+inline void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {}
+inline void attachInterruptArg(uint8_t pin, void (*handler)(void*), void *arg, int mode) {}
+inline void detachInterrupt(uint8_t pin) {}
+inline uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution) { return freq; }
+inline void ledcAttachPin(uint8_t pin, uint8_t channel) {}
+inline void ledcWrite(uint8_t channel, uint32_t duty) {}
+inline uint32_t ledcChangeFrequency(uint8_t channel, uint32_t freq, uint8_t resolution) { return freq; }
+inline bool psramFound() { return false; }
+
+// The host's time zone, already set
+inline bool getLocalTime(struct tm *info, uint32_t ms = 5000) {
+  time_t now = time(nullptr);
+  localtime_r(&now, info);
+  return true;
+}
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) {}
+  void end() {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+  size_t write(const uint8_t *buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+  void flush() override { fflush(stdout); }
+  using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+#endif // SHIM_ARDUINO_H
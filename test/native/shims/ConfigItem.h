@@ -0,0 +1,127 @@
+#ifndef SHIM_CONFIG_ITEM_H
+#define SHIM_CONFIG_ITEM_H
+
+#include <Arduino.h>
+
+/*
+ * ESPConfig's configuration items, without the EEPROM behind them. put() and get() do nothing, the
+ * values are only ever what the code sets them to. toJSON() writes the same JSON the web pages read.
+ */
+class BaseConfigItem {
+public:
+  BaseConfigItem(const char *name, int start, unsigned char maxSize) : name(name), start(start), maxSize(maxSize) {}
+  virtual ~BaseConfigItem() {}
+
+  virtual BaseConfigItem* get(const char *name) { return strcmp(name, this->name) == 0 ? this : nullptr; }
+  virtual void get() {}
+  virtual void put() const {}
+  virtual BaseConfigItem& init() { return *this; }
+  virtual void fromString(const String &s) = 0;
+  virtual String toString(const char **excludes = nullptr) const = 0;
+  virtual String toJSON(bool bare = false, const char **excludes = nullptr) const {
+    return bare ? toString(excludes) : "\"" + String(name) + "\":" + toString(excludes);
+  }
+  virtual void debug(Print *debugPrint) const {}
+  virtual void notify() {}
+
+  const char *name;
+  int start;
+  unsigned char maxSize;
+};
+
+template <typename T>
+class ConfigItem : public BaseConfigItem {
+public:
+  typedef void (*Callback)(ConfigItem<T>&);
+
+  ConfigItem(const char *name, unsigned char maxSize, const T &value) : BaseConfigItem(name, 0, maxSize), value(value) {}
+
+  operator T() const { return value; }
+  ConfigItem& operator=(const T &value) { this->value = value; return *this; }
+
+  void setCallback(Callback callback) { this->callback = callback; }
+  void notify() override { if (callback != nullptr) callback(*this); }
+
+  T value;
+
+protected:
+  Callback callback = nullptr;
+};
+
+class BooleanConfigItem : public ConfigItem<bool> {
+public:
+  BooleanConfigItem(const char *name, bool value) : ConfigItem(name, 1, value) {}
+  BooleanConfigItem& operator=(bool value) { this->value = value; return *this; }
+  void fromString(const String &s) override { value = s == "true"; }
+  String toString(const char **excludes = nullptr) const override { return value ? "true" : "false"; }
+};
+
+class ByteConfigItem : public ConfigItem<byte> {
+public:
+  ByteConfigItem(const char *name, byte value) : ConfigItem(name, 1, value) {}
+  ByteConfigItem& operator=(byte value) { this->value = value; return *this; }
+  void fromString(const String &s) override { value = s.toInt(); }
+  String toString(const char **excludes = nullptr) const override { return String((unsigned int)value); }
+};
+
+class IntConfigItem : public ConfigItem<int> {
+public:
+  IntConfigItem(const char *name, int value) : ConfigItem(name, sizeof(int), value) {}
+  IntConfigItem& operator=(int value) { this->value = value; return *this; }
+  void fromString(const String &s) override { value = s.toInt(); }
+  String toString(const char **excludes = nullptr) const override { return String(value); }
+};
+
+class StringConfigItem : public ConfigItem<String> {
+public:
+  StringConfigItem(const char *name, unsigned char maxSize, const String &value) : ConfigItem(name, maxSize, value) {}
+  StringConfigItem& operator=(const String &value) { this->value = value; return *this; }
+  void fromString(const String &s) override { value = s; }
+  String toString(const char **excludes = nullptr) const override { return value; }
+  String toJSON(bool bare = false, const char **excludes = nullptr) const override {
+    String quoted = "\"";
+    for (unsigned int i = 0; i < value.length(); i++) {
+      char c = value[i];
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+      }
+      quoted += c;
+    }
+    quoted += '"';
+    return bare ? quoted : "\"" + String(name) + "\":" + quoted;
+  }
+};
+
+class CompositeConfigItem : public ConfigItem<BaseConfigItem**> {
+public:
+  CompositeConfigItem(const char *name, int start, BaseConfigItem **value) : ConfigItem(name, 0, value) {}
+
+  BaseConfigItem* get(const char *name) override {
+    if (strcmp(name, this->name) == 0) {
+      return this;
+    }
+    for (BaseConfigItem **item = value; *item != nullptr; item++) {
+      BaseConfigItem *found = (*item)->get(name);
+      if (found != nullptr) {
+        return found;
+      }
+    }
+    return nullptr;
+  }
+  void get() override {}
+  void fromString(const String &s) override {}
+  String toString(const char **excludes = nullptr) const override { return toJSON(true, excludes); }
+  String toJSON(bool bare = false, const char **excludes = nullptr) const override {
+    String json = bare ? "{" : "\"" + String(name) + "\":{";
+    for (BaseConfigItem **item = value; *item != nullptr; item++) {
+      if (item != value) {
+        json += ',';
+      }
+      json += (*item)->toJSON(false, excludes);
+    }
+    json += '}';
+    return json;
+  }
+};
+
+#endif // SHIM_CONFIG_ITEM_H
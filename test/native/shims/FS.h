@@ -0,0 +1,201 @@
+#ifndef SHIM_FS_H
+#define SHIM_FS_H
+
+#include <Arduino.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * The Arduino file system API over a directory on the host. Paths are relative to the file system's
+ * root directory, so "/ips/cache/0.bmp" on a file system rooted at "data" is data/ips/cache/0.bmp.
+ * Directories list their entries in name order, as LittleFS does.
+ */
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+public:
+  File() {}
+
+  static File openHost(const std::string &root, const std::string &path, const char *mode) {
+    File file;
+    std::string hostPath = root + path;
+    struct stat st;
+    if (stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      DIR *dir = opendir(hostPath.c_str());
+      if (dir == nullptr) {
+        return file;
+      }
+      auto impl = std::make_shared<Impl>();
+      impl->path = path;
+      impl->directory = true;
+      while (struct dirent *entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+          impl->entries.push_back(entry->d_name);
+        }
+      }
+      closedir(dir);
+      std::sort(impl->entries.begin(), impl->entries.end());
+      impl->root = root;
+      file.impl = impl;
+      return file;
+    }
+
+    std::string hostMode = mode;
+    if (hostMode.find('b') == std::string::npos) {
+      hostMode += 'b';
+    }
+    FILE *f = fopen(hostPath.c_str(), hostMode.c_str());
+    if (f != nullptr) {
+      auto impl = std::make_shared<Impl>();
+      impl->path = path;
+      impl->root = root;
+      impl->f = f;
+      file.impl = impl;
+    }
+    return file;
+  }
+
+  explicit operator bool() const { return impl != nullptr && (impl->f != nullptr || impl->directory); }
+
+  int available() override {
+    if (impl == nullptr || impl->f == nullptr) return 0;
+    return size() - position();
+  }
+  int read() override {
+    if (impl == nullptr || impl->f == nullptr) return -1;
+    int c = fgetc(impl->f);
+    return c == EOF ? -1 : c;
+  }
+  size_t read(uint8_t *buffer, size_t size) {
+    if (impl == nullptr || impl->f == nullptr) return 0;
+    return fread(buffer, 1, size, impl->f);
+  }
+  size_t readBytes(char *buffer, size_t length) override { return read((uint8_t*)buffer, length); }
+  int peek() override {
+    int c = read();
+    if (c >= 0) ungetc(c, impl->f);
+    return c;
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (impl == nullptr || impl->f == nullptr) return 0;
+    return fwrite(buffer, 1, size, impl->f);
+  }
+  using Print::write;
+  void flush() override { if (impl != nullptr && impl->f != nullptr) fflush(impl->f); }
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+    if (impl == nullptr || impl->f == nullptr) return false;
+    return fseek(impl->f, pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+  }
+  size_t position() const { return impl == nullptr || impl->f == nullptr ? 0 : ftell(impl->f); }
+  size_t size() const {
+    if (impl == nullptr || impl->f == nullptr) return 0;
+    long at = ftell(impl->f);
+    fseek(impl->f, 0, SEEK_END);
+    long end = ftell(impl->f);
+    fseek(impl->f, at, SEEK_SET);
+    return end;
+  }
+  void close() {
+    if (impl != nullptr && impl->f != nullptr) {
+      fclose(impl->f);
+      impl->f = nullptr;
+    }
+    impl = nullptr;
+  }
+
+  const char* path() const { return impl == nullptr ? nullptr : impl->path.c_str(); }
+  const char* name() const {
+    if (impl == nullptr) return nullptr;
+    size_t slash = impl->path.rfind('/');
+    return impl->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+  }
+  bool isDirectory() const { return impl != nullptr && impl->directory; }
+
+  File openNextFile(const char *mode = FILE_READ) {
+    if (!isDirectory() || impl->next >= impl->entries.size()) {
+      return File();
+    }
+    return openHost(impl->root, childPath(impl->entries[impl->next++]), mode);
+  }
+  String getNextFileName() {
+    if (!isDirectory() || impl->next >= impl->entries.size()) {
+      return String();
+    }
+    return String(childPath(impl->entries[impl->next++]));
+  }
+  void rewindDirectory() { if (isDirectory()) impl->next = 0; }
+
+private:
+  struct Impl {
+    ~Impl() { if (f != nullptr) fclose(f); }
+    std::string root;
+    std::string path;
+    FILE *f = nullptr;
+    bool directory = false;
+    std::vector<std::string> entries;
+    size_t next = 0;
+  };
+
+  std::string childPath(const std::string &name) const {
+    return impl->path == "/" ? "/" + name : impl->path + "/" + name;
+  }
+
+  std::shared_ptr<Impl> impl;
+};
+
+class FS {
+public:
+  FS(const char *root = ".") : root(root) {}
+
+  // Where on the host "/" is
+  void setRoot(const char *root) { this->root = root; }
+  const char* getRoot() const { return root.c_str(); }
+
+  File open(const char *path, const char *mode = FILE_READ, bool create = false) {
+    return File::openHost(root, path, mode);
+  }
+  File open(const String &path, const char *mode = FILE_READ, bool create = false) { return open(path.c_str(), mode, create); }
+  bool exists(const char *path) { struct stat st; return stat(hostPath(path).c_str(), &st) == 0; }
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path) { return ::unlink(hostPath(path).c_str()) == 0; }
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to) { return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0; }
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  bool rmdir(const char *path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+  bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+private:
+  std::string hostPath(const char *path) const { return root + path; }
+
+  std::string root;
+};
+
+}
+
+#ifndef FS_NO_GLOBALS
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+#endif
+
+#endif // SHIM_FS_H
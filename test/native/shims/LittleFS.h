@@ -0,0 +1,29 @@
+#ifndef SHIM_LITTLEFS_H
+#define SHIM_LITTLEFS_H
+
+#include "FS.h"
+
+/*
+ * LittleFS is the data directory, unless a test points it somewhere else with LittleFS.setRoot().
+ */
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+  LittleFSFS() : FS("data") {}
+
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+      const char *partitionLabel = "spiffs") {
+    return exists("/");
+  }
+  void end() {}
+  bool format() { return false; }
+  size_t totalBytes() { return 0x160000; }
+  size_t usedBytes() { return 0; }
+};
+
+}
+
+inline fs::LittleFSFS LittleFS;
+
+#endif // SHIM_LITTLEFS_H
@@ -0,0 +1,6 @@
+/*
+ * What main.cpp defines for everything else on the clock, which the host builds leave out.
+ */
+class TFTs;
+
+TFTs *tfts = 0;
@@ -0,0 +1,105 @@
+#ifndef SHIM_NEOPIXELBUS_H
+#define SHIM_NEOPIXELBUS_H
+
+#include <Arduino.h>
+#include <math.h>
+#include <vector>
+
+/*
+ * NeoPixelBus keeping the pixels in memory. Show() copies them to what the LEDs would be showing.
+ */
+struct HsbColor {
+  HsbColor(float h, float s, float b) : H(h), S(s), B(b) {}
+
+  float H;
+  float S;
+  float B;
+};
+
+struct RgbColor {
+  RgbColor(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0) : R(r), G(g), B(b) {}
+  RgbColor(const HsbColor &color) {
+    float r, g, b;
+    float h = color.H, s = color.S, v = color.B;
+
+    if (s == 0.0f) {
+      r = g = b = v;
+    } else {
+      if (h < 0.0f) {
+        h += 1.0f;
+      } else if (h >= 1.0f) {
+        h -= 1.0f;
+      }
+      h *= 6.0f;
+      int i = (int)h;
+      float f = h - i;
+      float q = v * (1.0f - s * f);
+      float p = v * (1.0f - s);
+      float t = v * (1.0f - s * (1.0f - f));
+      switch (i) {
+        case 0: r = v; g = t; b = p; break;
+        case 1: r = q; g = v; b = p; break;
+        case 2: r = p; g = v; b = t; break;
+        case 3: r = p; g = q; b = v; break;
+        case 4: r = t; g = p; b = v; break;
+        default: r = v; g = p; b = q; break;
+      }
+    }
+
+    R = (uint8_t)(r * 255.0f);
+    G = (uint8_t)(g * 255.0f);
+    B = (uint8_t)(b * 255.0f);
+  }
+
+  bool operator==(const RgbColor &other) const { return R == other.R && G == other.G && B == other.B; }
+  bool operator!=(const RgbColor &other) const { return !(*this == other); }
+
+  uint8_t R;
+  uint8_t G;
+  uint8_t B;
+};
+
+class NeoGrbFeature {};
+class Neo800KbpsMethod {};
+
+// The library's table is this equation worked out in advance
+class NeoGammaTableMethod {
+public:
+  static uint8_t Correct(uint8_t value) {
+    return (uint8_t)(pow(value / 255.0, 1 / 0.45) * 255.0 + 0.5);
+  }
+};
+
+template <typename T_METHOD> class NeoGamma {
+public:
+  static RgbColor Correct(const RgbColor &color) {
+    return RgbColor(T_METHOD::Correct(color.R), T_METHOD::Correct(color.G), T_METHOD::Correct(color.B));
+  }
+};
+
+template <typename T_COLOR_FEATURE, typename T_METHOD> class NeoPixelBus {
+public:
+  NeoPixelBus(uint16_t countPixels, uint8_t pin) : pixels(countPixels), shown(countPixels) {}
+
+  void Begin() {}
+  void Show() { shown = pixels; }
+  bool CanShow() const { return true; }
+  uint16_t PixelCount() const { return pixels.size(); }
+
+  void SetPixelColor(uint16_t index, const RgbColor &color) {
+    if (index < pixels.size()) pixels[index] = color;
+  }
+  RgbColor GetPixelColor(uint16_t index) const {
+    return index < pixels.size() ? pixels[index] : RgbColor();
+  }
+  void ClearTo(const RgbColor &color) { pixels.assign(pixels.size(), color); }
+
+  // What the LEDs were last sent
+  const std::vector<RgbColor>& GetShown() const { return shown; }
+
+private:
+  std::vector<RgbColor> pixels;
+  std::vector<RgbColor> shown;
+};
+
+#endif // SHIM_NEOPIXELBUS_H
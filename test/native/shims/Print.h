@@ -0,0 +1,68 @@
+#ifndef SHIM_PRINT_H
+#define SHIM_PRINT_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size-- > 0 && write(*buffer++) == 1) {
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char *s) { return s == nullptr ? 0 : write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+  virtual void flush() {}
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < (int)sizeof(buffer)) {
+      return write((const uint8_t*)buffer, len);
+    }
+
+    char *heap = (char*)malloc(len + 1);
+    va_start(args, format);
+    vsnprintf(heap, len + 1, format, args);
+    va_end(args);
+    size_t n = write((const uint8_t*)heap, len);
+    free(heap);
+    return n;
+  }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC) { return print(String(n, base)); }
+  size_t print(unsigned long n, int base = DEC) { return print(String(n, base)); }
+  size_t print(long long n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned long long n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(double n, int digits = 2) { return print(String(n, digits)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T &value, int format) { return print(value, format) + println(); }
+};
+
+#endif // SHIM_PRINT_H
@@ -0,0 +1,97 @@
+#ifndef SHIM_CLOCK_H
+#define SHIM_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/*
+ * The time that millis(), micros() and esp_timer_get_time() return. It follows the host's monotonic
+ * clock, so that benchmarks time real work, until a test calls setTimeUs(). From then on it only moves
+ * when the test moves it, or something calls delay(), and esp_timers fire as it passes them.
+ */
+namespace shim {
+
+inline std::atomic<bool> frozen{false};
+inline std::atomic<uint64_t> frozenUs{0};
+
+inline uint64_t hostUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline uint64_t nowUs() {
+  return frozen ? frozenUs.load() : hostUs();
+}
+
+struct Timer {
+  std::function<void()> fire;
+  uint64_t dueUs = 0;
+  bool armed = false;
+};
+
+// How late one-shot timers fire, so that a test can stand in for a busy esp_timer task
+inline std::function<uint64_t()> timerLatencyUs;
+
+inline std::vector<Timer*>& timers() {
+  static std::vector<Timer*> all;
+  return all;
+}
+
+// Fire every armed timer that is due at or before nowUs(), earliest first
+inline void runTimers() {
+  while (true) {
+    Timer *next = nullptr;
+    for (Timer *timer : timers()) {
+      if (timer->armed && timer->dueUs <= nowUs() && (next == nullptr || timer->dueUs < next->dueUs)) {
+        next = timer;
+      }
+    }
+    if (next == nullptr) {
+      return;
+    }
+    next->armed = false;
+    next->fire();
+  }
+}
+
+inline void setTimeUs(uint64_t us) {
+  frozenUs = us;
+  frozen = true;
+  runTimers();
+}
+
+// Stops at each timer on the way, so that a callback sees the time it was due
+inline void advanceTimeUs(uint64_t us) {
+  if (!frozen) {
+    setTimeUs(hostUs());
+  }
+
+  uint64_t endUs = frozenUs + us;
+  while (true) {
+    uint64_t stopUs = endUs;
+    for (Timer *timer : timers()) {
+      if (timer->armed && timer->dueUs < stopUs) {
+        stopUs = timer->dueUs;
+      }
+    }
+    if (stopUs > frozenUs) {
+      frozenUs = stopUs;
+    }
+    runTimers();
+    if (stopUs >= endUs) {
+      return;
+    }
+  }
+}
+
+inline void useHostTime() {
+  frozen = false;
+}
+
+}
+
+#endif // SHIM_CLOCK_H
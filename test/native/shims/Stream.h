@@ -0,0 +1,41 @@
+#ifndef SHIM_STREAM_H
+#define SHIM_STREAM_H
+
+#include "Print.h"
+
+/*
+ * Reads don't wait, they stop at the first byte that isn't there.
+ */
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+  unsigned long getTimeout() const { return timeout; }
+
+  virtual size_t readBytes(char *buffer, size_t length) {
+    size_t n = 0;
+    int c;
+    while (n < length && (c = read()) >= 0) {
+      buffer[n++] = (char)c;
+    }
+    return n;
+  }
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+  String readString() {
+    String s;
+    int c;
+    while ((c = read()) >= 0) {
+      s += (char)c;
+    }
+    return s;
+  }
+
+protected:
+  unsigned long timeout = 1000;
+};
+
+#endif // SHIM_STREAM_H
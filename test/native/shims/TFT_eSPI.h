@@ -0,0 +1,460 @@
+#ifndef SHIM_TFT_ESPI_H
+#define SHIM_TFT_ESPI_H
+
+#include <Arduino.h>
+#include <byteswap.h>
+#include <vector>
+
+/*
+ * TFT_eSPI drawing into memory. The panel is a single TFT_WIDTH x TFT_HEIGHT frame buffer that holds
+ * what the last selected digit was sent, in the byte order it went over the bus. Sprites keep their
+ * pixels byte swapped, as the library does, so that they can be sent as they are.
+ *
+ * Free fonts are drawn properly so that the animations put the same pixels in a sprite as they would
+ * on the clock. The built in fonts only move the cursor.
+ */
+typedef struct {
+  uint16_t bitmapOffset;
+  uint8_t width;
+  uint8_t height;
+  uint8_t xAdvance;
+  int8_t xOffset;
+  int8_t yOffset;
+} GFXglyph;
+
+typedef struct {
+  uint8_t *bitmap;
+  GFXglyph *glyph;
+  uint16_t first;
+  uint16_t last;
+  uint8_t yAdvance;
+} GFXfont;
+
+#define TFT_BLACK       0x0000
+#define TFT_NAVY        0x000F
+#define TFT_DARKGREEN   0x03E0
+#define TFT_MAROON      0x7800
+#define TFT_PURPLE      0x780F
+#define TFT_DARKGREY    0x7BEF
+#define TFT_BLUE        0x001F
+#define TFT_GREEN       0x07E0
+#define TFT_CYAN        0x07FF
+#define TFT_RED         0xF800
+#define TFT_MAGENTA     0xF81F
+#define TFT_YELLOW      0xFFE0
+#define TFT_WHITE       0xFFFF
+#define TFT_ORANGE      0xFDA0
+#define TFT_PINK        0xFE19
+#define TFT_BROWN       0x9A60
+#define TFT_GOLD        0xFEA0
+#define TFT_SILVER      0xC618
+#define TFT_SKYBLUE     0x867D
+#define TFT_VIOLET      0x915C
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+class TFT_eSprite;
+
+class TFT_eSPI : public Print {
+public:
+  TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT) : _init_width(w), _init_height(h) {
+    _width = w;
+    _height = h;
+    panel.assign((size_t)w * h, 0);
+    resetViewport();
+  }
+  virtual ~TFT_eSPI() {}
+
+  void init(uint8_t tc = 0) {
+    panel.assign((size_t)_init_width * _init_height, 0);
+    _width = _init_width;
+    _height = _init_height;
+    resetViewport();
+  }
+  void begin(uint8_t tc = 0) { init(tc); }
+
+  // What the panel was last sent, in bus byte order
+  const uint16_t* getPanel() const { return panel.data(); }
+
+  void writecommand(uint8_t c) {}
+  void writedata(uint8_t d) {}
+  void startWrite() {}
+  void endWrite() {}
+  void setRotation(uint8_t r) { rotation = r; }
+
+  bool initDMA(bool ctrl_cs = false) { return true; }
+  void deInitDMA() {}
+  bool dmaBusy() { return false; }
+  void dmaWait() {}
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer = nullptr) {
+    copyIn(x, y, w, h, data, false);
+  }
+
+  virtual int16_t width() const { return _width; }
+  virtual int16_t height() const { return _height; }
+
+  void setSwapBytes(bool swap) { _swapBytes = swap; }
+  bool getSwapBytes() const { return _swapBytes; }
+
+  void setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool vpDatum = true) {
+    _xDatum = vpDatum ? x : 0;
+    _yDatum = vpDatum ? y : 0;
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > width()) w = width() - x;
+    if (y + h > height()) h = height() - y;
+    _vpOoB = w < 1 || h < 1;
+    _vpX = x;
+    _vpY = y;
+    _vpW = x + w;
+    _vpH = y + h;
+  }
+  void resetViewport() { setViewport(0, 0, _width, _height); }
+  void setPivot(int16_t x, int16_t y) { _xPivot = x; _yPivot = y; }
+  void setTextWrap(bool wrapX, bool wrapY = false) { textwrapX = wrapX; textwrapY = wrapY; }
+
+  static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) {
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+  static uint16_t alphaBlend(uint8_t alpha, uint16_t fgc, uint16_t bgc) {
+    uint16_t fgR = ((fgc >> 10) & 0x3E) + 1;
+    uint16_t fgG = ((fgc >>  4) & 0x7E) + 1;
+    uint16_t fgB = ((fgc <<  1) & 0x3E) + 1;
+
+    uint16_t bgR = ((bgc >> 10) & 0x3E) + 1;
+    uint16_t bgG = ((bgc >>  4) & 0x7E) + 1;
+    uint16_t bgB = ((bgc <<  1) & 0x3E) + 1;
+
+    uint16_t r = (((fgR * alpha) + (bgR * (255 - alpha))) >> 9);
+    uint16_t g = (((fgG * alpha) + (bgG * (255 - alpha))) >> 9);
+    uint16_t b = (((fgB * alpha) + (bgB * (255 - alpha))) >> 9);
+
+    return (r << 11) | (g << 5) | (b << 0);
+  }
+
+  void fillScreen(uint32_t color) { fillRect(0, 0, width(), height(), color); }
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    x += _xDatum;
+    y += _yDatum;
+    int32_t x1 = std::max(x, _vpX), y1 = std::max(y, _vpY);
+    int32_t x2 = std::min(x + w, _vpW), y2 = std::min(y + h, _vpH);
+    uint16_t stored = storedColor(color);
+    for (int32_t py = y1; py < y2; py++) {
+      for (int32_t px = x1; px < x2; px++) {
+        frame()[px + py * frameWidth()] = stored;
+      }
+    }
+  }
+  void drawPixel(int32_t x, int32_t y, uint32_t color) {
+    x += _xDatum;
+    y += _yDatum;
+    if (x >= _vpX && x < _vpW && y >= _vpY && y < _vpH) {
+      frame()[x + y * frameWidth()] = storedColor(color);
+    }
+  }
+  uint16_t readPixel(int32_t x, int32_t y) {
+    x += _xDatum;
+    y += _yDatum;
+    if (x < _vpX || x >= _vpW || y < _vpY || y >= _vpH) return 0;
+    return __bswap_16(frame()[x + y * frameWidth()]);
+  }
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) { fillRect(x, y, w, 1, color); }
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) { fillRect(x, y, 1, h, color); }
+  void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y, h, color);
+    drawFastVLine(x + w - 1, y, h, color);
+  }
+  void fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color) {
+    for (int32_t y = -r; y <= r; y++) {
+      for (int32_t x = -r; x <= r; x++) {
+        if (x * x + y * y <= r * r) drawPixel(x0 + x, y0 + y, color);
+      }
+    }
+  }
+  void drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color) {
+    for (int32_t y = -r; y <= r; y++) {
+      for (int32_t x = -r; x <= r; x++) {
+        int32_t d = x * x + y * y;
+        if (d <= r * r && d > (r - 1) * (r - 1)) drawPixel(x0 + x, y0 + y, color);
+      }
+    }
+  }
+  void drawSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t fg, uint32_t bg) { drawCircle(x, y, r, fg); }
+  void fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color, uint32_t bg = 0x00FFFFFF) { fillCircle(x, y, r, color); }
+  // Angles are clockwise from 6 o'clock, as in the library
+  void drawArc(int32_t x0, int32_t y0, int32_t r, int32_t ir, uint32_t startAngle, uint32_t endAngle,
+      uint32_t fg, uint32_t bg, bool roundEnds = false) {
+    for (int32_t y = -r; y <= r; y++) {
+      for (int32_t x = -r; x <= r; x++) {
+        int32_t d = x * x + y * y;
+        if (d > r * r || d < ir * ir) continue;
+        int32_t angle = (int32_t)lround(atan2(-x, y) * 180 / M_PI);
+        if (angle < 0) angle += 360;
+        if ((uint32_t)angle >= startAngle && (uint32_t)angle <= endAngle) drawPixel(x0 + x, y0 + y, fg);
+      }
+    }
+  }
+  void drawSmoothArc(int32_t x, int32_t y, int32_t r, int32_t ir, uint32_t startAngle, uint32_t endAngle,
+      uint32_t fg, uint32_t bg, bool roundEnds = false) {
+    drawArc(x, y, r, ir, startAngle, endAngle, fg, bg, roundEnds);
+  }
+
+  // Colors are RGB565, and are byte swapped if setSwapBytes(true)
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data) { copyIn(x, y, w, h, data, _swapBytes); }
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data) { copyIn(x, y, w, h, data, _swapBytes); }
+  void pushRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data) { pushImage(x, y, w, h, data); }
+
+  void setCursor(int16_t x, int16_t y) { cursor_x = x; cursor_y = y; }
+  void setCursor(int16_t x, int16_t y, uint8_t font) { setTextFont(font); setCursor(x, y); }
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+  void setTextColor(uint16_t color) { textcolor = textbgcolor = color; }
+  void setTextColor(uint16_t fg, uint16_t bg, bool bgfill = false) { textcolor = fg; textbgcolor = bg; _fillbg = bgfill; }
+  void setTextSize(uint8_t size) { textsize = size > 0 ? size : 1; }
+  void setTextFont(uint8_t font) { gfxFont = nullptr; textfont = font; }
+  void setFreeFont(const GFXfont *font = nullptr) { gfxFont = font; textfont = font != nullptr ? 1 : textfont; }
+  void setTextDatum(uint8_t datum) { textdatum = datum; }
+  uint8_t getTextDatum() const { return textdatum; }
+  void setTextPadding(uint16_t width) { padX = width; }
+
+  int16_t fontHeight() const { return gfxFont != nullptr ? gfxFont->yAdvance * textsize : builtInHeight() * textsize; }
+  int16_t textWidth(const char *s) const {
+    int16_t w = 0;
+    for (; *s; s++) w += charWidth(*s);
+    return w;
+  }
+  int16_t textWidth(const String &s) const { return textWidth(s.c_str()); }
+
+  int16_t drawString(const char *s, int32_t x, int32_t y) {
+    int16_t w = textWidth(s);
+    int16_t h = fontHeight();
+    switch (textdatum) {
+      case TC_DATUM: x -= w / 2; break;
+      case TR_DATUM: x -= w; break;
+      case ML_DATUM: y -= h / 2; break;
+      case MC_DATUM: x -= w / 2; y -= h / 2; break;
+      case MR_DATUM: x -= w; y -= h / 2; break;
+      case BL_DATUM: y -= h; break;
+      case BC_DATUM: x -= w / 2; y -= h; break;
+      case BR_DATUM: x -= w; y -= h; break;
+    }
+    if (gfxFont != nullptr) {
+      // Free fonts are drawn from their baseline
+      y += gfxFont->yAdvance * textsize * 3 / 4;
+    }
+    int16_t oldX = cursor_x, oldY = cursor_y;
+    cursor_x = x;
+    cursor_y = y;
+    for (const char *c = s; *c; c++) drawChar(*c);
+    cursor_x = oldX;
+    cursor_y = oldY;
+    return w;
+  }
+  int16_t drawString(const String &s, int32_t x, int32_t y) { return drawString(s.c_str(), x, y); }
+  int16_t drawCentreString(const char *s, int32_t x, int32_t y, uint8_t font) {
+    uint8_t datum = textdatum;
+    setTextFont(font);
+    textdatum = TC_DATUM;
+    int16_t w = drawString(s, x, y);
+    textdatum = datum;
+    return w;
+  }
+
+  size_t write(uint8_t c) override {
+    drawChar(c);
+    return 1;
+  }
+  using Print::write;
+
+protected:
+  virtual uint16_t* frame() { return panel.data(); }
+  virtual int32_t frameWidth() const { return _init_width; }
+
+  // The frame holds pixels in bus byte order
+  static uint16_t storedColor(uint32_t color) { return __bswap_16((uint16_t)color); }
+
+  void copyIn(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data, bool swap) {
+    if (_vpOoB || data == nullptr) return;
+    x += _xDatum;
+    y += _yDatum;
+    int32_t dx = 0, dy = 0, dw = w, dh = h;
+    if (x < _vpX) { dx = _vpX - x; dw -= dx; x = _vpX; }
+    if (y < _vpY) { dy = _vpY - y; dh -= dy; y = _vpY; }
+    if (x + dw > _vpW) dw = _vpW - x;
+    if (y + dh > _vpH) dh = _vpH - y;
+    if (dw < 1 || dh < 1) return;
+
+    const uint16_t *src = data + dx + dy * w;
+    uint16_t *dst = frame() + x + y * frameWidth();
+    for (int32_t row = 0; row < dh; row++) {
+      if (swap) {
+        for (int32_t col = 0; col < dw; col++) dst[col] = __bswap_16(src[col]);
+      } else {
+        memcpy(dst, src, dw * sizeof(uint16_t));
+      }
+      src += w;
+      dst += frameWidth();
+    }
+  }
+
+  int16_t builtInHeight() const {
+    switch (textfont) {
+      case 2: return 16;
+      case 4: return 26;
+      case 6: return 48;
+      case 7: return 48;
+      default: return 8;
+    }
+  }
+  int16_t charWidth(char c) const {
+    if (gfxFont != nullptr) {
+      if ((uint8_t)c < gfxFont->first || (uint8_t)c > gfxFont->last) return 0;
+      return gfxFont->glyph[(uint8_t)c - gfxFont->first].xAdvance * textsize;
+    }
+    return builtInHeight() * textsize / 2;
+  }
+
+  void drawChar(char c) {
+    if (c == '\n') {
+      cursor_x = 0;
+      cursor_y += fontHeight();
+      return;
+    }
+    if (c == '\r') return;
+    if (gfxFont == nullptr) {
+      if (_fillbg) fillRect(cursor_x, cursor_y, charWidth(c), fontHeight(), textbgcolor);
+      cursor_x += charWidth(c);
+      return;
+    }
+    if ((uint8_t)c < gfxFont->first || (uint8_t)c > gfxFont->last) return;
+
+    const GFXglyph &glyph = gfxFont->glyph[(uint8_t)c - gfxFont->first];
+    const uint8_t *bitmap = gfxFont->bitmap + glyph.bitmapOffset;
+    uint32_t bit = 0;
+    for (int32_t gy = 0; gy < glyph.height; gy++) {
+      for (int32_t gx = 0; gx < glyph.width; gx++, bit++) {
+        if (bitmap[bit >> 3] & (0x80 >> (bit & 7))) {
+          if (textsize == 1) {
+            drawPixel(cursor_x + glyph.xOffset + gx, cursor_y + glyph.yOffset + gy, textcolor);
+          } else {
+            fillRect(cursor_x + (glyph.xOffset + gx) * textsize, cursor_y + (glyph.yOffset + gy) * textsize,
+              textsize, textsize, textcolor);
+          }
+        }
+      }
+    }
+    cursor_x += glyph.xAdvance * textsize;
+  }
+
+  std::vector<uint16_t> panel;
+  int32_t _init_width, _init_height;
+  int32_t _width, _height;
+  int32_t _vpX = 0, _vpY = 0, _vpW = 0, _vpH = 0;
+  int32_t _xDatum = 0, _yDatum = 0;
+  bool _vpOoB = false;
+  int16_t _xPivot = 0, _yPivot = 0;
+  int32_t cursor_x = 0, cursor_y = 0;
+  uint32_t textcolor = TFT_WHITE, textbgcolor = TFT_BLACK;
+  uint8_t textsize = 1, textfont = 1, textdatum = TL_DATUM, rotation = 0;
+  uint16_t padX = 0;
+  bool textwrapX = true, textwrapY = false;
+  bool _fillbg = false;
+  bool _swapBytes = false;
+  const GFXfont *gfxFont = nullptr;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+public:
+  explicit TFT_eSprite(TFT_eSPI *tft) : TFT_eSPI(0, 0), _tft(tft) {}
+  ~TFT_eSprite() { deleteSprite(); }
+
+  void* createSprite(int16_t w, int16_t h, uint8_t frames = 1) {
+    if (_created) return _img;
+    _iwidth = _dwidth = _bitwidth = w;
+    _iheight = _dheight = h;
+    _img = (uint16_t*)calloc((size_t)w * h, sizeof(uint16_t));
+    _img8 = _img8_1 = _img8_2 = _img4 = (uint8_t*)_img;
+    _allocated = _created = _img != nullptr;
+    cursor_x = cursor_y = 0;
+    _sx = _sy = 0;
+    _sw = w;
+    _sh = h;
+    _scolor = TFT_BLACK;
+    setViewport(0, 0, w, h);
+    setPivot(w / 2, h / 2);
+    return _img;
+  }
+  void deleteSprite() {
+    if (_allocated) free(_img);
+    _img = nullptr;
+    _allocated = _created = false;
+  }
+  bool created() const { return _created; }
+  void* getPointer() { return _img; }
+
+  int16_t width() const override { return _dwidth; }
+  int16_t height() const override { return _dheight; }
+
+  void fillSprite(uint32_t color) { fillRect(0, 0, _dwidth, _dheight, color); }
+
+  // The sprite's pixels go to the panel as they are
+  void pushSprite(int32_t x, int32_t y) {
+    if (!_created) return;
+    bool swap = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    _tft->pushImage(x, y, _dwidth, _dheight, _img);
+    _tft->setSwapBytes(swap);
+  }
+  bool pushSprite(int32_t tx, int32_t ty, int32_t sx, int32_t sy, int32_t sw, int32_t sh) {
+    if (!_created) return false;
+    if (sx < 0) { sw += sx; sx = 0; }
+    if (sy < 0) { sh += sy; sy = 0; }
+    if (sx + sw > _dwidth) sw = _dwidth - sx;
+    if (sy + sh > _dheight) sh = _dheight - sy;
+    if (sw < 1 || sh < 1) return false;
+
+    bool swap = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    for (int32_t row = 0; row < sh; row++) {
+      _tft->pushImage(tx, ty + row, sw, 1, _img + sx + (sy + row) * _iwidth);
+    }
+    _tft->setSwapBytes(swap);
+    return true;
+  }
+  bool pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y) {
+    if (!_created || !dspr->_created) return false;
+    dspr->copyIn(x, y, _dwidth, _dheight, _img, false);
+    return true;
+  }
+
+protected:
+  uint16_t* frame() override { return _img; }
+  int32_t frameWidth() const override { return _iwidth; }
+
+  // Blend fg into bg, both in sprite byte order, as the library does for anti-aliased fonts
+  void fastBlend(uint16_t alpha, uint16_t fgc, uint16_t &bgc) {
+    bgc = __bswap_16(alphaBlend(alpha, __bswap_16(fgc), __bswap_16(bgc)));
+  }
+
+  TFT_eSPI *_tft;
+  uint16_t *_img = nullptr;
+  uint8_t *_img8 = nullptr, *_img8_1 = nullptr, *_img8_2 = nullptr, *_img4 = nullptr;
+  int32_t _iwidth = 0, _iheight = 0, _dwidth = 0, _dheight = 0, _bitwidth = 0;
+  int32_t _sx = 0, _sy = 0;
+  uint32_t _sw = 0, _sh = 0;
+  uint32_t _scolor = TFT_BLACK;
+  bool _created = false;
+  bool _allocated = false;
+};
+
+#endif // SHIM_TFT_ESPI_H
@@ -0,0 +1,16 @@
+#ifndef SHIM_TIME_SYNC_H
+#define SHIM_TIME_SYNC_H
+
+#include <Arduino.h>
+
+// The clock is only ever set by the host
+class TimeSync {
+public:
+  virtual ~TimeSync() {}
+  virtual void init() {}
+  virtual void enabled(bool enable) {}
+  virtual bool initialized() { return true; }
+  virtual void setDevice() {}
+};
+
+#endif // SHIM_TIME_SYNC_H
@@ -0,0 +1,127 @@
+#ifndef SHIM_WSTRING_H
+#define SHIM_WSTRING_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/*
+ * Arduino's String, kept in a std::string.
+ */
+class String {
+public:
+  String() {}
+  String(const char *s) : s(s != nullptr ? s : "") {}
+  String(const std::string &s) : s(s) {}
+  explicit String(char c) : s(1, c) {}
+  String(int value, unsigned char base = 10) : String((long)value, base) {}
+  String(unsigned int value, unsigned char base = 10) : String((unsigned long)value, base) {}
+  String(long value, unsigned char base = 10) {
+    if (value < 0 && base == 10) {
+      s = "-" + toBase((unsigned long)-value, base);
+    } else {
+      s = toBase((unsigned long)value, base);
+    }
+  }
+  String(unsigned long value, unsigned char base = 10) : s(toBase(value, base)) {}
+  String(float value, unsigned int decimals = 2) : String((double)value, decimals) {}
+  String(double value, unsigned int decimals = 2) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    s = buffer;
+  }
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.length(); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+  bool concat(const String &other) { s += other.s; return true; }
+  bool concat(const char *other) { s += other; return true; }
+  bool concat(char c) { s += c; return true; }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+  bool concat(const char *other, unsigned int len) { s.append(other, len); return true; }
+
+  template <typename T>
+  String& operator+=(const T &other) { concat(other); return *this; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+  friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.s); }
+  friend String operator+(const String &a, char b) { return String(a.s + b); }
+  friend String operator+(const String &a, int b) { return a + String(b); }
+  friend String operator+(const String &a, unsigned int b) { return a + String(b); }
+  friend String operator+(const String &a, long b) { return a + String(b); }
+  friend String operator+(const String &a, unsigned long b) { return a + String(b); }
+  friend String operator+(const String &a, double b) { return a + String(b); }
+
+  bool equals(const String &other) const { return s == other.s; }
+  bool equals(const char *other) const { return s == other; }
+  bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+  bool operator==(const String &other) const { return s == other.s; }
+  bool operator==(const char *other) const { return s == other; }
+  bool operator!=(const String &other) const { return s != other.s; }
+  bool operator!=(const char *other) const { return s != other; }
+  bool operator<(const String &other) const { return s < other.s; }
+  int compareTo(const String &other) const { return s.compare(other.s); }
+  bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+  bool endsWith(const String &suffix) const {
+    return s.length() >= suffix.s.length() && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+  }
+
+  char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+  void setCharAt(unsigned int index, char c) { if (index < s.length()) s[index] = c; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index) { return s[index]; }
+
+  int indexOf(char c, unsigned int from = 0) const { return find(s.find(c, from)); }
+  int indexOf(const String &other, unsigned int from = 0) const { return find(s.find(other.s, from)); }
+  int lastIndexOf(char c) const { return find(s.rfind(c)); }
+  int lastIndexOf(const String &other) const { return find(s.rfind(other.s)); }
+  String substring(unsigned int from) const { return from < s.length() ? String(s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s.length()) return String();
+    return String(s.substr(from, to - from));
+  }
+
+  void replace(const String &find, const String &with) {
+    if (find.s.empty()) return;
+    for (size_t at = s.find(find.s); at != std::string::npos; at = s.find(find.s, at + with.s.length())) {
+      s.replace(at, find.s.length(), with.s);
+    }
+  }
+  void remove(unsigned int index) { if (index < s.length()) s.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < s.length()) s.erase(index, count); }
+  void toLowerCase() { for (char &c : s) c = tolower(c); }
+  void toUpperCase() { for (char &c : s) c = toupper(c); }
+  void trim() {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    size_t end = s.find_last_not_of(" \t\r\n");
+    s = start == std::string::npos ? "" : s.substr(start, end - start + 1);
+  }
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return atof(c_str()); }
+  double toDouble() const { return atof(c_str()); }
+
+private:
+  static int find(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+  static std::string toBase(unsigned long value, unsigned char base) {
+    std::string digits;
+    do {
+      digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[value % base]);
+      value /= base;
+    } while (value != 0);
+    return digits;
+  }
+
+  std::string s;
+};
+
+#endif // SHIM_WSTRING_H
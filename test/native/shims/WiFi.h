@@ -0,0 +1,6 @@
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+#include <Arduino.h>
+
+#endif // SHIM_WIFI_H
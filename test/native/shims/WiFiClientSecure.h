@@ -0,0 +1,20 @@
+#ifndef SHIM_WIFI_CLIENT_SECURE_H
+#define SHIM_WIFI_CLIENT_SECURE_H
+
+#include <Arduino.h>
+
+// There is no network, so it never connects. Tests feed the parsers a Stream instead.
+class WiFiClientSecure : public Stream {
+public:
+  void setInsecure() {}
+  int connect(const char *host, uint16_t port) { return 0; }
+  uint8_t connected() { return 0; }
+  void stop() {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t c) override { return 1; }
+  using Print::write;
+};
+
+#endif // SHIM_WIFI_CLIENT_SECURE_H
@@ -0,0 +1,28 @@
+#ifndef SHIM_ESP_HEAP_CAPS_H
+#define SHIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+// The host's heap stands in for all of them. It reports what an ESP32 without PSRAM has free after boot.
+#ifndef SHIM_FREE_HEAP
+#define SHIM_FREE_HEAP (160 * 1024)
+#endif
+
+inline void* heap_caps_malloc(size_t size, unsigned int caps) { return malloc(size); }
+inline void* heap_caps_calloc(size_t n, size_t size, unsigned int caps) { return calloc(n, size); }
+inline void* heap_caps_realloc(void *ptr, size_t size, unsigned int caps) { return realloc(ptr, size); }
+inline void heap_caps_free(void *ptr) { free(ptr); }
+inline size_t heap_caps_get_free_size(unsigned int caps) { return caps & MALLOC_CAP_SPIRAM ? 0 : SHIM_FREE_HEAP; }
+inline size_t heap_caps_get_minimum_free_size(unsigned int caps) { return heap_caps_get_free_size(caps); }
+inline size_t heap_caps_get_largest_free_block(unsigned int caps) { return heap_caps_get_free_size(caps); }
+
+#endif // SHIM_ESP_HEAP_CAPS_H
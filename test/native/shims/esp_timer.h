@@ -0,0 +1,94 @@
+#ifndef SHIM_ESP_TIMER_H
+#define SHIM_ESP_TIMER_H
+
+#include <algorithm>
+#include "ShimClock.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+  ESP_TIMER_TASK,
+  ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void *arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char *name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer : shim::Timer {
+  uint64_t periodUs = 0;
+};
+typedef esp_timer *esp_timer_handle_t;
+
+inline int64_t esp_timer_get_time() {
+  return shim::nowUs();
+}
+
+// Timers only fire while a test is moving the clock with shim::advanceTimeUs()
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+  if (args == nullptr || args->callback == nullptr || handle == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_timer *timer = new esp_timer();
+  esp_timer_cb_t callback = args->callback;
+  void *arg = args->arg;
+  timer->fire = [timer, callback, arg]() {
+    if (timer->periodUs != 0) {
+      timer->dueUs += timer->periodUs;
+      timer->armed = true;
+    }
+    callback(arg);
+  };
+  shim::timers().push_back(timer);
+  *handle = timer;
+
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->periodUs = 0;
+  timer->dueUs = shim::nowUs() + timeoutUs + (shim::timerLatencyUs ? shim::timerLatencyUs() : 0);
+  timer->armed = true;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  if (timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->periodUs = periodUs;
+  timer->dueUs = shim::nowUs() + periodUs;
+  timer->armed = true;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer->armed) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  std::vector<shim::Timer*> &all = shim::timers();
+  all.erase(std::remove(all.begin(), all.end(), timer), all.end());
+  delete timer;
+  return ESP_OK;
+}
+
+#endif // SHIM_ESP_TIMER_H
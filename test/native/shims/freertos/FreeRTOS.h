@@ -0,0 +1,37 @@
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <mutex>
+
+/*
+ * FreeRTOS on top of threads. A tick is a millisecond of host time, whatever the shim clock says.
+ */
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configASSERT(x) do { if (!(x)) abort(); } while (0)
+#define portYIELD_FROM_ISR(...) do {} while (0)
+
+// Critical sections nest on the same core, so the lock is recursive
+struct portMUX_TYPE {
+  std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+#endif // SHIM_FREERTOS_H
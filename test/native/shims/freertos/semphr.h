@@ -0,0 +1,68 @@
+#ifndef SHIM_FREERTOS_SEMPHR_H
+#define SHIM_FREERTOS_SEMPHR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include "FreeRTOS.h"
+
+// Mutexes are counting semaphores too, they just don't know who holds them
+struct QueueDefinition {
+  std::mutex mutex;
+  std::condition_variable changed;
+  UBaseType_t count;
+  UBaseType_t max;
+};
+typedef QueueDefinition *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+  SemaphoreHandle_t semaphore = new QueueDefinition();
+  semaphore->count = initial;
+  semaphore->max = max;
+  return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return xSemaphoreCreateCounting(1, 1);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xSemaphoreCreateCounting(1, 0);
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete semaphore;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(semaphore->mutex);
+  auto available = [semaphore]() { return semaphore->count > 0; };
+  if (ticks == portMAX_DELAY) {
+    semaphore->changed.wait(lock, available);
+  } else if (!semaphore->changed.wait_for(lock, std::chrono::milliseconds(ticks), available)) {
+    return pdFALSE;
+  }
+
+  semaphore->count--;
+  return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  std::lock_guard<std::mutex> lock(semaphore->mutex);
+  if (semaphore->count == semaphore->max) {
+    return pdFALSE;
+  }
+
+  semaphore->count++;
+  semaphore->changed.notify_one();
+  return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken) {
+  if (woken != nullptr) {
+    *woken = pdFALSE;
+  }
+  return xSemaphoreGive(semaphore);
+}
+
+#endif // SHIM_FREERTOS_SEMPHR_H
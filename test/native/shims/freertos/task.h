@@ -0,0 +1,167 @@
+#ifndef SHIM_FREERTOS_TASK_H
+#define SHIM_FREERTOS_TASK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "FreeRTOS.h"
+#include "../ShimClock.h"
+
+typedef void (*TaskFunction_t)(void *arg);
+
+typedef enum {
+  eNoAction,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite
+} eNotifyAction;
+
+// A task is a thread with a notification value
+struct tskTaskControlBlock {
+  std::mutex mutex;
+  std::condition_variable changed;
+  uint32_t value = 0;
+  bool notified = false;
+};
+typedef tskTaskControlBlock *TaskHandle_t;
+
+namespace shim {
+
+// Thrown by vTaskDelete(nullptr) to unwind the task's thread
+struct TaskDeleted {};
+
+inline TaskHandle_t& currentTask() {
+  thread_local TaskHandle_t task = nullptr;
+  return task;
+}
+
+// Wait for a notification, return the value and let clear change it. clear returns true if the
+// task is still notified afterwards. False on timeout.
+template <typename Clear>
+bool waitNotify(TickType_t ticks, uint32_t *value, Clear clear) {
+  if (currentTask() == nullptr) {
+    currentTask() = new tskTaskControlBlock();
+  }
+  TaskHandle_t task = currentTask();
+
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (ticks == portMAX_DELAY) {
+    task->changed.wait(lock, [task]() { return task->notified; });
+  } else if (!task->changed.wait_for(lock, std::chrono::milliseconds(ticks), [task]() { return task->notified; })) {
+    return false;
+  }
+
+  *value = task->value;
+  task->notified = clear(task->value);
+  return true;
+}
+
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (shim::currentTask() == nullptr) {
+    shim::currentTask() = new tskTaskControlBlock();
+  }
+  return shim::currentTask();
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *arg,
+    UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  TaskHandle_t task = new tskTaskControlBlock();
+  if (handle != nullptr) {
+    *handle = task;
+  }
+
+  std::thread([fn, arg, task]() {
+    shim::currentTask() = task;
+    try {
+      fn(arg);
+    } catch (const shim::TaskDeleted&) {
+    }
+  }).detach();
+
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *arg,
+    UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, arg, priority, handle, 0);
+}
+
+// Only a task can delete itself
+inline void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == shim::currentTask()) {
+    throw shim::TaskDeleted();
+  }
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+  return shim::nowUs() / 1000;
+}
+
+inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+  std::lock_guard<std::mutex> lock(task->mutex);
+  if (action == eSetValueWithoutOverwrite && task->notified) {
+    return pdFAIL;
+  }
+
+  switch (action) {
+    case eSetBits: task->value |= value; break;
+    case eIncrement: task->value++; break;
+    case eSetValueWithOverwrite:
+    case eSetValueWithoutOverwrite: task->value = value; break;
+    case eNoAction: break;
+  }
+  task->notified = true;
+  task->changed.notify_all();
+
+  return pdPASS;
+}
+
+inline BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken) {
+  if (woken != nullptr) {
+    *woken = pdTRUE;
+  }
+  return xTaskNotify(task, value, action);
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  return xTaskNotify(task, 0, eIncrement);
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+inline BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->value &= ~clearOnEntry;
+  }
+
+  uint32_t notified = 0;
+  if (!shim::waitNotify(ticks, &notified, [clearOnExit](uint32_t &v) { v &= ~clearOnExit; return false; })) {
+    return pdFALSE;
+  }
+  if (value != nullptr) {
+    *value = notified;
+  }
+  return pdTRUE;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  uint32_t count = 0;
+  if (!shim::waitNotify(ticks, &count, [clearOnExit](uint32_t &v) { v = clearOnExit ? 0 : v - 1; return v != 0; })) {
+    return 0;
+  }
+  return count;
+}
+
+#endif // SHIM_FREERTOS_TASK_H
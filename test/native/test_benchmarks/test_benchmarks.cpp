@@ -0,0 +1,273 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include "Benchmark.h"
+#include "TFTs.h"
+#include "Backlights.h"
+#include "DigitalRainAnimation.h"
+#include "OpenWeatherMapWeatherService.h"
+#include "ConfigJson.h"
+
+/*
+ * Runs the benchmarks that only need the CPU and compares them with test/benchmarks_native.json. The
+ * host is much faster than the device, so each benchmark is called again and again for RUN_US, adding
+ * up each case. That is done RUNS times and the fastest is kept.
+ *
+ * A host's speed changes from moment to moment, and hosts differ, so each run also times a fixed
+ * calibration loop, and what is compared is each case's time per operation as a fraction of that
+ * ("relative" in the baseline). After a change that is meant to be slower, or to record a faster
+ * baseline, run
+ *
+ *   BENCHMARK_SAVE=1 pio test -e native -f native/test_benchmarks
+ *
+ * and check the new file in. BENCHMARK_TOLERANCE sets how much slower than the baseline, as a
+ * percentage, a case can be (DEFAULT_TOLERANCE otherwise). Where the stack and heap happen to land
+ * can make a decode case half as slow again from one run to the next, so this only catches big
+ * regressions. tools/benchmarks.py on the device is still the way to compare small ones. Cases that
+ * take less than MIN_COMPARE_US in a run are printed but not compared, as a host can't time them
+ * reliably.
+ */
+
+#define BASELINE_FILE "test/benchmarks_native.json"
+#define RUN_US 50000
+#define RUNS 10
+#define DEFAULT_TOLERANCE 100
+#define MIN_COMPARE_US 1000
+
+struct Result {
+  uint32_t n = 0;
+  uint32_t us = 0;
+  double relative = 0;
+  double usPerOp() const { return (double)us / max(n, 1u); }
+};
+
+static std::map<std::string, Result> results;
+static std::map<std::string, Result> run;
+
+static void add(const char *benchmark, const char *name, uint32_t n, uint32_t us) {
+  Result &result = run[std::string(benchmark) + ":" + name];
+  result.n += n;
+  result.us += us;
+}
+
+// FNV-1a over a buffer, which only depends on the speed of the host. Microseconds per pass.
+static double calibrate() {
+  static uint8_t buffer[16 * 1024];
+  for (size_t i = 0; i < sizeof(buffer); i++) {
+    buffer[i] = i * 31;
+  }
+
+  const uint32_t passes = 64;
+  volatile uint32_t hash = 2166136261u;
+  uint32_t start = micros();
+  for (uint32_t i = 0; i < passes; i++) {
+    for (size_t j = 0; j < sizeof(buffer); j++) {
+      hash = (hash ^ buffer[j]) * 16777619u;
+    }
+  }
+  return (double)(micros() - start) / passes;
+}
+
+// Call benchmark for at least RUN_US, RUNS times, and keep the fastest run of each case
+template <typename Benchmark>
+static void measure(Benchmark benchmark) {
+  benchmarkListener() = add;
+  for (int i = 0; i < RUNS; i++) {
+    run.clear();
+    double calibrationUs = calibrate();
+    uint32_t start = micros();
+    do {
+      benchmark();
+    } while (micros() - start < RUN_US);
+    calibrationUs = min(calibrationUs, calibrate());
+
+    for (auto &result : run) {
+      result.second.relative = result.second.usPerOp() / calibrationUs;
+      auto fastest = results.find(result.first);
+      if (fastest == results.end() || result.second.relative < fastest->second.relative) {
+        results[result.first] = result.second;
+      }
+    }
+  }
+  benchmarkListener() = nullptr;
+}
+
+// The same shape as the device's config, from the items the host builds have
+static BaseConfigItem *ledSet[] = {
+  &Backlights::getLEDPattern(),
+  &Backlights::getLEDHue(),
+  &Backlights::getLEDSaturation(),
+  &Backlights::getLEDValue(),
+  &Backlights::getBreathPerMin(),
+  &Backlights::getHuePerLed(),
+  0
+};
+static CompositeConfigItem ledConfig("leds", 0, ledSet);
+
+static BaseConfigItem *weatherSet[] = {
+  &WeatherService::getWeatherToken(),
+  &WeatherService::getLatitude(),
+  &WeatherService::getLongitude(),
+  &WeatherService::getUnits(),
+  0
+};
+static CompositeConfigItem weatherConfig("weather", 0, weatherSet);
+
+static BaseConfigItem *matrixSet[] = {
+  &DigitalRainAnimation::getMatrixSpeed(),
+  &DigitalRainAnimation::getMatrixHue(),
+  &DigitalRainAnimation::getMatrixSaturation(),
+  &DigitalRainAnimation::getMatrixValue(),
+  &DigitalRainAnimation::getMatrixHueCycling(),
+  &DigitalRainAnimation::getMatrixHueCycleTime(),
+  0
+};
+static CompositeConfigItem matrixConfig("matrix", 0, matrixSet);
+
+static StringConfigItem hostName("hostname", 63, "ipsclock");
+static BaseConfigItem *globalSet[] = { &hostName, 0 };
+static CompositeConfigItem globalConfig("global", 0, globalSet);
+
+static BaseConfigItem *rootSet[] = { &globalConfig, &ledConfig, &weatherConfig, &matrixConfig, 0 };
+static CompositeConfigItem rootConfig("root", 0, rootSet);
+
+static VolatileState volatileState() {
+  VolatileState state;
+  state.screenSaverOn = false;
+  state.brightness = 255;
+  state.custom = "custom";
+  state.display = 0;
+  state.backlightOn = true;
+  state.backlightHue = 85;
+  state.backlightSaturation = 255;
+  state.backlightBrightness = 255;
+  state.hasUnderlight = false;
+  return state;
+}
+
+// The baseline, as tools/benchmarks.py --save writes it
+static std::map<std::string, Result> readBaseline() {
+  std::map<std::string, Result> baseline;
+  FILE *f = fopen(BASELINE_FILE, "r");
+  if (f == nullptr) {
+    return baseline;
+  }
+
+  char line[256];
+  char key[200] = "";
+  unsigned long value;
+  double relative;
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    if (strchr(line, '{') != nullptr && sscanf(line, " \"%199[^\"]\"", key) == 1) {
+      baseline[key] = Result();
+    } else if (sscanf(line, " \"n\": %lu", &value) == 1) {
+      baseline[key].n = value;
+    } else if (sscanf(line, " \"us\": %lu", &value) == 1) {
+      baseline[key].us = value;
+    } else if (sscanf(line, " \"relative\": %lf", &relative) == 1) {
+      baseline[key].relative = relative;
+    }
+  }
+  fclose(f);
+  return baseline;
+}
+
+static bool saveBaseline() {
+  FILE *f = fopen(BASELINE_FILE, "w");
+  if (f == nullptr) {
+    return false;
+  }
+
+  fprintf(f, "{");
+  const char *separator = "\n";
+  for (const auto &result : results) {
+    fprintf(f, "%s  \"%s\": {\n    \"n\": %u,\n    \"relative\": %.6g,\n    \"us\": %u,\n    \"us_per_op\": %.6g\n  }",
+      separator, result.first.c_str(), result.second.n, result.second.relative, result.second.us, result.second.usPerOp());
+    separator = ",\n";
+  }
+  fprintf(f, "\n}\n");
+  return fclose(f) == 0;
+}
+
+static TFTs *display;
+static Backlights *backlights;
+static OpenWeatherMapWeatherService *weather;
+
+static void runBenchmarks() {
+  measure([]() { display->benchmarkDecode(); });
+  measure([]() { display->benchmarkAnimation(); });
+  measure([]() { backlights->benchmark(); });
+  measure([]() { weather->benchmark(); });
+  measure([]() { benchmarkJson(rootConfig, volatileState()); });
+}
+
+// The number of cases slower than the baseline allows, or not in it
+static int compare(const std::map<std::string, Result> &baseline, double allowed, bool print) {
+  int regressions = 0;
+  for (const auto &result : results) {
+    auto expected = baseline.find(result.first);
+    if (expected == baseline.end()) {
+      if (print) {
+        printf("%-40s %10.3fus/op  not in " BASELINE_FILE "\n", result.first.c_str(), result.second.usPerOp());
+      }
+      regressions++;
+      continue;
+    }
+
+    double ratio = result.second.relative / expected->second.relative;
+    const char *status = "ok";
+    if (result.second.us < MIN_COMPARE_US) {
+      status = "too short to compare";
+    } else if (ratio > allowed) {
+      status = "SLOWER";
+      regressions++;
+    }
+    if (print) {
+      printf("%-40s %10.3fus/op  %+6.1f%%  %s\n", result.first.c_str(), result.second.usPerOp(), (ratio - 1) * 100, status);
+    }
+  }
+  return regressions;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_run_benchmarks() {
+  runBenchmarks();
+  TEST_ASSERT_GREATER_THAN(0, results.size());
+
+  if (getenv("BENCHMARK_SAVE") != nullptr) {
+    TEST_ASSERT_TRUE(saveBaseline());
+    printf("Saved %u results to " BASELINE_FILE "\n", (unsigned)results.size());
+  }
+}
+
+void test_compare_with_baseline() {
+  std::map<std::string, Result> baseline = readBaseline();
+  TEST_ASSERT_GREATER_THAN_MESSAGE(0, baseline.size(), "no results in " BASELINE_FILE);
+
+  const char *tolerance = getenv("BENCHMARK_TOLERANCE");
+  double allowed = 1 + (tolerance != nullptr ? atof(tolerance) : DEFAULT_TOLERANCE) / 100.0;
+
+  // Something else running on the host can make a case look slower, so check again before failing
+  if (compare(baseline, allowed, false) != 0) {
+    runBenchmarks();
+  }
+  TEST_ASSERT_EQUAL_INT(0, compare(baseline, allowed, true));
+}
+
+int main(int argc, char **argv) {
+  display = new TFTs();
+  fs::FS files(".");
+  display->begin(files);
+  backlights = new Backlights();
+  backlights->begin();
+  weather = new OpenWeatherMapWeatherService();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_run_benchmarks);
+  RUN_TEST(test_compare_with_baseline);
+  return UNITY_END();
+}
@@ -0,0 +1,200 @@
+#include <unity.h>
+#include "ButtonStateMachine.h"
+
+#define MS 1000
+
+// An edge from the button's interrupt, atUs after the start of the trace
+struct Edge {
+  bool pressed;
+  uint32_t atUs;
+};
+
+// Starts of the traces that make micros() wrap part way through them
+static const uint32_t wrappingStarts[] = {
+  UINT32_MAX - 150 * MS,
+  UINT32_MAX - BUTTON_DEBOUNCE_US / 2,
+};
+
+static ButtonStateMachine machine;
+static uint32_t startUs = 0;
+
+void setUp() {
+  machine = ButtonStateMachine();
+}
+
+void tearDown() {}
+
+// Feed the edges from startUs, and return the events they caused or'd together
+static uint8_t play(const Edge *edges, size_t count) {
+  uint8_t events = 0;
+  for (size_t i = 0; i < count; i++) {
+    events |= machine.edge(edges[i].pressed, startUs + edges[i].atUs);
+  }
+  return events;
+}
+
+static uint8_t updateAt(uint32_t us) {
+  return machine.update(startUs + us);
+}
+
+void test_click() {
+  const Edge edges[] = { { true, 0 }, { false, 200 * MS } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, play(edges, 1));
+  TEST_ASSERT_TRUE(machine.isPressed());
+  // Reported as soon as it's released, without waiting to see if there's another
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges + 1, 1));
+  TEST_ASSERT_FALSE(machine.isPressed());
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(2000 * MS));
+}
+
+void test_bounce_is_ignored() {
+  // Contacts chatter for a few ms after each press and release
+  const Edge edges[] = {
+    { true, 0 }, { false, 1 * MS }, { true, 2 * MS }, { false, 4 * MS }, { true, 7 * MS },
+    { false, 200 * MS }, { true, 201 * MS }, { false, 203 * MS }, { true, 230 * MS }, { false, 249 * MS },
+  };
+
+  uint8_t events = 0;
+  uint32_t clicks = 0;
+  for (const Edge &edge : edges) {
+    uint8_t e = machine.edge(edge.pressed, startUs + edge.atUs);
+    events |= e;
+    clicks += (e & ButtonStateMachine::CLICK) != 0;
+  }
+  events |= updateAt(1000 * MS);
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, events);
+  TEST_ASSERT_EQUAL_UINT32(1, clicks);
+  TEST_ASSERT_FALSE(machine.isPressed());
+}
+
+void test_level_at_end_of_bounce_is_taken() {
+  // A tap shorter than the debounce time still counts, once the level has been steady for long enough
+  const Edge edges[] = { { true, 0 }, { false, 10 * MS } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, play(edges, 2));
+  TEST_ASSERT_TRUE(machine.isPressed());
+  TEST_ASSERT_EQUAL_UINT32(BUTTON_DEBOUNCE_US - 10 * MS, machine.usUntilUpdate(startUs + 10 * MS));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(BUTTON_DEBOUNCE_US - 1));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, updateAt(BUTTON_DEBOUNCE_US));
+  TEST_ASSERT_FALSE(machine.isPressed());
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, machine.usUntilUpdate(startUs + BUTTON_DEBOUNCE_US));
+}
+
+void test_double_click() {
+  const Edge edges[] = { { true, 0 }, { false, 100 * MS }, { true, 250 * MS }, { false, 350 * MS } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges, 2));
+  // The second click of a pair is both
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK | ButtonStateMachine::DOUBLE_CLICK, play(edges + 2, 2));
+
+  // A third click starts a new pair
+  const Edge third[] = { { true, 450 * MS }, { false, 500 * MS } };
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(third, 2));
+}
+
+void test_slow_second_click_is_not_a_double_click() {
+  const Edge edges[] = {
+    { true, 0 }, { false, 100 * MS },
+    { true, 100 * MS + BUTTON_DOUBLE_CLICK_US - 50 * MS }, { false, 100 * MS + BUTTON_DOUBLE_CLICK_US + 1 },
+  };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges, 2));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges + 2, 2));
+}
+
+void test_long_press_while_held() {
+  const Edge press = { true, 0 };
+  play(&press, 1);
+
+  TEST_ASSERT_EQUAL_UINT32(BUTTON_LONG_PRESS_US + 1, machine.usUntilUpdate(startUs));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(BUTTON_LONG_PRESS_US));
+  TEST_ASSERT_EQUAL_UINT32(1, machine.usUntilUpdate(startUs + BUTTON_LONG_PRESS_US));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::LONG_PRESS, updateAt(BUTTON_LONG_PRESS_US + 1));
+  // Only once, and nothing more to wait for while it is held
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(BUTTON_LONG_PRESS_US + 200 * MS));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, machine.usUntilUpdate(startUs + BUTTON_LONG_PRESS_US + 200 * MS));
+
+  // Releasing it doesn't also click
+  const Edge release = { false, 2000 * MS };
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, play(&release, 1));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(3000 * MS));
+}
+
+void test_long_press_on_release() {
+  // Nobody called update() while it was held, so the release reports it
+  const Edge edges[] = { { true, 0 }, { false, BUTTON_LONG_PRESS_US + 100 * MS } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, play(edges, 1));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::LONG_PRESS, play(edges + 1, 1));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, updateAt(3000 * MS));
+}
+
+void test_long_press_does_not_start_a_double_click() {
+  const Edge edges[] = {
+    { true, 0 }, { false, BUTTON_LONG_PRESS_US + 10 * MS },
+    { true, BUTTON_LONG_PRESS_US + 100 * MS }, { false, BUTTON_LONG_PRESS_US + 200 * MS },
+  };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::LONG_PRESS, play(edges, 2));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges + 2, 2));
+}
+
+void test_press_just_short_of_long_is_a_click() {
+  const Edge edges[] = { { true, 0 }, { false, BUTTON_LONG_PRESS_US } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges, 2));
+}
+
+void test_click_after_long_idle() {
+  // Long enough for the time since the last change to look negative as a signed 32 bit number
+  const uint32_t idleUs = 40 * 60 * 1000 * MS;
+  const Edge edges[] = { { true, 0 }, { false, 100 * MS }, { true, 100 * MS + idleUs }, { false, 200 * MS + idleUs } };
+
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges, 2));
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::NONE, play(edges + 2, 1));
+  TEST_ASSERT_TRUE(machine.isPressed());
+  TEST_ASSERT_EQUAL_UINT8(ButtonStateMachine::CLICK, play(edges + 3, 1));
+}
+
+// Each trace again, from starts that make micros() wrap part way through it
+#define ACROSS_WRAP(test) \
+  void test##_across_wrap() { \
+    for (uint32_t start : wrappingStarts) { \
+      startUs = start; \
+      setUp(); \
+      test(); \
+    } \
+    startUs = 0; \
+  }
+
+ACROSS_WRAP(test_click)
+ACROSS_WRAP(test_bounce_is_ignored)
+ACROSS_WRAP(test_level_at_end_of_bounce_is_taken)
+ACROSS_WRAP(test_double_click)
+ACROSS_WRAP(test_long_press_while_held)
+ACROSS_WRAP(test_long_press_on_release)
+ACROSS_WRAP(test_click_after_long_idle)
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_click);
+  RUN_TEST(test_bounce_is_ignored);
+  RUN_TEST(test_level_at_end_of_bounce_is_taken);
+  RUN_TEST(test_double_click);
+  RUN_TEST(test_slow_second_click_is_not_a_double_click);
+  RUN_TEST(test_long_press_while_held);
+  RUN_TEST(test_long_press_on_release);
+  RUN_TEST(test_long_press_does_not_start_a_double_click);
+  RUN_TEST(test_press_just_short_of_long_is_a_click);
+  RUN_TEST(test_click_after_long_idle);
+  RUN_TEST(test_click_across_wrap);
+  RUN_TEST(test_bounce_is_ignored_across_wrap);
+  RUN_TEST(test_level_at_end_of_bounce_is_taken_across_wrap);
+  RUN_TEST(test_double_click_across_wrap);
+  RUN_TEST(test_long_press_while_held_across_wrap);
+  RUN_TEST(test_long_press_on_release_across_wrap);
+  RUN_TEST(test_click_after_long_idle_across_wrap);
+  return UNITY_END();
+}
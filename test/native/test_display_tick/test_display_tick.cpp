@@ -0,0 +1,155 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "DisplayTick.h"
+
+// Timer latency and how much it varies either way
+#define LATENCY_US 2000
+#define JITTER_US 300
+
+// latencyUs only moves while the error is at least 8us, and each tick can be JITTER_US off the mean
+#define LATENCY_TOLERANCE_US (JITTER_US + 8)
+
+#define START_US 1700000000400000LL
+
+static uint32_t jitterState;
+
+static void resetJitter() {
+  jitterState = 12345;
+}
+
+// Deterministic, so a failure can be reproduced
+static int32_t jitter() {
+  jitterState = jitterState * 1103515245 + 12345;
+  return (int32_t)((jitterState >> 8) % (2 * JITTER_US + 1)) - JITTER_US;
+}
+
+static int32_t phaseErrorUs(int64_t nowUs, uint32_t leadUs) {
+  int32_t errorUs = (int32_t)(nowUs % 1000000) - (int32_t)(1000000 - leadUs);
+  if (errorUs >= 500000) {
+    errorUs -= 1000000;
+  } else if (errorUs < -500000) {
+    errorUs += 1000000;
+  }
+  return errorUs;
+}
+
+// The wall clock, which is the shim clock plus whatever the time has been set to
+class WallClock : public DisplayTick::TimeSource {
+public:
+  virtual int64_t nowUs() { return offsetUs + (int64_t)shim::nowUs(); }
+
+  int64_t offsetUs = START_US;
+};
+
+void setUp() {
+  resetJitter();
+  shim::setTimeUs(0);
+  shim::timerLatencyUs = []() { return (uint64_t)(LATENCY_US + jitter()); };
+}
+
+void tearDown() {
+  shim::timerLatencyUs = nullptr;
+  shim::useHostTime();
+}
+
+void test_schedule_learns_latency() {
+  DisplayTick tick;
+  int64_t nowUs = START_US;
+
+  for (int i = 0; i < 60; i++) {
+    uint32_t delayUs = tick.schedule(nowUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(DISPLAY_TICK_MIN_DELAY_US, delayUs);
+    TEST_ASSERT_LESS_THAN(DISPLAY_TICK_MIN_DELAY_US + 1000000, delayUs);
+
+    nowUs += delayUs + LATENCY_US + jitter();
+    if (i >= 40) {
+      // Converged, so only the jitter is left
+      TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US + JITTER_US, 0, phaseErrorUs(nowUs, tick.getLeadUs()));
+    }
+  }
+
+  const DisplayTick::Stats &stats = tick.getStats();
+  TEST_ASSERT_EQUAL_UINT32(59, stats.ticks);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.steps);
+  TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US, LATENCY_US, stats.latencyUs);
+  // The first tick, before anything was learnt, is the furthest off
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_US + JITTER_US, stats.maxErrorUs);
+  TEST_ASSERT_LESS_THAN(LATENCY_US / 2, stats.meanErrorUs());
+}
+
+void test_tick_is_one_second_apart() {
+  DisplayTick tick;
+  // An hour in, so the phase wraps many times
+  int64_t nowUs = START_US + 3600LL * 1000000;
+
+  tick.schedule(nowUs);
+  for (int i = 0; i < 20; i++) {
+    nowUs += tick.schedule(nowUs) + LATENCY_US;
+  }
+  uint32_t delayUs = tick.schedule(nowUs);
+  TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US, 1000000, delayUs + LATENCY_US);
+}
+
+void test_timer_ticks_and_notifies() {
+  WallClock clock;
+  DisplayTick tick;
+  TEST_ASSERT_TRUE(tick.begin(xTaskGetCurrentTaskHandle(), &clock));
+
+  uint32_t ticks = 0;
+  for (int i = 0; i < 30; i++) {
+    shim::advanceTimeUs(1000000);
+    uint32_t value = 0;
+    if (xTaskNotifyWait(0, DISPLAY_TICK_NOTIFY_BIT, &value, 0) == pdTRUE && (value & DISPLAY_TICK_NOTIFY_BIT)) {
+      ticks++;
+    }
+    TEST_ASSERT_TRUE(tick.take());
+    TEST_ASSERT_FALSE(tick.take());
+  }
+  tick.end();
+
+  TEST_ASSERT_FALSE(tick.isRunning());
+  TEST_ASSERT_EQUAL_UINT32(30, ticks);
+  TEST_ASSERT_INT_WITHIN(1, 30, tick.getStats().ticks);
+  TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US, LATENCY_US, tick.getStats().latencyUs);
+}
+
+void test_wall_clock_steps_are_ignored() {
+  WallClock clock;
+  DisplayTick tick;
+  TEST_ASSERT_TRUE(tick.begin(xTaskGetCurrentTaskHandle(), &clock));
+
+  shim::advanceTimeUs(30 * 1000000);
+  DisplayTick::Stats settled = tick.getStats();
+  TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US, LATENCY_US, settled.latencyUs);
+
+  // Forward by 3.3s in the middle of a second, as SNTP might, and then back by 0.6s
+  shim::advanceTimeUs(500000);
+  clock.offsetUs += 3300000;
+  shim::advanceTimeUs(10 * 1000000);
+  clock.offsetUs -= 600000;
+  shim::advanceTimeUs(20 * 1000000);
+
+  const DisplayTick::Stats &stats = tick.getStats();
+  TEST_ASSERT_EQUAL_UINT32(2, stats.steps);
+  // What was learnt before the steps still holds
+  TEST_ASSERT_INT_WITHIN(LATENCY_TOLERANCE_US, LATENCY_US, stats.latencyUs);
+  // No tick that wasn't a step was further off than the timer's latency before it was learnt
+  TEST_ASSERT_EQUAL_UINT32(settled.maxErrorUs, stats.maxErrorUs);
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_US + JITTER_US, stats.maxErrorUs);
+  // And the ticks after them are back on the second
+  uint64_t errorSinceUs = stats.totalErrorUs - settled.totalErrorUs;
+  uint32_t ticksSince = (stats.ticks - stats.steps) - (settled.ticks - settled.steps);
+  TEST_ASSERT_GREATER_THAN(25, ticksSince);
+  TEST_ASSERT_LESS_OR_EQUAL(LATENCY_TOLERANCE_US, errorSinceUs / ticksSince);
+
+  tick.end();
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_schedule_learns_latency);
+  RUN_TEST(test_tick_is_one_second_apart);
+  RUN_TEST(test_timer_ticks_and_notifies);
+  RUN_TEST(test_wall_clock_steps_are_ignored);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <FS.h>
+#include <stdio.h>
+#include "TFTs.h"
+#include "IPSClock.h"
+
+/*
+ * The glyph cache only holds a couple of full screen digits without PSRAM, so what it has to hold is
+ * the working set of a ticking clock: the digit that is showing and the next second's, which the render
+ * task prefetches after each tick. This runs a clock through ten minutes of ticks the same way and
+ * checks how often the digits drawn at the tick come from the cache.
+ */
+
+#define TICKS 600
+#define MIN_HIT_PERCENT 95
+
+// Paths start with "/", from the top of the project
+static fs::FS files(".");
+static TFTs *display;
+
+// HHMMSS for second t of the day
+static void digitNames(int t, char names[NUM_DIGITS][4]) {
+  int h = (t / 3600) % 24;
+  int m = (t / 60) % 60;
+  int s = t % 60;
+  int digits[NUM_DIGITS] = { h / 10, h % 10, m / 10, m % 10, s / 10, s % 10 };
+  for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+    snprintf(names[digit], sizeof(names[digit]), "%d", digits[digit]);
+  }
+}
+
+// Returns the percentage of the glyphs looked up at the ticks that were found
+static uint32_t tickHitPercent(const char *dir) {
+  display->flushGlyphCache();
+  display->setCacheDir(IPSClock::TIME, dir);
+  display->invalidateAllDigits();
+
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+  int start = 9 * 3600 + 55 * 60;
+
+  for (int t = start; t < start + TICKS; t++) {
+    char names[NUM_DIGITS][4];
+    char next[NUM_DIGITS][4];
+    digitNames(t, names);
+    digitNames(t + 1, next);
+
+    GlyphCache::Stats before = display->getGlyphCacheStats();
+    display->claim();
+    display->setShowDigits(IPSClock::TIME);
+    display->beginUpdate();
+    for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+      display->setDigit(digit, names[digit], TFTs::yes);
+    }
+    display->release();
+    // The first tick draws every digit from the files
+    if (t != start) {
+      hits += display->getGlyphCacheStats().hits - before.hits;
+      misses += display->getGlyphCacheStats().misses - before.misses;
+    }
+
+    const char *prefetch[NUM_DIGITS];
+    for (uint8_t digit = 0; digit < NUM_DIGITS; digit++) {
+      prefetch[digit] = next[digit];
+    }
+    display->claim();
+    display->prefetchDigits(prefetch);
+    display->release();
+  }
+
+  printf("%s: %u hits, %u misses at the tick\n", dir, hits, misses);
+  return hits * 100 / (hits + misses);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_full_screen_digits_are_prefetched() {
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(MIN_HIT_PERCENT, tickHitPercent("/more_faces/led5"));
+}
+
+void test_smaller_digits_are_prefetched() {
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(MIN_HIT_PERCENT, tickHitPercent("/data/ips/cache"));
+}
+
+int main(int argc, char **argv) {
+  display = new TFTs();
+  display->begin(files);
+  display->setTransition(TFTs::NO_TRANSITION);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_full_screen_digits_are_prefetched);
+  RUN_TEST(test_smaller_digits_are_prefetched);
+  return UNITY_END();
+}
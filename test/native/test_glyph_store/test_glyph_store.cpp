@@ -0,0 +1,113 @@
+#include <unity.h>
+#include <string.h>
+#include "GlyphStore.h"
+
+static GlyphStoreHeader makeHeader(const char *dir, uint32_t length) {
+  GlyphStoreHeader header = {};
+  header.magic = GLYPH_STORE_MAGIC;
+  header.version = GLYPH_STORE_VERSION;
+  header.length = length;
+  strncpy(header.dir, dir, sizeof(header.dir));
+  return header;
+}
+
+// Write a store holding atlas for dir, the way TFTs::storeGlyphs() does
+static bool store(GlyphStore &glyphs, const char *dir, const uint8_t *atlas, uint32_t length) {
+  GlyphStoreHeader header = makeHeader(dir, length);
+  return glyphs.erase(sizeof(header) + length)
+    && glyphs.write(sizeof(header), atlas, length)
+    && glyphs.write(0, &header, sizeof(header))
+    && glyphs.end();
+}
+
+static GlyphStore glyphs;
+
+void setUp() {
+  if (!glyphs.mapped()) {
+    TEST_ASSERT_TRUE(glyphs.begin());
+  }
+}
+
+void tearDown() {}
+
+void test_maps_the_whole_file() {
+  TEST_ASSERT_TRUE(glyphs.mapped());
+  TEST_ASSERT_EQUAL_UINT32(GLYPH_STORE_FILE_SIZE, glyphs.size());
+  TEST_ASSERT_NOT_NULL(glyphs.getHeader());
+}
+
+void test_reads_back_what_was_stored() {
+  uint8_t atlas[1000];
+  for (size_t i = 0; i < sizeof(atlas); i++) {
+    atlas[i] = i * 7;
+  }
+
+  TEST_ASSERT_TRUE(store(glyphs, "/ips/cache", atlas, sizeof(atlas)));
+
+  const uint8_t *mapped = glyphs.getAtlas("/ips/cache");
+  TEST_ASSERT_NOT_NULL(mapped);
+  TEST_ASSERT_EQUAL_MEMORY(atlas, mapped, sizeof(atlas));
+  TEST_ASSERT_EQUAL_UINT32(sizeof(atlas), glyphs.getHeader()->length);
+  // Atlas images are word aligned relative to the atlas, so the atlas must be too
+  TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t)mapped % 4);
+}
+
+void test_other_directory_is_not_found() {
+  uint8_t atlas[16] = { 1, 2, 3 };
+  TEST_ASSERT_TRUE(store(glyphs, "/ips/cache", atlas, sizeof(atlas)));
+
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/weather_cache"));
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/cach"));
+}
+
+void test_erased_store_has_no_atlas() {
+  uint8_t atlas[16] = {};
+  TEST_ASSERT_TRUE(store(glyphs, "/ips/cache", atlas, sizeof(atlas)));
+
+  // Nothing is mapped between erase() and end(), so a half written store can't be read
+  TEST_ASSERT_TRUE(glyphs.erase(sizeof(GlyphStoreHeader)));
+  TEST_ASSERT_FALSE(glyphs.mapped());
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/cache"));
+
+  TEST_ASSERT_TRUE(glyphs.end());
+  TEST_ASSERT_EQUAL_HEX32(0xffffffff, glyphs.getHeader()->magic);
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/cache"));
+}
+
+void test_rejects_bad_headers() {
+  uint8_t atlas[16] = {};
+  TEST_ASSERT_TRUE(store(glyphs, "/ips/cache", atlas, sizeof(atlas)));
+
+  GlyphStoreHeader header = makeHeader("/ips/cache", sizeof(atlas));
+  header.version = GLYPH_STORE_VERSION + 1;
+  TEST_ASSERT_TRUE(glyphs.erase(sizeof(header)));
+  TEST_ASSERT_TRUE(glyphs.write(0, &header, sizeof(header)));
+  TEST_ASSERT_TRUE(glyphs.end());
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/cache"));
+
+  // Longer than the store
+  header = makeHeader("/ips/cache", GLYPH_STORE_FILE_SIZE);
+  TEST_ASSERT_TRUE(glyphs.erase(sizeof(header)));
+  TEST_ASSERT_TRUE(glyphs.write(0, &header, sizeof(header)));
+  TEST_ASSERT_TRUE(glyphs.end());
+  TEST_ASSERT_NULL(glyphs.getAtlas("/ips/cache"));
+}
+
+void test_rejects_writes_past_the_end() {
+  uint8_t byte = 0;
+  TEST_ASSERT_FALSE(glyphs.erase(GLYPH_STORE_FILE_SIZE + 1));
+  TEST_ASSERT_FALSE(glyphs.write(GLYPH_STORE_FILE_SIZE, &byte, 1));
+  TEST_ASSERT_TRUE(glyphs.write(GLYPH_STORE_FILE_SIZE - 1, &byte, 1));
+  TEST_ASSERT_TRUE(glyphs.end());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_maps_the_whole_file);
+  RUN_TEST(test_reads_back_what_was_stored);
+  RUN_TEST(test_other_directory_is_not_found);
+  RUN_TEST(test_erased_store_has_no_atlas);
+  RUN_TEST(test_rejects_bad_headers);
+  RUN_TEST(test_rejects_writes_past_the_end);
+  return UNITY_END();
+}
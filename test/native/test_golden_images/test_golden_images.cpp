@@ -0,0 +1,246 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <FS.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "TFTs.h"
+
+/*
+ * Decodes every image in data/ips, more_faces and weather_icons through TFTs::hashImage() and checks
+ * the hashes against test/golden_images.json, so a change to a decoder has to draw the same pixels.
+ * Directories that only have .tar.gz files are unpacked under .pio first. After a change that is
+ * meant to draw differently, save new hashes with
+ *
+ *   GOLDEN_IMAGES_SAVE=1 pio test -e native -f native/test_golden_images
+ *
+ * and check the new file in. The decode time of each image is printed with -v.
+ */
+
+#define GOLDEN_FILE "test/golden_images.json"
+#define UNPACK_DIR "/.pio/golden_images"
+
+static const char *roots[] = { "/data/ips", "/more_faces", "/weather_icons" };
+
+// Paths start with "/", from the top of the project
+static fs::FS files(".");
+static TFTs *display;
+
+struct Result {
+  uint32_t hash;
+  uint32_t us;
+};
+
+static std::map<std::string, Result> results;
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t length = strlen(suffix);
+  return s.length() >= length && s.compare(s.length() - length, length, suffix) == 0;
+}
+
+static std::string baseName(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static void makeDirs(const std::string &path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+    files.mkdir(path.substr(0, slash).c_str());
+  }
+  files.mkdir(path.c_str());
+}
+
+/*
+ * Unpack the images in a .tar.gz into dir. The faces are plain tar files of images, but may have been
+ * made on a Mac, so directories and "._" files are skipped.
+ */
+static bool unpack(const std::string &archive, const std::string &dir) {
+  gzFile in = gzopen(("." + archive).c_str(), "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  makeDirs(dir);
+
+  bool ok = false;
+  char header[512];
+  while (gzread(in, header, sizeof(header)) == sizeof(header)) {
+    if (header[0] == 0) {
+      ok = true;
+      break;
+    }
+
+    std::string name = baseName(std::string(header, strnlen(header, 100)));
+    size_t size = strtoul(std::string(header + 124, 12).c_str(), nullptr, 8);
+    char type = header[156];
+
+    std::vector<char> data((size + 511) / 512 * 512);
+    if (!data.empty() && gzread(in, data.data(), data.size()) != (int)data.size()) {
+      break;
+    }
+
+    if ((type == '0' || type == 0) && endsWith(name, ".bmp") && name.compare(0, 2, "._") != 0) {
+      fs::File out = files.open((dir + "/" + name).c_str(), FILE_WRITE);
+      if (!out) {
+        break;
+      }
+      out.write((const uint8_t*)data.data(), size);
+      out.close();
+    }
+  }
+
+  gzclose(in);
+  return ok;
+}
+
+// Hash each image in dir, named from under name
+static void hashDir(const std::string &dir, const std::string &name) {
+  fs::File root = files.open(dir.c_str());
+  String fileName = root.getNextFileName();
+  while (fileName.length() > 0) {
+    std::string path = fileName.c_str();
+    if (endsWith(path, ".bmp")) {
+      std::string image = baseName(path);
+      image.resize(image.length() - 4);
+
+      uint32_t start = micros();
+      uint32_t hash = display->hashImage(dir.c_str(), image.c_str());
+      uint32_t us = micros() - start;
+
+      results[name + "/" + image] = { hash, us };
+    }
+    fileName = root.getNextFileName();
+  }
+  root.close();
+}
+
+// The images in dir and the directories below it, and in archives in directories without loose images
+static void hashTree(const std::string &dir) {
+  std::vector<std::string> archives;
+  bool hasImages = false;
+
+  fs::File root = files.open(dir.c_str());
+  for (fs::File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+    std::string path = entry.path();
+    if (entry.isDirectory()) {
+      hashTree(path);
+    } else if (endsWith(path, ".bmp")) {
+      hasImages = true;
+    } else if (endsWith(path, ".tar.gz")) {
+      archives.push_back(path);
+    }
+  }
+  root.close();
+
+  if (hasImages) {
+    hashDir(dir, dir.substr(1));
+    return;
+  }
+
+  // The loose images are what the archive was made from, when they are there
+  for (const std::string &archive : archives) {
+    std::string name = archive.substr(1, archive.length() - 1 - strlen(".tar.gz"));
+    std::string unpacked = UNPACK_DIR "/" + name;
+    TEST_ASSERT_TRUE_MESSAGE(unpack(archive, unpacked), archive.c_str());
+    hashDir(unpacked, name);
+  }
+}
+
+// The same format as tools/golden_images.py --save: { "name": "hash", ... }, one to a line
+static std::map<std::string, std::string> readGolden() {
+  std::map<std::string, std::string> golden;
+  FILE *f = fopen(GOLDEN_FILE, "r");
+  if (f == nullptr) {
+    return golden;
+  }
+
+  char line[256];
+  char name[200];
+  char hash[9];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    if (sscanf(line, " \"%199[^\"]\": \"%8[0-9a-f]\"", name, hash) == 2) {
+      golden[name] = hash;
+    }
+  }
+  fclose(f);
+  return golden;
+}
+
+static bool saveGolden() {
+  FILE *f = fopen(GOLDEN_FILE, "w");
+  if (f == nullptr) {
+    return false;
+  }
+
+  fprintf(f, "{");
+  const char *separator = "\n";
+  for (const auto &result : results) {
+    fprintf(f, "%s  \"%s\": \"%08x\"", separator, result.first.c_str(), result.second.hash);
+    separator = ",\n";
+  }
+  fprintf(f, "\n}\n");
+  return fclose(f) == 0;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_hashes_every_image() {
+  for (const char *root : roots) {
+    hashTree(root);
+  }
+  TEST_ASSERT_GREATER_THAN(0, results.size());
+
+  uint64_t totalUs = 0;
+  for (const auto &result : results) {
+    printf("%-50s %08x %6uus\n", result.first.c_str(), result.second.hash, result.second.us);
+    totalUs += result.second.us;
+  }
+  printf("%u images decoded in %llums\n", (unsigned)results.size(), (unsigned long long)(totalUs / 1000));
+
+  if (getenv("GOLDEN_IMAGES_SAVE") != nullptr) {
+    TEST_ASSERT_TRUE(saveGolden());
+    printf("Saved %u hashes to " GOLDEN_FILE "\n", (unsigned)results.size());
+  }
+}
+
+void test_hashes_match_golden() {
+  std::map<std::string, std::string> golden = readGolden();
+  TEST_ASSERT_GREATER_THAN_MESSAGE(0, golden.size(), "no hashes in " GOLDEN_FILE);
+
+  int mismatches = 0;
+  char hash[9];
+  for (const auto &result : results) {
+    snprintf(hash, sizeof(hash), "%08x", result.second.hash);
+    auto expected = golden.find(result.first);
+    if (expected == golden.end()) {
+      printf("%s isn't in " GOLDEN_FILE "\n", result.first.c_str());
+      mismatches++;
+    } else if (expected->second != hash) {
+      printf("%s hash %s, expected %s\n", result.first.c_str(), hash, expected->second.c_str());
+      mismatches++;
+    }
+  }
+
+  // An image that has gone is a mismatch too
+  for (const auto &expected : golden) {
+    if (results.find(expected.first) == results.end()) {
+      printf("%s is missing\n", expected.first.c_str());
+      mismatches++;
+    }
+  }
+
+  TEST_ASSERT_EQUAL_INT(0, mismatches);
+}
+
+int main(int argc, char **argv) {
+  display = new TFTs();
+  display->begin(files);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_hashes_every_image);
+  RUN_TEST(test_hashes_match_golden);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "Scheduler.h"
+
+#define EVENT_A (1 << 1)
+#define EVENT_B (1 << 2)
+
+// Time only moves when the test, or a job using CPU time, moves it
+class FakeClock : public Scheduler::Clock {
+public:
+  virtual uint64_t nowUs() { return us; }
+
+  uint64_t us = 5000000;
+};
+
+static FakeClock fakeClock;
+static Scheduler *scheduler;
+
+void setUp() {
+  fakeClock = FakeClock();
+  scheduler = new Scheduler();
+  scheduler->begin(xTaskGetCurrentTaskHandle(), &fakeClock);
+}
+
+void tearDown() {
+  delete scheduler;
+}
+
+// Wake the scheduler at ms after the start
+static uint32_t runAt(uint32_t ms, uint32_t events = 0) {
+  fakeClock.us = 5000000 + (uint64_t)ms * 1000;
+  return scheduler->run(events, fakeClock.us);
+}
+
+void test_periodic_job_runs_at_once_then_every_period() {
+  uint32_t runs = 0;
+  scheduler->add("tick", [&runs]() { runs++; }, 100);
+
+  TEST_ASSERT_EQUAL_UINT32(100, runAt(0));
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+
+  TEST_ASSERT_EQUAL_UINT32(40, runAt(60));
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+
+  TEST_ASSERT_EQUAL_UINT32(100, runAt(100));
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  TEST_ASSERT_EQUAL_UINT32(2, scheduler->getJobStats(0).runs);
+  TEST_ASSERT_EQUAL_STRING("tick", scheduler->getJobStats(0).name);
+}
+
+void test_late_wakeup_keeps_to_the_period() {
+  uint32_t runs = 0;
+  scheduler->add("tick", [&runs]() { runs++; }, 100);
+
+  runAt(0);
+  // 30ms late, so the next run is 70ms away rather than 100ms
+  TEST_ASSERT_EQUAL_UINT32(70, runAt(130));
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  TEST_ASSERT_EQUAL_UINT32(100, runAt(200));
+  TEST_ASSERT_EQUAL_UINT32(3, runs);
+
+  // A run every 101ms doesn't drift away from the period
+  for (uint32_t ms = 301; ms < 10000; ms += 101) {
+    runAt(ms);
+  }
+  TEST_ASSERT_EQUAL_UINT32(100, runs);
+}
+
+void test_missed_periods_run_once() {
+  uint32_t runs = 0;
+  scheduler->add("tick", [&runs]() { runs++; }, 100);
+
+  runAt(0);
+  // Four periods missed, one run, and the period starts again from now
+  TEST_ASSERT_EQUAL_UINT32(100, runAt(450));
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  TEST_ASSERT_EQUAL_UINT32(50, runAt(500));
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  runAt(550);
+  TEST_ASSERT_EQUAL_UINT32(3, runs);
+}
+
+void test_event_only_job() {
+  uint32_t runs = 0;
+  scheduler->add("events", [&runs]() { runs++; }, 0, EVENT_A);
+
+  // Nothing is ever due, so sleep until an event
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, runAt(0));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, runAt(100000));
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, runAt(100001, EVENT_B));
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, runAt(100002, EVENT_A | EVENT_B));
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+  runAt(100002, EVENT_A);
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+}
+
+void test_event_restarts_the_period() {
+  uint32_t runs = 0;
+  scheduler->add("both", [&runs]() { runs++; }, 100, EVENT_A);
+
+  runAt(0);
+  TEST_ASSERT_EQUAL_UINT32(100, runAt(30, EVENT_A));
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  runAt(100);
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+  runAt(130);
+  TEST_ASSERT_EQUAL_UINT32(3, runs);
+}
+
+void test_delay_is_to_the_soonest_job_after_running() {
+  scheduler->add("slow", []() { fakeClock.us += 2500; }, 250);
+  scheduler->add("fast", []() {}, 100);
+  scheduler->add("events", []() {}, 0, EVENT_A);
+
+  // Measured from when the jobs finished, and rounded up so the job is due when the task wakes
+  TEST_ASSERT_EQUAL_UINT32(98, runAt(0));
+  TEST_ASSERT_EQUAL_UINT32(50, runAt(200));
+  TEST_ASSERT_EQUAL_UINT32(48, runAt(250));
+  // Already due
+  fakeClock.us += 1000000;
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->run(0, fakeClock.us - 1000000));
+}
+
+void test_slow_job_does_not_push_the_others_back() {
+  uint32_t fastRuns = 0;
+  scheduler->add("slow", []() { fakeClock.us += 40000; }, 100);
+  scheduler->add("fast", [&fastRuns]() { fastRuns++; }, 100);
+
+  // Both ran at 0, even though fast started 40ms late, so both are due at 100
+  TEST_ASSERT_EQUAL_UINT32(60, runAt(0));
+  runAt(100);
+  TEST_ASSERT_EQUAL_UINT32(2, fastRuns);
+}
+
+void test_wakeups_and_cpu_time_per_second() {
+  scheduler->add("busy", []() { fakeClock.us += 2000; }, 100);
+  scheduler->add("idle", []() {}, 0, EVENT_A);
+  scheduler->add("events", []() { fakeClock.us += 500; }, 0, EVENT_A);
+
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->getWakeupsPerSecond());
+
+  // 10 periodic wakeups and 5 events a second, for three seconds
+  for (uint32_t ms = 0; ms < 3000; ms += 100) {
+    runAt(ms);
+    if (ms % 200 == 0) {
+      runAt(ms + 50, EVENT_A);
+    }
+  }
+  runAt(3000);
+
+  TEST_ASSERT_EQUAL_UINT32(15, scheduler->getWakeupsPerSecond());
+  TEST_ASSERT_EQUAL_UINT32(30 + 1, scheduler->getJobStats(0).runs);
+  TEST_ASSERT_EQUAL_UINT32(10 * 2000, scheduler->getJobStats(0).usPerSecond);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->getJobStats(1).usPerSecond);
+  TEST_ASSERT_EQUAL_UINT32(5 * 500, scheduler->getJobStats(2).usPerSecond);
+
+  // A quiet second
+  runAt(4000);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->getWakeupsPerSecond());
+  TEST_ASSERT_EQUAL_UINT32(2000, scheduler->getJobStats(0).usPerSecond);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->getJobStats(2).usPerSecond);
+}
+
+void test_loop_runs_signalled_jobs() {
+  uint32_t runs = 0;
+  scheduler->add("events", [&runs]() { runs++; }, 0, EVENT_A);
+
+  // Nothing signalled yet, so the first wait times out at once
+  scheduler->loop();
+  TEST_ASSERT_EQUAL_UINT32(0, runs);
+
+  scheduler->signal(EVENT_A);
+  scheduler->loop();
+  TEST_ASSERT_EQUAL_UINT32(1, runs);
+
+  BaseType_t woken = pdFALSE;
+  scheduler->signalFromISR(EVENT_A, &woken);
+  scheduler->loop();
+  TEST_ASSERT_EQUAL_UINT32(2, runs);
+}
+
+void test_full_scheduler_refuses_jobs() {
+  for (uint8_t i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, scheduler->add("job", []() {}, 100));
+  }
+  TEST_ASSERT_EQUAL_UINT8(SCHEDULER_MAX_JOBS, scheduler->add("one too many", []() {}, 100));
+  TEST_ASSERT_EQUAL_UINT8(SCHEDULER_MAX_JOBS, scheduler->getJobCount());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_job_runs_at_once_then_every_period);
+  RUN_TEST(test_late_wakeup_keeps_to_the_period);
+  RUN_TEST(test_missed_periods_run_once);
+  RUN_TEST(test_event_only_job);
+  RUN_TEST(test_event_restarts_the_period);
+  RUN_TEST(test_delay_is_to_the_soonest_job_after_running);
+  RUN_TEST(test_slow_job_does_not_push_the_others_back);
+  RUN_TEST(test_wakeups_and_cpu_time_per_second);
+  RUN_TEST(test_loop_runs_signalled_jobs);
+  RUN_TEST(test_full_scheduler_refuses_jobs);
+  return UNITY_END();
+}
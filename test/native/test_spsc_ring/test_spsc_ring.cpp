@@ -0,0 +1,98 @@
+#include <unity.h>
+#include <thread>
+#include "SpscRing.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_pops_in_push_order() {
+  SpscRing<uint32_t, 8> ring;
+  uint32_t item;
+
+  TEST_ASSERT_FALSE(ring.pop(item));
+  for (uint32_t i = 0; i < 5; i++) {
+    TEST_ASSERT_TRUE(ring.push(i));
+  }
+  for (uint32_t i = 0; i < 5; i++) {
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(i, item);
+  }
+  TEST_ASSERT_FALSE(ring.pop(item));
+  TEST_ASSERT_FALSE(ring.takeOverflow());
+}
+
+void test_full_ring_drops_and_remembers() {
+  SpscRing<uint32_t, 4> ring;
+  uint32_t item;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(ring.push(i));
+  }
+  TEST_ASSERT_FALSE(ring.push(4));
+  TEST_ASSERT_TRUE(ring.takeOverflow());
+  TEST_ASSERT_FALSE(ring.takeOverflow());
+
+  // What was already queued is untouched
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(i, item);
+  }
+  TEST_ASSERT_TRUE(ring.push(5));
+  TEST_ASSERT_FALSE(ring.takeOverflow());
+}
+
+void test_wraps_around_many_times() {
+  SpscRing<uint32_t, 4> ring;
+  uint32_t item;
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_TRUE(ring.push(i + 1000000));
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(i, item);
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(i + 1000000, item);
+  }
+  TEST_ASSERT_FALSE(ring.takeOverflow());
+}
+
+// One thread in the place of the ISR, the test in the place of the task
+void test_producer_and_consumer_threads() {
+  static SpscRing<uint32_t, 16> ring;
+  const uint32_t count = 200000;
+
+  std::thread producer([count]() {
+    for (uint32_t i = 0; i < count; i++) {
+      while (!ring.push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  uint32_t item;
+  while (expected < count) {
+    if (ring.pop(item)) {
+      if (item != expected) {
+        break;
+      }
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(count, expected);
+  TEST_ASSERT_FALSE(ring.pop(item));
+  ring.takeOverflow();
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pops_in_push_order);
+  RUN_TEST(test_full_ring_drops_and_remembers);
+  RUN_TEST(test_wraps_around_many_times);
+  RUN_TEST(test_producer_and_consumer_threads);
+  return UNITY_END();
+}
@@ -0,0 +1,196 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <new>
+#include <string>
+#include "OpenWeatherMapWeatherService.h"
+#include "Benchmark.h"
+
+// When test/weather.json was recorded, a Tuesday afternoon in Zocca (UTC+2)
+#define NOW 1661870592
+#define TUESDAY 2
+
+// The most the heap grew by while reading, through operator new. The parser is meant not to allocate.
+static bool counting = false;
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+
+void* operator new(size_t size) {
+  // Room in front of the block for its size
+  size_t *block = (size_t*)malloc(size + sizeof(max_align_t));
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  *block = size;
+  if (counting) {
+    liveBytes += size;
+    peakBytes = max(peakBytes, liveBytes);
+  }
+  return (char*)block + sizeof(max_align_t);
+}
+
+void operator delete(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  size_t *block = (size_t*)((char*)p - sizeof(max_align_t));
+  if (counting) {
+    liveBytes -= min(liveBytes, *block);
+  }
+  free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+static void startCounting() {
+  liveBytes = 0;
+  peakBytes = 0;
+  counting = true;
+}
+
+static size_t stopCounting() {
+  counting = false;
+  return peakBytes;
+}
+
+// Empty if it can't be read, which the parser rejects
+static std::string readFile(const char *path) {
+  std::string contents;
+  FILE *f = fopen(path, "rb");
+  if (f != nullptr) {
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+      contents.append(buffer, n);
+    }
+    fclose(f);
+  }
+  return contents;
+}
+
+static bool readCurrent(OpenWeatherMapWeatherService &weather, const std::string &json) {
+  BenchmarkStream stream(json.data(), json.length());
+  return weather.readCurrent(stream);
+}
+
+static bool readForecast(OpenWeatherMapWeatherService &weather, const std::string &json, time_t now = NOW) {
+  BenchmarkStream stream(json.data(), json.length());
+  return weather.readForecast(stream, now);
+}
+
+// Each day's low and high, from the entries in test/forecast_40.json on that date in UTC+2. Day 5
+// is today and day 0 is 5 days from now.
+static void assertFiveDays(OpenWeatherMapWeatherService &weather) {
+  const int days[] = { 0, 6, 5, 4, 3, TUESDAY };
+  const float lows[] = { 288.81, 292.03, 296.16, 295.05, 290.38, 295.69 };
+  const float highs[] = { 298.62, 300.94, 305.07, 303.3, 300.19, 300.36 };
+  for (int day = 0; day < 6; day++) {
+    TEST_ASSERT_EQUAL_INT_MESSAGE(days[day], weather.getDayOfWeek(day), "day of the week");
+    TEST_ASSERT_FLOAT_WITHIN(0.01, lows[day], weather.getLow(day));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, highs[day], weather.getHigh(day));
+  }
+
+  // The icon at noon on each of the next 5 days, and now
+  const char *icons[] = { "01d", "11d", "02d", "10d", "03d", "10d" };
+  for (int day = 0; day < 6; day++) {
+    TEST_ASSERT_EQUAL_STRING(icons[day], weather.getIconName(day).c_str());
+  }
+}
+
+void setUp() {}
+
+void tearDown() {
+  counting = false;
+}
+
+void test_reads_the_current_weather() {
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, readFile("test/weather.json")));
+  weather.commit();
+
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 298.48, weather.getNowTemp());
+  TEST_ASSERT_EQUAL_STRING("10d", weather.getIconName(5).c_str());
+}
+
+void test_nothing_changes_until_commit() {
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, readFile("test/weather.json")));
+  TEST_ASSERT_TRUE(readForecast(weather, readFile("test/forecast_40.json")));
+
+  TEST_ASSERT_TRUE(isnan(weather.getNowTemp()));
+  TEST_ASSERT_EQUAL_INT(-1, weather.getDayOfWeek(0));
+  TEST_ASSERT_EQUAL_STRING("unknown", weather.getIconName(0).c_str());
+}
+
+void test_splits_a_5_day_forecast_into_days() {
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, readFile("test/weather.json")));
+  TEST_ASSERT_TRUE(readForecast(weather, readFile("test/forecast_40.json")));
+  weather.commit();
+
+  assertFiveDays(weather);
+}
+
+// Only 6 days are shown, and the days after them mustn't change them
+void test_a_15_day_forecast_shows_the_same_days() {
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, readFile("test/weather.json")));
+  TEST_ASSERT_TRUE(readForecast(weather, readFile("test/forecast_120.json")));
+  weather.commit();
+
+  assertFiveDays(weather);
+}
+
+void test_the_current_weather_comes_first() {
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_FALSE(readForecast(weather, readFile("test/forecast_40.json")));
+}
+
+void test_a_forecast_in_another_timezone_is_rejected() {
+  std::string current = readFile("test/weather.json");
+  size_t at = current.find("\"timezone\": 7200");
+  TEST_ASSERT_TRUE(at != std::string::npos);
+  current.replace(at, strlen("\"timezone\": 7200"), "\"timezone\": 3600");
+
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, current));
+  TEST_ASSERT_FALSE(readForecast(weather, readFile("test/forecast_40.json")));
+}
+
+void test_a_truncated_forecast_is_an_error() {
+  std::string forecast = readFile("test/forecast_40.json");
+  forecast.resize(forecast.length() / 2);
+
+  OpenWeatherMapWeatherService weather;
+  TEST_ASSERT_TRUE(readCurrent(weather, readFile("test/weather.json")));
+  TEST_ASSERT_FALSE(readForecast(weather, forecast));
+}
+
+void test_reading_allocates_nothing() {
+  std::string current = readFile("test/weather.json");
+  std::string forecast = readFile("test/forecast_120.json");
+  OpenWeatherMapWeatherService weather;
+
+  startCounting();
+  bool read = readCurrent(weather, current) && readForecast(weather, forecast);
+  size_t peak = stopCounting();
+
+  TEST_ASSERT_TRUE(read);
+  printf("peak heap while reading %u bytes of forecast: %u bytes\n", (unsigned)forecast.length(), (unsigned)peak);
+  TEST_ASSERT_EQUAL_UINT32(0, peak);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reads_the_current_weather);
+  RUN_TEST(test_nothing_changes_until_commit);
+  RUN_TEST(test_splits_a_5_day_forecast_into_days);
+  RUN_TEST(test_a_15_day_forecast_shows_the_same_days);
+  RUN_TEST(test_the_current_weather_comes_first);
+  RUN_TEST(test_a_forecast_in_another_timezone_is_rejected);
+  RUN_TEST(test_a_truncated_forecast_is_an_error);
+  RUN_TEST(test_reading_allocates_nothing);
+  return UNITY_END();
+}
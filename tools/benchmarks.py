@@ -0,0 +1,69 @@
+# Pick the benchmark results out of a serial log from a BENCHMARK_* build, and either save them as a
+# baseline or compare them with one.
+#
+#   pio device monitor | tee run.log
+#   python tools/benchmarks.py run.log --save baseline.json
+#   python tools/benchmarks.py run.log --baseline baseline.json --tolerance 10
+#
+# Exits with status 1 if anything is slower than the baseline by more than the tolerance. The cases
+# that only need the CPU are also run on the host, against test/benchmarks_native.json, by
+# pio test -e native -f native/test_benchmarks.
+import argparse
+import json
+import sys
+
+def read_results(log):
+    results = {}
+    with open(log, errors="replace") as f:
+        for line in f:
+            start = line.find('{"benchmark":')
+            if start < 0:
+                continue
+            try:
+                result = json.loads(line[start:].strip())
+            except json.JSONDecodeError:
+                continue
+            key = result["benchmark"] + ":" + result["case"]
+            n = max(result["n"], 1)
+            results[key] = { "n": result["n"], "us": result["us"], "us_per_op": result["us"] / n }
+    return results
+
+parser = argparse.ArgumentParser(description="Save or compare on-device benchmark results")
+parser.add_argument("log", help="serial log containing the benchmark output")
+parser.add_argument("--save", metavar="BASELINE", help="write the results to this file")
+parser.add_argument("--baseline", metavar="BASELINE", help="compare the results with this file")
+parser.add_argument("--tolerance", type=float, default=10, help="percentage slower than the baseline that is allowed")
+args = parser.parse_args()
+
+results = read_results(args.log)
+if not results:
+    print("No benchmark results in " + args.log)
+    sys.exit(1)
+
+if args.save:
+    with open(args.save, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print("Saved " + str(len(results)) + " results to " + args.save)
+
+if args.baseline:
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    regressions = 0
+    for key in sorted(results):
+        now = results[key]["us_per_op"]
+        if key not in baseline:
+            print("%-50s %12.2f us  (new)" % (key, now))
+            continue
+        before = baseline[key]["us_per_op"]
+        change = (now - before) * 100 / before if before else 0
+        flag = ""
+        if change > args.tolerance:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-50s %12.2f us  %+6.1f%%%s" % (key, now, change, flag))
+
+    for key in sorted(set(baseline) - set(results)):
+        print("%-50s missing" % key)
+
+    sys.exit(1 if regressions else 0)
@@ -0,0 +1,74 @@
+# Check the image decoders against hashes from a known good build. Build with -D GOLDEN_IMAGES (the
+# elekstubev2_benchmark env does), upload the icon packs to check, select each one so that it is
+# unpacked, and save the serial log.
+#
+#   python tools/golden_images.py run.log --save golden.json
+#   python tools/golden_images.py run.log --golden golden.json
+#
+# Every image is hashed straight after unpacking ("decode") and again after it has been converted to
+# the raw format ("raw"). Both have to match the golden hash, and each other. Exits with status 1 if
+# anything doesn't match.
+#
+# test/native/test_golden_images checks every image in the repository the same way on the host, against
+# test/golden_images.json. This is for checking a build on the device itself.
+import argparse
+import json
+import sys
+
+def read_results(log):
+    results = {}
+    with open(log, errors="replace") as f:
+        for line in f:
+            start = line.find('{"golden":')
+            if start < 0:
+                continue
+            try:
+                result = json.loads(line[start:].strip())
+            except json.JSONDecodeError:
+                continue
+            results.setdefault(result["golden"], {})[result["stage"]] = result
+    return results
+
+parser = argparse.ArgumentParser(description="Save or check decoded image hashes")
+parser.add_argument("log", help="serial log containing the GOLDEN_IMAGES output")
+parser.add_argument("--save", metavar="GOLDEN", help="write the decode hashes to this file")
+parser.add_argument("--golden", metavar="GOLDEN", help="check the hashes against this file")
+args = parser.parse_args()
+
+results = read_results(args.log)
+if not results:
+    print("No image hashes in " + args.log)
+    sys.exit(1)
+
+failures = 0
+for name in sorted(results):
+    stages = results[name]
+    hashes = set(stage["hash"] for stage in stages.values())
+    times = ", ".join("%s %dus" % (stage, stages[stage]["us"]) for stage in sorted(stages))
+    status = "ok"
+    if len(hashes) > 1:
+        status = "stages differ"
+        failures += 1
+    print("%-40s %s  (%s)" % (name, status, times))
+
+if args.save:
+    golden = { name: results[name].get("decode", next(iter(results[name].values())))["hash"] for name in results }
+    with open(args.save, "w") as f:
+        json.dump(golden, f, indent=2, sort_keys=True)
+    print("Saved " + str(len(golden)) + " hashes to " + args.save)
+
+if args.golden:
+    with open(args.golden) as f:
+        golden = json.load(f)
+
+    for name in sorted(results):
+        if name not in golden:
+            print("%-40s not in %s" % (name, args.golden))
+            continue
+        for stage, result in sorted(results[name].items()):
+            if result["hash"] != golden[name]:
+                print("%-40s %s hash %s, expected %s" % (name, stage, result["hash"], golden[name]))
+                failures += 1
+
+print(str(failures) + " mismatches")
+sys.exit(1 if failures else 0)
@@ -161,6 +161,7 @@ var state = {
 	"1": {
 		'time_or_date':  1,
 		'date_format':  1,
+		'slide_transition':  0,
 		'time_format':  true,
 		'leading_zero': false,
 		'display_on':  10,
@@ -188,6 +189,11 @@ var state = {
 			'divergence': 'divergence.tar.gz',
 			'dots': 'dots.tar.gz'
 		},
+		'face_resident' : {
+			'divergence': 412672,
+			'dots': 198144
+		},
+		'cache_reserve': 64,
 		'file_set':'faces',	// Deliberately out of order
 		'set_icon_weather': 'Bletch'
 	},
@@ -161,6 +161,7 @@ var state = {
 	"1": {
 		'time_or_date':  1,
 		'date_format':  1,
+		'slide_transition':  0,
 		'time_format':  true,
 		'leading_zero': false,
 		'display_on':  10,